@@ -0,0 +1,150 @@
+#ifndef ALLOCATION_STATS_H__
+#define ALLOCATION_STATS_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/*! \brief Indexing Stage
+ *
+ *  What a thread is doing when it allocates; set with AllocationStageScope
+ */
+enum AllocationStage
+    {
+    //! anything outside the tagged stages, f.e start up and logging
+    STAGE_OTHER,
+    //! reading the files into the text buffers
+    STAGE_READ,
+    //! finding the tokens in the text
+    STAGE_TOKENIZE,
+    //! adding each token to the counts
+    STAGE_COUNT,
+    //! combining the counts of the workers, files and runs
+    STAGE_REDUCE,
+    //! picking the top entries and writing the results
+    STAGE_FINALIZE
+    };
+
+//! number of AllocationStage values
+const int ALLOCATION_STAGES = 6;
+
+//! threads counted on their own; any after these share the last slot
+const int MAX_COUNTED_THREADS = 256;
+
+/*! \brief Allocation Counts
+ */
+struct AllocationCounts
+    {
+    //! blocks allocated; a reallocation counts as one allocation and one free
+    uint64_t allocations;
+    //! blocks released
+    uint64_t frees;
+    //! bytes allocated
+    uint64_t bytes;
+    };
+
+/*! \brief Allocations of a Thread
+ */
+struct ThreadAllocations
+    {
+    //! order in which the thread first allocated; 0 is normally the main thread
+    int thread;
+    //! counts per AllocationStage
+    AllocationCounts stages[ALLOCATION_STAGES];
+    };
+
+/*! \brief Allocation Statistics
+ */
+struct AllocationReport
+    {
+    //! counts per AllocationStage, over all the threads
+    AllocationCounts stages[ALLOCATION_STAGES];
+    //! highest live bytes reached by an allocation in each AllocationStage
+    uint64_t stagePeaks[ALLOCATION_STAGES];
+    //! counts of every thread that allocated
+    std::vector<ThreadAllocations> threads;
+    //! bytes allocated and not yet released
+    int64_t liveBytes;
+    //! highest live bytes
+    uint64_t peakBytes;
+    };
+
+/*! \brief Instrumented Build
+ *
+ *  The counting allocator is only compiled in with ALLOCATION_STATS defined
+ *  (cmake -DALLOCATION_STATS=ON), and only on glibc, whose allocator it
+ *  wraps. Without it the stage scopes compile to nothing.
+ *
+ *  \return true if allocations are being counted
+ */
+bool allocationStatsEnabled();
+
+/*! \brief Start Counting Afresh
+ *
+ *  Zero the counts; the live bytes carry on, and the peaks restart from them
+ */
+void resetAllocationStats();
+
+/*! \brief Allocation Statistics
+ *
+ *  \return the counts so far; all 0 unless allocationStatsEnabled()
+ */
+AllocationReport allocationReport();
+
+/*! \brief Stage Name
+ *
+ *  \param _stage - stage to name
+ *
+ *  \return the name used in the --stats report, f.e "tokenize"
+ */
+const char* allocationStageName(AllocationStage _stage);
+
+/*! \brief Mapped Memory Accounting
+ *
+ *  Count memory taken straight from the kernel rather than through malloc,
+ *  f.e the large count tables
+ *
+ *  \param _bytes - size of the mapping
+ */
+void countMappedAllocation(size_t _bytes);
+
+/*! \brief Mapped Memory Accounting
+ *
+ *  \param _bytes - size of the mapping released
+ */
+void countMappedRelease(size_t _bytes);
+
+#ifdef ALLOCATION_STATS
+/*! \brief Scoped Stage Tag
+ *
+ *  Allocations by the thread are counted against the stage until the scope
+ *  ends, when the stage it replaced is restored, so scopes nest
+ */
+class AllocationStageScope
+    {
+    public:
+        /*! \brief Constructor
+         *
+         *  \param _stage - stage the thread is entering
+         */
+        explicit AllocationStageScope(AllocationStage _stage);
+        /*! \brief Deconstructor
+         */
+        ~AllocationStageScope();
+
+    private:
+        //! stage to restore
+        AllocationStage previous;
+    };
+#else
+//! nothing to tag without the counting allocator
+class AllocationStageScope
+    {
+    public:
+        explicit AllocationStageScope(AllocationStage)
+            {
+            }
+    };
+#endif
+
+#endif //ALLOCATION_STATS_H__
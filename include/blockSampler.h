@@ -0,0 +1,226 @@
+#ifndef BLOCK_SAMPLER_H__
+#define BLOCK_SAMPLER_H__
+
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+#include <QElapsedTimer>
+#include <QList>
+
+#include <inputDedup.h>
+
+//! bytes in each sampled block
+const qint64 SAMPLE_BLOCK_SIZE = 65536;
+
+//! bytes read past the end of a block so its last words can be finished
+const qint64 SAMPLE_BLOCK_OVERHANG = 1024;
+
+//! most bytes read before a block to find a character no token can contain
+const qint64 SAMPLE_BLOCK_LOOKBACK = 1024;
+
+/*! \brief Sampled Block Location
+ */
+struct SampleBlock
+    {
+    //! index of the input in the sampling plan
+    int input;
+    //! start of the block in the file
+    qint64 offset;
+    //! bytes in the block; the last block of a file may be short
+    qint64 length;
+    };
+
+/*! \brief Consecutive Blocks of the Sampling Order
+ *
+ *  The unit handed to a worker, so workers stop within a block of the
+ *  deadline without QtConcurrent stepping through every block left over
+ */
+struct SampleBatch
+    {
+    //! first position in the sampling order
+    uint64_t begin;
+    //! position after the last
+    uint64_t end;
+    };
+
+/*! \brief Count Estimate
+ */
+struct SampleEstimate
+    {
+    //! estimated count in the whole input
+    uint64_t count;
+    //! half width of the 95% confidence interval; 0 if every block was read, negative if unknown
+    double margin;
+    };
+
+/*! \brief Counts of a Sampling Worker
+ *
+ *  A sampling worker counts each block into block, then folds it into
+ *  counts, and the square of every count in it into squares. The sums of
+ *  squares give the spread of each entry between blocks, from which its
+ *  confidence interval is worked out.
+ */
+template <typename Accumulator>
+struct SampleTally
+    {
+    /*! \brief Constructor
+     *
+     *  \param _prototype - value each of the accumulators starts as
+     */
+    SampleTally(const Accumulator& _prototype=Accumulator()) : counts(_prototype), squares(_prototype), block(_prototype)
+        {
+        }
+
+    /*! \brief Block Finished
+     *
+     *  Fold the block's counts into the totals and empty it
+     */
+    void blockDone()
+        {
+        counts.merge(block);
+        squares.mergeSquares(block);
+        block.clear();
+        }
+
+    /*! \brief Combine Results
+     *
+     *  \param _other - another worker's counts
+     */
+    void merge(const SampleTally& _other)
+        {
+        counts.merge(_other.counts);
+        squares.merge(_other.squares);
+        }
+
+    //! counts of every block read
+    Accumulator counts;
+    //! sums of the squares of the per-block counts
+    Accumulator squares;
+    //! counts of the block being read
+    Accumulator block;
+    };
+
+/*! \brief Random Block Sampling
+ *
+ *  Splits the inputs into fixed size blocks and picks a uniform random
+ *  sample of them, in random order. Workers read the blocks in that order
+ *  until they are all read or the time budget runs out; either way the
+ *  blocks read are a uniform random sample, so every count is scaled by
+ *  the blocks in the inputs over the blocks read.
+ *
+ *  The confidence interval treats the blocks as a simple random sample
+ *  without replacement, with the per-block count of an entry as the value
+ *  of each block; the finite population correction makes it 0 once every
+ *  block has been read.
+ */
+class BlockSampler
+    {
+    public:
+        /*! \brief Constructor
+         */
+        BlockSampler();
+
+        /*! \brief Choose the Blocks
+         *
+         *  Inputs whose size is unknown or 0 are left out. The time budget
+         *  covers the planning too; if it runs out, no blocks are chosen.
+         *
+         *  \param _inputs - files to sample
+         *  \param _rate - fraction of the blocks to read, (0, 1]
+         *  \param _seed - seed of the random choice; 0 for a random seed
+         *  \param _workers - number of workers that will read the blocks
+         */
+        void plan(const QList<IndexInput>& _inputs, double _rate, uint64_t _seed, int _workers);
+
+        /*! \brief Inputs Sampled
+         *
+         *  \return the files of the plan
+         */
+        const QList<IndexInput>& inputs() const;
+
+        /*! \brief Work Units
+         *
+         *  \return consecutive ranges of the sampling order, for QtConcurrent::map()
+         */
+        std::vector<SampleBatch>& batches();
+
+        /*! \brief Block Lookup
+         *
+         *  \param _position - position in the sampling order
+         *
+         *  \return the file and byte range of the block
+         */
+        SampleBlock block(uint64_t _position) const;
+
+        /*! \brief Start the Clock
+         *
+         *  Called before the inputs are examined and planned, so the budget
+         *  covers all of the work
+         *
+         *  \param _seconds - time budget; 0 for none
+         */
+        void start(double _seconds);
+
+        /*! \brief Deadline Check
+         *
+         *  Called by the workers before each block
+         *
+         *  \return true once the time budget has run out
+         */
+        bool expired();
+
+        /*! \brief Block Finished
+         *
+         *  Called by a worker after each block it has counted
+         *
+         *  \param _bytes - bytes in the block
+         */
+        void blockRead(qint64 _bytes);
+
+        //! \return number of blocks in the inputs
+        uint64_t totalBlocks() const;
+        //! \return number of bytes in the inputs
+        uint64_t totalBytes() const;
+        //! \return number of blocks chosen to be read
+        uint64_t plannedBlocks() const;
+        //! \return number of blocks read so far
+        uint64_t blocksRead() const;
+        //! \return number of bytes read so far
+        uint64_t bytesRead() const;
+        //! \return true if the time budget ran out before the chosen blocks were read, or before they were chosen
+        bool stoppedEarly() const;
+        //! \return seconds since start()
+        double seconds() const;
+
+        /*! \brief Scale a Sampled Count
+         *
+         *  \param _observed - total count of an entry in the blocks read
+         *  \param _squares - sum of the squares of its count in each block read
+         *
+         *  \return the estimated count in the whole input and its 95% confidence margin
+         */
+        SampleEstimate estimate(uint64_t _observed, uint64_t _squares) const;
+
+    private:
+        //! files sampled
+        QList<IndexInput> files;
+        //! first global block of each file, plus the end of the last
+        std::vector<uint64_t> firstBlock;
+        //! global block numbers in the order they are read
+        std::vector<uint64_t> order;
+        //! order split into work units
+        std::vector<SampleBatch> units;
+        uint64_t bytesTotal;
+
+        QElapsedTimer timer;
+        //! milliseconds from start() to the deadline; 0 for no limit
+        qint64 budget;
+        //! whether plan() stopped at the deadline
+        bool planCut;
+        std::atomic<bool> timedOut;
+        std::atomic<uint64_t> readBlocks;
+        std::atomic<uint64_t> readBytes;
+    };
+
+#endif //BLOCK_SAMPLER_H__
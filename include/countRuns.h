@@ -0,0 +1,435 @@
+#ifndef COUNT_RUNS_H__
+#define COUNT_RUNS_H__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <QByteArray>
+#include <QChar>
+#include <QFile>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+
+#include <ngramCount.h>
+
+/*! \brief Run File Identification
+ *
+ *  First bytes of every run file
+ */
+#define RUN_FILE_MAGIC "SFIRUN01"
+
+/*! \brief Partial Result Identification
+ *
+ *  First bytes of a partial result file; the words per key follow as a number,
+ *  then the records as in a run file
+ */
+#define PARTIAL_FILE_MAGIC "SFIPRT01"
+
+/*! \brief Code Point Ordering
+ *
+ *  Run files are sorted by the UTF-8 bytes of their keys, which is code point
+ *  order. UTF-16 code units compare the same way except for surrogates, which
+ *  stand for code points above every other unit; this moves them there.
+ *
+ *  \param _unit - UTF-16 code unit
+ *
+ *  \return a value that orders code units as their code points order
+ */
+inline uint32_t codePointOrder(ushort _unit)
+    {
+    if (_unit >= 0xD800)
+        {
+        return (_unit < 0xE000) ? (_unit + 0x2000U) : (_unit - 0x800U);
+        }
+    return _unit;
+    }
+
+/*! \brief Merge Destination
+ *
+ *  Receives the keys of a merge in sorted order, each key exactly once with
+ *  its total count
+ */
+class RunConsumer
+    {
+    public:
+        /*! \brief Deconstructor
+         */
+        virtual ~RunConsumer();
+
+        /*! \brief Merged Key
+         *
+         *  \param _key - UTF-8 key
+         *  \param _count - total count for the key
+         */
+        virtual void add(const QByteArray& _key, uint64_t _count) = 0;
+    };
+
+/*! \brief Sorted Run Writer
+ *
+ *  Writes (key, count) records that are already in ascending key order to a
+ *  compact file: each key is stored as the number of leading bytes it shares
+ *  with the previous key plus the remaining bytes, and all the numbers are
+ *  variable length. Output is collected in a large buffer and written in blocks.
+ */
+class RunWriter : public RunConsumer
+    {
+    public:
+        /*! \brief Constructor
+         */
+        RunWriter();
+        /*! \brief Deconstructor
+         *
+         *  Closes the file if it is still open
+         */
+        ~RunWriter();
+
+        /*! \brief Start a Run
+         *
+         *  \param _fileName - file to create; replaced if it exists
+         *  \param _order - words per key when writing a partial result; 0 for a scratch run
+         *
+         *  \return true if the file could be created
+         */
+        bool open(const QString& _fileName, int _order=0);
+
+        /*! \brief Add a Record
+         *
+         *  \param _key - UTF-8 key; must sort after the previous key
+         *  \param _count - count for the key
+         */
+        void add(const QByteArray& _key, uint64_t _count);
+
+        /*! \brief Add a Record
+         *
+         *  \param _key - UTF-8 key bytes; must sort after the previous key
+         *  \param _length - number of bytes in the key
+         *  \param _count - count for the key
+         */
+        void add(const char* _key, int _length, uint64_t _count);
+
+        /*! \brief Add a Record
+         *
+         *  \param _key - key characters; must sort after the previous key
+         *  \param _length - number of characters in the key
+         *  \param _count - count for the key
+         */
+        void add(const QChar* _key, int _length, uint64_t _count);
+
+        /*! \brief Start a Key
+         *
+         *  Build a key from several pieces without allocating; finish it
+         *  with endKey()
+         */
+        void beginKey();
+        /*! \brief Extend a Key
+         *
+         *  \param _text - characters to append to the key
+         *  \param _length - number of characters
+         */
+        void appendKey(const QChar* _text, int _length);
+        /*! \brief Finish a Key
+         *
+         *  \param _count - count for the key built since beginKey()
+         */
+        void endKey(uint64_t _count);
+
+        /*! \brief Finish the Run
+         *
+         *  \return true if everything was written
+         */
+        bool close();
+
+        /*! \brief Record Count
+         *
+         *  \return number of records written
+         */
+        uint64_t records() const;
+
+    private:
+        //! append a record to the buffer
+        void writeRecord(const char* _key, int _length, uint64_t _count);
+        //! write the buffer to the file
+        void flush();
+
+        QFile output;
+        //! encoded records not yet written
+        QByteArray buffer;
+        //! previous key, for the shared prefix
+        std::string previous;
+        //! key being built by beginKey()/appendKey()
+        std::string pending;
+        uint64_t recordCount;
+        bool failed;
+    };
+
+/*! \brief Sorted Run Reader
+ *
+ *  Reads the records of a run file one at a time
+ */
+class RunReader
+    {
+    public:
+        /*! \brief Constructor
+         */
+        RunReader();
+
+        /*! \brief Open a Run
+         *
+         *  \param _fileName - run file or partial result to read
+         *
+         *  \return true if the file could be opened and is a run file
+         */
+        bool open(const QString& _fileName);
+
+        /*! \brief Words per Key
+         *
+         *  \return the words per key of a partial result, 0 for a scratch run
+         */
+        int order() const;
+
+        /*! \brief Advance
+         *
+         *  \return true if another record was read, false at the end or on an error
+         */
+        bool next();
+
+        /*! \brief Current Key
+         *
+         *  \return UTF-8 key of the current record
+         */
+        const QByteArray& key() const;
+
+        /*! \brief Current Count
+         *
+         *  \return count of the current record
+         */
+        uint64_t count() const;
+
+        /*! \brief Error State
+         *
+         *  \return true if the file was truncated or corrupt
+         */
+        bool failed() const;
+
+    private:
+        //! refill the read buffer; returns false if no data is left
+        bool fill();
+        //! read a byte, refilling as needed
+        bool readByte(unsigned char& _byte);
+        //! read a variable length number
+        bool readNumber(uint64_t& _value);
+
+        QFile input;
+        QByteArray buffer;
+        int position;
+        QByteArray currentKey;
+        uint64_t currentCount;
+        int keyOrder;
+        bool corrupt;
+    };
+
+/*! \brief Streaming K-Way Merge
+ *
+ *  Merge sorted runs into a single sorted stream, adding the counts of equal
+ *  keys. Only one record per run is held in memory. When there are more runs
+ *  than can be open at once they are merged in passes through intermediate
+ *  runs in _scratchDirectory.
+ *
+ *  \param _runs - the run files
+ *  \param _consumer - receives the merged records
+ *  \param _error - receives a description of the problem on failure
+ *  \param _scratchDirectory - where intermediate runs go; empty to open every run at once
+ *
+ *  \return true if all the runs were merged
+ */
+bool mergeRuns(const QStringList& _runs, RunConsumer& _consumer, QString& _error, const QString& _scratchDirectory=QString());
+
+/*! \brief Partial Result Check
+ *
+ *  Read the header of every partial, so a file that is not a partial or
+ *  counts another kind of key is found before anything is merged or written
+ *
+ *  \param _partials - the partial result files
+ *  \param _order - receives the words per key of the partials
+ *  \param _error - receives a description of the problem on failure
+ *
+ *  \return true if all the partials can be merged together
+ */
+bool checkPartials(const QStringList& _partials, int& _order, QString& _error);
+
+/*! \brief Partial Result Merge
+ *
+ *  Merge the partial results written by separate indexing runs, f.e one per
+ *  slice of the file list. The partials must all count the same kind of key.
+ *
+ *  \param _partials - the partial result files
+ *  \param _consumer - receives the merged records
+ *  \param _order - receives the words per key of the partials
+ *  \param _error - receives a description of the problem on failure
+ *  \param _scratchDirectory - where intermediate runs go; empty to open every partial at once
+ *
+ *  \return true if all the partials were merged
+ */
+bool mergePartials(const QStringList& _partials, RunConsumer& _consumer, int& _order, QString& _error,
+                   const QString& _scratchDirectory=QString());
+
+/*! \brief Merge to Two Destinations
+ *
+ *  Hands every merged record to both consumers, f.e to write the full
+ *  result and select its top-K in one pass
+ */
+class SplitConsumer : public RunConsumer
+    {
+    public:
+        /*! \brief Constructor
+         *
+         *  \param _first - first destination; must outlive the split
+         *  \param _second - second destination; must outlive the split
+         */
+        SplitConsumer(RunConsumer& _first, RunConsumer& _second);
+
+        void add(const QByteArray& _key, uint64_t _count);
+
+    private:
+        RunConsumer& first;
+        RunConsumer& second;
+    };
+
+/*! \brief Top-K Selection
+ *
+ *  Merge destination that keeps the most frequent keys in a bounded heap,
+ *  so the full vocabulary never has to be held in memory
+ */
+class TopCounts : public RunConsumer
+    {
+    public:
+        /*! \brief Constructor
+         *
+         *  \param _limit - number of keys to keep
+         */
+        TopCounts(int _limit);
+
+        void add(const QByteArray& _key, uint64_t _count);
+
+        /*! \brief Most Frequent Keys
+         *
+         *  Ties are listed the same way as the in-memory results, later keys first
+         *
+         *  \return up to the limit keys, most frequent first
+         */
+        std::vector<PhraseCount> top() const;
+
+        /*! \brief Distinct Keys
+         *
+         *  \return number of keys seen
+         */
+        uint64_t distinct() const;
+
+    private:
+        struct Entry
+            {
+            uint64_t count;
+            QByteArray key;
+            };
+        //! heap order; the least frequent kept key is on top
+        static bool ranksHigher(const Entry& _left, const Entry& _right);
+
+        int limit;
+        std::vector<Entry> heap;
+        uint64_t keys;
+    };
+
+/*! \brief Memory Budget Enforcement
+ *
+ *  Shared by the workers; once a worker's accumulator grows past its share of
+ *  the budget it is written out as a sorted run and emptied. Once a run could
+ *  not be written the results are lost, so accumulators past their share are
+ *  only emptied, and the workers are expected to stop. The accumulator must
+ *  provide memoryUsage(), spillTo(RunWriter&) and clear().
+ *
+ *  The run files are removed when the spiller is destroyed.
+ */
+class RunSpiller
+    {
+    public:
+        /*! \brief Constructor
+         *
+         *  \param _directory - where the run files go
+         *  \param _threadLimit - bytes each accumulator may use before it is spilled
+         */
+        RunSpiller(const QString& _directory, uint64_t _threadLimit);
+        /*! \brief Deconstructor
+         */
+        ~RunSpiller();
+
+        /*! \brief Budget Check
+         *
+         *  \param _accumulator - the calling worker's accumulator
+         */
+        template <typename Accumulator>
+        void checkpoint(Accumulator& _accumulator)
+            {
+            if (_accumulator.memoryUsage() > threadLimit)
+                {
+                if (failed() || !spill(_accumulator))
+                    {
+                    _accumulator.clear();
+                    }
+                }
+            }
+
+        /*! \brief Spill an Accumulator
+         *
+         *  \param _accumulator - accumulator to write out; emptied on success
+         *
+         *  \return true if the run was written
+         */
+        template <typename Accumulator>
+        bool spill(Accumulator& _accumulator)
+            {
+            QString fileName = nextFileName();
+            RunWriter writer;
+            bool written = writer.open(fileName) && _accumulator.spillTo(writer) && writer.close();
+            finished(fileName, written);
+            return written;
+            }
+
+        /*! \brief Run Files
+         *
+         *  \return the runs written so far
+         */
+        QStringList runs() const;
+
+        /*! \brief Scratch Location
+         *
+         *  \return the directory the runs are written to
+         */
+        QString directory() const;
+
+        /*! \brief Error State
+         *
+         *  \return true if a run could not be written
+         */
+        bool failed() const;
+
+        /*! \brief Error Description
+         *
+         *  \return the file that could not be written, if any
+         */
+        QString error() const;
+
+    private:
+        QString nextFileName();
+        void finished(const QString& _fileName, bool _written);
+
+        QString spillDirectory;
+        uint64_t threadLimit;
+        mutable QMutex lock;
+        QStringList runFiles;
+        QString failure;
+        int sequence;
+    };
+
+#endif //COUNT_RUNS_H__
@@ -2,24 +2,51 @@
 #define FILE_INDEXER_H__
 
 #include <stdint.h>
+#include <functional>
 
 #include <QObject>
 #include <QString>
 #include <QStringList>
 #include <QThread>
 #include <QFuture>
+#include <QFutureWatcher>
+#include <QTimer>
 
+#include <allocationStats.h>
+#include <blockSampler.h>
+#include <countRuns.h>
+#include <indexProgress.h>
+#include <indexerOptions.h>
+#include <inputDedup.h>
 #include <logger.h>
+#include <memoryPlacement.h>
+#include <ngramCount.h>
+#include <resultTable.h>
+#include <stopwordFilter.h>
+#include <threadAccumulators.h>
+#include <tokenMatcher.h>
+#include <vocabularyTrie.h>
+#include <wordTally.h>
 
 //! Word Count Results
 typedef QMap<QString, uint64_t> WordCount;
 //! Delayed Word Count Result
 typedef QFuture<WordCount> FutureWordCount;
+//! Delayed Phrase Count Result
+typedef QFuture<NgramCount> FutureNgramCount;
 
 
+/*! \brief File Processing Log
+ *
+ *  Receives the messages about each file being processed: the file name and
+ *  the message. Called on the worker threads; an empty one logs nothing.
+ */
+typedef std::function<void (const QString&, const QString&)> FileLog;
+
 /*! \brief File Processing Logging
  *
  *  Convenience method for logging messages for a given file being processed
+ *  through qDebug(); the FileLog the command-line indexer uses
  *
  *  \param _filename - the filename being processed
  *  \param _message - the log message to be recorded
@@ -42,10 +69,105 @@ void addWord(WordCount& _results, QString wordToAdd, uint64_t _count=1);
  *  Count the words in a given file
  *
  *  \param fileName - filename to process
+ *  \param matcher - compiled token pattern used to find the words
+ *  \param stopwords - words that are not counted
+ *  \param log - receives the progress messages for the file
  *
  *  \return WordCount object containing the counts of all words in the file
  */
-WordCount indexFile(QString fileName);
+WordCount indexFile(QString fileName, const TokenMatcher& matcher=TokenMatcher::defaultMatcher(),
+                    const StopwordFilter& stopwords=StopwordFilter::none(), const FileLog& log=FileLog());
+
+/*! \brief Single File Phrase Indexing
+ *
+ *  Count the phrases of consecutive words in a given file on its own; the
+ *  indexer counts into per-thread accumulators with indexFileInto() instead
+ *
+ *  \param fileName - filename to process
+ *  \param order - number of words in a phrase, 2 or 3
+ *  \param matcher - compiled token pattern used to find the words
+ *  \param stopwords - words that are not counted; a phrase never spans one
+ *  \param log - receives the progress messages for the file
+ *
+ *  \return NgramCount object containing the counts of all phrases in the file
+ */
+NgramCount indexFileNgrams(QString fileName, int order, const TokenMatcher& matcher=TokenMatcher::defaultMatcher(),
+                           const StopwordFilter& stopwords=StopwordFilter::none(), const FileLog& log=FileLog());
+
+/*! \brief Single File Word Indexing
+ *
+ *  Count the words in a given file into an existing result, so one
+ *  accumulator can be reused across many files
+ *
+ *  \param fileName - filename to process
+ *  \param results - WordTally object to add the counts of the words in the file to
+ *  \param matcher - compiled token pattern used to find the words
+ *  \param stopwords - words that are not counted
+ *  \param occurrences - number of input files with this content; each word counts this many times
+ *  \param spiller - memory budget; the results are written out to a run whenever they outgrow it
+ *  \param progress - told of every block and file read, and of the words counted so far
+ *  \param log - receives the progress messages for the file
+ */
+void indexFileInto(QString fileName, WordTally& results, const TokenMatcher& matcher=TokenMatcher::defaultMatcher(),
+                   const StopwordFilter& stopwords=StopwordFilter::none(), uint64_t occurrences=1, RunSpiller* spiller=NULL,
+                   IndexProgress* progress=NULL, const FileLog& log=FileLog());
+
+/*! \brief Single File Phrase Indexing
+ *
+ *  Count the phrases in a given file into an existing result. A phrase never
+ *  spans the end of one file and the start of the next.
+ *
+ *  \param fileName - filename to process
+ *  \param results - NgramCount object to add the counts of the phrases in the file to
+ *  \param matcher - compiled token pattern used to find the words
+ *  \param stopwords - words that are not counted; a phrase never spans one
+ *  \param occurrences - number of input files with this content; each phrase counts this many times
+ *  \param spiller - memory budget; the results are written out to a run whenever they outgrow it
+ *  \param progress - told of every block and file read, and of the phrases counted so far
+ *  \param log - receives the progress messages for the file
+ */
+void indexFileInto(QString fileName, NgramCount& results, const TokenMatcher& matcher=TokenMatcher::defaultMatcher(),
+                   const StopwordFilter& stopwords=StopwordFilter::none(), uint64_t occurrences=1, RunSpiller* spiller=NULL,
+                   IndexProgress* progress=NULL, const FileLog& log=FileLog());
+
+/*! \brief Sampled Block Word Indexing
+ *
+ *  Count the words that start within a block of a file. The scan starts
+ *  after the last character before the block that no token can contain, up
+ *  to SAMPLE_BLOCK_LOOKBACK bytes back, so the words are split as a full
+ *  pass splits them and a word that began earlier belongs to the previous
+ *  block; a word running past the end of the block is finished from up to
+ *  SAMPLE_BLOCK_OVERHANG bytes after it. Reading every block gives the
+ *  counts of the whole file unless a token is longer than those limits.
+ *
+ *  \param fileName - file the block is read from
+ *  \param offset - start of the block in the file
+ *  \param length - bytes in the block
+ *  \param results - WordTally object to add the counts of the words in the block to
+ *  \param matcher - compiled token pattern used to find the words
+ *  \param stopwords - words that are not counted
+ *  \param occurrences - number of input files with this content; each word counts this many times
+ *  \param log - receives the message if the block cannot be read
+ */
+void indexBlockInto(const QString& fileName, qint64 offset, qint64 length, WordTally& results, const TokenMatcher& matcher=TokenMatcher::defaultMatcher(),
+                    const StopwordFilter& stopwords=StopwordFilter::none(), uint64_t occurrences=1, const FileLog& log=FileLog());
+
+/*! \brief Sampled Block Phrase Indexing
+ *
+ *  Count the phrases whose first word starts within a block of a file; the
+ *  words after the block only complete those phrases
+ *
+ *  \param fileName - file the block is read from
+ *  \param offset - start of the block in the file
+ *  \param length - bytes in the block
+ *  \param results - NgramCount object to add the counts of the phrases in the block to
+ *  \param matcher - compiled token pattern used to find the words
+ *  \param stopwords - words that are not counted; a phrase never spans one
+ *  \param occurrences - number of input files with this content; each phrase counts this many times
+ *  \param log - receives the message if the block cannot be read
+ */
+void indexBlockInto(const QString& fileName, qint64 offset, qint64 length, NgramCount& results, const TokenMatcher& matcher=TokenMatcher::defaultMatcher(),
+                    const StopwordFilter& stopwords=StopwordFilter::none(), uint64_t occurrences=1, const FileLog& log=FileLog());
 
 /*! \brief Buffer Processing
  *
@@ -57,8 +179,217 @@ WordCount indexFile(QString fileName);
  *        end of the buffer to be a word; if false, leave alone and return to
  *        the caller so more data can be added to the buffer
  *    \param results - WordCount object to update with the counts of the words found
+ *    \param matcher - compiled token pattern used to find the words
+ *    \param stopwords - words that are skipped before they reach the results
+ *    \param log - receives the progress messages for the buffer
+ */
+void processBuffer(const QString& fileName, QString& buffer, bool allow_ending_word, WordCount& results,
+                   const TokenMatcher& matcher=TokenMatcher::defaultMatcher(),
+                   const StopwordFilter& stopwords=StopwordFilter::none(), const FileLog& log=FileLog());
+
+/*! \brief Buffer Processing
+ *
+ *    Count the phrases contained within a QString data-buffer. The last words
+ *    of the buffer are remembered by the results, so phrases continue across
+ *    calls for the same file.
+ *
+ *  \param fileName - the filename being processed
+ *    \param buffer - data buffer to process
+ *    \param allow_ending_word - as for the WordCount form
+ *    \param results - NgramCount object to update with the counts of the phrases found
+ *    \param matcher - compiled token pattern used to find the words
+ *    \param stopwords - words that are skipped; a phrase never spans one
+ *    \param log - receives the progress messages for the buffer
+ */
+void processBuffer(const QString& fileName, QString& buffer, bool allow_ending_word, NgramCount& results,
+                   const TokenMatcher& matcher=TokenMatcher::defaultMatcher(),
+                   const StopwordFilter& stopwords=StopwordFilter::none(), const FileLog& log=FileLog());
+
+/*! \brief Word Count MapReduce Mapper
+ *
+ *  Function object handed to MapReduce so every worker indexes its file
+ *  with the same read-only token scanner and stopword filter
+ */
+class FileIndexMapper
+    {
+    public:
+        //! result type required by QtConcurrent for function objects
+        typedef WordCount result_type;
+
+        /*! \brief Constructor
+         *
+         *  \param _matcher - token scanner; must outlive the mapper
+         *  \param _stopwords - stopword filter; must outlive the mapper
+         *  \param _log - receives the progress messages for each file
+         */
+        FileIndexMapper(const TokenMatcher& _matcher, const StopwordFilter& _stopwords, const FileLog& _log=FileLog());
+
+        /*! \brief Single File Word Indexing
+         *
+         *  \param fileName - filename to process
+         *
+         *  \return WordCount object containing the counts of all words in the file
+         */
+        WordCount operator()(const QString& fileName) const;
+
+    private:
+        //! shared token scanner
+        const TokenMatcher* matcher;
+        //! shared stopword filter
+        const StopwordFilter* stopwords;
+        //! progress messages
+        FileLog log;
+    };
+
+/*! \brief Per-Thread Accumulating Mapper
+ *
+ *  Function object handed to QtConcurrent::map(); every worker counts its
+ *  files straight into its own long-lived accumulator rather than building
+ *  a result per file for the reducer to merge. Once a run could not be
+ *  written the remaining files are skipped
  */
-void processBuffer(const QString& fileName, QString& buffer, bool empty_buffer, WordCount& results);
+template <typename Accumulator>
+class AccumulatingMapper
+    {
+    public:
+        /*! \brief Constructor
+         *
+         *  \param _accumulators - per-thread results; must outlive the mapper
+         *  \param _matcher - token scanner; must outlive the mapper
+         *  \param _stopwords - stopword filter; must outlive the mapper
+         *  \param _spiller - memory budget shared by the workers; NULL for none
+         *  \param _progress - progress channel shared by the workers; NULL for none
+         *  \param _placement - NUMA placement of the workers; NULL to leave them where they are
+         *  \param _log - receives the progress messages for each file
+         */
+        AccumulatingMapper(ThreadAccumulators<Accumulator>& _accumulators, const TokenMatcher& _matcher, const StopwordFilter& _stopwords,
+                           RunSpiller* _spiller=NULL, IndexProgress* _progress=NULL, NumaPlacement* _placement=NULL, const FileLog& _log=FileLog()) :
+            accumulators(&_accumulators), matcher(&_matcher), stopwords(&_stopwords), spiller(_spiller), progress(_progress),
+            placement(_placement), log(_log)
+            {
+            }
+
+        /*! \brief Single File Indexing
+         *
+         *  \param fileName - filename to process
+         */
+        void operator()(const QString& fileName) const
+            {
+            if (stopped())
+                {
+                return;
+                }
+            place();
+            indexFileInto(fileName, accumulators->local(), *matcher, *stopwords, 1, spiller, progress, log);
+            }
+
+        /*! \brief Deduplicated File Indexing
+         *
+         *  \param input - file to process and how many times its contents were listed
+         */
+        void operator()(const IndexInput& input) const
+            {
+            if (stopped())
+                {
+                return;
+                }
+            place();
+            indexFileInto(input.fileName, accumulators->local(), *matcher, *stopwords, input.occurrences, spiller, progress, log);
+            }
+
+    private:
+        //! per-thread results
+        ThreadAccumulators<Accumulator>* accumulators;
+        //! shared token scanner
+        const TokenMatcher* matcher;
+        //! shared stopword filter
+        const StopwordFilter* stopwords;
+        //! shared memory budget
+        RunSpiller* spiller;
+        //! shared progress channel
+        IndexProgress* progress;
+        //! shared worker placement
+        NumaPlacement* placement;
+        //! progress messages
+        FileLog log;
+
+        //! pin the worker before its accumulator is first touched, so the memory is node-local
+        void place() const
+            {
+            if (placement != NULL)
+                {
+                placement->placeCurrentThread();
+                }
+            }
+
+        //! once a run could not be written there will be no results, so the rest of the files are skipped
+        bool stopped() const
+            {
+            return (spiller != NULL) && spiller->failed();
+            }
+    };
+
+/*! \brief Block Sampling Mapper
+ *
+ *  Function object handed to QtConcurrent::map() in sampling mode; every
+ *  worker counts its share of the sampled blocks into its own SampleTally,
+ *  and stops before the next block once the time budget has run out
+ */
+template <typename Accumulator>
+class SamplingMapper
+    {
+    public:
+        /*! \brief Constructor
+         *
+         *  \param _accumulators - per-thread results; must outlive the mapper
+         *  \param _sampler - the sampling plan and deadline; must outlive the mapper
+         *  \param _matcher - token scanner; must outlive the mapper
+         *  \param _stopwords - stopword filter; must outlive the mapper
+         *  \param _placement - NUMA placement of the workers; NULL to leave them where they are
+         *  \param _log - receives the messages about blocks that cannot be read
+         */
+        SamplingMapper(ThreadAccumulators<SampleTally<Accumulator> >& _accumulators, BlockSampler& _sampler, const TokenMatcher& _matcher,
+                       const StopwordFilter& _stopwords, NumaPlacement* _placement=NULL, const FileLog& _log=FileLog()) :
+            accumulators(&_accumulators), sampler(&_sampler), matcher(&_matcher), stopwords(&_stopwords), placement(_placement), log(_log)
+            {
+            }
+
+        /*! \brief Sampled Blocks Indexing
+         *
+         *  \param batch - positions in the sampling order to read
+         */
+        void operator()(const SampleBatch& batch) const
+            {
+            if (placement != NULL)
+                {
+                placement->placeCurrentThread();
+                }
+            SampleTally<Accumulator>& tally = accumulators->local();
+            for (uint64_t position = batch.begin; position < batch.end && !sampler->expired(); ++position)
+                {
+                SampleBlock block = sampler->block(position);
+                const IndexInput& input = sampler->inputs()[block.input];
+                indexBlockInto(input.fileName, block.offset, block.length, tally.block, *matcher, *stopwords, input.occurrences, log);
+                AllocationStageScope reducing(STAGE_REDUCE);
+                tally.blockDone();
+                sampler->blockRead(block.length);
+                }
+            }
+
+    private:
+        //! per-thread results
+        ThreadAccumulators<SampleTally<Accumulator> >* accumulators;
+        //! shared plan and deadline
+        BlockSampler* sampler;
+        //! shared token scanner
+        const TokenMatcher* matcher;
+        //! shared stopword filter
+        const StopwordFilter* stopwords;
+        //! shared worker placement
+        NumaPlacement* placement;
+        //! progress messages
+        FileLog log;
+    };
 
 /*! \brief Word Count MapReduce Accumulator
  *
@@ -70,6 +401,84 @@ void processBuffer(const QString& fileName, QString& buffer, bool empty_buffer,
  */
 void indexFileReducer(WordCount& _results, const WordCount& fileResult);
 
+/*! \brief Phrase Count MapReduce Accumulator
+ *
+ *  Combines the per-file phrase counts back into a single result
+ *
+ *  \param _results - the final result object
+ *  \param fileResult - the individual file results
+ */
+void ngramIndexReducer(NgramCount& _results, const NgramCount& fileResult);
+
+/*! \brief Per-Thread Result Merge
+ *
+ *  Combine the per-thread word tallies once all the workers are done. The
+ *  tallies are merged into the largest one and only the combined tally is
+ *  turned into a WordCount.
+ *
+ *  \param _accumulators - per-thread results
+ *
+ *  \return the combined counts
+ */
+WordCount mergeAccumulators(ThreadAccumulators<WordTally>& _accumulators);
+
+/*! \brief Per-Thread Result Merge
+ *
+ *  Combine the per-thread phrase counts once all the workers are done
+ *
+ *  \param _accumulators - per-thread results
+ *  \param _order - number of words in a phrase, used when there are no results
+ *
+ *  \return the combined counts
+ */
+NgramCount mergeAccumulators(ThreadAccumulators<NgramCount>& _accumulators, int _order);
+
+/*! \brief Most Frequent Words
+ *
+ *  \param _results - counts of all the words
+ *  \param _limit - number of words to return
+ *
+ *  \return up to _limit words, most frequent first; ties list later words first
+ */
+std::vector<PhraseCount> topWords(const WordCount& _results, int _limit);
+
+/*! \brief Top-K Output
+ *
+ *  Send a list of the most frequent entries to stdout
+ *
+ *  \param _kind - what is being listed, f.e "Words"
+ *  \param _top - the entries, most frequent first
+ *  \param _limit - number of entries the list is meant to hold
+ */
+void printTopList(const QString& _kind, const std::vector<PhraseCount>& _top, int _limit);
+
+/*! \brief Partial Result Merging
+ *
+ *  The merge subcommand: combine the partial results written with
+ *  --emit-partial by a streaming k-way merge and report the top entries
+ *  across all of them. The merge is exact, and may itself be written out
+ *  as another partial or as a vocabulary.
+ *
+ *  \param _options - the partials and what to do with them
+ *  \param _error - receives a description of the problem on failure
+ *
+ *  \return true if the partials were merged
+ */
+bool mergePartialResults(const MergeOptions& _options, QString& _error);
+
+/*! \brief Vocabulary Queries
+ *
+ *  The query subcommand: look up keys in a vocabulary written with
+ *  --emit-vocabulary, list the keys with a prefix, or the most frequent of
+ *  them, straight from the mapped file
+ *
+ *  \param _options - the vocabulary and what to look up
+ *  \param _error - receives a description of the problem on failure
+ *
+ *  \return true if the vocabulary could be read
+ */
+bool queryVocabulary(const QueryOptions& _options, QString& _error);
+
 /*! \brief File Processing Object
  *
  *  QObject to process the a file and generate the word counts
@@ -84,6 +493,12 @@ class FileIndexer : QObject
          *  \param _parent - parent QObject
          */
         FileIndexer(QStringList filesToAnalyze, QObject* _parent=NULL);
+        /*! \brief Constructor
+         *
+         *  \param _options - the files to process and how to process them
+         *  \param _parent - parent QObject
+         */
+        FileIndexer(const IndexerOptions& _options, QObject* _parent=NULL);
         /*! \brief Deconstructor
          */
         ~FileIndexer();
@@ -126,15 +541,142 @@ class FileIndexer : QObject
         //! Log Recorder
         Logger theLog;
 
-        //! Cumulative Indexing Results
-        FutureWordCount anticipatedResults;
+        //! Completion of the indexing of all the files
+        QFuture<void> anticipatedResults;
 
         //! List of files to be processed
         QStringList fileList;
 
+        //! Whether identical copies are found by content as well as by inode
+        bool dedupContent;
+        //! Files actually read after deduplication
+        QList<IndexInput> inputs;
+        //! What deduplication skipped
+        DedupStats dedupStats;
+
+        //! Token scanner shared by all the workers
+        TokenMatcher matcher;
+
+        //! Stopword filter shared by all the workers
+        StopwordFilter stopwords;
+
+        //! Words per phrase; 1 counts single words
+        int ngramOrder;
+
+        //! Per-worker word counts, merged once all the files are done
+        ThreadAccumulators<WordTally> wordAccumulators;
+        //! Per-worker phrase counts, when counting phrases
+        ThreadAccumulators<NgramCount> ngramAccumulators;
+
+        //! Memory budget for all the workers in bytes; 0 for no limit
+        uint64_t memoryLimit;
+        //! Where counts that do not fit in the budget are written
+        QString spillDirectory;
+        //! Where the full counts are written for a later merge; empty for none
+        QString partialFile;
+        //! Where the full counts are written as a queryable vocabulary; empty for none
+        QString vocabularyFile;
+        //! Format of the full table written to stdout in place of the top 10
+        TableFormat tableFormat;
+        //! Order of the rows of the full table
+        TableOrder tableOrder;
+        //! Sorted runs written by the workers, when there is a budget
+        RunSpiller* spiller;
+
+        //! Seconds between progress reports; 0 for none
+        int progressInterval;
+        //! Progress published by the workers while they count
+        IndexProgress progress;
+        //! Notifies the event loop when the workers are done, when reporting progress
+        QFutureWatcher<void> indexingWatcher;
+        //! Triggers the progress reports
+        QTimer progressTimer;
+
+        //! Whether the workers are pinned to NUMA nodes
+        bool numaPlacement;
+        //! How the count tables are backed
+        HugePageMode hugePages;
+        //! Placement of the workers, when pinning them
+        NumaPlacement* placement;
+
+        //! Fraction of the blocks to read when sampling; 1 reads them all
+        double sampleRate;
+        //! Seconds the sampled blocks may be read for; 0 for no limit
+        double timeBudget;
+        //! Seed of the block choice; 0 for a random one
+        uint64_t sampleSeed;
+        //! The sampled blocks and the deadline, when sampling
+        BlockSampler sampler;
+        //! Per-worker word counts of the sampled blocks
+        ThreadAccumulators<SampleTally<WordTally> > sampledWords;
+        //! Per-worker phrase counts of the sampled blocks, when counting phrases
+        ThreadAccumulators<SampleTally<NgramCount> > sampledPhrases;
+
+        //! Whether the allocations of each stage are reported
+        bool allocationStats;
+
+        //! Common constructor setup
+        void initialize();
+
+        /*! \brief Deduplication Output
+         *
+         *  Tell the user how many files and bytes were skipped as duplicates
+         */
+        void reportDuplicates();
+
+        /*! \brief Out of Memory Results
+         *
+         *  Write out what is left in the accumulators and merge all the
+         *  runs, keeping only the top 10 and writing the partial result and
+         *  the vocabulary if they were asked for
+         *
+         *  \param _kind - what is being counted, f.e "Words"
+         *  \param _accumulators - per-worker results
+         */
+        template <typename Accumulator>
+        void finalizeSpilledResults(const QString& _kind, ThreadAccumulators<Accumulator>& _accumulators);
+
+        /*! \brief Sampled Results
+         *
+         *  Combine the counts of the sampled blocks and report the top 10
+         *  with their counts scaled up to the whole input and the 95%
+         *  confidence margin of each
+         *
+         *  \param _kind - what is being counted, f.e "Words"
+         *  \param _accumulators - per-worker results
+         */
+        template <typename Accumulator>
+        void finalizeSampledResults(const QString& _kind, ThreadAccumulators<SampleTally<Accumulator> >& _accumulators);
+
+        /*! \brief Result Output
+         *
+         *  Send the top entries to stdout and to the log
+         *
+         *  \param _kind - what is being listed, f.e "Words"
+         *  \param _top - the entries, most frequent first
+         */
+        void reportTopList(const QString& _kind, const std::vector<PhraseCount>& _top);
+
+        /*! \brief Allocation Output
+         *
+         *  Send the allocations of each stage and thread since indexing
+         *  started to stderr and to the log, when --stats was given
+         */
+        void reportAllocations();
+
     private Q_SLOTS:
         //! Notification the results are available
         void finalizeResults();
+
+        //! Notification the workers are done, when reporting progress
+        void indexingFinished();
+
+        /*! \brief Progress Output
+         *
+         *  Send the files and bytes done so far, the throughput and the
+         *  leading entries to stderr and to the log
+         */
+        void reportProgress();
     };
 
 #endif //FILE_INDEXER_H__
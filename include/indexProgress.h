@@ -0,0 +1,162 @@
+#ifndef INDEX_PROGRESS_H__
+#define INDEX_PROGRESS_H__
+
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+#include <QElapsedTimer>
+#include <QMutex>
+
+#include <ngramCount.h>
+#include <threadAccumulators.h>
+#include <wordTally.h>
+
+/*! \brief Progress Report
+ *
+ *  State of an indexing run while it is in flight
+ */
+struct ProgressReport
+    {
+    /*! \brief Constructor
+     */
+    ProgressReport();
+
+    //! Files finished so far
+    uint64_t filesDone;
+    //! Files to be read
+    uint64_t filesTotal;
+    //! Bytes read so far
+    uint64_t bytesDone;
+    //! Time since indexing started
+    double seconds;
+    //! Bytes read per second since indexing started
+    double bytesPerSecond;
+    //! Approximate most frequent entries so far, most frequent first
+    std::vector<PhraseCount> top;
+    };
+
+/*! \brief Live Progress Channel
+ *
+ *  Workers record the bytes and files they finish and publish a snapshot of
+ *  their own top entries; a reader combines them into a ProgressReport.
+ *
+ *  Neither side waits for the other. Every report starts a new epoch, and a
+ *  worker only builds a snapshot the first time it finishes a block in a new
+ *  epoch, so between reports the hot path is two relaxed atomic operations.
+ *  Snapshots are swapped in through an atomic pointer; the old one is freed
+ *  by its worker once no report that could still be reading it is running.
+ *
+ *  The top entries are approximate: the sum of each worker's own top list,
+ *  as of the previous report, and without anything already spilled to disk.
+ *  Reports must come from one thread at a time; they are serialized.
+ */
+class IndexProgress
+    {
+    public:
+        /*! \brief Constructor
+         *
+         *  \param _topCount - number of entries in each report
+         */
+        IndexProgress(int _topCount=10);
+
+        /*! \brief Start of Indexing
+         *
+         *  \param _filesTotal - number of files that will be read
+         */
+        void start(uint64_t _filesTotal);
+
+        /*! \brief Block Finished
+         *
+         *  Called by a worker after each block it reads
+         *
+         *  \param _results - the worker's accumulator
+         *  \param _bytes - bytes in the block
+         */
+        template <typename Accumulator>
+        void blockDone(const Accumulator& _results, qint64 _bytes)
+            {
+            WorkerSlot& slot = workers.local();
+            if (_bytes > 0)
+                {
+                slot.bytes.store(slot.bytes.load(std::memory_order_relaxed) + static_cast<uint64_t>(_bytes), std::memory_order_relaxed);
+                }
+            uint64_t epoch = requested.load(std::memory_order_relaxed);
+            if (slot.publishedEpoch != epoch)
+                {
+                slot.publishedEpoch = epoch;
+                publish(slot, topEntries(_results));
+                }
+            }
+
+        /*! \brief File Finished
+         *
+         *  Called by a worker after each file it reads
+         */
+        void fileDone();
+
+        /*! \brief Current Progress
+         *
+         *  Also asks every worker for a fresh snapshot for the next report
+         *
+         *  \return the progress as of now, and the top entries as of the previous report
+         */
+        ProgressReport report();
+
+    private:
+        //! a worker's top entries at one point in time
+        struct Snapshot
+            {
+            std::vector<PhraseCount> top;
+            //! epoch in which it was replaced
+            uint64_t retiredEpoch;
+            //! next retired snapshot of the same worker
+            Snapshot* next;
+            };
+
+        //! what one worker has published
+        class WorkerSlot
+            {
+            public:
+                WorkerSlot();
+                //! a fresh slot; required by ThreadAccumulators, nothing is copied
+                WorkerSlot(const WorkerSlot& _other);
+                ~WorkerSlot();
+
+                std::atomic<uint64_t> bytes;
+                std::atomic<uint64_t> files;
+                //! latest snapshot, read by reports
+                std::atomic<Snapshot*> latest;
+                //! epoch of the latest snapshot; only used by the worker
+                uint64_t publishedEpoch;
+                //! replaced snapshots not yet freed; only used by the worker
+                Snapshot* retired;
+            private:
+                WorkerSlot& operator=(const WorkerSlot&);
+            };
+
+        static std::vector<PhraseCount> topEntries(const WordTally& _results, int _limit);
+        static std::vector<PhraseCount> topEntries(const NgramCount& _results, int _limit);
+        template <typename Accumulator>
+        std::vector<PhraseCount> topEntries(const Accumulator& _results) const
+            {
+            return topEntries(_results, topCount);
+            }
+
+        //! swap in a new snapshot and free the ones no report can be reading
+        void publish(WorkerSlot& _slot, const std::vector<PhraseCount>& _top);
+
+        int topCount;
+        uint64_t filesTotal;
+        QElapsedTimer elapsed;
+        //! per-worker state; only the first block of a worker takes a lock
+        ThreadAccumulators<WorkerSlot> workers;
+        //! epoch of the latest report
+        std::atomic<uint64_t> requested;
+        //! epoch of the report in progress, 0 when there is none
+        std::atomic<uint64_t> reading;
+        //! one report at a time
+        QMutex readerLock;
+    };
+
+#endif //INDEX_PROGRESS_H__
@@ -0,0 +1,189 @@
+#ifndef INDEXER_OPTIONS_H__
+#define INDEXER_OPTIONS_H__
+
+#include <stdint.h>
+
+#include <QString>
+#include <QStringList>
+
+#include <memoryPlacement.h>
+#include <ngramCount.h>
+#include <resultTable.h>
+#include <stopwordFilter.h>
+#include <tokenMatcher.h>
+
+/*! \brief Indexer Configuration
+ *
+ *  Everything the user selected on the command-line
+ */
+struct IndexerOptions
+    {
+    /*! \brief Constructor
+     *
+     *  Defaults match running without any options
+     */
+    IndexerOptions();
+
+    //! List of files to be processed
+    QStringList files;
+
+    //! Token scanner compiled from --token-pattern
+    TokenMatcher matcher;
+
+    //! Words excluded from the counts via --stopwords and --stopword-file
+    StopwordFilter stopwords;
+
+    //! Words per counted phrase from --ngrams; 1 counts single words
+    int ngramOrder;
+
+    //! Find identical copies by content hash as well as by inode, from --dedup-content
+    bool dedupContent;
+
+    //! Bytes the counts may use before they are written to disk, from --memory-limit; 0 for no limit
+    uint64_t memoryLimit;
+
+    //! Where counts are written once they exceed the memory limit, from --spill-dir
+    QString spillDirectory;
+
+    //! File to write the full counts to for a later merge, from --emit-partial; empty for none
+    QString partialFile;
+
+    //! File to write the full counts to as a queryable vocabulary, from --emit-vocabulary; empty for none
+    QString vocabularyFile;
+
+    //! Format of the full table written to stdout instead of the top 10, from --output
+    TableFormat tableFormat;
+
+    //! Order of the rows of the full table, from --sort
+    TableOrder tableOrder;
+
+    //! Seconds between progress reports while indexing, from --progress; 0 for none
+    int progressInterval;
+
+    //! Pin the workers to NUMA nodes, from --numa
+    bool numaPlacement;
+
+    //! How the count tables are backed, from --huge-pages
+    HugePageMode hugePages;
+
+    //! Fraction of the input blocks to sample, from --sample-rate; 1 reads them all
+    double sampleRate;
+
+    //! Seconds to spend reading sampled blocks, from --time-budget; 0 for no limit
+    double timeBudget;
+
+    //! Seed of the block choice, from --sample-seed; 0 for a random one
+    uint64_t sampleSeed;
+
+    //! Report the allocations of each stage and thread, from --stats
+    bool allocationStats;
+    };
+
+/*! \brief Merge Configuration
+ *
+ *  Everything the user selected on the command-line of the merge subcommand
+ */
+struct MergeOptions
+    {
+    /*! \brief Constructor
+     */
+    MergeOptions();
+
+    //! Partial results to be merged
+    QStringList partials;
+
+    //! Number of entries to report, from --top
+    int topCount;
+
+    //! File to write the merged counts to as another partial, from --emit-partial; empty for none
+    QString partialFile;
+
+    //! File to write the merged counts to as a queryable vocabulary, from --emit-vocabulary; empty for none
+    QString vocabularyFile;
+
+    //! Format of the full table written to stdout instead of the top entries, from --output
+    TableFormat tableFormat;
+
+    //! Order of the rows of the full table, from --sort
+    TableOrder tableOrder;
+
+    //! Where intermediate runs go when there are many partials, from --spill-dir
+    QString spillDirectory;
+    };
+
+/*! \brief Query Configuration
+ *
+ *  Everything the user selected on the command-line of the query subcommand
+ */
+struct QueryOptions
+    {
+    /*! \brief Constructor
+     */
+    QueryOptions();
+
+    //! Vocabulary file to query
+    QString vocabularyFile;
+
+    //! Keys to look up exactly
+    QStringList keys;
+
+    //! Prefix the listed keys start with, from --prefix
+    QString prefix;
+
+    //! Whether a prefix was given; an empty one lists every key
+    bool listPrefix;
+
+    //! Number of the most frequent keys to list, from --top; 0 to list them all
+    int topCount;
+    };
+
+/*! \brief Command-Line Parsing
+ *
+ *  Options start with "--" and take their value either as "--option=value"
+ *  or as the following argument; every other argument is a file to process.
+ *  A lone "--" ends option processing.
+ *
+ *  \param _arguments - the command-line arguments, excluding the program name
+ *  \param _options - receives the parsed configuration
+ *  \param _error - receives a description of the problem if parsing fails
+ *
+ *  \return true if the arguments were valid, false otherwise
+ */
+bool parseIndexerOptions(const QStringList& _arguments, IndexerOptions& _options, QString& _error);
+
+/*! \brief Merge Command-Line Parsing
+ *
+ *  As parseIndexerOptions(), for the arguments following "merge"; every
+ *  argument that is not an option is a partial result
+ *
+ *  \param _arguments - the command-line arguments after "merge"
+ *  \param _options - receives the parsed configuration
+ *  \param _error - receives a description of the problem if parsing fails
+ *
+ *  \return true if the arguments were valid, false otherwise
+ */
+bool parseMergeOptions(const QStringList& _arguments, MergeOptions& _options, QString& _error);
+
+/*! \brief Query Command-Line Parsing
+ *
+ *  As parseIndexerOptions(), for the arguments following "query"; the first
+ *  argument that is not an option is the vocabulary file, the rest are keys
+ *  to look up
+ *
+ *  \param _arguments - the command-line arguments after "query"
+ *  \param _options - receives the parsed configuration
+ *  \param _error - receives a description of the problem if parsing fails
+ *
+ *  \return true if the arguments were valid, false otherwise
+ */
+bool parseQueryOptions(const QStringList& _arguments, QueryOptions& _options, QString& _error);
+
+/*! \brief Command-Line Usage
+ *
+ *  \param _program - name the program was invoked as
+ *
+ *  \return usage text for the command-line
+ */
+QString indexerUsage(const QString& _program);
+
+#endif //INDEXER_OPTIONS_H__
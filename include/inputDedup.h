@@ -0,0 +1,93 @@
+#ifndef INPUT_DEDUP_H__
+#define INPUT_DEDUP_H__
+
+#include <stdint.h>
+#include <functional>
+
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+/*! \brief Unique Input File
+ *
+ *  A file to index along with the number of times its contents appear in
+ *  the input list
+ */
+struct IndexInput
+    {
+    /*! \brief Constructor
+     *
+     *  \param _fileName - file that is read
+     *  \param _size - size of the file in bytes, -1 if unknown
+     */
+    IndexInput(const QString& _fileName=QString(), qint64 _size=-1);
+
+    //! file that is read
+    QString fileName;
+    //! size of the file in bytes, -1 if it could not be determined
+    qint64 size;
+    //! number of input files with these contents; counts are multiplied by it
+    uint64_t occurrences;
+    };
+
+/*! \brief Deduplication Results
+ */
+struct DedupStats
+    {
+    /*! \brief Constructor
+     */
+    DedupStats();
+
+    //! files given
+    int files;
+    //! files skipped because their contents are read through another file
+    int duplicateFiles;
+    //! bytes not read because of the skipped files
+    uint64_t bytesSkipped;
+    };
+
+/*! \brief Input Deduplication
+ *
+ *  Collapse the file list so each distinct content is only read once.
+ *  Paths naming the same file (hard links, repeated arguments) are
+ *  grouped by device and inode, which costs a stat() per file. With
+ *  _hashContent files of equal size are also read and grouped by a
+ *  64-bit content hash, which finds byte-identical copies.
+ *
+ *  Files that cannot be examined are kept as they are; the indexer
+ *  reports them when it fails to read them.
+ *
+ *  \param _files - the files to index
+ *  \param _hashContent - also group identical copies by content
+ *  \param _stats - receives what was skipped
+ *  \param _expired - if set, asked before each file; once it returns true
+ *      the remaining files are kept as they are, without being examined
+ *
+ *  \return the unique inputs, in the order they were first listed
+ */
+QList<IndexInput> deduplicateInputs(const QStringList& _files, bool _hashContent, DedupStats& _stats,
+                                    const std::function<bool ()>& _expired=std::function<bool ()>());
+
+/*! \brief Content Hash
+ *
+ *  XXH64 of the file contents, read in large blocks
+ *
+ *  \param _fileName - file to hash
+ *  \param _hash - receives the hash
+ *
+ *  \return true if the file could be read
+ */
+bool contentHash(const QString& _fileName, uint64_t& _hash);
+
+/*! \brief Buffer Hash
+ *
+ *  XXH64 of a block of memory, seed 0
+ *
+ *  \param _data - bytes to hash
+ *  \param _length - number of bytes
+ *
+ *  \return the hash
+ */
+uint64_t contentHash(const char* _data, uint64_t _length);
+
+#endif //INPUT_DEDUP_H__
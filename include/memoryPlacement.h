@@ -0,0 +1,233 @@
+#ifndef MEMORY_PLACEMENT_H__
+#define MEMORY_PLACEMENT_H__
+
+#include <stddef.h>
+#include <atomic>
+#include <limits>
+#include <new>
+#include <vector>
+
+#include <QMutex>
+#include <QString>
+
+//! Allocations from this size on are page aligned and may be backed by huge pages
+#define HUGE_TABLE_THRESHOLD (static_cast<size_t>(2) << 20)
+
+/*! \brief Huge Page Use for the Count Tables
+ */
+enum HugePageMode
+    {
+    //! ordinary pages
+    HUGE_PAGES_OFF,
+    //! ask the kernel to back large tables with transparent huge pages
+    HUGE_PAGES_TRANSPARENT,
+    //! take large tables from the reserved huge page pool, falling back to transparent ones
+    HUGE_PAGES_EXPLICIT
+    };
+
+/*! \brief Huge Page Selection
+ *
+ *  Process wide; applies to tables allocated from then on
+ *
+ *  \param _mode - how large tables are backed
+ */
+void setHugePageMode(HugePageMode _mode);
+
+/*! \brief Huge Page Selection
+ *
+ *  \return how large tables are backed
+ */
+HugePageMode hugePageMode();
+
+/*! \brief Table Allocation
+ *
+ *  Small blocks come from the heap. Blocks of HUGE_TABLE_THRESHOLD or more
+ *  are mapped directly, aligned to the huge page size and, depending on
+ *  hugePageMode(), backed by huge pages. Either way the pages are only
+ *  placed when first written, so on a NUMA machine they end up on the node
+ *  of the thread that fills them.
+ *
+ *  \param _bytes - size of the block
+ *
+ *  \return the block; throws std::bad_alloc like operator new if there is no memory
+ */
+void* allocateTable(size_t _bytes);
+
+/*! \brief Table Release
+ *
+ *  \param _memory - block returned by allocateTable()
+ *  \param _bytes - size it was allocated with
+ */
+void releaseTable(void* _memory, size_t _bytes);
+
+/*! \brief Count Table Allocator
+ *
+ *  Standard allocator over allocateTable(), for the vectors holding the
+ *  hash tables and word pools that grow large
+ */
+template <typename T>
+class TableAllocator
+    {
+    public:
+        typedef T value_type;
+        typedef T* pointer;
+        typedef const T* const_pointer;
+        typedef T& reference;
+        typedef const T& const_reference;
+        typedef size_t size_type;
+        typedef ptrdiff_t difference_type;
+
+        template <typename U>
+        struct rebind
+            {
+            typedef TableAllocator<U> other;
+            };
+
+        TableAllocator()
+            {
+            }
+        template <typename U>
+        TableAllocator(const TableAllocator<U>&)
+            {
+            }
+
+        T* allocate(size_t _count)
+            {
+            if (_count > max_size())
+                {
+                throw std::bad_alloc();
+                }
+            return static_cast<T*>(allocateTable(_count * sizeof(T)));
+            }
+        void deallocate(T* _memory, size_t _count)
+            {
+            releaseTable(_memory, _count * sizeof(T));
+            }
+        size_t max_size() const
+            {
+            return std::numeric_limits<size_t>::max() / sizeof(T);
+            }
+
+        template <typename U>
+        bool operator==(const TableAllocator<U>&) const
+            {
+            return true;
+            }
+        template <typename U>
+        bool operator!=(const TableAllocator<U>&) const
+            {
+            return false;
+            }
+    };
+
+/*! \brief NUMA Worker Placement
+ *
+ *  Spreads the worker threads evenly over the NUMA nodes and pins each one
+ *  to the CPUs of its node. Since every worker fills its own accumulator,
+ *  that keeps each accumulator in memory local to the node counting into
+ *  it, and the accumulators of different nodes only meet in the merge at
+ *  the end.
+ *
+ *  The nodes are read from /sys/devices/system/node; elsewhere, or on a
+ *  single node machine, there is one node and placement does nothing unless
+ *  nodes are emulated. Emulated nodes only split the CPUs, so they exercise
+ *  the pinning but all share the same memory; the kernel's own emulation
+ *  (numa=fake=<n> on its command-line) gives nodes with memory of their own.
+ *
+ *  The workers are pool threads that go on to run other tasks, so their
+ *  CPUs are given back by release(), or at the latest on destruction.
+ */
+class NumaPlacement
+    {
+    public:
+        /*! \brief Constructor
+         *
+         *  \param _emulatedNodes - when the machine has a single node, split
+         *      its CPUs into this many nodes; 0 to use the real topology
+         */
+        NumaPlacement(int _emulatedNodes=0);
+        /*! \brief Deconstructor
+         *
+         *  Releases any threads still pinned
+         */
+        ~NumaPlacement();
+
+        /*! \brief Node Count
+         *
+         *  \return number of nodes the workers are spread over
+         */
+        int nodeCount() const;
+
+        /*! \brief Node CPUs
+         *
+         *  \param _node - node index, 0 to nodeCount() - 1
+         *
+         *  \return the CPUs of the node
+         */
+        const std::vector<int>& nodeCpus(int _node) const;
+
+        /*! \brief Pin the Calling Thread
+         *
+         *  Called by a worker before it touches its accumulator. The first
+         *  call on each thread pins it to the next node in turn; later calls
+         *  are a thread-local read.
+         *
+         *  \return the node of the calling thread, or -1 if it could not be pinned
+         */
+        int placeCurrentThread();
+
+        /*! \brief Unpin the Workers
+         *
+         *  Give every thread pinned so far the CPUs it had before, so later
+         *  tasks on the same pool threads may run anywhere. A thread that
+         *  calls placeCurrentThread() afterwards is placed again.
+         */
+        void release();
+
+        /*! \brief Threads Placed
+         *
+         *  \param _node - node index, 0 to nodeCount() - 1
+         *
+         *  \return number of threads pinned to the node
+         */
+        int threadsOn(int _node) const;
+
+        /*! \brief CPU List Parsing
+         *
+         *  \param _text - list in the kernel's format, f.e "0-3,8-11"
+         *  \param _cpus - receives the CPUs listed
+         *
+         *  \return true if the list was valid
+         */
+        static bool parseCpuList(const QString& _text, std::vector<int>& _cpus);
+
+    private:
+        //! pin the calling thread to the CPUs of a node
+        bool pin(int _node);
+
+        //! a pinned thread and the CPUs it could run on before
+        struct PinnedThread
+            {
+            //! kernel thread id
+            long thread;
+            //! CPUs to give back
+            std::vector<int> cpus;
+            };
+
+        //! CPUs of each node
+        std::vector<std::vector<int> > nodes;
+        //! threads placed so far; the next one goes to node placed % nodeCount()
+        std::atomic<int> placed;
+        //! tag of this object in the thread-local cache; changes on release()
+        int generation;
+        //! threads pinned and not yet released
+        std::vector<PinnedThread> pinned;
+        //! guards pinned
+        QMutex pinnedLock;
+
+        // the thread-local cache refers to the object; not copyable
+        NumaPlacement(const NumaPlacement&);
+        NumaPlacement& operator=(const NumaPlacement&);
+    };
+
+#endif //MEMORY_PLACEMENT_H__
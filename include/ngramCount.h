@@ -0,0 +1,379 @@
+#ifndef NGRAM_COUNT_H__
+#define NGRAM_COUNT_H__
+
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+#include <QChar>
+#include <QString>
+
+#include <memoryPlacement.h>
+
+//! Largest supported phrase length
+#define MAX_NGRAM_ORDER 3
+
+//! Packed N-Gram; the word ids of the phrase stored side by side
+typedef uint64_t NgramKey;
+
+//! Phrase and its count, as reported in a top-K listing
+typedef std::pair<uint64_t, QString> PhraseCount;
+
+class RunWriter;
+
+/*! \brief Word Interning Table
+ *
+ *  Gives each distinct (lowercase) word a small integer id. Ids start at 1 so
+ *  0 can never appear in a packed key. The characters of all the words are kept
+ *  in a single pool and looked up with open addressing, so interning a token
+ *  does not allocate unless the word is new.
+ */
+class WordInterner
+    {
+    public:
+        /*! \brief Constructor
+         */
+        WordInterner();
+
+        /*! \brief Intern a Word
+         *
+         *  \param _word - word characters; case is ignored
+         *  \param _length - number of characters in the word
+         *  \param _limit - largest id that may be handed out for a new word
+         *
+         *  \return the id of the word, or 0 if it is new and _limit has been reached
+         */
+        uint32_t intern(const QChar* _word, int _length, uint32_t _limit=0xFFFFFFFF);
+
+        /*! \brief Intern a Word
+         *
+         *  \param _word - word to intern; case is ignored
+         *  \param _limit - largest id that may be handed out for a new word
+         *
+         *  \return the id of the word, or 0 if it is new and _limit has been reached
+         */
+        uint32_t intern(const QString& _word, uint32_t _limit=0xFFFFFFFF);
+
+        /*! \brief Find a Word
+         *
+         *  \param _word - word to look up; case is ignored
+         *
+         *  \return the id of the word, or 0 if it has not been interned
+         */
+        uint32_t find(const QString& _word) const;
+
+        /*! \brief Word Lookup
+         *
+         *  \param _id - id returned by intern()
+         *
+         *  \return the lowercase word
+         */
+        QString word(uint32_t _id) const;
+
+        /*! \brief Word Characters
+         *
+         *  \param _id - id returned by intern()
+         *
+         *  \return the lowercase characters of the word, without copying them
+         */
+        const QChar* wordData(uint32_t _id) const;
+
+        /*! \brief Word Length
+         *
+         *  \param _id - id returned by intern()
+         *
+         *  \return number of characters in the word
+         */
+        int wordLength(uint32_t _id) const;
+
+        /*! \brief Vocabulary Size
+         *
+         *  \return number of distinct words interned
+         */
+        int size() const;
+
+        /*! \brief Memory Use
+         *
+         *  \return bytes allocated for the table and the words, plus what
+         *      growing the largest of them would briefly need on top
+         */
+        uint64_t memoryUsage() const;
+
+        /*! \brief Reset
+         *
+         *  Forget all the words and release their memory
+         */
+        void clear();
+
+    private:
+        //! hash of the case folded word
+        static uint32_t hashWord(const QChar* _word, int _length);
+        //! locate a word; returns its id, or 0 with _slot set to the empty slot it would go in
+        uint32_t probe(const QChar* _word, int _length, uint32_t _hash, uint32_t& _slot) const;
+        //! double the slot table
+        void grow();
+
+        //! storage for the table and the word pool
+        typedef std::vector<uint32_t, TableAllocator<uint32_t> > IdVector;
+
+        //! open addressing slots holding word ids; 0 is empty
+        IdVector slotIds;
+        //! hash of each word by id, kept so growing does not rehash the characters
+        IdVector hashes;
+        //! offsets into characters; word id spans [offsets[id], offsets[id + 1])
+        IdVector offsets;
+        //! lowercase characters of all the words
+        std::vector<QChar, TableAllocator<QChar> > characters;
+    };
+
+/*! \brief Integer-Keyed Count Table
+ *
+ *  Open addressing hash table from packed n-gram keys to counts. Keys are
+ *  never 0, which marks an empty slot.
+ */
+class NgramTable
+    {
+    public:
+        /*! \brief Table Slot
+         */
+        struct Entry
+            {
+            //! packed key; 0 for an empty slot
+            NgramKey key;
+            //! number of times the key was seen
+            uint64_t count;
+            };
+
+        //! Slot storage; large tables may be backed by huge pages
+        typedef std::vector<Entry, TableAllocator<Entry> > Entries;
+
+        /*! \brief Constructor
+         */
+        NgramTable();
+
+        /*! \brief Increase a Count
+         *
+         *  \param _key - packed n-gram, must not be 0
+         *  \param _count - the count to increment by
+         */
+        void add(NgramKey _key, uint64_t _count=1);
+
+        /*! \brief Count Lookup
+         *
+         *  \param _key - packed n-gram
+         *
+         *  \return the count for the key, 0 if it has not been seen
+         */
+        uint64_t value(NgramKey _key) const;
+
+        /*! \brief Table Size
+         *
+         *  \return number of distinct keys
+         */
+        int size() const;
+
+        /*! \brief Slot Access
+         *
+         *  \return all the slots of the table, including the empty ones
+         */
+        const Entries& entries() const;
+
+        /*! \brief Memory Use
+         *
+         *  \return bytes allocated for the slots, plus the doubled slots
+         *      grow() briefly holds beside them
+         */
+        uint64_t memoryUsage() const;
+
+        /*! \brief Take the Slots
+         *
+         *  Move the slots out, leaving the table empty
+         *
+         *  \param _entries - receives all the slots, including the empty ones
+         */
+        void takeEntries(Entries& _entries);
+
+        /*! \brief Reset
+         *
+         *  Remove all the keys and shrink the table back to its initial size
+         */
+        void clear();
+
+    private:
+        //! slot a key starts probing from
+        inline uint32_t home(NgramKey _key) const;
+        //! double the slot table
+        void grow();
+
+        //! open addressing slots
+        Entries table;
+        //! number of keys stored
+        uint32_t used;
+        //! 64 - log2(table size), for multiplicative hashing
+        int shift;
+    };
+
+/*! \brief N-Gram Word Count Results
+ *
+ *  Counts phrases of a fixed number of consecutive words. Each word is interned
+ *  and the phrase is packed into a single 64-bit key: 2 x 32 bits for bigrams
+ *  and 3 x 21 bits for trigrams. Once a trigram has a word id past 21 bits the
+ *  keys are rebuilt as the id of the first two words plus the third word id,
+ *  32 bits each, so a large vocabulary is still counted exactly.
+ *
+ *  The ids are local to each object; merge() translates them, so each worker
+ *  can count without sharing anything.
+ */
+class NgramCount
+    {
+    public:
+        /*! \brief Constructor
+         *
+         *  \param _order - number of words in a phrase, 2 or 3
+         */
+        NgramCount(int _order=2);
+
+        /*! \brief Phrase Length
+         *
+         *  \return number of words in a phrase
+         */
+        int order() const;
+
+        /*! \brief Add a Word
+         *
+         *  Add the next word of the text; once enough words have been seen
+         *  this counts the phrase ending with it
+         *
+         *  \param _word - word characters
+         *  \param _length - number of characters in the word
+         *  \param _count - the count to increment the phrase by
+         */
+        void addToken(const QChar* _word, int _length, uint64_t _count=1);
+
+        /*! \brief Break the Phrase
+         *
+         *  Called at the end of a file and for skipped words, so a phrase
+         *  never spans words that were not next to each other
+         */
+        void endSequence();
+
+        /*! \brief Combine Results
+         *
+         *  \param _other - counts to add to these
+         */
+        void merge(const NgramCount& _other);
+
+        /*! \brief Combine Squared Results
+         *
+         *  Add the square of each of the other object's counts, f.e to
+         *  collect the spread of the counts between sampled blocks
+         *
+         *  \param _other - counts whose squares are added to these
+         */
+        void mergeSquares(const NgramCount& _other);
+
+        /*! \brief Phrase Lookup
+         *
+         *  \param _phrase - words separated by single spaces
+         *
+         *  \return the count for the phrase
+         */
+        uint64_t count(const QString& _phrase) const;
+
+        /*! \brief Distinct Phrases
+         *
+         *  \return number of distinct phrases counted
+         */
+        int size() const;
+
+        /*! \brief Most Frequent Phrases
+         *
+         *  \param _limit - number of phrases to return
+         *
+         *  \return up to _limit phrases, most frequent first
+         */
+        std::vector<PhraseCount> topPhrases(int _limit) const;
+
+        /*! \brief Memory Use
+         *
+         *  \return bytes allocated for the words and the phrase table,
+         *      including room for their next growth
+         */
+        uint64_t memoryUsage() const;
+
+        /*! \brief Write Out the Counts
+         *
+         *  Write every phrase, sorted, to a run and empty the counts. The words
+         *  of the phrase in progress are kept, so counting can carry on in the
+         *  middle of a file.
+         *
+         *  \param _writer - open run
+         *
+         *  \return true
+         */
+        bool spillTo(RunWriter& _writer);
+
+        /*! \brief Reset
+         *
+         *  Forget all the words and phrases; the phrase in progress carries on
+         */
+        void clear();
+
+        /*! \brief Key Packing
+         *
+         *  \param _ids - word ids of the phrase, in order
+         *  \param _order - number of words in the phrase
+         *
+         *  \return the packed key
+         */
+        static NgramKey pack(const uint32_t* _ids, int _order);
+
+        /*! \brief Key Unpacking
+         *
+         *  \param _key - packed key
+         *  \param _order - number of words in the phrase
+         *  \param _ids - receives the word ids of the phrase, in order
+         */
+        static void unpack(NgramKey _key, int _order, uint32_t* _ids);
+
+        /*! \brief Largest Word Id
+         *
+         *  \param _order - number of words in the phrase
+         *
+         *  \return largest id that fits in a packed key
+         */
+        static uint32_t maximumId(int _order);
+
+    private:
+        //! count a phrase, widening the keys first if its ids do not fit
+        void addPhrase(const uint32_t* _ids, uint64_t _count);
+        //! key of a phrase in the table, giving a new word pair an id once the keys are wide
+        NgramKey phraseKey(const uint32_t* _ids);
+        //! word ids of a key in the table
+        void phraseIds(NgramKey _key, uint32_t* _ids) const;
+        //! switch the trigram keys to word pair ids
+        void widen();
+        //! join the words of a key with spaces
+        QString phrase(NgramKey _key) const;
+        //! shared by merge() and mergeSquares()
+        void mergeCounts(const NgramCount& _other, bool _squared);
+
+        //! words in a phrase
+        int ngramOrder;
+        //! interned words
+        WordInterner words;
+        //! phrase counts
+        NgramTable counts;
+        //! ids of the most recent words, oldest first
+        uint32_t history[MAX_NGRAM_ORDER];
+        //! number of valid entries in history
+        int historyLength;
+        //! true once the trigram keys hold a word pair id and a word id
+        bool wideKeys;
+        //! word pair ids by packed pair, kept in the count of each entry
+        NgramTable pairs;
+        //! packed pair by word pair id; id 0 is unused
+        std::vector<NgramKey, TableAllocator<NgramKey> > pairKeys;
+    };
+
+#endif //NGRAM_COUNT_H__
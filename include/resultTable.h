@@ -0,0 +1,169 @@
+#ifndef RESULT_TABLE_H__
+#define RESULT_TABLE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+#include <QStringList>
+
+#include <countRuns.h>
+#include <memoryPlacement.h>
+
+/*! \brief Full Table Formats
+ */
+enum TableFormat
+    {
+    //! no table; only the top entries are listed
+    TABLE_NONE,
+    //! comma separated, quoted where needed
+    TABLE_CSV,
+    //! tab separated, with tabs, newlines and backslashes escaped
+    TABLE_TSV,
+    //! a JSON array of objects
+    TABLE_JSON
+    };
+
+/*! \brief Full Table Row Order
+ */
+enum TableOrder
+    {
+    //! most frequent first; ties list later keys first, as the top entries do
+    TABLE_BY_COUNT,
+    //! ascending key (code point) order
+    TABLE_BY_KEY
+    };
+
+/*! \brief Table Row for Sorting
+ *
+ *  A count and the position of its key in the table
+ */
+struct RankedKey
+    {
+    uint64_t count;
+    uint32_t key;
+    };
+
+/*! \brief Parallel Sort by Count
+ *
+ *  Stable LSD radix sort on the counts, most frequent first. Only as many
+ *  byte passes are made as the largest count needs; each pass counts the
+ *  digits of a slice per thread, then every thread scatters its own slice.
+ *  Small tables are sorted on the calling thread.
+ *
+ *  \param _rows - rows to sort in place
+ */
+void sortByCount(std::vector<RankedKey, TableAllocator<RankedKey> >& _rows);
+
+/*! \brief Full Table Output
+ *
+ *  Merge destination that writes every (key, count) it is given as CSV, TSV
+ *  or JSON. Keys arrive in ascending order; they are written as they arrive
+ *  when ordered by key, and collected into one key pool and sorted by
+ *  sortByCount() when ordered by count. Rows held past the memory limit, or
+ *  past the 2^32 a RankedKey can refer to, are sorted and written to a run
+ *  in count order, and close() merges the runs by count, so the table needs
+ *  no more memory than the limit. The rows are formatted by hand into a
+ *  large buffer that is written in blocks.
+ */
+class TableExport : public RunConsumer
+    {
+    public:
+        /*! \brief Constructor
+         */
+        TableExport();
+        /*! \brief Deconstructor
+         *
+         *  Closes the output if it is still open
+         */
+        ~TableExport();
+
+        /*! \brief External Sort
+         *
+         *  Set before open(); without a scratch directory every row is held
+         *
+         *  \param _scratchDirectory - where the rows sorted by count are written once there are too many to hold
+         *  \param _memoryLimit - bytes the held rows may use; 0 for no limit
+         */
+        void setSortSpill(const QString& _scratchDirectory, uint64_t _memoryLimit=0);
+
+        /*! \brief Start the Table
+         *
+         *  \param _fileName - file to create, replaced if it exists; empty for stdout
+         *  \param _format - how the rows are written
+         *  \param _order - how the rows are sorted
+         *  \param _ngramOrder - words per key; names the key column
+         *
+         *  \return true if the output could be opened
+         */
+        bool open(const QString& _fileName, TableFormat _format, TableOrder _order, int _ngramOrder=1);
+
+        /*! \brief Add a Row
+         *
+         *  \param _key - UTF-8 key; must sort after the previous key
+         *  \param _count - count for the key
+         */
+        void add(const QByteArray& _key, uint64_t _count);
+
+        /*! \brief Finish the Table
+         *
+         *  Sorts the rows if they are ordered by count, and writes whatever
+         *  is left
+         *
+         *  \return true if everything was written
+         */
+        bool close();
+
+        /*! \brief Row Count
+         *
+         *  \return number of rows added
+         */
+        uint64_t rows() const;
+
+    private:
+        //! hands the rows of the final merge to writeRow()
+        class RowWriter;
+
+        //! format a row into the buffer
+        void writeRow(const char* _key, int _length, uint64_t _count);
+        //! write the buffer to the output
+        void flush();
+        //! sort the held rows by count and write them to the output
+        void writeHeld();
+        //! sort the held rows by count into a run, and release them
+        void spillHeld();
+        //! merge the spilled runs by count into the output
+        void mergeSpilled();
+        //! bytes the held rows use
+        uint64_t heldBytes() const;
+
+        QFile output;
+        //! formatted rows not yet written
+        QByteArray buffer;
+        TableFormat format;
+        TableOrder order;
+        //! name of the key column
+        QByteArray keyName;
+        uint64_t rowCount;
+        uint64_t rowsWritten;
+        bool failed;
+
+        //! keys held for sorting by count, back to back
+        std::vector<char, TableAllocator<char> > keys;
+        //! start of each held key in keys, plus the end of the last
+        std::vector<uint64_t, TableAllocator<uint64_t> > keyOffsets;
+        //! the held rows
+        std::vector<RankedKey, TableAllocator<RankedKey> > ranked;
+
+        //! where runs of rows sorted by count go; empty to hold every row
+        QString scratchDirectory;
+        //! bytes the held rows may use before they are spilled; 0 for no limit
+        uint64_t memoryLimit;
+        //! runs spilled so far, each in count order and after the previous in key order
+        QStringList sortedRuns;
+    };
+
+#endif //RESULT_TABLE_H__
@@ -0,0 +1,155 @@
+#ifndef SIMPLE_FILE_INDEXER_H__
+#define SIMPLE_FILE_INDEXER_H__
+
+#include <stdint.h>
+#include <functional>
+#include <vector>
+
+#include <QFuture>
+#include <QString>
+#include <QStringList>
+
+#include <fileIndexer.h>
+#include <indexerOptions.h>
+#include <inputDedup.h>
+#include <ngramCount.h>
+#include <stopwordFilter.h>
+#include <tokenMatcher.h>
+
+/*! \brief Indexing Results
+ *
+ *  Everything counted by one call to SimpleFileIndexer
+ */
+struct IndexResult
+    {
+    /*! \brief Constructor
+     *
+     *  \param _order - words per entry
+     */
+    IndexResult(int _order=1);
+
+    //! Words per entry; 1 for single words
+    int ngramOrder;
+
+    //! Count of every word, when counting single words
+    WordCount words;
+
+    //! Count of every phrase, when counting phrases
+    NgramCount phrases;
+
+    //! The most frequent entries, most frequent first
+    std::vector<PhraseCount> top;
+
+    //! Input files and what deduplication skipped; empty for a buffer
+    DedupStats dedup;
+    };
+
+/*! \brief Embeddable Indexer
+ *
+ *  Library entry point to the indexer. It needs no event loop and every call
+ *  counts into accumulators of its own, so any number of calls may run at
+ *  once from any thread; the work is spread over QThreadPool::globalInstance().
+ *
+ *  The command-line only options (--memory-limit, --spill-dir, --emit-partial,
+ *  --emit-vocabulary, --output and the sampling options) are not used: the
+ *  counts are always exact and returned in memory.
+ *
+ *  Per-file progress messages only go to the log given to setFileLog(); by
+ *  default there is none. A few things are still shared with the rest of
+ *  the process:
+ *  - the count tables are allocated in the process-wide setHugePageMode()
+ *  - each pool thread remembers the accumulators of only its last 4 calls;
+ *    with more overlapping on a thread the counts stay exact, but a call may
+ *    create a second accumulator on that thread
+ */
+class SimpleFileIndexer
+    {
+    public:
+        //! Receives the results of an asynchronous call, on a pool thread
+        typedef std::function<void (const IndexResult&)> ResultCallback;
+
+        /*! \brief Constructor
+         *
+         *  \param _options - how to count; the file list is not used
+         *  \param _topCount - number of entries to put in IndexResult::top
+         */
+        SimpleFileIndexer(const IndexerOptions& _options=IndexerOptions(), int _topCount=10);
+
+        /*! \brief Progress Messages
+         *
+         *  \param _log - receives the messages about each file read, on the
+         *      pool threads; an empty one turns them off
+         */
+        void setFileLog(const FileLog& _log);
+
+        /*! \brief Index Files
+         *
+         *  Count the files, blocking until they are done. Files that cannot
+         *  be read count as empty.
+         *
+         *  \param _files - files to process
+         *
+         *  \return the counts
+         */
+        IndexResult indexFiles(const QStringList& _files) const;
+
+        /*! \brief Index a Buffer
+         *
+         *  Count the text of a buffer, as if it were the whole of a file
+         *
+         *  \param _text - text to process
+         *
+         *  \return the counts
+         */
+        IndexResult indexBuffer(const QString& _text) const;
+
+        /*! \brief Index Files Asynchronously
+         *
+         *  \param _files - files to process
+         *
+         *  \return the future counts
+         */
+        QFuture<IndexResult> indexFilesAsync(const QStringList& _files) const;
+
+        /*! \brief Index Files Asynchronously
+         *
+         *  \param _files - files to process
+         *  \param _callback - called with the counts once they are done
+         *
+         *  \return completion of the call, including the callback
+         */
+        QFuture<void> indexFilesAsync(const QStringList& _files, const ResultCallback& _callback) const;
+
+        /*! \brief Index a Buffer Asynchronously
+         *
+         *  \param _text - text to process
+         *
+         *  \return the future counts
+         */
+        QFuture<IndexResult> indexBufferAsync(const QString& _text) const;
+
+        /*! \brief Index a Buffer Asynchronously
+         *
+         *  \param _text - text to process
+         *  \param _callback - called with the counts once they are done
+         *
+         *  \return completion of the call, including the callback
+         */
+        QFuture<void> indexBufferAsync(const QString& _text, const ResultCallback& _callback) const;
+
+    private:
+        //! token scanner shared by the workers
+        TokenMatcher matcher;
+        //! stopword filter shared by the workers
+        StopwordFilter stopwords;
+        //! words per phrase; 1 counts single words
+        int ngramOrder;
+        //! whether identical copies are found by content as well as by inode
+        bool dedupContent;
+        //! entries to report
+        int topCount;
+        //! progress messages; none unless asked for
+        FileLog fileLog;
+    };
+
+#endif //SIMPLE_FILE_INDEXER_H__
@@ -0,0 +1,162 @@
+#ifndef STOPWORD_FILTER_H__
+#define STOPWORD_FILTER_H__
+
+#include <stdint.h>
+#include <vector>
+
+#include <QChar>
+#include <QString>
+#include <QStringList>
+
+#include <tokenMatcher.h>
+
+/*! \brief Stopword Lookup
+ *
+ *  Set of words that are never counted. The words are placed in a perfect
+ *  hash table (hash and displace) when the filter is built, so a lookup is a
+ *  single hash of the token, one displacement fetch and at most one string
+ *  comparison. Tokens are compared case insensitively.
+ *
+ *  Once built the object is only ever read, so a single instance may be
+ *  shared by all worker threads.
+ */
+class StopwordFilter
+    {
+    public:
+        /*! \brief Constructor
+         *
+         *  Creates an empty filter that does not match anything
+         */
+        StopwordFilter();
+
+        /*! \brief Build the Perfect Hash
+         *
+         *  Replaces the contents of the filter with the given words. Duplicates
+         *  and differences in case are ignored.
+         *
+         *  \param _words - the stopwords
+         *
+         *  \return true if the table was built, false if no perfect hash could be found
+         */
+        bool build(const QStringList& _words);
+
+        /*! \brief Filter State
+         *
+         *  \return true if the filter contains no words
+         */
+        bool isEmpty() const;
+
+        /*! \brief Filter Size
+         *
+         *  \return number of distinct stopwords
+         */
+        int size() const;
+
+        /*! \brief Stopword Check
+         *
+         *  \param _word - token characters
+         *  \param _length - number of characters in the token
+         *
+         *  \return true if the token is a stopword
+         */
+        inline bool contains(const QChar* _word, int _length) const;
+
+        /*! \brief Stopword Check
+         *
+         *  \param _word - token to check
+         *
+         *  \return true if the token is a stopword
+         */
+        bool contains(const QString& _word) const;
+
+        /*! \brief Built-in Stopwords
+         *
+         *  \return the built-in list of common English words
+         */
+        static QStringList builtinWords();
+
+        /*! \brief Load Stopwords
+         *
+         *  Read whitespace separated words from a file; anything following
+         *  a '#' up to the end of the line is ignored
+         *
+         *  \param _fileName - file to read
+         *  \param _words - list the words are appended to
+         *
+         *  \return true if the file could be read
+         */
+        static bool readWordFile(const QString& _fileName, QStringList& _words);
+
+        /*! \brief Empty Filter
+         *
+         *  \return shared filter that does not match anything
+         */
+        static const StopwordFilter& none();
+
+    private:
+        /*! \brief Case Folded Token Hash
+         *
+         *  FNV-1a over the lowercase form of each character
+         */
+        static inline uint64_t hashWord(const QChar* _word, int _length);
+
+        //! per-bucket displacement; the slot for a word is (hash + displacement * stride) & slotMask
+        std::vector<uint32_t> displacements;
+        //! offset into characters of the word stored in each slot
+        std::vector<uint32_t> slotOffsets;
+        //! length of the word stored in each slot; 0 for an empty slot
+        std::vector<uint16_t> slotLengths;
+        //! lowercase characters of all the stopwords
+        std::vector<QChar> characters;
+        //! number of buckets - 1; a power of two minus one
+        uint32_t bucketMask;
+        //! number of slots - 1; a power of two minus one
+        uint32_t slotMask;
+        //! shortest and longest stopword, for rejecting tokens without hashing
+        int minimumLength;
+        int maximumLength;
+        //! number of stopwords
+        int wordCount;
+    };
+
+inline uint64_t StopwordFilter::hashWord(const QChar* _word, int _length)
+    {
+    uint64_t hash = 14695981039346656037ULL;
+    for (int i = 0; i < _length; ++i)
+        {
+        hash ^= foldCharacter(_word[i]);
+        hash *= 1099511628211ULL;
+        }
+    return hash;
+    }
+
+inline bool StopwordFilter::contains(const QChar* _word, int _length) const
+    {
+    if (_length < minimumLength || _length > maximumLength)
+        {
+        return false;
+        }
+
+    uint64_t hash = hashWord(_word, _length);
+    uint32_t bucket = static_cast<uint32_t>(hash >> 40) & bucketMask;
+    uint32_t stride = static_cast<uint32_t>(hash >> 20) | 1;
+    uint32_t slot = (static_cast<uint32_t>(hash) + displacements[bucket] * stride) & slotMask;
+    if (slotLengths[slot] != _length)
+        {
+        return false;
+        }
+
+    // a perfect hash only guarantees stopwords do not collide; any other
+    // token can still land on a slot, so confirm it is the same word
+    const QChar* stored = &characters[slotOffsets[slot]];
+    for (int i = 0; i < _length; ++i)
+        {
+        if (stored[i].unicode() != foldCharacter(_word[i]))
+            {
+            return false;
+            }
+        }
+    return true;
+    }
+
+#endif //STOPWORD_FILTER_H__
@@ -0,0 +1,166 @@
+#ifndef THREAD_ACCUMULATORS_H__
+#define THREAD_ACCUMULATORS_H__
+
+#include <stdint.h>
+#include <vector>
+
+#include <QAtomicInt>
+#include <QMutex>
+#include <QMutexLocker>
+
+/*! \brief Per-Thread Result Accumulators
+ *
+ *  Gives every worker thread its own long-lived accumulator so files can be
+ *  counted straight into it instead of into a fresh per-file result that then
+ *  has to be merged. The accumulators belong to this object and are merged by
+ *  the caller once all the work is done.
+ *
+ *  Looking up the calling thread's accumulator is a thread-local read; the
+ *  registry lock is only taken the first time a thread is seen. Worker threads
+ *  outlive a single run, so the thread-local cache is tagged with the run's
+ *  generation and a new run never picks up an old run's accumulator. A few
+ *  entries are cached per thread, so a worker that alternates between the
+ *  runs of several concurrent instances keeps one accumulator in each.
+ */
+template <typename Accumulator>
+class ThreadAccumulators
+    {
+    public:
+        /*! \brief Constructor
+         *
+         *  \param _prototype - value each new accumulator starts as
+         */
+        ThreadAccumulators(const Accumulator& _prototype=Accumulator()) :
+            prototype(_prototype), generation(nextGeneration())
+            {
+            }
+
+        /*! \brief Deconstructor
+         */
+        ~ThreadAccumulators()
+            {
+            clear();
+            }
+
+        /*! \brief Calling Thread's Accumulator
+         *
+         *  \return the accumulator owned by the calling thread, created on first use
+         */
+        Accumulator& local()
+            {
+            LocalSlot* cache = localSlots();
+            for (int i = 0; i < LOCAL_SLOTS; ++i)
+                {
+                if (cache[i].generation == generation)
+                    {
+                    return *static_cast<Accumulator*>(cache[i].accumulator);
+                    }
+                }
+
+            // first time this thread is seen for this run; replace the oldest run's entry
+            LocalSlot* slot = cache;
+            for (int i = 1; i < LOCAL_SLOTS; ++i)
+                {
+                if (cache[i].generation < slot->generation)
+                    {
+                    slot = cache + i;
+                    }
+                }
+            QMutexLocker lock(&registryLock);
+            accumulators.push_back(new Accumulator(prototype));
+            slot->generation = generation;
+            slot->accumulator = accumulators.back();
+            return *static_cast<Accumulator*>(slot->accumulator);
+            }
+
+        /*! \brief Accumulator Count
+         *
+         *  \return number of threads that have used an accumulator
+         */
+        int size() const
+            {
+            return static_cast<int>(accumulators.size());
+            }
+
+        /*! \brief Accumulator Access
+         *
+         *  Only safe once the workers have finished
+         *
+         *  \param _index - accumulator index, 0 to size() - 1
+         *
+         *  \return the accumulator
+         */
+        Accumulator& at(int _index)
+            {
+            return *accumulators[_index];
+            }
+
+        /*! \brief Accumulators So Far
+         *
+         *  Unlike size() and at(), safe to call while the workers are still
+         *  running, f.e to read their progress; the registry lock is only
+         *  held while the list is copied
+         *
+         *  \return the accumulators handed out for the current run
+         */
+        std::vector<Accumulator*> registered()
+            {
+            QMutexLocker lock(&registryLock);
+            return accumulators;
+            }
+
+        /*! \brief Reset
+         *
+         *  Drop all the accumulators; the next call to local() on any thread
+         *  starts from the prototype again
+         */
+        void clear()
+            {
+            QMutexLocker lock(&registryLock);
+            for (typename std::vector<Accumulator*>::iterator iter = accumulators.begin(); iter != accumulators.end(); ++iter)
+                {
+                delete *iter;
+                }
+            accumulators.clear();
+            generation = nextGeneration();
+            }
+
+    private:
+        //! thread-local cache of the accumulator for the current run
+        struct LocalSlot
+            {
+            int generation;
+            void* accumulator;
+            };
+
+        //! runs remembered per thread
+        static const int LOCAL_SLOTS = 4;
+
+        static LocalSlot* localSlots()
+            {
+            static thread_local LocalSlot cache[LOCAL_SLOTS] = { { 0, NULL }, { 0, NULL }, { 0, NULL }, { 0, NULL } };
+            return cache;
+            }
+
+        static int nextGeneration()
+            {
+            // generations start at 1 so a fresh thread-local slot never matches
+            static QAtomicInt counter(0);
+            return counter.fetchAndAddOrdered(1) + 1;
+            }
+
+        //! starting value of each accumulator
+        Accumulator prototype;
+        //! tag of the current run
+        int generation;
+        //! all accumulators handed out for the current run
+        std::vector<Accumulator*> accumulators;
+        //! guards accumulators while threads register
+        QMutex registryLock;
+
+        // owns raw pointers; not copyable
+        ThreadAccumulators(const ThreadAccumulators&);
+        ThreadAccumulators& operator=(const ThreadAccumulators&);
+    };
+
+#endif //THREAD_ACCUMULATORS_H__
@@ -0,0 +1,206 @@
+#ifndef TOKEN_MATCHER_H__
+#define TOKEN_MATCHER_H__
+
+#include <stdint.h>
+#include <vector>
+
+#include <QChar>
+#include <QString>
+
+//! Pattern used for tokens when the user does not provide one
+#define DEFAULT_TOKEN_PATTERN "[A-Za-z0-9]+"
+
+/*! \brief Case Folding
+ *
+ *  Lowercase form of a character, matching what QString::toLower() produces
+ *  for the words that are counted
+ *
+ *  \param _character - character to fold
+ *
+ *  \return the lowercase character code
+ */
+inline ushort foldCharacter(QChar _character)
+    {
+    ushort c = _character.unicode();
+    if (c < 128)
+        {
+        return (c >= 'A' && c <= 'Z') ? static_cast<ushort>(c + 0x20) : c;
+        }
+    return _character.toLower().unicode();
+    }
+
+/*! \brief Token Match Location
+ *
+ *  Result of scanning a buffer for the next token
+ */
+struct TokenMatch
+    {
+    //! offset of the first character of the token
+    int start;
+    //! number of characters in the token; 0 if no complete token was found at start
+    int length;
+    //! true if the scan reached the end of the buffer while a longer token was still possible
+    bool open;
+    };
+
+/*! \brief Scan Memo
+ *
+ *  What the scanner has learnt about one buffer: the (DFA state, position)
+ *  pairs from which no longer token can be found. A scan that reaches one
+ *  stops there instead of reading on, so every pair is only ever walked
+ *  once and repeated findToken() calls over the buffer take linear time.
+ *
+ *  The memo belongs to the contents of a single buffer; reset() it, or use
+ *  a new one, once the buffer changes.
+ */
+class TokenScanMemo
+    {
+    public:
+        /*! \brief Constructor
+         */
+        TokenScanMemo();
+
+        /*! \brief Forget the Buffer
+         */
+        void reset();
+
+    private:
+        friend class TokenMatcher;
+
+        //! size the memo for a buffer, clearing it if it was for another one
+        void prepare(int _length, int _states);
+        //! true if the pair is known; _open receives whether the scan from there reaches the end of the buffer
+        bool known(int32_t _state, int _position, bool& _open) const;
+        //! remember that the scan from the pair finds no token, ending alive at the end of the buffer if _open
+        void remember(int32_t _state, int _position, bool _open);
+
+        //! pairs known to find nothing more, a bit per position and state
+        std::vector<uint64_t> exhausted;
+        //! of those, the ones whose scan reaches the end of the buffer
+        std::vector<uint64_t> reachesEnd;
+        //! buffer length the memo is for
+        int length;
+        //! DFA states the memo is for
+        int states;
+        //! furthest position remembered, -1 for none; scans past it need not look
+        int horizon;
+    };
+
+/*! \brief Token Pattern Scanner
+ *
+ *  Compiles a token pattern once into a table-driven DFA and then scans buffers
+ *  for the leftmost-longest token. The input alphabet is compressed into byte
+ *  classes so the transition table stays small; characters outside of Latin-1
+ *  share a single class.
+ *
+ *  Supported syntax: literals, '.', [...] and [^...] classes with ranges,
+ *  \\d \\w \\s \\D \\W \\S, \\xHH, escaped meta-characters, (...) and (?:...) groups,
+ *  '|', '*', '+', '?' and {m}, {m,}, {m,n} repetition. Matching is case insensitive.
+ *
+ *  Once compiled the object is only ever read, so a single instance may be
+ *  shared by all worker threads.
+ */
+class TokenMatcher
+    {
+    public:
+        /*! \brief Constructor
+         *
+         *  Compiles the default token pattern
+         */
+        TokenMatcher();
+        /*! \brief Constructor
+         *
+         *  \param _pattern - token pattern to compile; check isValid() for the result
+         */
+        explicit TokenMatcher(const QString& _pattern);
+
+        /*! \brief Compile a Token Pattern
+         *
+         *  \param _pattern - token pattern to compile
+         *  \param _error - if not NULL, receives a description of why the pattern was rejected
+         *
+         *  \return true if the pattern was compiled, false otherwise
+         */
+        bool compile(const QString& _pattern, QString* _error=NULL);
+
+        /*! \brief Compilation Status
+         *
+         *  \return true if a pattern has been compiled successfully
+         */
+        bool isValid() const;
+
+        /*! \brief Token Pattern
+         *
+         *  \return the pattern the scanner was compiled from
+         */
+        QString pattern() const;
+
+        /*! \brief DFA Size
+         *
+         *  \return number of states in the compiled DFA, including the dead state
+         */
+        int stateCount() const;
+
+        /*! \brief Byte Class Count
+         *
+         *  \return number of input classes the alphabet was compressed to
+         */
+        int classCount() const;
+
+        /*! \brief Find the Next Token
+         *
+         *  Scan the data for the leftmost-longest token starting at or after _from.
+         *  A single call takes time linear in the data it reads; a memo kept across
+         *  the calls over one buffer keeps the whole buffer linear, where otherwise
+         *  a pattern that fails late, f.e "[a-z]+\\.[a-z]+" over a long word, would
+         *  read the same characters again from every start.
+         *
+         *  \param _data - character data to scan
+         *  \param _length - number of characters in _data
+         *  \param _from - offset to begin the scan at
+         *  \param _match - receives the location of the token
+         *  \param _memo - if not NULL, what earlier calls learnt about the same data
+         *
+         *  \return true if a token (or the start of a possible token reaching the end
+         *      of the data) was found; false if the rest of the data holds no token
+         */
+        bool findToken(const QChar* _data, int _length, int _from, TokenMatch& _match, TokenScanMemo* _memo=NULL) const;
+
+        /*! \brief Separator Check
+         *
+         *  A character that is part of no token ends any token before it, so
+         *  a scan of the text after it finds the same tokens as a scan that
+         *  started further back
+         *
+         *  \param _character - character to check
+         *
+         *  \return true if no token can contain the character
+         */
+        bool separates(QChar _character) const;
+
+        /*! \brief Default Scanner
+         *
+         *  \return shared scanner for DEFAULT_TOKEN_PATTERN
+         */
+        static const TokenMatcher& defaultMatcher();
+
+    private:
+        //! input symbol to byte class mapping; the last entry is for non-Latin-1 characters
+        std::vector<uint16_t> symbolClass;
+        //! transition table, stateCount() rows of classCount() entries; state 0 is dead
+        std::vector<int32_t> transitions;
+        //! whether each state accepts
+        std::vector<uint8_t> accepting;
+        //! whether a token can start with a given byte class
+        std::vector<uint8_t> startable;
+        //! whether a given byte class can not appear anywhere in a token
+        std::vector<uint8_t> separating;
+        //! number of byte classes
+        int classes;
+        //! initial state
+        int32_t startState;
+        //! source pattern
+        QString sourcePattern;
+    };
+
+#endif //TOKEN_MATCHER_H__
@@ -0,0 +1,226 @@
+#ifndef VOCABULARY_TRIE_H__
+#define VOCABULARY_TRIE_H__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+
+#include <countRuns.h>
+#include <ngramCount.h>
+
+/*! \brief Vocabulary File Identification
+ *
+ *  First bytes of every vocabulary file; the words per key follow as a number
+ */
+#define VOCABULARY_FILE_MAGIC "SFIVOC01"
+
+/*! \brief Vocabulary Trie Writer
+ *
+ *  Builds a compressed trie of (key, count) records that arrive in ascending
+ *  key order, f.e from a merge of sorted runs. Keys that share a prefix share
+ *  the nodes for it, and a chain of nodes with a single child is stored as
+ *  one edge, so "connect", "connected" and "connection" store "connect"
+ *  once. Every node also records the highest count below it, which lets the
+ *  reader find the most frequent keys under a prefix without visiting the
+ *  rest.
+ *
+ *  Nodes are written as soon as the keys below them are complete, children
+ *  before their parents, so only the nodes on the path of the current key are
+ *  held in memory.
+ */
+class VocabularyWriter : public RunConsumer
+    {
+    public:
+        /*! \brief Constructor
+         */
+        VocabularyWriter();
+        /*! \brief Deconstructor
+         *
+         *  Closes the file if it is still open
+         */
+        ~VocabularyWriter();
+
+        /*! \brief Start a Vocabulary
+         *
+         *  \param _fileName - file to create; replaced if it exists
+         *  \param _order - words per key
+         *
+         *  \return true if the file could be created
+         */
+        bool open(const QString& _fileName, int _order=1);
+
+        /*! \brief Add a Record
+         *
+         *  \param _key - UTF-8 key; must sort after the previous key
+         *  \param _count - count for the key, below 2^63; a count of 0 is not stored
+         */
+        void add(const QByteArray& _key, uint64_t _count);
+
+        /*! \brief Finish the Vocabulary
+         *
+         *  \return true if everything was written and the keys were in order
+         */
+        bool close();
+
+        /*! \brief Record Count
+         *
+         *  \return number of keys written
+         */
+        uint64_t records() const;
+
+        /*! \brief File Size
+         *
+         *  \return bytes written so far
+         */
+        uint64_t size() const;
+
+    private:
+        //! edge from a node to a finished child
+        struct Edge
+            {
+            std::string label;
+            uint64_t offset;
+            };
+        //! node on the path of the current key, still taking children
+        struct PathNode
+            {
+            //! length of the key prefix the node stands for
+            size_t depth;
+            //! count of that prefix as a key; 0 if it is not one
+            uint64_t count;
+            //! highest count of the node and everything below it
+            uint64_t best;
+            std::vector<Edge> children;
+            };
+
+        //! write the deepest node on the path and attach it to its parent, splitting the edge at _shared
+        void finishNode(size_t _shared);
+        //! encode a node into the buffer; returns its offset
+        uint64_t writeNode(const PathNode& _node);
+        //! write the buffer to the file
+        void flush();
+
+        QFile output;
+        //! encoded nodes not yet written
+        QByteArray buffer;
+        //! bytes already written to the file
+        uint64_t written;
+        //! previous key; the path follows it
+        std::string previous;
+        //! the root and the nodes along the previous key, deepest last
+        std::vector<PathNode> path;
+        uint64_t recordCount;
+        bool failed;
+    };
+
+/*! \brief Vocabulary Trie Reader
+ *
+ *  Answers queries straight from a memory mapped vocabulary file: nothing is
+ *  decoded up front, and only the nodes on the way to an answer are touched.
+ */
+class Vocabulary
+    {
+    public:
+        /*! \brief Constructor
+         */
+        Vocabulary();
+        /*! \brief Deconstructor
+         */
+        ~Vocabulary();
+
+        /*! \brief Open a Vocabulary
+         *
+         *  \param _fileName - vocabulary file to map
+         *
+         *  \return true if the file could be mapped and is a vocabulary file
+         */
+        bool open(const QString& _fileName);
+
+        /*! \brief Release the Mapping
+         */
+        void close();
+
+        /*! \brief Words per Key
+         *
+         *  \return the words per key of the vocabulary, 0 if none is open
+         */
+        int order() const;
+
+        /*! \brief Key Count
+         *
+         *  \return number of keys in the vocabulary
+         */
+        uint64_t size() const;
+
+        /*! \brief Exact Lookup
+         *
+         *  \param _key - key to find, as counted (lowercase)
+         *
+         *  \return the count of the key, 0 if it is not in the vocabulary
+         */
+        uint64_t count(const QString& _key) const;
+
+        /*! \brief Prefix Enumeration
+         *
+         *  \param _prefix - prefix the keys start with; empty for every key
+         *  \param _consumer - receives the keys in ascending order
+         *
+         *  \return false if the file turned out to be corrupt
+         */
+        bool entries(const QString& _prefix, RunConsumer& _consumer) const;
+
+        /*! \brief Most Frequent Keys under a Prefix
+         *
+         *  Ties are listed the same way as the other results, later keys first
+         *
+         *  \param _prefix - prefix the keys start with; empty for every key
+         *  \param _limit - number of keys to return
+         *
+         *  \return up to _limit keys, most frequent first
+         */
+        std::vector<PhraseCount> top(const QString& _prefix, int _limit) const;
+
+        /*! \brief Error State
+         *
+         *  \return true if a query found the file to be corrupt
+         */
+        bool failed() const;
+
+    private:
+        //! header of a node
+        struct Node
+            {
+            uint64_t count;
+            uint64_t best;
+            uint64_t children;
+            //! offset of the first edge
+            uint64_t edges;
+            };
+        //! decode the node at _offset
+        bool readNode(uint64_t _offset, Node& _node) const;
+        //! decode the edge at _position, of the node at _parent, and advance past it
+        bool readEdge(uint64_t& _position, uint64_t _parent, const char*& _label, uint64_t& _length, uint64_t& _child) const;
+        //! read a variable length number at _position and advance past it
+        bool readNumber(uint64_t& _position, uint64_t& _value) const;
+        //! find the node below which every key starts with _prefix, and the key of that node
+        bool locate(const QByteArray& _prefix, uint64_t& _node, QByteArray& _key) const;
+
+        QFile input;
+        const char* data;
+        //! bytes before the trailer
+        uint64_t length;
+        uint64_t root;
+        uint64_t keys;
+        int keyOrder;
+        mutable bool corrupt;
+
+        // the mapping belongs to the object; not copyable
+        Vocabulary(const Vocabulary&);
+        Vocabulary& operator=(const Vocabulary&);
+    };
+
+#endif //VOCABULARY_TRIE_H__
@@ -0,0 +1,127 @@
+#ifndef WORD_TALLY_H__
+#define WORD_TALLY_H__
+
+#include <stdint.h>
+#include <vector>
+
+#include <QChar>
+#include <QString>
+
+#include <memoryPlacement.h>
+#include <ngramCount.h>
+
+class RunWriter;
+
+/*! \brief Interned Word Counts
+ *
+ *  Word counts kept as a count per interned word id. Counting a word that
+ *  has been seen before neither allocates nor builds a string, which makes
+ *  this the accumulator a worker keeps across all of its files; it is turned
+ *  into a WordCount once, after all the files are done.
+ */
+class WordTally
+    {
+    public:
+        /*! \brief Constructor
+         */
+        WordTally();
+
+        /*! \brief Count a Word
+         *
+         *  \param _word - word characters; case is ignored
+         *  \param _length - number of characters in the word
+         *  \param _count - the count to increment by
+         */
+        void addToken(const QChar* _word, int _length, uint64_t _count=1);
+
+        /*! \brief Increase a Count
+         *
+         *  \param _word - word the count is for; case is ignored
+         *  \param _count - the count to increment by
+         */
+        void add(const QString& _word, uint64_t _count=1);
+
+        /*! \brief Combine Results
+         *
+         *  \param _other - counts to add to these
+         */
+        void merge(const WordTally& _other);
+
+        /*! \brief Combine Squared Results
+         *
+         *  Add the square of each of the other object's counts, f.e to
+         *  collect the spread of the counts between sampled blocks
+         *
+         *  \param _other - counts whose squares are added to these
+         */
+        void mergeSquares(const WordTally& _other);
+
+        /*! \brief Distinct Words
+         *
+         *  \return number of distinct words; their ids run from 1 to size()
+         */
+        int size() const;
+
+        /*! \brief Word Lookup
+         *
+         *  \param _id - word id, 1 to size()
+         *
+         *  \return the lowercase word
+         */
+        QString word(uint32_t _id) const;
+
+        /*! \brief Count Lookup
+         *
+         *  \param _id - word id, 1 to size()
+         *
+         *  \return the count for the word
+         */
+        uint64_t count(uint32_t _id) const;
+
+        /*! \brief Count Lookup
+         *
+         *  \param _word - word to look up; case is ignored
+         *
+         *  \return the count for the word, 0 if it has not been seen
+         */
+        uint64_t count(const QString& _word) const;
+
+        /*! \brief Most Frequent Words
+         *
+         *  \param _limit - number of words to return
+         *
+         *  \return up to _limit words, most frequent first
+         */
+        std::vector<PhraseCount> topWords(int _limit) const;
+
+        /*! \brief Memory Use
+         *
+         *  \return bytes allocated for the words and their counts,
+         *      including room for their next growth
+         */
+        uint64_t memoryUsage() const;
+
+        /*! \brief Write Out the Counts
+         *
+         *  Write every word, sorted, to a run and empty the tally
+         *
+         *  \param _writer - open run
+         *
+         *  \return true
+         */
+        bool spillTo(RunWriter& _writer);
+
+        /*! \brief Reset
+         *
+         *  Forget all the words and release their memory
+         */
+        void clear();
+
+    private:
+        //! interned words
+        WordInterner words;
+        //! count per word id; entry 0 is unused
+        std::vector<uint64_t, TableAllocator<uint64_t> > counts;
+    };
+
+#endif //WORD_TALLY_H__
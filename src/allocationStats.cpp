@@ -0,0 +1,303 @@
+#include <allocationStats.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+
+#include <QtGlobal>
+
+#if defined(ALLOCATION_STATS) && defined(__GLIBC__)
+// the counting allocator wraps glibc's own entry points
+#define COUNTING_ALLOCATOR
+#include <malloc.h>
+
+extern "C"
+    {
+    void* __libc_malloc(size_t _bytes);
+    void* __libc_calloc(size_t _count, size_t _bytes);
+    void* __libc_realloc(void* _memory, size_t _bytes);
+    void* __libc_memalign(size_t _alignment, size_t _bytes);
+    void __libc_free(void* _memory);
+    }
+#endif
+
+namespace
+    {
+    /*! \brief Counts of One Stage of One Thread
+     *
+     *  Only written by its own thread, except in the shared overflow slot;
+     *  atomic so a report can read them while the workers run
+     */
+    struct StageCounters
+        {
+        std::atomic<uint64_t> allocations;
+        std::atomic<uint64_t> frees;
+        std::atomic<uint64_t> bytes;
+        };
+
+    //! counts of one thread
+    struct ThreadCounters
+        {
+        StageCounters stages[ALLOCATION_STAGES];
+        };
+
+    // none of these may need a constructor to run: malloc is called before
+    // any static initialization is done, and the counters must not allocate
+    ThreadCounters threadCounters[MAX_COUNTED_THREADS];
+    std::atomic<int> threadsSeen(0);
+    std::atomic<int64_t> liveBytes(0);
+    std::atomic<uint64_t> peakBytes(0);
+    std::atomic<uint64_t> stagePeaks[ALLOCATION_STAGES];
+
+    const char* const STAGE_NAMES[ALLOCATION_STAGES] = { "other", "read", "tokenize", "count", "reduce", "finalize" };
+
+#ifdef ALLOCATION_STATS
+    //! stage the thread's allocations are counted against
+    thread_local int currentStage = STAGE_OTHER;
+#endif
+
+#ifdef COUNTING_ALLOCATOR
+    //! the thread's slot, once it has allocated
+    thread_local ThreadCounters* counters = NULL;
+
+    //! the calling thread's counters, claiming a slot the first time
+    ThreadCounters& localCounters()
+        {
+        if (counters == NULL)
+            {
+            int slot = threadsSeen.fetch_add(1, std::memory_order_relaxed);
+            counters = &threadCounters[(slot < MAX_COUNTED_THREADS) ? slot : MAX_COUNTED_THREADS - 1];
+            }
+        return *counters;
+        }
+
+    //! raise a high water mark to _value
+    void raisePeak(std::atomic<uint64_t>& _peak, int64_t _value)
+        {
+        if (_value <= 0)
+            {
+            return;
+            }
+        uint64_t value = static_cast<uint64_t>(_value);
+        uint64_t peak = _peak.load(std::memory_order_relaxed);
+        while (value > peak && !_peak.compare_exchange_weak(peak, value, std::memory_order_relaxed))
+            {
+            }
+        }
+
+    void countAllocation(size_t _bytes)
+        {
+        StageCounters& stage = localCounters().stages[currentStage];
+        stage.allocations.fetch_add(1, std::memory_order_relaxed);
+        stage.bytes.fetch_add(_bytes, std::memory_order_relaxed);
+        int64_t live = liveBytes.fetch_add(static_cast<int64_t>(_bytes), std::memory_order_relaxed) + static_cast<int64_t>(_bytes);
+        raisePeak(peakBytes, live);
+        raisePeak(stagePeaks[currentStage], live);
+        }
+
+    void countRelease(size_t _bytes)
+        {
+        localCounters().stages[currentStage].frees.fetch_add(1, std::memory_order_relaxed);
+        liveBytes.fetch_sub(static_cast<int64_t>(_bytes), std::memory_order_relaxed);
+        }
+
+    //! count a block from the glibc allocator by the size it really takes
+    void* counted(void* _memory)
+        {
+        if (_memory != NULL)
+            {
+            countAllocation(malloc_usable_size(_memory));
+            }
+        return _memory;
+        }
+#endif
+    }
+
+#ifdef COUNTING_ALLOCATOR
+// Replacing the C allocator catches everything: operator new, the Qt
+// containers and strings, and the standard containers all come through here
+extern "C"
+    {
+    void* malloc(size_t _bytes) __THROW
+        {
+        return counted(__libc_malloc(_bytes));
+        }
+
+    void* calloc(size_t _count, size_t _bytes) __THROW
+        {
+        return counted(__libc_calloc(_count, _bytes));
+        }
+
+    void* realloc(void* _memory, size_t _bytes) __THROW
+        {
+        size_t previous = malloc_usable_size(_memory);
+        void* moved = __libc_realloc(_memory, _bytes);
+        if (moved == NULL && _bytes > 0)
+            {
+            // the old block is untouched
+            return NULL;
+            }
+        if (_memory != NULL)
+            {
+            countRelease(previous);
+            }
+        return counted(moved);
+        }
+
+    void free(void* _memory) __THROW
+        {
+        if (_memory != NULL)
+            {
+            countRelease(malloc_usable_size(_memory));
+            }
+        __libc_free(_memory);
+        }
+
+    // the aligned forms have to be replaced too, or free() would count
+    // blocks that were never counted going out
+    void* memalign(size_t _alignment, size_t _bytes) __THROW
+        {
+        return counted(__libc_memalign(_alignment, _bytes));
+        }
+
+    void* aligned_alloc(size_t _alignment, size_t _bytes) __THROW
+        {
+        return counted(__libc_memalign(_alignment, _bytes));
+        }
+
+    int posix_memalign(void** _memory, size_t _alignment, size_t _bytes) __THROW
+        {
+        if (_alignment < sizeof(void*) || (_alignment & (_alignment - 1)) != 0)
+            {
+            return EINVAL;
+            }
+        void* memory = counted(__libc_memalign(_alignment, _bytes));
+        if (memory == NULL)
+            {
+            return ENOMEM;
+            }
+        *_memory = memory;
+        return 0;
+        }
+
+    void* valloc(size_t _bytes) __THROW
+        {
+        return counted(__libc_memalign(static_cast<size_t>(sysconf(_SC_PAGESIZE)), _bytes));
+        }
+
+    void* pvalloc(size_t _bytes) __THROW
+        {
+        size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        return counted(__libc_memalign(page, (_bytes + page - 1) & ~(page - 1)));
+        }
+    }
+#endif
+
+bool allocationStatsEnabled()
+    {
+#ifdef COUNTING_ALLOCATOR
+    return true;
+#else
+    return false;
+#endif
+    }
+
+void resetAllocationStats()
+    {
+    int threads = std::min(threadsSeen.load(), MAX_COUNTED_THREADS);
+    for (int thread = 0; thread < threads; ++thread)
+        {
+        for (int stage = 0; stage < ALLOCATION_STAGES; ++stage)
+            {
+            StageCounters& counts = threadCounters[thread].stages[stage];
+            counts.allocations.store(0, std::memory_order_relaxed);
+            counts.frees.store(0, std::memory_order_relaxed);
+            counts.bytes.store(0, std::memory_order_relaxed);
+            }
+        }
+    // blocks allocated before now are still released later, so the live bytes carry on
+    int64_t live = liveBytes.load();
+    uint64_t restart = (live > 0) ? static_cast<uint64_t>(live) : 0;
+    peakBytes.store(restart);
+    for (int stage = 0; stage < ALLOCATION_STAGES; ++stage)
+        {
+        stagePeaks[stage].store(restart);
+        }
+    }
+
+AllocationReport allocationReport()
+    {
+    AllocationReport report;
+    for (int stage = 0; stage < ALLOCATION_STAGES; ++stage)
+        {
+        AllocationCounts none = { 0, 0, 0 };
+        report.stages[stage] = none;
+        report.stagePeaks[stage] = stagePeaks[stage].load();
+        }
+    report.liveBytes = liveBytes.load();
+    report.peakBytes = peakBytes.load();
+
+    int threads = std::min(threadsSeen.load(), MAX_COUNTED_THREADS);
+    report.threads.reserve(threads);
+    for (int thread = 0; thread < threads; ++thread)
+        {
+        ThreadAllocations counted;
+        counted.thread = thread;
+        bool used = false;
+        for (int stage = 0; stage < ALLOCATION_STAGES; ++stage)
+            {
+            const StageCounters& counts = threadCounters[thread].stages[stage];
+            AllocationCounts& copy = counted.stages[stage];
+            copy.allocations = counts.allocations.load(std::memory_order_relaxed);
+            copy.frees = counts.frees.load(std::memory_order_relaxed);
+            copy.bytes = counts.bytes.load(std::memory_order_relaxed);
+            report.stages[stage].allocations += copy.allocations;
+            report.stages[stage].frees += copy.frees;
+            report.stages[stage].bytes += copy.bytes;
+            used = used || copy.allocations > 0;
+            }
+        // threads that have only released memory since the last reset are left out
+        if (used)
+            {
+            report.threads.push_back(counted);
+            }
+        }
+    return report;
+    }
+
+const char* allocationStageName(AllocationStage _stage)
+    {
+    return (_stage >= 0 && _stage < ALLOCATION_STAGES) ? STAGE_NAMES[_stage] : "unknown";
+    }
+
+void countMappedAllocation(size_t _bytes)
+    {
+#ifdef COUNTING_ALLOCATOR
+    countAllocation(_bytes);
+#else
+    Q_UNUSED(_bytes);
+#endif
+    }
+
+void countMappedRelease(size_t _bytes)
+    {
+#ifdef COUNTING_ALLOCATOR
+    countRelease(_bytes);
+#else
+    Q_UNUSED(_bytes);
+#endif
+    }
+
+#ifdef ALLOCATION_STATS
+AllocationStageScope::AllocationStageScope(AllocationStage _stage) : previous(static_cast<AllocationStage>(currentStage))
+    {
+    currentStage = _stage;
+    }
+
+AllocationStageScope::~AllocationStageScope()
+    {
+    currentStage = previous;
+    }
+#endif
@@ -0,0 +1,168 @@
+#include <stdint.h>
+#include <iostream>
+
+#include <QtGlobal>
+#include <qtconcurrentmap.h>
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QStringList>
+
+#include <fileIndexer.h>
+#include <memoryPlacement.h>
+
+/*! \brief NUMA Placement and Huge Page Benchmark
+ *
+ *  Writes a corpus with a large vocabulary, so every worker's tables grow to
+ *  many megabytes, and counts it with the workers left to the scheduler or
+ *  pinned to NUMA nodes, on ordinary or transparent huge pages. All four
+ *  must give the same counts.
+ *
+ *  On a single node machine the CPUs can be split into emulated nodes; that
+ *  shows the cost of the pinning itself but not the gain from local memory,
+ *  for which the kernel's own emulation (numa=fake=<n> on the kernel
+ *  command-line) or a real multi-socket machine is needed.
+ *
+ *  Usage: bench_numaPlacement [file count] [words per file] [emulated nodes]
+ */
+
+namespace
+    {
+    //! write the corpus; each file draws from a vocabulary far larger than itself
+    QStringList writeCorpus(const QString& _directory, int _fileCount, int _wordsPerFile)
+        {
+        QStringList files;
+        uint32_t state = 12345;
+        for (int i = 0; i < _fileCount; ++i)
+            {
+            QString fileName = QString("%1/file%2.txt").arg(_directory).arg(i);
+            QFile output(fileName);
+            if (output.open(QIODevice::WriteOnly|QIODevice::Truncate) == false)
+                {
+                std::cerr<<"Unable to write "<<fileName.toLatin1().data()<<std::endl;
+                break;
+                }
+
+            QByteArray contents;
+            for (int j = 0; j < _wordsPerFile; ++j)
+                {
+                // a skewed draw from about a million words, so some repeat often
+                state = state * 1103515245 + 12345;
+                uint32_t word = (state >> 8) % 1000000;
+                word = (j % 4 == 0) ? (word % 1000) : word;
+                contents += "w";
+                contents += QByteArray::number(word, 36);
+                contents += ((j % 12) == 11) ? '\n' : ' ';
+                }
+            output.write(contents);
+            files << fileName;
+            }
+        return files;
+        }
+
+    //! remove the corpus again
+    void removeCorpus(const QString& _directory, const QStringList& _files)
+        {
+        for (QStringList::const_iterator iter = _files.constBegin(); iter != _files.constEnd(); ++iter)
+            {
+            QFile::remove(*iter);
+            }
+        QDir().rmdir(_directory);
+        }
+
+    //! kilobytes of the process currently on transparent huge pages, or -1 if unknown
+    qint64 hugePageKilobytes()
+        {
+        QFile rollup("/proc/self/smaps_rollup");
+        if (!rollup.open(QIODevice::ReadOnly))
+            {
+            return -1;
+            }
+        QList<QByteArray> lines = rollup.readAll().split('\n');
+        for (QList<QByteArray>::const_iterator iter = lines.constBegin(); iter != lines.constEnd(); ++iter)
+            {
+            if (iter->startsWith("AnonHugePages:"))
+                {
+                return iter->mid(14).trimmed().split(' ').first().toLongLong();
+                }
+            }
+        return -1;
+        }
+
+    //! count the files once with the given placement and page size
+    WordCount countOnce(QStringList& _files, const QString& _label, HugePageMode _hugePages, NumaPlacement* _placement)
+        {
+        setHugePageMode(_hugePages);
+        QElapsedTimer timer;
+        timer.start();
+        ThreadAccumulators<WordTally> accumulators;
+        QtConcurrent::blockingMap(_files, AccumulatingMapper<WordTally>(accumulators, TokenMatcher::defaultMatcher(), StopwordFilter::none(),
+                                                                        NULL, NULL, _placement));
+        qint64 countTime = timer.elapsed();
+        qint64 hugeKilobytes = hugePageKilobytes();
+        WordCount results = mergeAccumulators(accumulators);
+        qint64 totalTime = timer.elapsed();
+
+        std::cout<<_label.toLatin1().data()<<countTime<<" ms counting, "<<totalTime<<" ms with the merge";
+        if (hugeKilobytes >= 0)
+            {
+            std::cout<<", "<<(hugeKilobytes / 1024)<<" MB on huge pages";
+            }
+        std::cout<<std::endl;
+        return results;
+        }
+    }
+
+int main(int argc, char* argv[])
+    {
+    QCoreApplication app(argc, argv);
+
+    int fileCount = (argc > 1) ? QString(argv[1]).toInt() : 400;
+    int wordsPerFile = (argc > 2) ? QString(argv[2]).toInt() : 50000;
+    int emulatedNodes = (argc > 3) ? QString(argv[3]).toInt() : 0;
+    if (fileCount <= 0 || wordsPerFile <= 0 || emulatedNodes < 0)
+        {
+        std::cerr<<"Usage: "<<argv[0]<<" [file count] [words per file] [emulated nodes]"<<std::endl;
+        return 1;
+        }
+
+    QString directory = QString("%1/simpleFileIndexer-bench-%2").arg(QDir::tempPath()).arg(QCoreApplication::applicationPid());
+    QDir().mkpath(directory);
+    QStringList files = writeCorpus(directory, fileCount, wordsPerFile);
+    std::cout<<"Corpus: "<<files.size()<<" files of "<<wordsPerFile<<" words"<<std::endl;
+
+    NumaPlacement placement(emulatedNodes);
+    std::cout<<"NUMA nodes: "<<placement.nodeCount()<<((emulatedNodes > 1) ? " (emulated when the machine has one)" : "")<<std::endl;
+    if (emulatedNodes > 1)
+        {
+        std::cout<<"\temulated nodes share their memory; the pinned times show the cost of the affinity, not the gain from"<<std::endl;
+        std::cout<<"\tlocal memory, for which boot with numa=fake=<n> and run without emulated nodes"<<std::endl;
+        }
+    for (int node = 0; node < placement.nodeCount(); ++node)
+        {
+        std::cout<<"\tnode "<<node<<": "<<placement.nodeCpus(node).size()<<" CPUs"<<std::endl;
+        }
+
+    // read everything once so every run starts with the files cached
+    WordCount warmup = countOnce(files, "Warm-up:                  ", HUGE_PAGES_OFF, NULL);
+
+    WordCount unpinned = countOnce(files, "Unpinned, ordinary pages: ", HUGE_PAGES_OFF, NULL);
+    WordCount unpinnedHuge = countOnce(files, "Unpinned, huge pages:     ", HUGE_PAGES_TRANSPARENT, NULL);
+    WordCount pinned = countOnce(files, "Pinned, ordinary pages:   ", HUGE_PAGES_OFF, &placement);
+    // unpinned between the runs, so every thread is placed again
+    placement.release();
+    WordCount pinnedHuge = countOnce(files, "Pinned, huge pages:       ", HUGE_PAGES_TRANSPARENT, &placement);
+    placement.release();
+    setHugePageMode(HUGE_PAGES_OFF);
+
+    removeCorpus(directory, files);
+
+    if (unpinned != warmup || unpinnedHuge != warmup || pinned != warmup || pinnedHuge != warmup)
+        {
+        std::cerr<<"Results differ between the placements"<<std::endl;
+        return 1;
+        }
+    return 0;
+    }
@@ -0,0 +1,735 @@
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include <QtGlobal>
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMap>
+#include <QString>
+#include <QStringList>
+#include <QThreadPool>
+
+#include <allocationStats.h>
+#include <fileIndexer.h>
+#include <indexerOptions.h>
+#include <tokenMatcher.h>
+#include <wordTally.h>
+
+/*! \brief Performance Regression Gate
+ *
+ *  Runs fixed synthetic workloads through the tokenizer, the counting table,
+ *  processBuffer(), the reducers and the whole FileIndexer pipeline, and
+ *  compares them with a recorded baseline. Built plainly it measures their
+ *  throughput; built with ALLOCATION_STATS, as bench_regression_allocations,
+ *  it counts their allocations instead, since the counting allocator would
+ *  slow every workload down. ctest runs the two as perf_regression and
+ *  perf_allocations; `make perf_baseline` records the baseline again after
+ *  a deliberate change.
+ *
+ *  Throughput is the median of the runs divided by that of a fixed
+ *  calibration loop, so a baseline recorded on one machine holds on another
+ *  of the same build. A workload fails if it is slower than the baseline by
+ *  more than the tolerance, or by more than NOISE_FACTOR times the spread
+ *  of its runs if that is larger. The baseline keeps a section for each
+ *  compiler, Qt and build type, since the ratios only roughly carry over
+ *  between them; if there is none for this one the gate fails.
+ *
+ *  Usage: bench_regression [--baseline=<file> [--update-baseline]] [--tolerance=<fraction>] [--repeat=<runs>]
+ *
+ *  Exits 0 if nothing regressed and 1 if something did.
+ */
+
+namespace
+    {
+    //! words in the synthetic corpus
+    const int CORPUS_WORDS = 600000;
+    //! distinct words the corpus draws from
+    const int VOCABULARY = 20000;
+    //! slices the reducers combine, as if from that many workers or files
+    const int REDUCE_SLICES = 8;
+    //! files the pipeline corpus is split into
+    const int PIPELINE_FILES = 4;
+    //! worker threads, fixed so the pipeline allocates the same on every machine
+    const int PIPELINE_THREADS = 2;
+    //! allocations may grow by this fraction before it is a regression
+    const double ALLOCATION_TOLERANCE = 0.10;
+    //! and by this many besides, for the threads of the pipeline
+    const uint64_t ALLOCATION_SLACK = 256;
+    //! time each workload is run for, at the least
+    const qint64 MEASURE_NANOSECONDS = Q_INT64_C(2000000000);
+    //! most runs of a workload
+    const int MAX_RUNS = 100;
+    //! a slowdown within this many times the spread of the runs is noise
+    const double NOISE_FACTOR = 3.0;
+
+    //! where the calibration leaves its result, so the loop is not optimized away
+    volatile uint32_t calibrationHash = 0;
+
+    //! one workload; returns the units it processed
+    typedef uint64_t (*Workload)(void* _context);
+
+    //! timing or allocations of a workload
+    struct Measurement
+        {
+        //! units per second, the median of the runs; 0 in an instrumented build
+        double throughput;
+        //! median deviation of the runs from the median, as a fraction of it
+        double noise;
+        //! allocations of a run; 0 unless instrumented
+        uint64_t allocations;
+        };
+
+    //! what a baseline records for one workload
+    struct BaselineEntry
+        {
+        //! throughput over the calibration's throughput; 0 if not recorded
+        double score;
+        //! spread of the runs the score came from
+        double noise;
+        //! allocations of a run; 0 if not recorded
+        uint64_t allocations;
+        };
+
+    //! the baseline of one compiler, Qt and build type
+    struct Baseline
+        {
+        //! compiler, Qt and build the baseline was recorded with
+        QString environment;
+        //! recorded calibration throughput, for information only; 0 if no throughput was recorded
+        double calibration;
+        //! entries by workload name
+        QMap<QString, BaselineEntry> entries;
+        };
+
+    //! inputs the workloads share
+    struct Corpus
+        {
+        //! the corpus as text
+        QString text;
+        //! start and length of every token, found once for the counting workload
+        std::vector<TokenMatch> tokens;
+        //! the corpus counted in slices, for the reducers
+        std::vector<WordTally> tallies;
+        //! the same slices as word counts
+        std::vector<WordCount> counts;
+        //! the corpus split into files, for the pipeline
+        QStringList files;
+        //! where the files are
+        QString directory;
+        };
+
+    //! environment a baseline only holds for
+    QString environment()
+        {
+#ifdef __OPTIMIZE__
+        const char* build = "optimized";
+#else
+        const char* build = "unoptimized";
+#endif
+#ifdef __VERSION__
+        const char* compiler = __VERSION__;
+#else
+        const char* compiler = "unknown";
+#endif
+        return QString("compiler %1; Qt %2; %3").arg(compiler).arg(qVersion()).arg(build);
+        }
+
+    //! the synthetic text; a skewed draw, so the low words repeat far more often than the high ones
+    QByteArray makeText()
+        {
+        QByteArray text;
+        uint32_t state = 2463534242u;
+        for (int i = 0; i < CORPUS_WORDS; ++i)
+            {
+            state = state * 1103515245 + 12345;
+            uint32_t draw = state >> 8;
+            state = state * 1103515245 + 12345;
+            uint32_t bound = 1 + (state >> 8) % VOCABULARY;
+            text += "w";
+            text += QByteArray::number(draw % bound, 36);
+            // some punctuation, and lines of about a dozen words
+            text += ((i % 17) == 16) ? ". " : "";
+            text += ((i % 12) == 11) ? '\n' : ' ';
+            }
+        return text;
+        }
+
+    //! split the text into files at line ends
+    QStringList writeFiles(const QString& _directory, const QByteArray& _text)
+        {
+        QStringList files;
+        int start = 0;
+        for (int i = 0; i < PIPELINE_FILES; ++i)
+            {
+            int end = (i + 1 < PIPELINE_FILES) ? _text.indexOf('\n', (_text.size() / PIPELINE_FILES) * (i + 1)) + 1 : _text.size();
+            QString fileName = QString("%1/file%2.txt").arg(_directory).arg(i);
+            QFile output(fileName);
+            if (output.open(QIODevice::WriteOnly|QIODevice::Truncate) == false)
+                {
+                std::cerr<<"Unable to write "<<fileName.toLatin1().data()<<std::endl;
+                break;
+                }
+            output.write(_text.mid(start, end - start));
+            files << fileName;
+            start = end;
+            }
+        return files;
+        }
+
+    //! remove the pipeline's files again
+    void removeFiles(const QString& _directory, const QStringList& _files)
+        {
+        for (QStringList::const_iterator iter = _files.constBegin(); iter != _files.constEnd(); ++iter)
+            {
+            QFile::remove(*iter);
+            }
+        QDir().rmdir(_directory);
+        }
+
+    //! build everything the workloads read, outside the timings
+    void prepare(Corpus& _corpus, const QByteArray& _text)
+        {
+        _corpus.text = QString::fromLatin1(_text);
+        const QChar* data = _corpus.text.constData();
+        int length = _corpus.text.length();
+
+        const TokenMatcher& matcher = TokenMatcher::defaultMatcher();
+        TokenMatch match;
+        TokenScanMemo memo;
+        int position = 0;
+        while (matcher.findToken(data, length, position, match, &memo))
+            {
+            if (match.length > 0)
+                {
+                _corpus.tokens.push_back(match);
+                position = match.start + match.length;
+                }
+            else
+                {
+                position = match.start + 1;
+                }
+            }
+
+        _corpus.tallies.resize(REDUCE_SLICES);
+        _corpus.counts.resize(REDUCE_SLICES);
+        for (size_t i = 0; i < _corpus.tokens.size(); ++i)
+            {
+            const TokenMatch& token = _corpus.tokens[i];
+            size_t slice = (i * REDUCE_SLICES) / _corpus.tokens.size();
+            _corpus.tallies[slice].addToken(data + token.start, token.length);
+            _corpus.counts[slice][QString(data + token.start, token.length).toLower()] += 1;
+            }
+        }
+
+    //! scan the corpus for tokens; counts characters
+    uint64_t tokenizeWorkload(void* _context)
+        {
+        const Corpus& corpus = *static_cast<Corpus*>(_context);
+        const QChar* data = corpus.text.constData();
+        int length = corpus.text.length();
+
+        const TokenMatcher& matcher = TokenMatcher::defaultMatcher();
+        TokenMatch match;
+        TokenScanMemo memo;
+        uint64_t found = 0;
+        int position = 0;
+        while (matcher.findToken(data, length, position, match, &memo))
+            {
+            found += (match.length > 0) ? 1 : 0;
+            position = match.start + qMax(match.length, 1);
+            }
+        return (found == corpus.tokens.size()) ? static_cast<uint64_t>(length) : 0;
+        }
+
+    //! count every token into a fresh table; counts tokens
+    uint64_t countWorkload(void* _context)
+        {
+        const Corpus& corpus = *static_cast<Corpus*>(_context);
+        const QChar* data = corpus.text.constData();
+
+        WordTally tally;
+        for (std::vector<TokenMatch>::const_iterator iter = corpus.tokens.begin(); iter != corpus.tokens.end(); ++iter)
+            {
+            tally.addToken(data + iter->start, iter->length);
+            }
+        return static_cast<uint64_t>(corpus.tokens.size());
+        }
+
+    //! tokenize and count the corpus as one buffer with processBuffer(); counts characters
+    uint64_t bufferWorkload(void* _context)
+        {
+        const Corpus& corpus = *static_cast<Corpus*>(_context);
+        QString buffer(corpus.text);
+        WordCount results;
+        processBuffer(QString("<regression>"), buffer, true, results);
+        return static_cast<uint64_t>(corpus.text.length());
+        }
+
+    //! combine the slices the way the workers' tables and per-file results are; counts entries
+    uint64_t reduceWorkload(void* _context)
+        {
+        const Corpus& corpus = *static_cast<Corpus*>(_context);
+        uint64_t entries = 0;
+
+        WordTally merged;
+        for (std::vector<WordTally>::const_iterator iter = corpus.tallies.begin(); iter != corpus.tallies.end(); ++iter)
+            {
+            merged.merge(*iter);
+            entries += static_cast<uint64_t>(iter->size());
+            }
+
+        WordCount reduced;
+        for (std::vector<WordCount>::const_iterator iter = corpus.counts.begin(); iter != corpus.counts.end(); ++iter)
+            {
+            indexFileReducer(reduced, *iter);
+            entries += static_cast<uint64_t>(iter->size());
+            }
+        return (merged.size() == reduced.size()) ? entries : 0;
+        }
+
+    //! index the files with FileIndexer, event loop and all; counts characters
+    uint64_t pipelineWorkload(void* _context)
+        {
+        const Corpus& corpus = *static_cast<Corpus*>(_context);
+        IndexerOptions options;
+        options.files = corpus.files;
+
+        // the top 10 of every run would bury the report
+        std::streambuf* console = std::cout.rdbuf(NULL);
+
+        // the indexer starts from the event loop and stops it when it is done
+        FileIndexer indexer(options);
+        QCoreApplication::exec();
+
+        std::cout.rdbuf(console);
+        std::cout.clear();
+        return static_cast<uint64_t>(corpus.text.length());
+        }
+
+    //! hash the corpus bytes; the yardstick the workloads are measured against, in bytes
+    uint64_t calibrationWorkload(void* _context)
+        {
+        const Corpus& corpus = *static_cast<Corpus*>(_context);
+        const QChar* data = corpus.text.constData();
+        int length = corpus.text.length();
+
+        uint32_t hash = 2166136261u;
+        for (int pass = 0; pass < 4; ++pass)
+            {
+            for (int i = 0; i < length; ++i)
+                {
+                hash = (hash ^ data[i].unicode()) * 16777619u;
+                }
+            }
+        calibrationHash = hash;
+        return static_cast<uint64_t>(length) * 4;
+        }
+
+    //! total allocations since the last reset
+    uint64_t allocationsSinceReset()
+        {
+        AllocationReport report = allocationReport();
+        uint64_t allocations = 0;
+        for (int stage = 0; stage < ALLOCATION_STAGES; ++stage)
+            {
+            allocations += report.stages[stage].allocations;
+            }
+        return allocations;
+        }
+
+    //! median of the values; sorts them
+    double median(std::vector<double>& _values)
+        {
+        std::sort(_values.begin(), _values.end());
+        size_t middle = _values.size() / 2;
+        return ((_values.size() % 2) == 1) ? _values[middle] : (_values[middle - 1] + _values[middle]) / 2.0;
+        }
+
+    /*! \brief Measure a Workload
+     *
+     *  One warm up run, then in an instrumented build the allocations of one
+     *  more, and otherwise the median throughput of at least _repeat runs;
+     *  short workloads keep running until MEASURE_NANOSECONDS have passed,
+     *  so a few preempted runs do not move the median
+     *
+     *  \param _workload - workload to run
+     *  \param _corpus - its inputs
+     *  \param _repeat - fewest timed runs
+     *  \param _result - receives the throughput and its noise, or the allocations
+     *
+     *  \return false if the workload did not process what it should have
+     */
+    bool measure(Workload _workload, Corpus& _corpus, int _repeat, Measurement& _result)
+        {
+        _result.throughput = 0.0;
+        _result.noise = 0.0;
+        _result.allocations = 0;
+        if (_workload(&_corpus) == 0)
+            {
+            return false;
+            }
+
+        if (allocationStatsEnabled())
+            {
+            resetAllocationStats();
+            bool processed = (_workload(&_corpus) > 0);
+            _result.allocations = allocationsSinceReset();
+            return processed;
+            }
+
+        std::vector<double> throughputs;
+        qint64 total = 0;
+        for (int run = 0; run < _repeat || (total < MEASURE_NANOSECONDS && run < MAX_RUNS); ++run)
+            {
+            QElapsedTimer timer;
+            timer.start();
+            uint64_t units = _workload(&_corpus);
+            qint64 elapsed = qMax(timer.nsecsElapsed(), static_cast<qint64>(1));
+            throughputs.push_back(static_cast<double>(units) * 1e9 / static_cast<double>(elapsed));
+            total += elapsed;
+            }
+        _result.throughput = median(throughputs);
+
+        std::vector<double> deviations;
+        for (std::vector<double>::const_iterator iter = throughputs.begin(); iter != throughputs.end(); ++iter)
+            {
+            deviations.push_back(std::fabs(*iter - _result.throughput));
+            }
+        _result.noise = median(deviations) / _result.throughput;
+        return true;
+        }
+
+    /*! \brief Read the Baselines
+     *
+     *  Lines are "<key> <value>". An "environment" line starts the baseline
+     *  of that compiler, Qt and build type; the lines after it are its
+     *  "calibration", and "<workload>.score", "<workload>.noise" and
+     *  "<workload>.allocations" for each workload. Anything after a '#' is a
+     *  comment.
+     *
+     *  \param _fileName - file to read
+     *  \param _baselines - receives a Baseline per environment
+     *  \param _error - receives a description of the problem if it fails
+     *
+     *  \return true if the file was read
+     */
+    bool readBaselines(const QString& _fileName, QList<Baseline>& _baselines, QString& _error)
+        {
+        QFile input(_fileName);
+        if (input.open(QIODevice::ReadOnly|QIODevice::Text) == false)
+            {
+            _error = QString("Unable to read the baseline %1").arg(_fileName);
+            return false;
+            }
+
+        QStringList lines = QString::fromLatin1(input.readAll()).split(QChar('\n'));
+        for (int i = 0; i < lines.size(); ++i)
+            {
+            QString line = lines[i];
+            int comment = line.indexOf(QChar('#'));
+            line = ((comment >= 0) ? line.left(comment) : line).trimmed();
+            if (line.isEmpty())
+                {
+                continue;
+                }
+
+            int space = line.indexOf(QChar(' '));
+            QString key = line.left(space);
+            QString value = (space > 0) ? line.mid(space + 1).trimmed() : QString();
+            bool valid = (space > 0);
+            if (key == "environment")
+                {
+                Baseline baseline;
+                baseline.environment = value;
+                baseline.calibration = 0.0;
+                _baselines.append(baseline);
+                }
+            else if (_baselines.isEmpty())
+                {
+                valid = false;
+                }
+            else if (key == "calibration")
+                {
+                _baselines.last().calibration = value.toDouble(&valid);
+                }
+            else if (key.endsWith(QString(".score")))
+                {
+                _baselines.last().entries[key.left(key.length() - 6)].score = value.toDouble(&valid);
+                }
+            else if (key.endsWith(QString(".noise")))
+                {
+                _baselines.last().entries[key.left(key.length() - 6)].noise = value.toDouble(&valid);
+                }
+            else if (key.endsWith(QString(".allocations")))
+                {
+                _baselines.last().entries[key.left(key.length() - 12)].allocations = value.toULongLong(&valid);
+                }
+            else
+                {
+                valid = false;
+                }
+
+            if (!valid)
+                {
+                _error = QString("%1:%2: unable to parse \"%3\"").arg(_fileName).arg(i + 1).arg(line);
+                return false;
+                }
+            }
+        return true;
+        }
+
+    //! write the baselines; the raw throughputs are kept as comments
+    bool writeBaselines(const QString& _fileName, const QList<Baseline>& _baselines, const QMap<QString, QString>& _units)
+        {
+        QFile output(_fileName);
+        if (output.open(QIODevice::WriteOnly|QIODevice::Truncate|QIODevice::Text) == false)
+            {
+            return false;
+            }
+
+        QString text;
+        text += QString("# Performance baseline for bench_regression (ctest -L perf), a section per environment.\n");
+        text += QString("# Scores are throughput over the calibration throughput; refresh with `make perf_baseline`.\n");
+        for (QList<Baseline>::const_iterator baseline = _baselines.constBegin(); baseline != _baselines.constEnd(); ++baseline)
+            {
+            text += QString("environment %1\n").arg(baseline->environment);
+            text += QString("calibration %1\n").arg(baseline->calibration, 0, 'f', 1);
+            for (QMap<QString, BaselineEntry>::const_iterator entry = baseline->entries.constBegin(); entry != baseline->entries.constEnd(); ++entry)
+                {
+                const BaselineEntry& recorded = entry.value();
+                if (recorded.score > 0.0)
+                    {
+                    text += QString("# %1: %2 %3/s\n").arg(entry.key()).arg(recorded.score * baseline->calibration, 0, 'f', 0)
+                                                         .arg(_units.value(entry.key(), QString("units")));
+                    text += QString("%1.score %2\n").arg(entry.key()).arg(recorded.score, 0, 'g', 6);
+                    text += QString("%1.noise %2\n").arg(entry.key()).arg(recorded.noise, 0, 'g', 3);
+                    }
+                if (recorded.allocations > 0)
+                    {
+                    text += QString("%1.allocations %2\n").arg(entry.key()).arg(recorded.allocations);
+                    }
+                }
+            }
+        return output.write(text.toLatin1()) == text.length();
+        }
+    }
+
+int main(int argc, char* argv[])
+    {
+    QCoreApplication app(argc, argv);
+
+    QString baselineFile;
+    bool update = false;
+    double tolerance = 0.2;
+    int repeat = 9;
+    bool valid = true;
+    for (int i = 1; i < argc && valid; ++i)
+        {
+        QString argument(argv[i]);
+        if (argument.startsWith(QString("--baseline=")))
+            {
+            baselineFile = argument.mid(11);
+            }
+        else if (argument == "--update-baseline")
+            {
+            update = true;
+            }
+        else if (argument.startsWith(QString("--tolerance=")))
+            {
+            tolerance = argument.mid(12).toDouble(&valid);
+            valid = valid && tolerance > 0.0 && tolerance < 1.0;
+            }
+        else if (argument.startsWith(QString("--repeat=")))
+            {
+            repeat = argument.mid(9).toInt(&valid);
+            valid = valid && repeat > 0;
+            }
+        else
+            {
+            valid = false;
+            }
+        }
+    if (!valid || (update && baselineFile.isEmpty()))
+        {
+        std::cerr<<"Usage: "<<argv[0]<<" [--baseline=<file> [--update-baseline]] [--tolerance=<fraction>] [--repeat=<runs>]"<<std::endl;
+        return 1;
+        }
+
+    // an instrumented build counts the allocations, a plain one times the workloads
+    bool counted = allocationStatsEnabled();
+    std::cout<<"Environment: "<<environment().toLatin1().data()<<"; "<<(counted ? "counting allocations" : "timing")<<std::endl;
+
+    // the baselines of every environment, so an update keeps the others
+    QList<Baseline> baselines;
+    int current = -1;
+    if (!baselineFile.isEmpty() && (!update || QFile::exists(baselineFile)))
+        {
+        QString error;
+        if (!readBaselines(baselineFile, baselines, error))
+            {
+            std::cerr<<error.toLatin1().data()<<std::endl;
+            return 1;
+            }
+        for (int i = 0; i < baselines.size() && current < 0; ++i)
+            {
+            current = (baselines[i].environment == environment()) ? i : -1;
+            }
+        if (current < 0 && !update)
+            {
+            // the ratios only roughly carry over between builds, so a foreign baseline proves nothing
+            std::cerr<<"No baseline for this environment in "<<baselineFile.toLatin1().data()
+                     <<"; record one with `make perf_baseline` and commit it"<<std::endl;
+            return 1;
+            }
+        }
+
+    Corpus corpus;
+    QByteArray text = makeText();
+    prepare(corpus, text);
+    corpus.directory = QString("%1/fileIndexer-regression-%2").arg(QDir::tempPath()).arg(QCoreApplication::applicationPid());
+    QDir().mkpath(corpus.directory);
+    corpus.files = writeFiles(corpus.directory, text);
+    QThreadPool::globalInstance()->setMaxThreadCount(PIPELINE_THREADS);
+    std::cout<<"Corpus: "<<text.size()<<" bytes, "<<corpus.tokens.size()<<" tokens in "<<corpus.files.size()<<" files"<<std::endl;
+
+    const char* names[] = { "tokenize", "count", "buffer", "reduce", "pipeline" };
+    const char* units[] = { "chars", "tokens", "chars", "entries", "chars" };
+    const Workload workloads[] = { tokenizeWorkload, countWorkload, bufferWorkload, reduceWorkload, pipelineWorkload };
+    const int workloadCount = sizeof(workloads) / sizeof(workloads[0]);
+
+    Measurement calibration;
+    if (!counted)
+        {
+        measure(calibrationWorkload, corpus, repeat, calibration);
+        std::cout<<"Calibration: "<<static_cast<uint64_t>(calibration.throughput)<<" bytes/s, noise "
+                 <<(calibration.noise * 100.0)<<"%"<<std::endl;
+        }
+
+    QMap<QString, QString> unitNames;
+    std::vector<Measurement> measurements(workloadCount);
+    bool completed = true;
+    for (int i = 0; i < workloadCount; ++i)
+        {
+        unitNames[QString(names[i])] = QString(units[i]);
+        if (!measure(workloads[i], corpus, repeat, measurements[i]))
+            {
+            std::cerr<<"Workload "<<names[i]<<" gave the wrong result"<<std::endl;
+            completed = false;
+            }
+        }
+    removeFiles(corpus.directory, corpus.files);
+    if (!completed)
+        {
+        return 1;
+        }
+
+    if (update)
+        {
+        // only what this build measures is replaced; the other build records the rest
+        if (current < 0)
+            {
+            Baseline baseline;
+            baseline.environment = environment();
+            baseline.calibration = 0.0;
+            baselines.append(baseline);
+            current = baselines.size() - 1;
+            }
+        Baseline& recording = baselines[current];
+        if (!counted)
+            {
+            recording.calibration = calibration.throughput;
+            }
+        for (int i = 0; i < workloadCount; ++i)
+            {
+            BaselineEntry& entry = recording.entries[QString(names[i])];
+            if (counted)
+                {
+                entry.allocations = measurements[i].allocations;
+                }
+            else
+                {
+                entry.score = measurements[i].throughput / calibration.throughput;
+                entry.noise = measurements[i].noise + calibration.noise;
+                }
+            }
+        if (!writeBaselines(baselineFile, baselines, unitNames))
+            {
+            std::cerr<<"Unable to write the baseline "<<baselineFile.toLatin1().data()<<std::endl;
+            return 1;
+            }
+        std::cout<<"Baseline written to "<<baselineFile.toLatin1().data()<<std::endl;
+        }
+
+    // compare against the baseline, if there is one
+    int regressions = 0;
+    bool faster = false;
+    for (int i = 0; i < workloadCount; ++i)
+        {
+        const Measurement& measured = measurements[i];
+        // the score moves with the calibration as well as the workload
+        double score = counted ? 0.0 : measured.throughput / calibration.throughput;
+        double noise = measured.noise + calibration.noise;
+        if (counted)
+            {
+            std::cout<<names[i]<<": "<<measured.allocations<<" allocations"<<std::endl;
+            }
+        else
+            {
+            std::cout<<names[i]<<": "<<static_cast<uint64_t>(measured.throughput)<<" "<<units[i]<<"/s, score "<<score
+                     <<", noise "<<(noise * 100.0)<<"%"<<std::endl;
+            }
+
+        if (update || baselineFile.isEmpty())
+            {
+            continue;
+            }
+        const BaselineEntry recorded = baselines[current].entries.value(QString(names[i]), BaselineEntry());
+        if ((counted && recorded.allocations == 0) || (!counted && recorded.score <= 0.0))
+            {
+            std::cout<<"\tREGRESSION: not in the baseline; record it with `make perf_baseline`"<<std::endl;
+            ++regressions;
+            continue;
+            }
+
+        if (counted)
+            {
+            uint64_t allowed = static_cast<uint64_t>(recorded.allocations * (1.0 + ALLOCATION_TOLERANCE)) + ALLOCATION_SLACK;
+            std::cout<<"\tallocations "<<measured.allocations<<" against "<<recorded.allocations<<" in the baseline"<<std::endl;
+            if (measured.allocations > allowed)
+                {
+                std::cout<<"\tREGRESSION: more than "<<allowed<<" allocations"<<std::endl;
+                ++regressions;
+                }
+            continue;
+            }
+
+        // noisier runs, now or when the baseline was recorded, need more room before a slowdown is real
+        double allowed = qMax(tolerance, NOISE_FACTOR * qMax(noise, recorded.noise));
+        double change = score / recorded.score - 1.0;
+        std::cout<<"\tthroughput "<<(change >= 0.0 ? "+" : "")<<(change * 100.0)<<"% against the baseline, "
+                 <<(allowed * 100.0)<<"% allowed"<<std::endl;
+        if (change < -allowed)
+            {
+            std::cout<<"\tREGRESSION: slower than the baseline by more than "<<(allowed * 100.0)<<"%"<<std::endl;
+            ++regressions;
+            }
+        faster = faster || (change > allowed);
+        }
+
+    if (faster)
+        {
+        std::cout<<"Some workloads are well ahead of the baseline; if that is deliberate, refresh it with `make perf_baseline`"<<std::endl;
+        }
+    if (regressions > 0)
+        {
+        std::cout<<regressions<<" regressions"<<std::endl;
+        return 1;
+        }
+    return 0;
+    }
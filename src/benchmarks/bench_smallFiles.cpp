@@ -0,0 +1,122 @@
+#include <stdint.h>
+#include <iostream>
+
+#include <QtGlobal>
+#include <qtconcurrentmap.h>
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QStringList>
+
+#include <fileIndexer.h>
+
+/*! \brief Many Small Files Benchmark
+ *
+ *  Writes a corpus of small files and counts it twice: once with a result per
+ *  file merged by the MapReduce reducer, once with per-thread word tallies
+ *  merged at the end. Both must give the same counts.
+ *
+ *  Usage: bench_smallFiles [file count] [words per file]
+ */
+
+namespace
+    {
+    //! write the corpus; a small vocabulary so most words repeat across files
+    QStringList writeCorpus(const QString& _directory, int _fileCount, int _wordsPerFile)
+        {
+        static const char* vocabulary[] = {
+            "alpha", "beta", "gamma", "delta", "epsilon", "zeta", "eta", "theta",
+            "iota", "kappa", "lambda", "mu", "nu", "xi", "omicron", "pi"
+            };
+        const int vocabularySize = sizeof(vocabulary) / sizeof(vocabulary[0]);
+
+        QStringList files;
+        for (int i = 0; i < _fileCount; ++i)
+            {
+            QString fileName = QString("%1/file%2.txt").arg(_directory).arg(i);
+            QFile output(fileName);
+            if (output.open(QIODevice::WriteOnly|QIODevice::Truncate) == false)
+                {
+                std::cerr<<"Unable to write "<<fileName.toLatin1().data()<<std::endl;
+                break;
+                }
+
+            QByteArray contents;
+            for (int j = 0; j < _wordsPerFile; ++j)
+                {
+                contents += vocabulary[(i * 7 + j * 3 + j / 5) % vocabularySize];
+                contents += ((j % 12) == 11) ? '\n' : ' ';
+                }
+            // a word unique to the file keeps the per-file results from being identical
+            contents += QString("unique%1\n").arg(i).toLatin1();
+            output.write(contents);
+            files << fileName;
+            }
+        return files;
+        }
+
+    //! remove the corpus again
+    void removeCorpus(const QString& _directory, const QStringList& _files)
+        {
+        for (QStringList::const_iterator iter = _files.constBegin(); iter != _files.constEnd(); ++iter)
+            {
+            QFile::remove(*iter);
+            }
+        QDir().rmdir(_directory);
+        }
+    }
+
+int main(int argc, char* argv[])
+    {
+    QCoreApplication app(argc, argv);
+
+    int fileCount = (argc > 1) ? QString(argv[1]).toInt() : 20000;
+    int wordsPerFile = (argc > 2) ? QString(argv[2]).toInt() : 200;
+    if (fileCount <= 0 || wordsPerFile <= 0)
+        {
+        std::cerr<<"Usage: "<<argv[0]<<" [file count] [words per file]"<<std::endl;
+        return 1;
+        }
+
+    QString directory = QString("%1/simpleFileIndexer-bench-%2").arg(QDir::tempPath()).arg(QCoreApplication::applicationPid());
+    QDir().mkpath(directory);
+    QStringList files = writeCorpus(directory, fileCount, wordsPerFile);
+    std::cout<<"Corpus: "<<files.size()<<" files of "<<wordsPerFile<<" words"<<std::endl;
+
+    const TokenMatcher& matcher = TokenMatcher::defaultMatcher();
+    const StopwordFilter& stopwords = StopwordFilter::none();
+
+    // read everything once so both methods start with the files cached
+    WordCount warmup = QtConcurrent::blockingMappedReduced(files, FileIndexMapper(matcher, stopwords), indexFileReducer);
+
+    // a result per file, merged by the reducer
+    QElapsedTimer timer;
+    timer.start();
+    WordCount perFile = QtConcurrent::blockingMappedReduced(files, FileIndexMapper(matcher, stopwords), indexFileReducer);
+    qint64 perFileTime = timer.elapsed();
+
+    // per-thread accumulators, merged once
+    timer.start();
+    ThreadAccumulators<WordTally> accumulators;
+    QtConcurrent::blockingMap(files, AccumulatingMapper<WordTally>(accumulators, matcher, stopwords));
+    WordCount perThread = mergeAccumulators(accumulators);
+    qint64 perThreadTime = timer.elapsed();
+
+    std::cout<<"Per-file results:       "<<perFileTime<<" ms"<<std::endl;
+    std::cout<<"Per-thread accumulators: "<<perThreadTime<<" ms ("<<accumulators.size()<<" threads)"<<std::endl;
+    if (perThreadTime > 0)
+        {
+        std::cout<<"Speedup: "<<(static_cast<double>(perFileTime) / perThreadTime)<<"x"<<std::endl;
+        }
+
+    removeCorpus(directory, files);
+
+    if (perFile != perThread || perFile != warmup)
+        {
+        std::cerr<<"Results differ between the two methods"<<std::endl;
+        return 1;
+        }
+    return 0;
+    }
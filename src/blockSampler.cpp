@@ -0,0 +1,211 @@
+#include <blockSampler.h>
+
+#include <math.h>
+
+#include <algorithm>
+#include <random>
+
+#include <QtGlobal>
+
+namespace
+    {
+    //! most blocks handed to a worker at once
+    const uint64_t MAX_BATCH_BLOCKS = 64;
+    //! work units per worker the batches aim for, so the workers stay balanced
+    const uint64_t BATCHES_PER_WORKER = 64;
+    //! two-sided 95% quantile of the normal distribution
+    const double CONFIDENCE_Z = 1.96;
+    //! blocks considered between looks at the clock while planning
+    const uint64_t PLAN_CHECK_BLOCKS = 65536;
+    }
+
+BlockSampler::BlockSampler() : firstBlock(1, 0), bytesTotal(0), budget(0), planCut(false), timedOut(false), readBlocks(0), readBytes(0)
+    {
+    }
+
+void BlockSampler::plan(const QList<IndexInput>& _inputs, double _rate, uint64_t _seed, int _workers)
+    {
+    files.clear();
+    firstBlock.assign(1, 0);
+    bytesTotal = 0;
+    order.clear();
+    units.clear();
+    for (QList<IndexInput>::const_iterator iter = _inputs.constBegin(); iter != _inputs.constEnd(); ++iter)
+        {
+        if (iter->size <= 0)
+            {
+            continue;
+            }
+        files << *iter;
+        firstBlock.push_back(firstBlock.back() + static_cast<uint64_t>((iter->size + SAMPLE_BLOCK_SIZE - 1) / SAMPLE_BLOCK_SIZE));
+        bytesTotal += static_cast<uint64_t>(iter->size);
+        }
+
+    // the budget may have run out examining the inputs
+    planCut = expired();
+    if (planCut)
+        {
+        return;
+        }
+
+    std::random_device entropy;
+    std::mt19937_64 random(_seed != 0 ? _seed : (static_cast<uint64_t>(entropy()) << 32) ^ entropy());
+    uint64_t total = firstBlock.back();
+    uint64_t wanted = std::min(total, static_cast<uint64_t>(ceil(_rate * static_cast<double>(total))));
+    order.reserve(wanted);
+    if (wanted == total)
+        {
+        for (uint64_t block = 0; block < total; ++block)
+            {
+            order.push_back(block);
+            }
+        }
+    else
+        {
+        // selection sampling: every block is kept with the probability that
+        // leaves exactly the number wanted, without holding the whole list
+        std::uniform_real_distribution<double> uniform(0.0, 1.0);
+        for (uint64_t block = 0; block < total && order.size() < wanted; ++block)
+            {
+            // a selection cut short would only cover the first files; choose nothing instead
+            if ((block % PLAN_CHECK_BLOCKS) == 0 && expired())
+                {
+                order.clear();
+                planCut = true;
+                return;
+                }
+            if (static_cast<double>(total - block) * uniform(random) < static_cast<double>(wanted - order.size()))
+                {
+                order.push_back(block);
+                }
+            }
+        }
+    // the blocks read by any deadline are then a random sample as well
+    std::shuffle(order.begin(), order.end(), random);
+    if (expired())
+        {
+        order.clear();
+        planCut = true;
+        return;
+        }
+
+    uint64_t batchBlocks = order.size() / (static_cast<uint64_t>(qMax(1, _workers)) * BATCHES_PER_WORKER);
+    batchBlocks = std::max(static_cast<uint64_t>(1), std::min(batchBlocks, MAX_BATCH_BLOCKS));
+    for (uint64_t begin = 0; begin < order.size(); begin += batchBlocks)
+        {
+        SampleBatch batch = { begin, std::min(begin + batchBlocks, static_cast<uint64_t>(order.size())) };
+        units.push_back(batch);
+        }
+    }
+
+const QList<IndexInput>& BlockSampler::inputs() const
+    {
+    return files;
+    }
+
+std::vector<SampleBatch>& BlockSampler::batches()
+    {
+    return units;
+    }
+
+SampleBlock BlockSampler::block(uint64_t _position) const
+    {
+    uint64_t global = order[_position];
+    // the file whose range of blocks holds it
+    std::vector<uint64_t>::const_iterator next = std::upper_bound(firstBlock.begin(), firstBlock.end(), global);
+    int input = static_cast<int>(next - firstBlock.begin()) - 1;
+
+    SampleBlock located;
+    located.input = input;
+    located.offset = static_cast<qint64>(global - firstBlock[input]) * SAMPLE_BLOCK_SIZE;
+    located.length = qMin(SAMPLE_BLOCK_SIZE, files[input].size - located.offset);
+    return located;
+    }
+
+void BlockSampler::start(double _seconds)
+    {
+    budget = static_cast<qint64>(_seconds * 1000.0);
+    timedOut.store(false);
+    readBlocks.store(0);
+    readBytes.store(0);
+    timer.start();
+    }
+
+bool BlockSampler::expired()
+    {
+    if (timedOut.load(std::memory_order_relaxed))
+        {
+        return true;
+        }
+    if (budget > 0 && timer.elapsed() >= budget)
+        {
+        timedOut.store(true, std::memory_order_relaxed);
+        return true;
+        }
+    return false;
+    }
+
+void BlockSampler::blockRead(qint64 _bytes)
+    {
+    readBlocks.fetch_add(1, std::memory_order_relaxed);
+    readBytes.fetch_add((_bytes > 0) ? static_cast<uint64_t>(_bytes) : 0, std::memory_order_relaxed);
+    }
+
+uint64_t BlockSampler::totalBlocks() const
+    {
+    return firstBlock.back();
+    }
+
+uint64_t BlockSampler::totalBytes() const
+    {
+    return bytesTotal;
+    }
+
+uint64_t BlockSampler::plannedBlocks() const
+    {
+    return order.size();
+    }
+
+uint64_t BlockSampler::blocksRead() const
+    {
+    return readBlocks.load();
+    }
+
+uint64_t BlockSampler::bytesRead() const
+    {
+    return readBytes.load();
+    }
+
+bool BlockSampler::stoppedEarly() const
+    {
+    return planCut || (timedOut.load() && blocksRead() < plannedBlocks());
+    }
+
+double BlockSampler::seconds() const
+    {
+    return timer.elapsed() / 1000.0;
+    }
+
+SampleEstimate BlockSampler::estimate(uint64_t _observed, uint64_t _squares) const
+    {
+    SampleEstimate result = { 0, -1.0 };
+    double read = static_cast<double>(blocksRead());
+    double total = static_cast<double>(totalBlocks());
+    if (read <= 0.0)
+        {
+        return result;
+        }
+    result.count = static_cast<uint64_t>(llround(static_cast<double>(_observed) * total / read));
+    if (read >= total)
+        {
+        result.margin = 0.0;
+        }
+    else if (read >= 2.0)
+        {
+        // variance of the per-block counts, then of their expanded total
+        double mean = static_cast<double>(_observed) / read;
+        double variance = qMax(0.0, (static_cast<double>(_squares) - mean * static_cast<double>(_observed)) / (read - 1.0));
+        result.margin = CONFIDENCE_Z * total * sqrt((1.0 - read / total) * variance / read);
+        }
+    return result;
+    }
@@ -0,0 +1,594 @@
+#include <countRuns.h>
+
+#include <string.h>
+
+#include <algorithm>
+
+#include <QAtomicInt>
+#include <QCoreApplication>
+#include <QMutexLocker>
+
+namespace
+    {
+    //! size of the write and read buffers
+    const int RUN_BUFFER_SIZE = 1 << 20;
+    const int RUN_READ_SIZE = 1 << 16;
+    //! most runs open at once during a merge
+    const int MAX_MERGE_FAN_IN = 64;
+    const int MAGIC_LENGTH = 8;
+
+    void appendNumber(QByteArray& _buffer, uint64_t _value)
+        {
+        while (_value >= 0x80)
+            {
+            _buffer.append(static_cast<char>((_value & 0x7F) | 0x80));
+            _value >>= 7;
+            }
+        _buffer.append(static_cast<char>(_value));
+        }
+
+    //! UTF-8 encoding of QChars, appended to _buffer
+    void appendUtf8(std::string& _buffer, const QChar* _text, int _length)
+        {
+        for (int i = 0; i < _length; ++i)
+            {
+            uint32_t code = _text[i].unicode();
+            if (code >= 0xD800 && code < 0xDC00 && (i + 1) < _length &&
+                _text[i + 1].unicode() >= 0xDC00 && _text[i + 1].unicode() < 0xE000)
+                {
+                code = 0x10000 + ((code - 0xD800) << 10) + (_text[i + 1].unicode() - 0xDC00);
+                ++i;
+                }
+            if (code < 0x80)
+                {
+                _buffer.push_back(static_cast<char>(code));
+                }
+            else if (code < 0x800)
+                {
+                _buffer.push_back(static_cast<char>(0xC0 | (code >> 6)));
+                _buffer.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+                }
+            else if (code < 0x10000)
+                {
+                _buffer.push_back(static_cast<char>(0xE0 | (code >> 12)));
+                _buffer.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+                _buffer.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+                }
+            else
+                {
+                _buffer.push_back(static_cast<char>(0xF0 | (code >> 18)));
+                _buffer.push_back(static_cast<char>(0x80 | ((code >> 12) & 0x3F)));
+                _buffer.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+                _buffer.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+                }
+            }
+        }
+
+    //! byte-wise key order; QByteArray's own operator stops at a NUL
+    int compareKeys(const QByteArray& _left, const QByteArray& _right)
+        {
+        int shared = std::min(_left.size(), _right.size());
+        int result = memcmp(_left.constData(), _right.constData(), shared);
+        if (result != 0)
+            {
+            return result;
+            }
+        return _left.size() - _right.size();
+        }
+
+    //! a run in the merge heap; the reader with the smallest key is on top
+    bool laterKey(const RunReader* _left, const RunReader* _right)
+        {
+        return compareKeys(_left->key(), _right->key()) > 0;
+        }
+
+    //! open readers, closed again when the merge is done
+    class ReaderSet
+        {
+        public:
+            ~ReaderSet()
+                {
+                for (std::vector<RunReader*>::iterator iter = readers.begin(); iter != readers.end(); ++iter)
+                    {
+                    delete *iter;
+                    }
+                }
+            RunReader* create()
+                {
+                readers.push_back(new RunReader());
+                return readers.back();
+                }
+        private:
+            std::vector<RunReader*> readers;
+        };
+
+    //! merge at most MAX_MERGE_FAN_IN runs straight into the consumer
+    bool mergeGroup(const QStringList& _runs, RunConsumer& _consumer, QString& _error)
+        {
+        ReaderSet readers;
+        std::vector<RunReader*> heap;
+        for (int i = 0; i < _runs.size(); ++i)
+            {
+            RunReader* reader = readers.create();
+            if (!reader->open(_runs[i]))
+                {
+                _error = QString("Unable to read run file %1").arg(_runs[i]);
+                return false;
+                }
+            if (reader->next())
+                {
+                heap.push_back(reader);
+                }
+            else if (reader->failed())
+                {
+                _error = QString("Run file %1 is corrupt").arg(_runs[i]);
+                return false;
+                }
+            }
+        std::make_heap(heap.begin(), heap.end(), laterKey);
+
+        QByteArray key;
+        uint64_t count = 0;
+        bool haveKey = false;
+        while (!heap.empty())
+            {
+            std::pop_heap(heap.begin(), heap.end(), laterKey);
+            RunReader* reader = heap.back();
+
+            // equal keys arrive together; add them up before handing the key on
+            if (haveKey && compareKeys(key, reader->key()) == 0)
+                {
+                count += reader->count();
+                }
+            else
+                {
+                if (haveKey)
+                    {
+                    _consumer.add(key, count);
+                    }
+                key = reader->key();
+                count = reader->count();
+                haveKey = true;
+                }
+
+            if (reader->next())
+                {
+                std::push_heap(heap.begin(), heap.end(), laterKey);
+                }
+            else
+                {
+                heap.pop_back();
+                if (reader->failed())
+                    {
+                    _error = QString("A run file is corrupt");
+                    return false;
+                    }
+                }
+            }
+        if (haveKey)
+            {
+            _consumer.add(key, count);
+            }
+        return true;
+        }
+    }
+
+RunConsumer::~RunConsumer()
+    {
+    }
+
+RunWriter::RunWriter() : recordCount(0), failed(false)
+    {
+    }
+
+RunWriter::~RunWriter()
+    {
+    if (output.isOpen())
+        {
+        close();
+        }
+    }
+
+bool RunWriter::open(const QString& _fileName, int _order)
+    {
+    output.setFileName(_fileName);
+    failed = !output.open(QIODevice::WriteOnly|QIODevice::Truncate);
+    buffer.clear();
+    buffer.reserve(RUN_BUFFER_SIZE + 4096);
+    if (_order > 0)
+        {
+        buffer.append(PARTIAL_FILE_MAGIC);
+        appendNumber(buffer, static_cast<uint64_t>(_order));
+        }
+    else
+        {
+        buffer.append(RUN_FILE_MAGIC);
+        }
+    previous.clear();
+    pending.clear();
+    recordCount = 0;
+    return !failed;
+    }
+
+void RunWriter::add(const QByteArray& _key, uint64_t _count)
+    {
+    writeRecord(_key.constData(), _key.size(), _count);
+    }
+
+void RunWriter::add(const char* _key, int _length, uint64_t _count)
+    {
+    writeRecord(_key, _length, _count);
+    }
+
+void RunWriter::add(const QChar* _key, int _length, uint64_t _count)
+    {
+    beginKey();
+    appendKey(_key, _length);
+    endKey(_count);
+    }
+
+void RunWriter::beginKey()
+    {
+    // keeps its capacity, so building keys does not allocate once warmed up
+    pending.clear();
+    }
+
+void RunWriter::appendKey(const QChar* _text, int _length)
+    {
+    appendUtf8(pending, _text, _length);
+    }
+
+void RunWriter::endKey(uint64_t _count)
+    {
+    writeRecord(pending.data(), static_cast<int>(pending.size()), _count);
+    }
+
+void RunWriter::writeRecord(const char* _key, int _length, uint64_t _count)
+    {
+    int shared = 0;
+    int limit = std::min(_length, static_cast<int>(previous.size()));
+    while (shared < limit && _key[shared] == previous[shared])
+        {
+        ++shared;
+        }
+
+    appendNumber(buffer, static_cast<uint64_t>(shared));
+    appendNumber(buffer, static_cast<uint64_t>(_length - shared));
+    buffer.append(_key + shared, _length - shared);
+    appendNumber(buffer, _count);
+    previous.assign(_key, _length);
+    ++recordCount;
+
+    if (buffer.size() >= RUN_BUFFER_SIZE)
+        {
+        flush();
+        }
+    }
+
+void RunWriter::flush()
+    {
+    if (!failed && buffer.size() > 0)
+        {
+        failed = (output.write(buffer) != buffer.size());
+        }
+    buffer.resize(0);
+    }
+
+bool RunWriter::close()
+    {
+    flush();
+    output.close();
+    return !failed;
+    }
+
+uint64_t RunWriter::records() const
+    {
+    return recordCount;
+    }
+
+RunReader::RunReader() : position(0), currentCount(0), keyOrder(0), corrupt(false)
+    {
+    }
+
+bool RunReader::open(const QString& _fileName)
+    {
+    input.setFileName(_fileName);
+    if (!input.open(QIODevice::ReadOnly))
+        {
+        return false;
+        }
+    QByteArray magic = input.read(MAGIC_LENGTH);
+    buffer.clear();
+    position = 0;
+    currentKey.clear();
+    corrupt = false;
+    keyOrder = 0;
+    if (magic == QByteArray(PARTIAL_FILE_MAGIC))
+        {
+        uint64_t order = 0;
+        if (!readNumber(order) || order < 1 || order > MAX_NGRAM_ORDER)
+            {
+            return false;
+            }
+        keyOrder = static_cast<int>(order);
+        return true;
+        }
+    return (magic == QByteArray(RUN_FILE_MAGIC));
+    }
+
+int RunReader::order() const
+    {
+    return keyOrder;
+    }
+
+bool RunReader::fill()
+    {
+    buffer = input.read(RUN_READ_SIZE);
+    position = 0;
+    return (buffer.size() > 0);
+    }
+
+bool RunReader::readByte(unsigned char& _byte)
+    {
+    if (position >= buffer.size() && !fill())
+        {
+        return false;
+        }
+    _byte = static_cast<unsigned char>(buffer[position++]);
+    return true;
+    }
+
+bool RunReader::readNumber(uint64_t& _value)
+    {
+    _value = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+        {
+        unsigned char byte;
+        if (!readByte(byte))
+            {
+            return false;
+            }
+        _value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+            {
+            return true;
+            }
+        }
+    return false;
+    }
+
+bool RunReader::next()
+    {
+    // a clean end of file falls exactly on a record boundary
+    if (position >= buffer.size() && !fill())
+        {
+        return false;
+        }
+
+    uint64_t shared;
+    uint64_t suffix;
+    if (!readNumber(shared) || shared > static_cast<uint64_t>(currentKey.size()) || !readNumber(suffix))
+        {
+        corrupt = true;
+        return false;
+        }
+    currentKey.resize(static_cast<int>(shared));
+    for (uint64_t i = 0; i < suffix; ++i)
+        {
+        unsigned char byte;
+        if (!readByte(byte))
+            {
+            corrupt = true;
+            return false;
+            }
+        currentKey.append(static_cast<char>(byte));
+        }
+    if (!readNumber(currentCount))
+        {
+        corrupt = true;
+        return false;
+        }
+    return true;
+    }
+
+const QByteArray& RunReader::key() const
+    {
+    return currentKey;
+    }
+
+uint64_t RunReader::count() const
+    {
+    return currentCount;
+    }
+
+bool RunReader::failed() const
+    {
+    return corrupt;
+    }
+
+bool mergeRuns(const QStringList& _runs, RunConsumer& _consumer, QString& _error, const QString& _scratchDirectory)
+    {
+    if (_runs.size() <= MAX_MERGE_FAN_IN || _scratchDirectory.isEmpty())
+        {
+        return mergeGroup(_runs, _consumer, _error);
+        }
+
+    // too many runs to open at once; merge them in groups into fewer, larger runs
+    static QAtomicInt passSequence(0);
+    QStringList current = _runs;
+    QStringList intermediates;
+    bool merged = true;
+    while (merged && current.size() > MAX_MERGE_FAN_IN)
+        {
+        QStringList next;
+        for (int first = 0; merged && first < current.size(); first += MAX_MERGE_FAN_IN)
+            {
+            QString fileName = QString("%1/simpleFileIndexer-%2-merge-%3.run").arg(_scratchDirectory)
+                .arg(QCoreApplication::applicationPid()).arg(passSequence.fetchAndAddOrdered(1));
+            RunWriter writer;
+            merged = writer.open(fileName) && mergeGroup(current.mid(first, MAX_MERGE_FAN_IN), writer, _error);
+            merged = writer.close() && merged;
+            intermediates << fileName;
+            next << fileName;
+            if (!merged && _error.isEmpty())
+                {
+                _error = QString("Unable to write run file %1").arg(fileName);
+                }
+            }
+        current = next;
+        }
+    merged = merged && mergeGroup(current, _consumer, _error);
+
+    for (QStringList::const_iterator iter = intermediates.constBegin(); iter != intermediates.constEnd(); ++iter)
+        {
+        QFile::remove(*iter);
+        }
+    return merged;
+    }
+
+bool checkPartials(const QStringList& _partials, int& _order, QString& _error)
+    {
+    _order = 0;
+    for (QStringList::const_iterator iter = _partials.constBegin(); iter != _partials.constEnd(); ++iter)
+        {
+        RunReader reader;
+        if (!reader.open(*iter) || reader.order() == 0)
+            {
+            _error = QString("%1 is not a partial result file").arg(*iter);
+            return false;
+            }
+        if (_order != 0 && reader.order() != _order)
+            {
+            _error = QString("%1 has %2 words per entry, the other partials %3").arg(*iter).arg(reader.order()).arg(_order);
+            return false;
+            }
+        _order = reader.order();
+        }
+    return true;
+    }
+
+bool mergePartials(const QStringList& _partials, RunConsumer& _consumer, int& _order, QString& _error, const QString& _scratchDirectory)
+    {
+    // check every header first so a mismatch is found before any merging
+    return checkPartials(_partials, _order, _error) && mergeRuns(_partials, _consumer, _error, _scratchDirectory);
+    }
+
+SplitConsumer::SplitConsumer(RunConsumer& _first, RunConsumer& _second) : first(_first), second(_second)
+    {
+    }
+
+void SplitConsumer::add(const QByteArray& _key, uint64_t _count)
+    {
+    first.add(_key, _count);
+    second.add(_key, _count);
+    }
+
+TopCounts::TopCounts(int _limit) : limit(_limit), keys(0)
+    {
+    }
+
+bool TopCounts::ranksHigher(const Entry& _left, const Entry& _right)
+    {
+    if (_left.count != _right.count)
+        {
+        return _left.count > _right.count;
+        }
+    return compareKeys(_left.key, _right.key) > 0;
+    }
+
+void TopCounts::add(const QByteArray& _key, uint64_t _count)
+    {
+    ++keys;
+    if (limit <= 0)
+        {
+        return;
+        }
+    Entry entry = { _count, _key };
+    if (static_cast<int>(heap.size()) < limit)
+        {
+        heap.push_back(entry);
+        std::push_heap(heap.begin(), heap.end(), ranksHigher);
+        }
+    else if (ranksHigher(entry, heap.front()))
+        {
+        std::pop_heap(heap.begin(), heap.end(), ranksHigher);
+        heap.back() = entry;
+        std::push_heap(heap.begin(), heap.end(), ranksHigher);
+        }
+    }
+
+std::vector<PhraseCount> TopCounts::top() const
+    {
+    std::vector<Entry> sorted(heap);
+    std::sort(sorted.begin(), sorted.end(), ranksHigher);
+    std::vector<PhraseCount> result;
+    for (std::vector<Entry>::const_iterator iter = sorted.begin(); iter != sorted.end(); ++iter)
+        {
+        result.push_back(PhraseCount(iter->count, QString::fromUtf8(iter->key.constData(), iter->key.size())));
+        }
+    return result;
+    }
+
+uint64_t TopCounts::distinct() const
+    {
+    return keys;
+    }
+
+RunSpiller::RunSpiller(const QString& _directory, uint64_t _threadLimit) :
+    spillDirectory(_directory), threadLimit(_threadLimit), sequence(0)
+    {
+    }
+
+RunSpiller::~RunSpiller()
+    {
+    for (QStringList::const_iterator iter = runFiles.constBegin(); iter != runFiles.constEnd(); ++iter)
+        {
+        QFile::remove(*iter);
+        }
+    }
+
+QString RunSpiller::nextFileName()
+    {
+    QMutexLocker locker(&lock);
+    return QString("%1/simpleFileIndexer-%2-%3.run").arg(spillDirectory).arg(QCoreApplication::applicationPid()).arg(sequence++);
+    }
+
+void RunSpiller::finished(const QString& _fileName, bool _written)
+    {
+    QMutexLocker locker(&lock);
+    if (_written)
+        {
+        runFiles << _fileName;
+        }
+    else
+        {
+        QFile::remove(_fileName);
+        if (failure.isEmpty())
+            {
+            failure = QString("Unable to write run file %1").arg(_fileName);
+            }
+        }
+    }
+
+QStringList RunSpiller::runs() const
+    {
+    QMutexLocker locker(&lock);
+    return runFiles;
+    }
+
+QString RunSpiller::directory() const
+    {
+    return spillDirectory;
+    }
+
+bool RunSpiller::failed() const
+    {
+    QMutexLocker locker(&lock);
+    return !failure.isEmpty();
+    }
+
+QString RunSpiller::error() const
+    {
+    QMutexLocker locker(&lock);
+    return failure;
+    }
@@ -1,19 +1,25 @@
 #include <fileIndexer.h>
 
+#include <math.h>
 #include <stdint.h>
 #include <iostream>
 #include <fstream>
+#include <functional>
+#include <limits>
 #include <locale>
 #include <map>
+#include <stdio.h>
 #include <strings.h>
 
 #include <QtGlobal>
 #include <qtconcurrentmap.h>
 
+#include <QCoreApplication>
 #include <QDebug>
 #include <QFile>
+#include <QFileInfo>
 #include <QMultiMap>
-#include <QRegExp>
+#include <QThreadPool>
 #include <QTimer>
 
 //! instance pointer used for capturing log data
@@ -46,10 +52,12 @@ void addWord(WordCount& _results, QString wordToAdd, uint64_t _count)
     // case insensitive comparison to unify the word to a single case
     QString actualWord = wordToAdd.toLower();
 
-    // if it exists, increase it, otherwise add it initialized to the specified count
-    if (_results.contains(actualWord) == true)
+    // if it exists, increase it, otherwise add it initialized to the specified count;
+    // a single lookup either way
+    WordCount::iterator iter = _results.find(actualWord);
+    if (iter != _results.end())
         {
-        _results[actualWord] += _count;
+        iter.value() += _count;
         }
     else
         {
@@ -57,116 +65,446 @@ void addWord(WordCount& _results, QString wordToAdd, uint64_t _count)
         }
     }
 
-WordCount indexFile(QString fileName)
+namespace
     {
-    // results for the single file
-    WordCount results;
+    /*! \brief Word Counting Destination
+     *
+     *  Receives the tokens found by scanBuffer() and counts each as a word
+     */
+    class WordSink
+        {
+        public:
+            WordSink(WordCount& _results, uint64_t _weight=1) : results(_results), weight(_weight)
+                {
+                }
+            void token(const QChar* _word, int _length)
+                {
+                addWord(results, QString(_word, _length), weight);
+                }
+            void skipped()
+                {
+                }
+            void endOfFile()
+                {
+                }
+            void blockDone(qint64)
+                {
+                }
+        private:
+            WordCount& results;
+            //! times each word is counted
+            uint64_t weight;
+        };
 
-    // log which file is being processed
-    resultDebugLog(fileName, QString("Received file for processing"));
+    /*! \brief Word Tally Destination
+     *
+     *  Receives the tokens found by scanBuffer() and counts each against its interned id
+     */
+    class TallySink
+        {
+        public:
+            TallySink(WordTally& _results, uint64_t _weight=1, RunSpiller* _spiller=NULL, IndexProgress* _progress=NULL) :
+                results(_results), weight(_weight), spiller(_spiller), progress(_progress)
+                {
+                }
+            void token(const QChar* _word, int _length)
+                {
+                results.addToken(_word, _length, weight);
+                }
+            void skipped()
+                {
+                }
+            void endOfFile()
+                {
+                if (progress != NULL)
+                    {
+                    progress->fileDone();
+                    }
+                }
+            void blockDone(qint64 _bytes)
+                {
+                // the snapshot is taken before a spill empties the tally
+                if (progress != NULL)
+                    {
+                    progress->blockDone(results, _bytes);
+                    }
+                if (spiller != NULL)
+                    {
+                    AllocationStageScope reducing(STAGE_REDUCE);
+                    spiller->checkpoint(results);
+                    }
+                }
+        private:
+            WordTally& results;
+            //! times each word is counted
+            uint64_t weight;
+            //! memory budget, if there is one
+            RunSpiller* spiller;
+            //! progress channel, if there is one
+            IndexProgress* progress;
+        };
 
-    QFile inputData(fileName);
-    // buffer information
-    const unsigned int MAX_INPUT_BUFFER = 32768;
-    const unsigned int MAX_READ = MAX_INPUT_BUFFER - 1;
+    /*! \brief Phrase Counting Destination
+     *
+     *  Receives the tokens found by scanBuffer() and counts the phrases they form
+     */
+    class NgramSink
+        {
+        public:
+            NgramSink(NgramCount& _results, uint64_t _weight=1, RunSpiller* _spiller=NULL, IndexProgress* _progress=NULL) :
+                results(_results), weight(_weight), spiller(_spiller), progress(_progress)
+                {
+                }
+            void token(const QChar* _word, int _length)
+                {
+                results.addToken(_word, _length, weight);
+                }
+            void skipped()
+                {
+                // words either side of a stopword were not next to each other
+                results.endSequence();
+                }
+            void endOfFile()
+                {
+                results.endSequence();
+                if (progress != NULL)
+                    {
+                    progress->fileDone();
+                    }
+                }
+            void blockDone(qint64 _bytes)
+                {
+                if (progress != NULL)
+                    {
+                    progress->blockDone(results, _bytes);
+                    }
+                // the phrase in progress survives a spill, so this is safe mid-file
+                if (spiller != NULL)
+                    {
+                    AllocationStageScope reducing(STAGE_REDUCE);
+                    spiller->checkpoint(results);
+                    }
+                }
+        private:
+            NgramCount& results;
+            //! times each phrase is counted
+            uint64_t weight;
+            //! memory budget, if there is one
+            RunSpiller* spiller;
+            //! progress channel, if there is one
+            IndexProgress* progress;
+        };
 
-    // attempt to open the file
-    if (inputData.open(QIODevice::ReadOnly|QIODevice::Text) == true)
+    /*! \brief Buffer Scanning
+     *
+     *  Shared by every form of processBuffer(); see there for the parameters.
+     *  Each token is handed to the sink, stopwords are reported as skipped.
+     */
+    template <typename TokenSink>
+    void scanBuffer(const QString& fileName, QString& buffer, bool allow_ending_word,
+                    const TokenMatcher& matcher, const StopwordFilter& stopwords, TokenSink& sink, const FileLog& log)
         {
-        // processing buffer
-        QString totalBuffer;
+        // the scanner walks the buffer in place; only the unprocessed tail is kept
+        // once the scan is done rather than removing each word as it is found
+        AllocationStageScope tokenizing(STAGE_TOKENIZE);
+        const QChar* data = buffer.constData();
+        const int length = buffer.length();
+        int position = 0;
+        // the buffer does not change until the scan is done, so what the scanner
+        // learns about it holds for every token
+        TokenScanMemo memo;
+
+        // now process the buffer
+        bool process_buffer = true;
+        while (process_buffer)
+            {
+            // scan the buffer for the next token
+            TokenMatch match;
+            if (!matcher.findToken(data, length, position, match, &memo))
+                {
+                // note: this means there are zero remaining matches in the buffer
+                //    thus the entire buffer can be tossed
+                if (log)
+                    {
+                    log(fileName, QString("No more matches - clearing buffer"));
+                    }
+                buffer.clear();
+
+                // terminate the loop
+                process_buffer = false;
+                }
+            else if (match.open && !allow_ending_word)
+                {
+                // the token reaches the end of the buffer and could continue into
+                // the next read; keep it for when more data has been added
+                buffer.remove(0, match.start);
+                process_buffer = false;
+                }
+            else if (match.length > 0)
+                {
+                // increase the count by 1 for each word read, unless it is a stopword;
+                // those are dropped here so they never reach the results or the reducer
+                if (stopwords.contains(data + match.start, match.length))
+                    {
+                    sink.skipped();
+                    }
+                else
+                    {
+                    AllocationStageScope counting(STAGE_COUNT);
+                    sink.token(data + match.start, match.length);
+                    }
 
-        // read buffer
-        char buffer[MAX_INPUT_BUFFER];
+                // move past the word
+                position = match.start + match.length;
+                }
+            else
+                {
+                // the start of a token ran out of data at the end of the input; nothing to count there
+                position = match.start + 1;
+                }
+            };
+        }
 
-        // whether or not to consider a word that reaches the end of the
-        // buffer a word. If true, consider it a word and terminate; if
-        // false add more data and reprocess
-        bool empty_buffer = false;
-        do
+    /*! \brief File Scanning
+     *
+     *  Shared by every form of indexFile(); reads the file in blocks and
+     *  scans each one, carrying a partial token over into the next block
+     */
+    template <typename TokenSink>
+    void scanFile(const QString& fileName, const TokenMatcher& matcher, const StopwordFilter& stopwords, TokenSink& sink, const FileLog& log)
+        {
+        // log which file is being processed; the messages are only built if anyone is listening
+        if (log)
             {
-            // prevent data leakage
-            bzero(buffer, MAX_INPUT_BUFFER);
+            log(fileName, QString("Received file for processing"));
+            }
 
-            // always read one less than the buffer size, ensuring
-            // a zero termination string
-            qint64 dataRead = inputData.read(buffer, MAX_READ);
+        // everything but the scan and the counting is part of reading the file
+        AllocationStageScope reading(STAGE_READ);
 
-            resultDebugLog(fileName, QString("Read %1 additional bytes").arg(dataRead));
+        QFile inputData(fileName);
+        // buffer information
+        const unsigned int MAX_INPUT_BUFFER = 32768;
+        const unsigned int MAX_READ = MAX_INPUT_BUFFER - 1;
 
-            // -1 -> error, 0 = EOF
-            empty_buffer = (dataRead <= 0);
+        // attempt to open the file
+        if (inputData.open(QIODevice::ReadOnly|QIODevice::Text) == true)
+            {
+            // processing buffer
+            QString totalBuffer;
 
-            // add the new data to the buffer
-            totalBuffer += QString::fromLatin1(buffer);
+            // read buffer
+            char buffer[MAX_INPUT_BUFFER];
 
-            // count all words in the buffer
-            processBuffer(fileName, totalBuffer, empty_buffer, results);
+            // whether or not to consider a word that reaches the end of the
+            // buffer a word. If true, consider it a word and terminate; if
+            // false add more data and reprocess
+            bool empty_buffer = false;
+            do
+                {
+                // prevent data leakage
+                bzero(buffer, MAX_INPUT_BUFFER);
 
-            resultDebugLog(fileName, QString("Remaining buffer size: %1 bytes").arg(totalBuffer.length()));
+                // always read one less than the buffer size, ensuring
+                // a zero termination string
+                qint64 dataRead = inputData.read(buffer, MAX_READ);
 
-            // continue so long as there is data in the file
-            } while (!empty_buffer);
-        }
-    else
-        {
-        // error reading the file - nothing will be counted from it
-        resultDebugLog(fileName, QString("Unable to open file - no counts added"));
-        }
+                if (log)
+                    {
+                    log(fileName, QString("Read %1 additional bytes").arg(dataRead));
+                    }
 
-    // send the results back to MapReduce
-    return results;
-    }
+                // -1 -> error, 0 = EOF
+                empty_buffer = (dataRead <= 0);
 
-void processBuffer(const QString& fileName, QString& buffer, bool allow_ending_word, WordCount& results)
-    {
-    // regular expression matching
-    QRegExp wordMatcher(
-        "[A-Za-z0-9]+",            // pattern - AZa-z0-9; letters with accents won't be counted
-        Qt::CaseInsensitive,    // case sensitivity
-        QRegExp::RegExp2        // pattern syntax type (Qt5 default, PERL like-greedy)
-    );
-    // now process the buffer
-    bool process_buffer = true;
-    while (process_buffer)
-        {
-        // test the buffer to see if any matches occur
-        int matchIndex = wordMatcher.indexIn(buffer);
-        if ( matchIndex == -1)
-            {
-            // note: this means there are zero remaining matches in the buffer
-            //    thus the entire buffer can be tossed
-            resultDebugLog(fileName, QString("No more matches - clearing buffer"));
-            buffer.clear();
+                // add the new data to the buffer
+                totalBuffer += QString::fromLatin1(buffer);
+
+                // count all words in the buffer
+                scanBuffer(fileName, totalBuffer, empty_buffer, matcher, stopwords, sink, log);
+                sink.blockDone(dataRead);
 
-            // terminate the loop
-            process_buffer = false;
+                if (log)
+                    {
+                    log(fileName, QString("Remaining buffer size: %1 bytes").arg(totalBuffer.length()));
+                    }
+
+                // continue so long as there is data in the file
+                } while (!empty_buffer);
             }
         else
             {
-            // grab the single word from the buffer
-            QString wordRead = wordMatcher.cap(0);
+            // error reading the file - nothing will be counted from it
+            if (log)
+                {
+                log(fileName, QString("Unable to open file - no counts added"));
+                }
+            }
+        sink.endOfFile();
+        }
 
-            // check if the word goes to the end of the buffer
-            if ((wordRead.length() + matchIndex) == buffer.length())
+    /*! \brief Sampled Block Window
+     *
+     *  Passes on only the tokens that start within a sampled block, and the
+     *  few after it that complete a phrase whose first word is inside it, so
+     *  every word or phrase belongs to exactly one block
+     */
+    template <typename TokenSink>
+    class BlockWindow
+        {
+        public:
+            BlockWindow(TokenSink& _sink, const QChar* _base, int _begin, int _end, int _trailing) :
+                sink(_sink), base(_base), begin(_begin), end(_end), trailing(_trailing)
+                {
+                }
+            void token(const QChar* _word, int _length)
                 {
-                // at the end of the buffer
-                // does the word count as a word, or is more data needed
-                if (!allow_ending_word)
+                int start = static_cast<int>(_word - base);
+                if (start < begin)
+                    {
+                    // the word began in the previous block
+                    return;
+                    }
+                if (start >= end)
                     {
-                    // more data is required...
-                    process_buffer = false;
-                    break;
+                    if (trailing == 0)
+                        {
+                        return;
+                        }
+                    --trailing;
                     }
+                sink.token(_word, _length);
                 }
+            void skipped()
+                {
+                sink.skipped();
+                }
+            void endOfFile()
+                {
+                sink.endOfFile();
+                }
+            void blockDone(qint64 _bytes)
+                {
+                sink.blockDone(_bytes);
+                }
+        private:
+            TokenSink& sink;
+            //! start of the text being scanned
+            const QChar* base;
+            //! first character of the block
+            int begin;
+            //! character after the block
+            int end;
+            //! words after the block still passed on
+            int trailing;
+        };
 
-            // increase the count by 1 for each word read
-            addWord(results, wordRead);
+    /*! \brief Block Scanning
+     *
+     *  Shared by every form of indexBlockInto(); reads the block with the
+     *  overhang after it and with the text before it back to the last
+     *  character no token can contain. A full pass starts afresh after that
+     *  character too, so scanning from there finds the tokens a full pass
+     *  finds even when they can hold separators, f.e "[a-z]+(-[a-z]+)*".
+     */
+    template <typename TokenSink>
+    void scanBlock(const QString& fileName, qint64 offset, qint64 length, const TokenMatcher& matcher, const StopwordFilter& stopwords,
+                   TokenSink& sink, int trailing, const FileLog& log)
+        {
+        AllocationStageScope reading(STAGE_READ);
+        QFile inputData(fileName);
+        qint64 lead = qMin(offset, SAMPLE_BLOCK_LOOKBACK);
+        if (inputData.open(QIODevice::ReadOnly) == true && inputData.seek(offset - lead) == true)
+            {
+            QByteArray block = inputData.read(lead + length + SAMPLE_BLOCK_OVERHANG);
+            lead = qMin(lead, static_cast<qint64>(block.size()));
 
-            // remove the word from the buffer
-            buffer.remove(0, wordRead.length() + matchIndex);
+            // the start of the file is a place to start from as well; failing
+            // both, a token longer than the lookback may be cut
+            qint64 resync = lead;
+            while (resync > 0 && !matcher.separates(QChar(static_cast<uchar>(block.at(static_cast<int>(resync - 1))))))
+                {
+                --resync;
+                }
+            QString text = QString::fromLatin1(block.constData() + resync, static_cast<int>(block.size() - resync));
+            BlockWindow<TokenSink> window(sink, text.constData(), static_cast<int>(lead - resync), static_cast<int>(lead - resync + length), trailing);
+            scanBuffer(fileName, text, true, matcher, stopwords, window, log);
             }
-        };
+        else
+            {
+            // the block counts as read, with nothing in it, as a full pass would
+            if (log)
+                {
+                log(fileName, QString("Unable to read block at %1 - no counts added").arg(offset));
+                }
+            }
+        sink.endOfFile();
+        }
+    }
+
+WordCount indexFile(QString fileName, const TokenMatcher& matcher, const StopwordFilter& stopwords, const FileLog& log)
+    {
+    // results for the single file
+    WordCount results;
+    WordSink sink(results);
+    scanFile(fileName, matcher, stopwords, sink, log);
+
+    // send the results back to MapReduce
+    return results;
+    }
+
+NgramCount indexFileNgrams(QString fileName, int order, const TokenMatcher& matcher, const StopwordFilter& stopwords, const FileLog& log)
+    {
+    // results for the single file
+    NgramCount results(order);
+    NgramSink sink(results);
+    scanFile(fileName, matcher, stopwords, sink, log);
+    return results;
+    }
+
+void indexFileInto(QString fileName, WordTally& results, const TokenMatcher& matcher, const StopwordFilter& stopwords, uint64_t occurrences, RunSpiller* spiller,
+                   IndexProgress* progress, const FileLog& log)
+    {
+    // identical copies are counted by weight rather than read again
+    TallySink sink(results, occurrences, spiller, progress);
+    scanFile(fileName, matcher, stopwords, sink, log);
+    }
+
+void indexFileInto(QString fileName, NgramCount& results, const TokenMatcher& matcher, const StopwordFilter& stopwords, uint64_t occurrences, RunSpiller* spiller,
+                   IndexProgress* progress, const FileLog& log)
+    {
+    // the sink ends the phrase at the end of the file
+    NgramSink sink(results, occurrences, spiller, progress);
+    scanFile(fileName, matcher, stopwords, sink, log);
+    }
+
+void indexBlockInto(const QString& fileName, qint64 offset, qint64 length, WordTally& results, const TokenMatcher& matcher, const StopwordFilter& stopwords,
+                    uint64_t occurrences, const FileLog& log)
+    {
+    TallySink sink(results, occurrences);
+    scanBlock(fileName, offset, length, matcher, stopwords, sink, 0, log);
+    }
+
+void indexBlockInto(const QString& fileName, qint64 offset, qint64 length, NgramCount& results, const TokenMatcher& matcher, const StopwordFilter& stopwords,
+                    uint64_t occurrences, const FileLog& log)
+    {
+    // a phrase starting near the end of the block needs the words after it
+    NgramSink sink(results, occurrences);
+    scanBlock(fileName, offset, length, matcher, stopwords, sink, results.order() - 1, log);
+    }
+
+void processBuffer(const QString& fileName, QString& buffer, bool allow_ending_word, WordCount& results,
+                   const TokenMatcher& matcher, const StopwordFilter& stopwords, const FileLog& log)
+    {
+    WordSink sink(results);
+    scanBuffer(fileName, buffer, allow_ending_word, matcher, stopwords, sink, log);
+    }
+
+void processBuffer(const QString& fileName, QString& buffer, bool allow_ending_word, NgramCount& results,
+                   const TokenMatcher& matcher, const StopwordFilter& stopwords, const FileLog& log)
+    {
+    NgramSink sink(results);
+    scanBuffer(fileName, buffer, allow_ending_word, matcher, stopwords, sink, log);
     }
 
 void indexFileReducer(WordCount& _results, const WordCount& fileResult)
@@ -175,6 +513,7 @@ void indexFileReducer(WordCount& _results, const WordCount& fileResult)
     //       to the file list being process.
 
     // add the per-file results to the final results
+    AllocationStageScope reducing(STAGE_REDUCE);
     for (WordCount::const_iterator iter = fileResult.constBegin(); iter != fileResult.constEnd(); ++iter)
         {
         // increase the per-word count by the file's count
@@ -182,7 +521,317 @@ void indexFileReducer(WordCount& _results, const WordCount& fileResult)
         }
     }
 
-FileIndexer::FileIndexer(QStringList filesToAnalyze, QObject* _parent) : QObject(_parent), fileList(filesToAnalyze)
+void ngramIndexReducer(NgramCount& _results, const NgramCount& fileResult)
+    {
+    // translate the file's word ids and add its phrase counts to the final results
+    AllocationStageScope reducing(STAGE_REDUCE);
+    _results.merge(fileResult);
+    }
+
+namespace
+    {
+    //! index of the accumulator with the most entries, or -1 if there are none
+    template <typename Accumulator>
+    int largestAccumulator(ThreadAccumulators<Accumulator>& _accumulators)
+        {
+        int largest = -1;
+        for (int i = 0; i < _accumulators.size(); ++i)
+            {
+            if (largest < 0 || _accumulators.at(i).size() > _accumulators.at(largest).size())
+                {
+                largest = i;
+                }
+            }
+        return largest;
+        }
+    }
+
+WordCount mergeAccumulators(ThreadAccumulators<WordTally>& _accumulators)
+    {
+    AllocationStageScope reducing(STAGE_REDUCE);
+    WordCount results;
+    int largest = largestAccumulator(_accumulators);
+    if (largest < 0)
+        {
+        return results;
+        }
+
+    // fold the other tallies into the largest, then build the strings once
+    WordTally& combined = _accumulators.at(largest);
+    for (int i = 0; i < _accumulators.size(); ++i)
+        {
+        if (i != largest)
+            {
+            combined.merge(_accumulators.at(i));
+            }
+        }
+    for (uint32_t id = 1; id <= static_cast<uint32_t>(combined.size()); ++id)
+        {
+        // the tally only holds lowercase words, so they can go in as they are
+        results.insert(combined.word(id), combined.count(id));
+        }
+    return results;
+    }
+
+NgramCount mergeAccumulators(ThreadAccumulators<NgramCount>& _accumulators, int _order)
+    {
+    AllocationStageScope reducing(STAGE_REDUCE);
+    NgramCount results(_order);
+    int largest = largestAccumulator(_accumulators);
+    if (largest < 0)
+        {
+        return results;
+        }
+
+    // start from the largest so its word ids do not need translating
+    results = _accumulators.at(largest);
+    for (int i = 0; i < _accumulators.size(); ++i)
+        {
+        if (i != largest)
+            {
+            ngramIndexReducer(results, _accumulators.at(i));
+            }
+        }
+    return results;
+    }
+
+std::vector<PhraseCount> topWords(const WordCount& _results, int _limit)
+    {
+    // the results contain the counts for all words in all files in
+    // a mapping of word to count. However, the requirement is only for
+    // the top words across all the files being processed
+    // therefore, flip the mapping from word:count to count:word,
+    // a multimap is used to allow duplicate entries
+    typedef std::pair<uint64_t, QString> reverseWordCounterPair;
+    typedef std::multimap<uint64_t, QString> reverseWordCounterMap;
+    reverseWordCounterMap reverseMap;
+    for (WordCount::const_iterator iter = _results.constBegin(); iter != _results.constEnd(); ++iter)
+        {
+        // flip the key and the value for the multimap
+        reverseWordCounterPair newSet;
+        newSet.first = iter.value();
+        newSet.second = iter.key();
+        reverseMap.insert(newSet);
+        }
+
+    // Note: Since the 'key' of the multimap is the numeric count, std::multimap will keep everything ordered.
+    //       As a result, the top words are at the end of the key list, and a simple reverse iterator can be
+    //       used to capture them without further lookups.
+    std::vector<PhraseCount> top;
+    for (reverseWordCounterMap::reverse_iterator rIter = reverseMap.rbegin(); rIter != reverseMap.rend() && static_cast<int>(top.size()) < _limit; ++rIter)
+        {
+        top.push_back(*rIter);
+        }
+    return top;
+    }
+
+namespace
+    {
+    //! file a result is written to until it is complete
+    QString pendingName(const QString& _fileName)
+        {
+        return QString("%1.%2.tmp").arg(_fileName).arg(QCoreApplication::applicationPid());
+        }
+
+    /*! move a complete result into place; rename(2) replaces an earlier file
+     *  of that name atomically, so either the old or the new one is left
+     */
+    bool replaceFile(const QString& _pending, const QString& _fileName)
+        {
+        if (::rename(QFile::encodeName(_pending).constData(), QFile::encodeName(_fileName).constData()) != 0)
+            {
+            QFile::remove(_pending);
+            return false;
+            }
+        return true;
+        }
+
+    /*! \brief Merge Destinations
+     *
+     *  Sends the records of a merge to the top-K selection and to whichever
+     *  of the partial result, the vocabulary and the full table were asked
+     *  for. The files are written under a temporary name and only replace
+     *  the requested ones once they are complete, so a failed merge neither
+     *  leaves a truncated result nor destroys an earlier one.
+     */
+    class MergeOutputs : public RunConsumer
+        {
+        public:
+            MergeOutputs(int _topCount, const QString& _partialFile, const QString& _vocabularyFile, TableFormat _tableFormat=TABLE_NONE,
+                         TableOrder _tableOrder=TABLE_BY_COUNT) :
+                top(_topCount), partialFile(_partialFile), vocabularyFile(_vocabularyFile), tableFormat(_tableFormat), tableOrder(_tableOrder)
+                {
+                }
+
+            //! create the files; _order is the words per key
+            bool open(int _order, QString& _error)
+                {
+                targets.assign(1, &top);
+                if (!partialFile.isEmpty())
+                    {
+                    if (!partial.open(pendingName(partialFile), _order))
+                        {
+                        _error = QString("Unable to write %1").arg(partialFile);
+                        return false;
+                        }
+                    targets.push_back(&partial);
+                    }
+                if (!vocabularyFile.isEmpty())
+                    {
+                    if (!vocabulary.open(pendingName(vocabularyFile), _order))
+                        {
+                        _error = QString("Unable to write %1").arg(vocabularyFile);
+                        finish(false, _error);
+                        return false;
+                        }
+                    targets.push_back(&vocabulary);
+                    }
+                if (tableFormat != TABLE_NONE)
+                    {
+                    // the table goes to stdout, so it can be piped
+                    if (!table.open(QString(), tableFormat, tableOrder, _order))
+                        {
+                        _error = QString("Unable to write the table to stdout");
+                        finish(false, _error);
+                        return false;
+                        }
+                    targets.push_back(&table);
+                    }
+                return true;
+                }
+
+            //! where the merge sends its records
+            RunConsumer& destination()
+                {
+                return (targets.size() == 1) ? static_cast<RunConsumer&>(top) : *this;
+                }
+
+            void add(const QByteArray& _key, uint64_t _count)
+                {
+                for (std::vector<RunConsumer*>::const_iterator iter = targets.begin(); iter != targets.end(); ++iter)
+                    {
+                    (*iter)->add(_key, _count);
+                    }
+                }
+
+            //! close the files; they replace the requested ones only if the merge and the writes all succeeded
+            bool finish(bool _merged, QString& _error)
+                {
+                if (!partialFile.isEmpty() && !partial.close() && _merged)
+                    {
+                    _error = QString("Unable to write %1").arg(partialFile);
+                    _merged = false;
+                    }
+                if (!vocabularyFile.isEmpty() && !vocabulary.close() && _merged)
+                    {
+                    _error = QString("Unable to write %1").arg(vocabularyFile);
+                    _merged = false;
+                    }
+                // a table cut short by a failed merge is still closed, so the JSON is well formed
+                if (tableFormat != TABLE_NONE && !table.close() && _merged)
+                    {
+                    _error = QString("Unable to write the table to stdout");
+                    _merged = false;
+                    }
+                if (_merged && !partialFile.isEmpty() && !replaceFile(pendingName(partialFile), partialFile))
+                    {
+                    _error = QString("Unable to write %1").arg(partialFile);
+                    _merged = false;
+                    }
+                if (_merged && !vocabularyFile.isEmpty() && !replaceFile(pendingName(vocabularyFile), vocabularyFile))
+                    {
+                    _error = QString("Unable to write %1").arg(vocabularyFile);
+                    _merged = false;
+                    }
+                if (!_merged)
+                    {
+                    if (!partialFile.isEmpty())
+                        {
+                        QFile::remove(pendingName(partialFile));
+                        }
+                    if (!vocabularyFile.isEmpty())
+                        {
+                        QFile::remove(pendingName(vocabularyFile));
+                        }
+                    }
+                return _merged;
+                }
+
+            TopCounts top;
+            RunWriter partial;
+            VocabularyWriter vocabulary;
+            TableExport table;
+
+        private:
+            QString partialFile;
+            QString vocabularyFile;
+            TableFormat tableFormat;
+            TableOrder tableOrder;
+            //! every destination that was opened
+            std::vector<RunConsumer*> targets;
+        };
+
+    //! most frequent entries of a sampled accumulator
+    std::vector<PhraseCount> topEntries(const WordTally& _counts, int _limit)
+        {
+        return _counts.topWords(_limit);
+        }
+    std::vector<PhraseCount> topEntries(const NgramCount& _counts, int _limit)
+        {
+        return _counts.topPhrases(_limit);
+        }
+
+    //! query destination that lists every key it is given
+    class KeyListing : public RunConsumer
+        {
+        public:
+            KeyListing() : count(0)
+                {
+                }
+            void add(const QByteArray& _key, uint64_t _count)
+                {
+                std::cout<<"\t";
+                std::cout.write(_key.constData(), _key.size());
+                std::cout<<" - "<<_count<<" times.\n";
+                ++count;
+                }
+            uint64_t listed() const
+                {
+                return count;
+                }
+        private:
+            uint64_t count;
+        };
+    }
+
+FileIndexMapper::FileIndexMapper(const TokenMatcher& _matcher, const StopwordFilter& _stopwords, const FileLog& _log) :
+    matcher(&_matcher), stopwords(&_stopwords), log(_log)
+    {
+    }
+
+WordCount FileIndexMapper::operator()(const QString& fileName) const
+    {
+    return indexFile(fileName, *matcher, *stopwords, log);
+    }
+
+FileIndexer::FileIndexer(QStringList filesToAnalyze, QObject* _parent) : QObject(_parent), fileList(filesToAnalyze), dedupContent(false), ngramOrder(1),
+    memoryLimit(0), tableFormat(TABLE_NONE), tableOrder(TABLE_BY_COUNT), spiller(NULL), progressInterval(0), numaPlacement(false), hugePages(HUGE_PAGES_OFF), placement(NULL),
+    sampleRate(1.0), timeBudget(0.0), sampleSeed(0), allocationStats(false)
+    {
+    initialize();
+    }
+
+FileIndexer::FileIndexer(const IndexerOptions& _options, QObject* _parent) : QObject(_parent), fileList(_options.files), dedupContent(_options.dedupContent), matcher(_options.matcher), stopwords(_options.stopwords), ngramOrder(_options.ngramOrder),
+    ngramAccumulators(NgramCount(_options.ngramOrder)), memoryLimit(_options.memoryLimit), spillDirectory(_options.spillDirectory), partialFile(_options.partialFile),
+    vocabularyFile(_options.vocabularyFile), tableFormat(_options.tableFormat), tableOrder(_options.tableOrder), spiller(NULL),
+    progressInterval(_options.progressInterval), numaPlacement(_options.numaPlacement), hugePages(_options.hugePages), placement(NULL),
+    sampleRate(_options.sampleRate), timeBudget(_options.timeBudget), sampleSeed(_options.sampleSeed),
+    sampledPhrases(SampleTally<NgramCount>(NgramCount(_options.ngramOrder))), allocationStats(_options.allocationStats)
+    {
+    initialize();
+    }
+
+void FileIndexer::initialize()
     {
     // capture log messages sent to qDebug()
     instance = this;
@@ -211,6 +860,10 @@ FileIndexer::~FileIndexer()
     logThread.quit();
     logThread.wait();
 
+    // removes any run files left behind
+    delete spiller;
+    delete placement;
+
     // clear the instance object just in case another one is made in after this one terminates
     // note: it cannot be reset until after the log closes in case there are outstanding log
     // messages that need to be captured via qDebug().
@@ -238,15 +891,101 @@ void FileIndexer::incomingMessage(QtMsgType _type, QString _msg)
 void FileIndexer::runIndexer()
     {
     Q_EMIT logMessage(tr("Starting File Indexing"));
+    // start up and option parsing are left out of the statistics
+    if (allocationStats)
+        {
+        resetAllocationStats();
+        }
 
     // only run if there are files to process
     if (fileList.size() > 0)
         {
-        // use the Map Reduce algorithm to count all the words in the specified files
-        anticipatedResults = QtConcurrent::mappedReduced(fileList, indexFile, indexFileReducer);
+        // count all the words in the specified files; each worker thread counts into
+        // its own accumulator and the accumulators are merged once at the end
+        Q_EMIT logMessage(tr("Token pattern: %1").arg(matcher.pattern()));
+        Q_EMIT logMessage(tr("Stopwords: %1").arg(stopwords.size()));
+
+        // each distinct file is only read once; copies are counted by weight. Hashing
+        // the contents would read every byte, which sampling is there to avoid
+        bool sampling = (sampleRate < 1.0 || timeBudget > 0.0);
+        std::function<bool ()> expired;
+        if (sampling)
+            {
+            // the budget covers examining the files and choosing the blocks as well as reading them
+            sampler.start(timeBudget);
+            expired = [this]() { return sampler.expired(); };
+            }
+        inputs = deduplicateInputs(fileList, dedupContent && !sampling, dedupStats, expired);
+        Q_EMIT logMessage(tr("Reading %1 unique files of %2").arg(inputs.size()).arg(dedupStats.files));
+
+        if (memoryLimit > 0)
+            {
+            // each worker gets an equal share of the budget for its accumulator
+            int workers = qMax(1, QThreadPool::globalInstance()->maxThreadCount());
+            spiller = new RunSpiller(spillDirectory, memoryLimit / workers);
+            Q_EMIT logMessage(tr("Memory limit: %1 bytes; spilling to %2").arg(memoryLimit).arg(spillDirectory));
+            }
+
+        // both apply to the accumulators as the workers fill them
+        setHugePageMode(hugePages);
+        if (hugePages != HUGE_PAGES_OFF)
+            {
+            Q_EMIT logMessage(tr("Large count tables use %1 huge pages").arg((hugePages == HUGE_PAGES_EXPLICIT) ? "explicit" : "transparent"));
+            }
+        if (numaPlacement)
+            {
+            placement = new NumaPlacement();
+            Q_EMIT logMessage(tr("Spreading the workers over %1 NUMA nodes").arg(placement->nodeCount()));
+            }
+
+        // the workers only publish progress when someone is going to read it
+        IndexProgress* channel = NULL;
+        if (progressInterval > 0)
+            {
+            channel = &progress;
+            progress.start(inputs.size());
+            }
+
+        if (sampling)
+            {
+            // the workers read a random sample of blocks from all the files at once
+            sampler.plan(inputs, sampleRate, sampleSeed, qMax(1, QThreadPool::globalInstance()->maxThreadCount()));
+            Q_EMIT logMessage(tr("Sampling %1 of %2 blocks of %3 bytes; time budget %4 seconds").arg(sampler.plannedBlocks())
+                              .arg(sampler.totalBlocks()).arg(SAMPLE_BLOCK_SIZE).arg(timeBudget));
+            if (ngramOrder > 1)
+                {
+                Q_EMIT logMessage(tr("Counting phrases of %1 words").arg(ngramOrder));
+                anticipatedResults = QtConcurrent::map(sampler.batches(), SamplingMapper<NgramCount>(sampledPhrases, sampler, matcher, stopwords, placement, resultDebugLog));
+                }
+            else
+                {
+                anticipatedResults = QtConcurrent::map(sampler.batches(), SamplingMapper<WordTally>(sampledWords, sampler, matcher, stopwords, placement, resultDebugLog));
+                }
+            }
+        else if (ngramOrder > 1)
+            {
+            Q_EMIT logMessage(tr("Counting phrases of %1 words").arg(ngramOrder));
+            anticipatedResults = QtConcurrent::map(inputs, AccumulatingMapper<NgramCount>(ngramAccumulators, matcher, stopwords, spiller, channel, placement, resultDebugLog));
+            }
+        else
+            {
+            anticipatedResults = QtConcurrent::map(inputs, AccumulatingMapper<WordTally>(wordAccumulators, matcher, stopwords, spiller, channel, placement, resultDebugLog));
+            }
+
+        if (channel != NULL)
+            {
+            // keep the event loop free to report while the workers count;
+            // the results are processed once the watcher sees them finish
+            connect(&indexingWatcher, SIGNAL(finished()), this, SLOT(indexingFinished()));
+            connect(&progressTimer, SIGNAL(timeout()), this, SLOT(reportProgress()));
+            progressTimer.start(progressInterval * 1000);
+            indexingWatcher.setFuture(anticipatedResults);
+            return;
+            }
 
         // process the results to capture the top 10 words
         finalizeResults();
+        reportAllocations();
         }
     else
         {
@@ -262,54 +1001,415 @@ void FileIndexer::runIndexer()
 void FileIndexer::finalizeResults()
     {
     Q_EMIT logMessage(tr("Waiting for indexing"));
-    // Get the results, this may block
-    WordCount results = anticipatedResults.result();
-    Q_EMIT logMessage(tr("Finished indexing"));
+    // wait for the workers, this may block
+    anticipatedResults.waitForFinished();
+    AllocationStageScope finalizing(STAGE_FINALIZE);
+    reportDuplicates();
+    if (placement != NULL)
+        {
+        for (int node = 0; node < placement->nodeCount(); ++node)
+            {
+            Q_EMIT logMessage(tr("NUMA node %1: %2 workers").arg(node).arg(placement->threadsOn(node)));
+            }
+        // the merge and sort below run on the same pool threads, unpinned
+        placement->release();
+        }
+
+    if (sampleRate < 1.0 || timeBudget > 0.0)
+        {
+        if (ngramOrder > 1)
+            {
+            finalizeSampledResults(tr("Phrases"), sampledPhrases);
+            }
+        else
+            {
+            finalizeSampledResults(tr("Words"), sampledWords);
+            }
+        return;
+        }
+
+    // a partial result, a vocabulary or a full table is written by the same merge as spilled runs
+    bool writeAll = !partialFile.isEmpty() || !vocabularyFile.isEmpty() || tableFormat != TABLE_NONE;
+    if (spiller == NULL && writeAll)
+        {
+        spiller = new RunSpiller(spillDirectory, std::numeric_limits<uint64_t>::max());
+        }
+
+    // under a memory limit the tables are written out and merged as runs even if nothing
+    // has been spilled yet, since folding them together would hold them all at once
+    if (ngramOrder > 1 && spiller != NULL)
+        {
+        finalizeSpilledResults(tr("Phrases"), ngramAccumulators);
+        return;
+        }
+    if (spiller != NULL)
+        {
+        finalizeSpilledResults(tr("Words"), wordAccumulators);
+        return;
+        }
+
+    if (ngramOrder > 1)
+        {
+        Q_EMIT logMessage(tr("Finished indexing; merging %1 worker results").arg(ngramAccumulators.size()));
+        NgramCount results = mergeAccumulators(ngramAccumulators, ngramOrder);
+        ngramAccumulators.clear();
+        Q_EMIT logMessage(tr("Found %1 phrases").arg(results.size()));
+
+        // the phrases are selected on their packed keys, only the top 10 become strings
+        Q_EMIT logMessage(tr("Generating Top-10 List"));
+        reportTopList(tr("Phrases"), results.topPhrases(10));
+        return;
+        }
+
+    Q_EMIT logMessage(tr("Finished indexing; merging %1 worker results").arg(wordAccumulators.size()));
+    WordCount results = mergeAccumulators(wordAccumulators);
+    wordAccumulators.clear();
     Q_EMIT logMessage(tr("Found %1 words").arg(results.size()));
 
-    // the results contain the counts for all words in all files in
-    // a mapping of word to count. However, the requirement is only for
-    // the 10 top words across all the files being processed
-    // therefore, flip the mapping from word:count to count:word,
-    // a multimap is used to allow duplicate entries
-    Q_EMIT logMessage(tr("Building count-oriented listing"));
-    typedef std::pair<uint64_t, QString> reverseWordCounterPair;
-    typedef std::multimap<uint64_t, QString> reverseWordCounterMap;
-    reverseWordCounterMap reverseMap;
-    for (WordCount::const_iterator iter = results.constBegin(); iter != results.constEnd(); ++iter)
+    Q_EMIT logMessage(tr("Generating Top-10 List"));
+    reportTopList(tr("Words"), topWords(results, 10));
+    }
+
+void FileIndexer::indexingFinished()
+    {
+    progressTimer.stop();
+    finalizeResults();
+    reportAllocations();
+
+    // everything is done, signal that it's time to close so the logs can clean up and terminate the program
+    Q_EMIT close();
+    }
+
+void FileIndexer::reportProgress()
+    {
+    ProgressReport report = progress.report();
+    QString line = tr("Progress: %1 of %2 files, %3 bytes, %4 MB/s")
+                   .arg(report.filesDone).arg(report.filesTotal).arg(report.bytesDone)
+                   .arg(report.bytesPerSecond / (1024.0 * 1024.0), 0, 'f', 1);
+    QStringList leading;
+    for (std::vector<PhraseCount>::const_iterator iter = report.top.begin(); iter != report.top.end(); ++iter)
         {
-        // flip the key and the value for the multimap
-        reverseWordCounterPair newSet;
-        newSet.first = iter.value();
-        newSet.second = iter.key();
-        reverseMap.insert(newSet);
+        leading << tr("%1 (%2)").arg(iter->second).arg(iter->first);
         }
 
-    // output the final results to stdout and to the log
-    // Note: Since the 'key' of the multimap is the numeric count, std::multimap will keep everything ordered.
-    //       As a result, the top 10 words are at the end of the key list, and a simple reverse iterator can be
-    //       used to capture them without further lookups.
+    // stdout is kept for the results
+    std::cerr<<line.toLocal8Bit().data()<<std::endl;
+    Q_EMIT logMessage(line);
+    if (!leading.isEmpty())
+        {
+        QString top = tr("Leading so far: %1").arg(leading.join(", "));
+        std::cerr<<"\t"<<top.toLocal8Bit().data()<<std::endl;
+        Q_EMIT logMessage(top);
+        }
+    }
+
+template <typename Accumulator>
+void FileIndexer::finalizeSpilledResults(const QString& _kind, ThreadAccumulators<Accumulator>& _accumulators)
+    {
+    // whatever the workers still hold becomes one more run each
+    AllocationStageScope reducing(STAGE_REDUCE);
+    for (int i = 0; i < _accumulators.size() && !spiller->failed(); ++i)
+        {
+        spiller->spill(_accumulators.at(i));
+        }
+    _accumulators.clear();
+    if (spiller->failed())
+        {
+        std::cerr<<"Unable to write "<<spiller->error().toLocal8Bit().data()<<"; no results."<<std::endl;
+        Q_EMIT logMessage(tr("Unable to write %1").arg(spiller->error()));
+        return;
+        }
+
+    // only the top 10 are kept while the runs are merged, unless every count
+    // is also going to the partial result, the vocabulary or the table
+    Q_EMIT logMessage(tr("Finished indexing; merging %1 sorted runs").arg(spiller->runs().size()));
+    MergeOutputs outputs(10, partialFile, vocabularyFile, tableFormat, tableOrder);
+    // the workers' tables are gone by now, so a table sorted by count may use the whole budget
+    outputs.table.setSortSpill(spillDirectory, memoryLimit);
+    QString error;
+    if (!outputs.open(ngramOrder, error))
+        {
+        std::cerr<<error.toLocal8Bit().data()<<std::endl;
+        Q_EMIT logMessage(error);
+        return;
+        }
+    bool merged = mergeRuns(spiller->runs(), outputs.destination(), error, spiller->directory());
+    if (!outputs.finish(merged, error))
+        {
+        std::cerr<<"Unable to merge the sorted runs: "<<error.toLocal8Bit().data()<<std::endl;
+        Q_EMIT logMessage(tr("Unable to merge the sorted runs: %1").arg(error));
+        return;
+        }
+    AllocationStageScope finalizing(STAGE_FINALIZE);
+    Q_EMIT logMessage(tr("Found %1 %2").arg(outputs.top.distinct()).arg(_kind.toLower()));
+    // stdout holds only the table when there is one
+    std::ostream& notes = (tableFormat == TABLE_NONE) ? std::cout : std::cerr;
+    if (tableFormat != TABLE_NONE)
+        {
+        Q_EMIT logMessage(tr("Wrote %1 %2 to stdout").arg(outputs.table.rows()).arg(_kind.toLower()));
+        }
+    if (!partialFile.isEmpty())
+        {
+        notes<<"Wrote "<<outputs.partial.records()<<" "<<_kind.toLower().toLatin1().data()<<" to "<<partialFile.toLocal8Bit().data()<<std::endl<<std::endl;
+        Q_EMIT logMessage(tr("Wrote %1 %2 to %3").arg(outputs.partial.records()).arg(_kind.toLower()).arg(partialFile));
+        }
+    if (!vocabularyFile.isEmpty())
+        {
+        notes<<"Wrote "<<outputs.vocabulary.records()<<" "<<_kind.toLower().toLatin1().data()<<" to "<<vocabularyFile.toLocal8Bit().data()
+                 <<" ("<<outputs.vocabulary.size()<<" bytes)"<<std::endl<<std::endl;
+        Q_EMIT logMessage(tr("Wrote %1 %2 to %3 (%4 bytes)").arg(outputs.vocabulary.records()).arg(_kind.toLower()).arg(vocabularyFile)
+                          .arg(outputs.vocabulary.size()));
+        }
 
-    // output the 10 top used words by looking at the back 10 items of the map
     Q_EMIT logMessage(tr("Generating Top-10 List"));
-    uint32_t count = 0;
-    std::cout<<"Top 10 Words:"<<std::endl;
-    Q_EMIT logMessage(tr("Top 10 Words:"));
-    for (reverseWordCounterMap::reverse_iterator rIter = reverseMap.rbegin(); rIter != reverseMap.rend(); ++rIter)
+    reportTopList(_kind, outputs.top.top());
+    }
+
+template <typename Accumulator>
+void FileIndexer::finalizeSampledResults(const QString& _kind, ThreadAccumulators<SampleTally<Accumulator> >& _accumulators)
+    {
+    Q_EMIT logMessage(tr("Finished sampling; merging %1 worker results").arg(_accumulators.size()));
+    AllocationStageScope reducing(STAGE_REDUCE);
+    for (int i = 1; i < _accumulators.size(); ++i)
+        {
+        _accumulators.at(0).merge(_accumulators.at(i));
+        }
+    AllocationStageScope finalizing(STAGE_FINALIZE);
+
+    double percent = (sampler.totalBlocks() > 0) ? (100.0 * sampler.blocksRead()) / sampler.totalBlocks() : 0.0;
+    QString summary = tr("Sampled %1 of %2 blocks (%3%, %4 of %5 bytes) in %6 seconds").arg(sampler.blocksRead()).arg(sampler.totalBlocks())
+                      .arg(percent, 0, 'f', 2).arg(sampler.bytesRead()).arg(sampler.totalBytes()).arg(sampler.seconds(), 0, 'f', 1);
+    if (sampler.stoppedEarly())
+        {
+        summary += tr("; stopped at the time budget");
+        }
+    std::cout<<summary.toLocal8Bit().data()<<"."<<std::endl<<std::endl;
+    Q_EMIT logMessage(summary);
+    // no worker has counts if the inputs were empty or the budget ran out at once
+    if (_accumulators.size() == 0)
         {
-        std::cout<<"\t"<<rIter->second.toLatin1().data()<<" - "<<rIter->first<<" times."<<std::endl;
-        Q_EMIT logMessage(tr("%1 - %2 times").arg(rIter->second).arg(rIter->first));
-        ++count;
-        if (count >= 10) break;
+        _accumulators.local();
         }
+    const SampleTally<Accumulator>& combined = _accumulators.at(0);
 
-    // warn if there were not enough words to make 10
+    // every count is scaled by the same factor, so the sample ranks the entries as the estimates would
+    Q_EMIT logMessage(tr("Generating Top-10 List"));
+    std::vector<PhraseCount> top = topEntries(combined.counts, 10);
+    // once every block has been read the counts are exact
+    QString heading = tr("Top 10 %1").arg(_kind);
+    if (sampler.blocksRead() < sampler.totalBlocks())
+        {
+        heading += tr(" (estimated, 95% confidence)");
+        }
+    std::cout<<heading.toLatin1().data()<<":"<<std::endl;
+    Q_EMIT logMessage(heading + ":");
+    for (std::vector<PhraseCount>::const_iterator iter = top.begin(); iter != top.end(); ++iter)
+        {
+        SampleEstimate estimate = sampler.estimate(iter->first, combined.squares.count(iter->second));
+        QString margin;
+        if (estimate.margin < 0.0)
+            {
+            margin = tr(" (+/- unknown)");
+            }
+        else if (estimate.margin > 0.0)
+            {
+            margin = tr(" (+/- %1)").arg(static_cast<qulonglong>(llround(estimate.margin)));
+            }
+        std::cout<<"\t"<<iter->second.toLatin1().data()<<" - "<<estimate.count<<" times"<<margin.toLatin1().data()<<"."<<std::endl;
+        Q_EMIT logMessage(tr("%1 - %2 times%3").arg(iter->second).arg(estimate.count).arg(margin));
+        }
+    if (top.size() < 10)
+        {
+        std::cout<<std::endl<<"Only "<<top.size()<<" "<<_kind.toLower().toLatin1().data()<<" were found in the sample."<<std::endl;
+        Q_EMIT logMessage(tr("Only %1 %2 were found in the sample.").arg(top.size()).arg(_kind.toLower()));
+        }
+    std::cout<<std::endl;
+    }
+
+void FileIndexer::reportAllocations()
+    {
+    if (!allocationStats)
+        {
+        return;
+        }
+    AllocationReport report = allocationReport();
+
+    // stdout is kept for the results
+    QStringList lines;
+    lines << tr("Allocations by stage:");
+    for (int stage = 0; stage < ALLOCATION_STAGES; ++stage)
+        {
+        const AllocationCounts& counts = report.stages[stage];
+        lines << tr("\t%1: %2 allocations, %3 frees, %4 bytes; peak live %5 bytes")
+                 .arg(allocationStageName(static_cast<AllocationStage>(stage))).arg(counts.allocations).arg(counts.frees)
+                 .arg(counts.bytes).arg(report.stagePeaks[stage]);
+        }
+    lines << tr("Allocations by thread:");
+    for (std::vector<ThreadAllocations>::const_iterator iter = report.threads.begin(); iter != report.threads.end(); ++iter)
+        {
+        uint64_t allocations = 0;
+        uint64_t bytes = 0;
+        QStringList stages;
+        for (int stage = 0; stage < ALLOCATION_STAGES; ++stage)
+            {
+            allocations += iter->stages[stage].allocations;
+            bytes += iter->stages[stage].bytes;
+            stages << tr("%1 %2").arg(allocationStageName(static_cast<AllocationStage>(stage))).arg(iter->stages[stage].allocations);
+            }
+        lines << tr("\tthread %1: %2 allocations, %3 bytes (%4)").arg(iter->thread).arg(allocations).arg(bytes).arg(stages.join(", "));
+        }
+    lines << tr("Peak live memory: %1 bytes; %2 bytes still live").arg(report.peakBytes).arg(report.liveBytes);
+
+    for (QStringList::const_iterator iter = lines.constBegin(); iter != lines.constEnd(); ++iter)
+        {
+        std::cerr<<iter->toLocal8Bit().data()<<std::endl;
+        Q_EMIT logMessage(iter->trimmed());
+        }
+    }
+
+void FileIndexer::reportDuplicates()
+    {
+    if (dedupStats.duplicateFiles == 0)
+        {
+        return;
+        }
+    std::ostream& notes = (tableFormat == TABLE_NONE) ? std::cout : std::cerr;
+    notes<<"Skipped "<<dedupStats.duplicateFiles<<" duplicate files ("<<dedupStats.bytesSkipped<<" bytes); their counts are included."<<std::endl<<std::endl;
+    Q_EMIT logMessage(tr("Skipped %1 duplicate files (%2 bytes)").arg(dedupStats.duplicateFiles).arg(dedupStats.bytesSkipped));
+    }
+
+void FileIndexer::reportTopList(const QString& _kind, const std::vector<PhraseCount>& _top)
+    {
+    // output the final results to stdout and to the log; a full table takes the place of the list
+    if (tableFormat == TABLE_NONE)
+        {
+        printTopList(_kind, _top, 10);
+        }
+    Q_EMIT logMessage(tr("Top 10 %1:").arg(_kind));
+    uint32_t count = 0;
+    for (std::vector<PhraseCount>::const_iterator iter = _top.begin(); iter != _top.end() && count < 10; ++iter, ++count)
+        {
+        Q_EMIT logMessage(tr("%1 - %2 times").arg(iter->second).arg(iter->first));
+        }
     if (count < 10)
         {
-        std::cout<<std::endl<<"Only "<<count<<" words were found in the files."<<std::endl;
-        Q_EMIT logMessage(tr("Only %1 words were found in the file.").arg(count));
+        Q_EMIT logMessage(tr("Only %1 %2 were found in the file.").arg(count).arg(_kind.toLower()));
+        }
+    }
+
+void printTopList(const QString& _kind, const std::vector<PhraseCount>& _top, int _limit)
+    {
+    int count = 0;
+    std::cout<<"Top "<<_limit<<" "<<_kind.toLatin1().data()<<":"<<std::endl;
+    for (std::vector<PhraseCount>::const_iterator iter = _top.begin(); iter != _top.end() && count < _limit; ++iter, ++count)
+        {
+        std::cout<<"\t"<<iter->second.toLatin1().data()<<" - "<<iter->first<<" times."<<std::endl;
+        }
+
+    // warn if there were not enough words to fill the list
+    if (count < _limit)
+        {
+        std::cout<<std::endl<<"Only "<<count<<" "<<_kind.toLower().toLatin1().data()<<" were found in the files."<<std::endl;
         }
 
     // add a blank line
     std::cout<<std::endl;
     }
+
+bool mergePartialResults(const MergeOptions& _options, QString& _error)
+    {
+    // the output counts the same kind of key as the inputs; check them all before any output is created
+    int order = 0;
+    if (!checkPartials(_options.partials, order, _error))
+        {
+        return false;
+        }
+    order = qMax(order, 1);
+
+    // an output that is also an input would be replaced while it is still being read
+    QStringList outputFiles;
+    outputFiles << _options.partialFile << _options.vocabularyFile;
+    for (QStringList::const_iterator output = outputFiles.constBegin(); output != outputFiles.constEnd(); ++output)
+        {
+        QFileInfo outputInfo(*output);
+        if (output->isEmpty() || !outputInfo.exists())
+            {
+            continue;
+            }
+        for (QStringList::const_iterator input = _options.partials.constBegin(); input != _options.partials.constEnd(); ++input)
+            {
+            if (QFileInfo(*input).canonicalFilePath() == outputInfo.canonicalFilePath())
+                {
+                _error = QString("%1 is both an input and an output of the merge").arg(*output);
+                return false;
+                }
+            }
+        }
+
+    MergeOutputs outputs(_options.topCount, _options.partialFile, _options.vocabularyFile, _options.tableFormat, _options.tableOrder);
+    // there is no limit here; the scratch directory only takes rows past what a single sort can refer to
+    outputs.table.setSortSpill(_options.spillDirectory);
+    if (!outputs.open(order, _error))
+        {
+        return false;
+        }
+    bool merged = mergePartials(_options.partials, outputs.destination(), order, _error, _options.spillDirectory);
+    if (!outputs.finish(merged, _error))
+        {
+        return false;
+        }
+
+    // stdout holds only the table when there is one
+    if (_options.tableFormat != TABLE_NONE)
+        {
+        std::cerr<<"Merged "<<_options.partials.size()<<" partial results; "<<outputs.table.rows()<<" distinct entries."<<std::endl;
+        return true;
+        }
+    std::cout<<"Merged "<<_options.partials.size()<<" partial results; "<<outputs.top.distinct()<<" distinct entries."<<std::endl<<std::endl;
+    printTopList((order > 1) ? QString("Phrases") : QString("Words"), outputs.top.top(), _options.topCount);
+    return true;
+    }
+
+bool queryVocabulary(const QueryOptions& _options, QString& _error)
+    {
+    Vocabulary vocabulary;
+    if (!vocabulary.open(_options.vocabularyFile))
+        {
+        _error = QString("%1 is not a vocabulary file").arg(_options.vocabularyFile);
+        return false;
+        }
+    QString kind = (vocabulary.order() > 1) ? QString("Phrases") : QString("Words");
+
+    // the keys were counted in lowercase
+    for (QStringList::const_iterator iter = _options.keys.constBegin(); iter != _options.keys.constEnd(); ++iter)
+        {
+        std::cout<<iter->toLower().toUtf8().data()<<" - "<<vocabulary.count(iter->toLower())<<" times."<<std::endl;
+        }
+
+    QString prefix = _options.prefix.toLower();
+    if (_options.listPrefix && _options.topCount == 0)
+        {
+        KeyListing listing;
+        if (!vocabulary.entries(prefix, listing))
+            {
+            _error = QString("%1 is corrupt").arg(_options.vocabularyFile);
+            return false;
+            }
+        std::cout<<listing.listed()<<" "<<kind.toLower().toLatin1().data()<<" start with \""<<prefix.toUtf8().data()<<"\"."<<std::endl;
+        }
+    else if (_options.listPrefix || _options.topCount > 0 || _options.keys.isEmpty())
+        {
+        int limit = (_options.topCount > 0) ? _options.topCount : 10;
+        if (!_options.keys.isEmpty())
+            {
+            std::cout<<std::endl;
+            }
+        printTopList(prefix.isEmpty() ? kind : QString("%1 starting with \"%2\"").arg(kind).arg(prefix), vocabulary.top(prefix, limit), limit);
+        }
+    if (vocabulary.failed())
+        {
+        _error = QString("%1 is corrupt").arg(_options.vocabularyFile);
+        return false;
+        }
+    return true;
+    }
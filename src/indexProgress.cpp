@@ -0,0 +1,138 @@
+#include <indexProgress.h>
+
+#include <algorithm>
+#include <functional>
+
+#include <QHash>
+#include <QMutexLocker>
+
+ProgressReport::ProgressReport() : filesDone(0), filesTotal(0), bytesDone(0), seconds(0.0), bytesPerSecond(0.0)
+    {
+    }
+
+IndexProgress::WorkerSlot::WorkerSlot() : bytes(0), files(0), latest(NULL), publishedEpoch(0), retired(NULL)
+    {
+    }
+
+IndexProgress::WorkerSlot::WorkerSlot(const WorkerSlot&) : bytes(0), files(0), latest(NULL), publishedEpoch(0), retired(NULL)
+    {
+    }
+
+IndexProgress::WorkerSlot::~WorkerSlot()
+    {
+    // no report can be running once the slots are destroyed
+    delete latest.load();
+    while (retired != NULL)
+        {
+        Snapshot* next = retired->next;
+        delete retired;
+        retired = next;
+        }
+    }
+
+IndexProgress::IndexProgress(int _topCount) : topCount(_topCount), filesTotal(0), requested(1), reading(0)
+    {
+    }
+
+void IndexProgress::start(uint64_t _filesTotal)
+    {
+    filesTotal = _filesTotal;
+    elapsed.start();
+    }
+
+void IndexProgress::fileDone()
+    {
+    WorkerSlot& slot = workers.local();
+    slot.files.store(slot.files.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+std::vector<PhraseCount> IndexProgress::topEntries(const WordTally& _results, int _limit)
+    {
+    return _results.topWords(_limit);
+    }
+
+std::vector<PhraseCount> IndexProgress::topEntries(const NgramCount& _results, int _limit)
+    {
+    return _results.topPhrases(_limit);
+    }
+
+void IndexProgress::publish(WorkerSlot& _slot, const std::vector<PhraseCount>& _top)
+    {
+    Snapshot* fresh = new Snapshot;
+    fresh->top = _top;
+    fresh->retiredEpoch = 0;
+    fresh->next = NULL;
+
+    // a report that started before the swap may still be reading the old
+    // snapshot; any such report has an epoch no later than the one read here
+    Snapshot* old = _slot.latest.exchange(fresh);
+    if (old != NULL)
+        {
+        old->retiredEpoch = requested.load();
+        old->next = _slot.retired;
+        _slot.retired = old;
+        }
+
+    // free what no running report can see: none is running, or it started afterwards
+    uint64_t active = reading.load();
+    Snapshot** link = &_slot.retired;
+    while (*link != NULL)
+        {
+        Snapshot* snapshot = *link;
+        if (active == 0 || active > snapshot->retiredEpoch)
+            {
+            *link = snapshot->next;
+            delete snapshot;
+            }
+        else
+            {
+            link = &snapshot->next;
+            }
+        }
+    }
+
+ProgressReport IndexProgress::report()
+    {
+    QMutexLocker lock(&readerLock);
+
+    ProgressReport result;
+    result.filesTotal = filesTotal;
+    result.seconds = elapsed.isValid() ? (elapsed.elapsed() / 1000.0) : 0.0;
+
+    // the new epoch asks each worker for a fresh snapshot, and marks this report
+    // as reading until it is done with the current ones
+    uint64_t epoch = requested.fetch_add(1) + 1;
+    reading.store(epoch);
+
+    QHash<QString, uint64_t> combined;
+    std::vector<WorkerSlot*> current = workers.registered();
+    for (std::vector<WorkerSlot*>::const_iterator iter = current.begin(); iter != current.end(); ++iter)
+        {
+        result.filesDone += (*iter)->files.load(std::memory_order_relaxed);
+        result.bytesDone += (*iter)->bytes.load(std::memory_order_relaxed);
+        const Snapshot* snapshot = (*iter)->latest.load();
+        if (snapshot != NULL)
+            {
+            for (std::vector<PhraseCount>::const_iterator entry = snapshot->top.begin(); entry != snapshot->top.end(); ++entry)
+                {
+                combined[entry->second] += entry->first;
+                }
+            }
+        }
+    reading.store(0);
+
+    // most frequent first; ties list later entries first, as the final results do
+    for (QHash<QString, uint64_t>::const_iterator iter = combined.constBegin(); iter != combined.constEnd(); ++iter)
+        {
+        result.top.push_back(PhraseCount(iter.value(), iter.key()));
+        }
+    size_t limit = std::min(result.top.size(), static_cast<size_t>(std::max(topCount, 0)));
+    std::partial_sort(result.top.begin(), result.top.begin() + limit, result.top.end(), std::greater<PhraseCount>());
+    result.top.resize(limit);
+
+    if (result.seconds > 0.0)
+        {
+        result.bytesPerSecond = result.bytesDone / result.seconds;
+        }
+    return result;
+    }
@@ -0,0 +1,535 @@
+#include <indexerOptions.h>
+
+#include <limits>
+
+#include <QDir>
+
+#include <allocationStats.h>
+
+namespace
+    {
+    /*! \brief Option Value Lookup
+     *
+     *  Fetch the value of an option given as "--name=value" or "--name value"
+     *
+     *  \param _arguments - the command-line arguments
+     *  \param _index - index of the option; advanced past a separate value
+     *  \param _value - receives the option value
+     *
+     *  \return true if a value was available
+     */
+    bool optionValue(const QStringList& _arguments, int& _index, QString& _value)
+        {
+        const QString& argument = _arguments[_index];
+        int equals = argument.indexOf('=');
+        if (equals != -1)
+            {
+            _value = argument.mid(equals + 1);
+            return true;
+            }
+        if ((_index + 1) < _arguments.size())
+            {
+            ++_index;
+            _value = _arguments[_index];
+            return true;
+            }
+        return false;
+        }
+
+    /*! \brief Size Parsing
+     *
+     *  Convert a size such as "512K", "64M" or "2G" to bytes; the suffixes are
+     *  powers of 1024 and a plain number is bytes
+     *
+     *  \param _text - size to convert
+     *  \param _bytes - receives the size in bytes
+     *
+     *  \return true if the size was valid
+     */
+    bool parseSize(const QString& _text, uint64_t& _bytes)
+        {
+        QString digits = _text.trimmed().toUpper();
+        uint64_t multiplier = 1;
+        if (digits.endsWith('K'))
+            {
+            multiplier = Q_UINT64_C(1) << 10;
+            }
+        else if (digits.endsWith('M'))
+            {
+            multiplier = Q_UINT64_C(1) << 20;
+            }
+        else if (digits.endsWith('G'))
+            {
+            multiplier = Q_UINT64_C(1) << 30;
+            }
+        if (multiplier > 1)
+            {
+            digits.chop(1);
+            }
+
+        bool valid = false;
+        uint64_t value = digits.toULongLong(&valid);
+        if (!valid || value > (std::numeric_limits<uint64_t>::max() / multiplier))
+            {
+            return false;
+            }
+        _bytes = value * multiplier;
+        return true;
+        }
+
+    /*! \brief Table Option Parsing
+     *
+     *  Handle --output and --sort, which the indexer and the merge share
+     *
+     *  \param _arguments - the command-line arguments
+     *  \param _index - index of the option; advanced past a separate value
+     *  \param _format - receives the table format from --output
+     *  \param _order - receives the row order from --sort
+     *  \param _error - receives a description of the problem if the value is invalid
+     *
+     *  \return true if the value was valid
+     */
+    bool tableOption(const QStringList& _arguments, int& _index, TableFormat& _format, TableOrder& _order, QString& _error)
+        {
+        QString name = _arguments[_index].section('=', 0, 0);
+        QString value;
+        bool valid = optionValue(_arguments, _index, value);
+        if (name == "--output")
+            {
+            if (valid && value == "csv")
+                {
+                _format = TABLE_CSV;
+                }
+            else if (valid && value == "tsv")
+                {
+                _format = TABLE_TSV;
+                }
+            else if (valid && value == "json")
+                {
+                _format = TABLE_JSON;
+                }
+            else
+                {
+                _error = QString("%1 requires csv, tsv or json").arg(name);
+                return false;
+                }
+            }
+        else if (valid && value == "count")
+            {
+            _order = TABLE_BY_COUNT;
+            }
+        else if (valid && value == "word")
+            {
+            _order = TABLE_BY_KEY;
+            }
+        else
+            {
+            _error = QString("%1 requires count or word").arg(name);
+            return false;
+            }
+        return true;
+        }
+    }
+
+IndexerOptions::IndexerOptions() : ngramOrder(1), dedupContent(false), memoryLimit(0), spillDirectory(QDir::tempPath()),
+    tableFormat(TABLE_NONE), tableOrder(TABLE_BY_COUNT), progressInterval(0), numaPlacement(false), hugePages(HUGE_PAGES_OFF),
+    sampleRate(1.0), timeBudget(0.0), sampleSeed(0), allocationStats(false)
+    {
+    }
+
+MergeOptions::MergeOptions() : topCount(10), tableFormat(TABLE_NONE), tableOrder(TABLE_BY_COUNT), spillDirectory(QDir::tempPath())
+    {
+    }
+
+QueryOptions::QueryOptions() : listPrefix(false), topCount(0)
+    {
+    }
+
+bool parseIndexerOptions(const QStringList& _arguments, IndexerOptions& _options, QString& _error)
+    {
+    bool options_done = false;
+    bool use_stopwords = false;
+    QStringList stopwordList;
+    for (int i = 0; i < _arguments.size(); ++i)
+        {
+        const QString& argument = _arguments[i];
+        if (options_done || !argument.startsWith("--"))
+            {
+            _options.files << argument;
+            continue;
+            }
+        if (argument == "--")
+            {
+            options_done = true;
+            continue;
+            }
+
+        QString name = argument.section('=', 0, 0);
+        QString value;
+        if (name == "--token-pattern")
+            {
+            if (!optionValue(_arguments, i, value))
+                {
+                _error = QString("%1 requires a pattern").arg(name);
+                return false;
+                }
+            QString patternError;
+            if (!_options.matcher.compile(value, &patternError))
+                {
+                _error = QString("Invalid token pattern '%1': %2").arg(value).arg(patternError);
+                return false;
+                }
+            }
+        else if (argument == "--stopwords")
+            {
+            use_stopwords = true;
+            stopwordList << StopwordFilter::builtinWords();
+            }
+        else if (name == "--stopword-file")
+            {
+            if (!optionValue(_arguments, i, value))
+                {
+                _error = QString("%1 requires a file name").arg(name);
+                return false;
+                }
+            if (!StopwordFilter::readWordFile(value, stopwordList))
+                {
+                _error = QString("Unable to read stopword file %1").arg(value);
+                return false;
+                }
+            use_stopwords = true;
+            }
+        else if (name == "--ngrams")
+            {
+            bool valid = false;
+            if (optionValue(_arguments, i, value))
+                {
+                _options.ngramOrder = value.toInt(&valid);
+                }
+            if (!valid || _options.ngramOrder < 1 || _options.ngramOrder > MAX_NGRAM_ORDER)
+                {
+                _error = QString("%1 requires a phrase length from 1 to %2").arg(name).arg(MAX_NGRAM_ORDER);
+                return false;
+                }
+            }
+        else if (argument == "--dedup-content")
+            {
+            _options.dedupContent = true;
+            }
+        else if (name == "--memory-limit")
+            {
+            if (!optionValue(_arguments, i, value) || !parseSize(value, _options.memoryLimit))
+                {
+                _error = QString("%1 requires a size, f.e 512M").arg(name);
+                return false;
+                }
+            }
+        else if (name == "--spill-dir")
+            {
+            if (!optionValue(_arguments, i, value) || !QDir(value).exists())
+                {
+                _error = QString("%1 requires an existing directory").arg(name);
+                return false;
+                }
+            _options.spillDirectory = value;
+            }
+        else if (name == "--emit-partial")
+            {
+            if (!optionValue(_arguments, i, value) || value.isEmpty())
+                {
+                _error = QString("%1 requires a file name").arg(name);
+                return false;
+                }
+            _options.partialFile = value;
+            }
+        else if (name == "--emit-vocabulary")
+            {
+            if (!optionValue(_arguments, i, value) || value.isEmpty())
+                {
+                _error = QString("%1 requires a file name").arg(name);
+                return false;
+                }
+            _options.vocabularyFile = value;
+            }
+        else if (name == "--output" || name == "--sort")
+            {
+            if (!tableOption(_arguments, i, _options.tableFormat, _options.tableOrder, _error))
+                {
+                return false;
+                }
+            }
+        else if (name == "--progress")
+            {
+            // the interval is optional, so it can only be given as "--progress=<seconds>"
+            bool valid = true;
+            _options.progressInterval = 5;
+            if (argument != name)
+                {
+                _options.progressInterval = argument.mid(name.length() + 1).toInt(&valid);
+                }
+            if (!valid || _options.progressInterval < 1)
+                {
+                _error = QString("%1 requires a number of seconds").arg(name);
+                return false;
+                }
+            }
+        else if (argument == "--numa")
+            {
+            _options.numaPlacement = true;
+            }
+        else if (argument == "--stats")
+            {
+            // the counting allocator costs too much to be in every build
+            if (!allocationStatsEnabled())
+                {
+                _error = QString("--stats needs a build configured with -DALLOCATION_STATS=ON");
+                return false;
+                }
+            _options.allocationStats = true;
+            }
+        else if (name == "--huge-pages")
+            {
+            // the kind is optional, so it can only be given as "--huge-pages=<kind>"
+            QString kind = (argument != name) ? argument.mid(name.length() + 1) : QString("transparent");
+            if (kind == "transparent")
+                {
+                _options.hugePages = HUGE_PAGES_TRANSPARENT;
+                }
+            else if (kind == "explicit")
+                {
+                _options.hugePages = HUGE_PAGES_EXPLICIT;
+                }
+            else
+                {
+                _error = QString("%1 requires transparent or explicit").arg(name);
+                return false;
+                }
+            }
+        else if (name == "--sample-rate")
+            {
+            // a fraction, or a percentage such as "5%"
+            bool valid = optionValue(_arguments, i, value);
+            double divisor = value.endsWith('%') ? 100.0 : 1.0;
+            if (valid)
+                {
+                _options.sampleRate = (divisor > 1.0 ? value.left(value.length() - 1) : value).toDouble(&valid) / divisor;
+                }
+            if (!valid || !(_options.sampleRate > 0.0 && _options.sampleRate <= 1.0))
+                {
+                _error = QString("%1 requires a fraction of the input, f.e 0.01 or 1%").arg(name);
+                return false;
+                }
+            }
+        else if (name == "--time-budget")
+            {
+            bool valid = false;
+            if (optionValue(_arguments, i, value))
+                {
+                _options.timeBudget = value.toDouble(&valid);
+                }
+            if (!valid || !(_options.timeBudget > 0.0))
+                {
+                _error = QString("%1 requires a number of seconds").arg(name);
+                return false;
+                }
+            }
+        else if (name == "--sample-seed")
+            {
+            bool valid = false;
+            if (optionValue(_arguments, i, value))
+                {
+                _options.sampleSeed = value.toULongLong(&valid);
+                }
+            if (!valid || _options.sampleSeed == 0)
+                {
+                _error = QString("%1 requires a number other than 0").arg(name);
+                return false;
+                }
+            }
+        else
+            {
+            _error = QString("Unknown option %1").arg(name);
+            return false;
+            }
+        }
+
+    // a sample only estimates the counts, so it cannot feed anything that expects them exact
+    bool sampling = (_options.sampleRate < 1.0 || _options.timeBudget > 0.0);
+    if (sampling && (!_options.partialFile.isEmpty() || !_options.vocabularyFile.isEmpty() || _options.tableFormat != TABLE_NONE ||
+                     _options.memoryLimit > 0 || _options.progressInterval > 0))
+        {
+        _error = QString("--sample-rate and --time-budget cannot be combined with --emit-partial, --emit-vocabulary, --output, --memory-limit or --progress");
+        return false;
+        }
+
+    // build the stopword hash once everything has been collected
+    if (use_stopwords && !_options.stopwords.build(stopwordList))
+        {
+        _error = QString("Unable to build the stopword table");
+        return false;
+        }
+    return true;
+    }
+
+bool parseMergeOptions(const QStringList& _arguments, MergeOptions& _options, QString& _error)
+    {
+    bool options_done = false;
+    for (int i = 0; i < _arguments.size(); ++i)
+        {
+        const QString& argument = _arguments[i];
+        if (options_done || !argument.startsWith("--"))
+            {
+            _options.partials << argument;
+            continue;
+            }
+        if (argument == "--")
+            {
+            options_done = true;
+            continue;
+            }
+
+        QString name = argument.section('=', 0, 0);
+        QString value;
+        if (name == "--top")
+            {
+            bool valid = false;
+            if (optionValue(_arguments, i, value))
+                {
+                _options.topCount = value.toInt(&valid);
+                }
+            if (!valid || _options.topCount < 1)
+                {
+                _error = QString("%1 requires a positive number").arg(name);
+                return false;
+                }
+            }
+        else if (name == "--emit-partial")
+            {
+            if (!optionValue(_arguments, i, value) || value.isEmpty())
+                {
+                _error = QString("%1 requires a file name").arg(name);
+                return false;
+                }
+            _options.partialFile = value;
+            }
+        else if (name == "--emit-vocabulary")
+            {
+            if (!optionValue(_arguments, i, value) || value.isEmpty())
+                {
+                _error = QString("%1 requires a file name").arg(name);
+                return false;
+                }
+            _options.vocabularyFile = value;
+            }
+        else if (name == "--output" || name == "--sort")
+            {
+            if (!tableOption(_arguments, i, _options.tableFormat, _options.tableOrder, _error))
+                {
+                return false;
+                }
+            }
+        else if (name == "--spill-dir")
+            {
+            if (!optionValue(_arguments, i, value) || !QDir(value).exists())
+                {
+                _error = QString("%1 requires an existing directory").arg(name);
+                return false;
+                }
+            _options.spillDirectory = value;
+            }
+        else
+            {
+            _error = QString("Unknown option %1").arg(name);
+            return false;
+            }
+        }
+    return true;
+    }
+
+bool parseQueryOptions(const QStringList& _arguments, QueryOptions& _options, QString& _error)
+    {
+    bool options_done = false;
+    for (int i = 0; i < _arguments.size(); ++i)
+        {
+        const QString& argument = _arguments[i];
+        if (options_done || !argument.startsWith("--"))
+            {
+            if (_options.vocabularyFile.isEmpty())
+                {
+                _options.vocabularyFile = argument;
+                }
+            else
+                {
+                _options.keys << argument;
+                }
+            continue;
+            }
+        if (argument == "--")
+            {
+            options_done = true;
+            continue;
+            }
+
+        QString name = argument.section('=', 0, 0);
+        QString value;
+        if (name == "--prefix")
+            {
+            if (!optionValue(_arguments, i, value))
+                {
+                _error = QString("%1 requires the start of the keys").arg(name);
+                return false;
+                }
+            _options.prefix = value;
+            _options.listPrefix = true;
+            }
+        else if (name == "--top")
+            {
+            bool valid = false;
+            if (optionValue(_arguments, i, value))
+                {
+                _options.topCount = value.toInt(&valid);
+                }
+            if (!valid || _options.topCount < 1)
+                {
+                _error = QString("%1 requires a positive number").arg(name);
+                return false;
+                }
+            }
+        else
+            {
+            _error = QString("Unknown option %1").arg(name);
+            return false;
+            }
+        }
+    return true;
+    }
+
+QString indexerUsage(const QString& _program)
+    {
+    QString usage;
+    usage += QString("%1 [options] [<file list>]\n").arg(_program);
+    usage += QString("%1 merge [--top=<n>] [--emit-partial=<file>] [--emit-vocabulary=<file>] [--output=<format>] [--sort=<order>] [--spill-dir=<dir>] <partial files>\n").arg(_program);
+    usage += QString("%1 query <vocabulary file> [--prefix=<text>] [--top=<n>] [<words>]\n").arg(_program);
+    usage += "Options:\n";
+    usage += "\t--token-pattern=<pattern>\tpattern words must match (default: " DEFAULT_TOKEN_PATTERN ")\n";
+    usage += "\t--stopwords\t\t\tdo not count common English words\n";
+    usage += "\t--stopword-file=<file>\t\tdo not count the words listed in the file\n";
+    usage += "\t--ngrams=<n>\t\t\tcount phrases of n consecutive words (1-3, default: 1)\n";
+    usage += "\t--dedup-content\t\t\tread byte-identical copies of a file only once\n";
+    usage += "\t--memory-limit=<size>\t\twrite the counts to sorted runs on disk past this size (f.e 512M)\n";
+    usage += "\t--spill-dir=<dir>\t\twhere the sorted runs go (default: the temporary directory)\n";
+    usage += "\t--emit-partial=<file>\t\talso write all the counts to a file for a later merge\n";
+    usage += "\t--emit-vocabulary=<file>\talso write all the counts to a compressed vocabulary for the query subcommand\n";
+    usage += "\t--output=<format>\t\twrite every count to stdout as csv, tsv or json instead of the top 10\n";
+    usage += "\t--sort=<order>\t\t\torder of the --output rows: count (default) or word\n";
+    usage += "\t--sample-rate=<fraction>\tcount random blocks making up this much of the input (f.e 1%) and estimate the top 10\n";
+    usage += "\t--time-budget=<seconds>\t\tcount random blocks until the time runs out and estimate the top 10\n";
+    usage += "\t--sample-seed=<n>\t\tchoose the same random blocks on every run\n";
+    usage += "\t--progress[=<seconds>]\t\treport progress and the top entries so far to stderr (default: every 5)\n";
+    usage += "\t--numa\t\t\t\tspread the workers over the NUMA nodes, each counting into node-local memory\n";
+    usage += "\t--huge-pages[=<kind>]\t\tback large count tables with transparent (default) or explicit huge pages\n";
+    usage += "\t--stats\t\t\t\treport the allocations of each indexing stage and thread to stderr (instrumented builds only)\n";
+    usage += "\t--top=<n>\t\t\t(merge and query only) number of entries to report (default: 10)\n";
+    usage += "\t--prefix=<text>\t\t\t(query only) list the entries starting with the text\n";
+    return usage;
+    }
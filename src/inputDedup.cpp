@@ -0,0 +1,343 @@
+#include <inputDedup.h>
+
+#include <string.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <map>
+#include <vector>
+#include <utility>
+
+#include <QFile>
+#include <QHash>
+#include <qtconcurrentmap.h>
+
+namespace
+    {
+    //! XXH64 primes
+    const uint64_t PRIME1 = 11400714785074694791ULL;
+    const uint64_t PRIME2 = 14029467366897019727ULL;
+    const uint64_t PRIME3 = 1609587929392839161ULL;
+    const uint64_t PRIME4 = 9650029242287828579ULL;
+    const uint64_t PRIME5 = 2870177450012600261ULL;
+
+    //! block size used when hashing a file
+    const qint64 HASH_READ_SIZE = 1 << 20;
+
+    inline uint64_t rotateLeft(uint64_t _value, int _bits)
+        {
+        return (_value << _bits) | (_value >> (64 - _bits));
+        }
+
+    inline uint64_t read64(const char* _data)
+        {
+        uint64_t value;
+        memcpy(&value, _data, sizeof(value));
+        return value;
+        }
+
+    inline uint32_t read32(const char* _data)
+        {
+        uint32_t value;
+        memcpy(&value, _data, sizeof(value));
+        return value;
+        }
+
+    inline uint64_t round64(uint64_t _accumulator, uint64_t _input)
+        {
+        _accumulator += _input * PRIME2;
+        _accumulator = rotateLeft(_accumulator, 31);
+        return _accumulator * PRIME1;
+        }
+
+    inline uint64_t mergeRound(uint64_t _hash, uint64_t _accumulator)
+        {
+        _hash ^= round64(0, _accumulator);
+        return _hash * PRIME1 + PRIME4;
+        }
+
+    /*! \brief Streaming XXH64
+     *
+     *  Hash a file a block at a time without holding all of it in memory
+     */
+    class ContentHasher
+        {
+        public:
+            ContentHasher() : total(0), pending(0)
+                {
+                lanes[0] = PRIME1 + PRIME2;
+                lanes[1] = PRIME2;
+                lanes[2] = 0;
+                lanes[3] = 0 - PRIME1;
+                }
+
+            void update(const char* _data, uint64_t _length)
+                {
+                total += _length;
+
+                // finish a partial stripe from the previous block first
+                if (pending > 0)
+                    {
+                    uint64_t fill = std::min<uint64_t>(32 - pending, _length);
+                    memcpy(stripe + pending, _data, fill);
+                    pending += fill;
+                    _data += fill;
+                    _length -= fill;
+                    if (pending < 32)
+                        {
+                        return;
+                        }
+                    consume(stripe);
+                    pending = 0;
+                    }
+
+                while (_length >= 32)
+                    {
+                    consume(_data);
+                    _data += 32;
+                    _length -= 32;
+                    }
+
+                memcpy(stripe, _data, _length);
+                pending = _length;
+                }
+
+            uint64_t digest() const
+                {
+                uint64_t hash;
+                if (total >= 32)
+                    {
+                    hash = rotateLeft(lanes[0], 1) + rotateLeft(lanes[1], 7) + rotateLeft(lanes[2], 12) + rotateLeft(lanes[3], 18);
+                    for (int i = 0; i < 4; ++i)
+                        {
+                        hash = mergeRound(hash, lanes[i]);
+                        }
+                    }
+                else
+                    {
+                    hash = PRIME5;
+                    }
+                hash += total;
+
+                // the tail that did not fill a stripe
+                const char* data = stripe;
+                uint64_t length = pending;
+                while (length >= 8)
+                    {
+                    hash ^= round64(0, read64(data));
+                    hash = rotateLeft(hash, 27) * PRIME1 + PRIME4;
+                    data += 8;
+                    length -= 8;
+                    }
+                if (length >= 4)
+                    {
+                    hash ^= static_cast<uint64_t>(read32(data)) * PRIME1;
+                    hash = rotateLeft(hash, 23) * PRIME2 + PRIME3;
+                    data += 4;
+                    length -= 4;
+                    }
+                while (length > 0)
+                    {
+                    hash ^= static_cast<unsigned char>(*data) * PRIME5;
+                    hash = rotateLeft(hash, 11) * PRIME1;
+                    ++data;
+                    --length;
+                    }
+
+                hash ^= hash >> 33;
+                hash *= PRIME2;
+                hash ^= hash >> 29;
+                hash *= PRIME3;
+                hash ^= hash >> 32;
+                return hash;
+                }
+
+        private:
+            void consume(const char* _data)
+                {
+                for (int i = 0; i < 4; ++i)
+                    {
+                    lanes[i] = round64(lanes[i], read64(_data + i * 8));
+                    }
+                }
+
+            //! the four accumulators
+            uint64_t lanes[4];
+            //! bytes seen so far
+            uint64_t total;
+            //! bytes waiting for a full stripe
+            char stripe[32];
+            uint64_t pending;
+        };
+
+    /*! \brief Content Hashing Job
+     *
+     *  One file whose size matched another; hashed by a worker
+     */
+    struct HashCandidate
+        {
+        //! index into the unique inputs
+        int input;
+        //! whether the file could be read
+        bool hashed;
+        //! the content hash
+        uint64_t hash;
+        };
+
+    /*! \brief Hashing Function Object
+     *
+     *  Binds the inputs so QtConcurrent::blockingMap() can hash the candidates
+     */
+    class CandidateHasher
+        {
+        public:
+            CandidateHasher(const QList<IndexInput>& _inputs) : inputs(&_inputs)
+                {
+                }
+            void operator()(HashCandidate& _candidate) const
+                {
+                _candidate.hashed = contentHash((*inputs)[_candidate.input].fileName, _candidate.hash);
+                }
+        private:
+            const QList<IndexInput>* inputs;
+        };
+    }
+
+IndexInput::IndexInput(const QString& _fileName, qint64 _size) : fileName(_fileName), size(_size), occurrences(1)
+    {
+    }
+
+DedupStats::DedupStats() : files(0), duplicateFiles(0), bytesSkipped(0)
+    {
+    }
+
+uint64_t contentHash(const char* _data, uint64_t _length)
+    {
+    ContentHasher hasher;
+    hasher.update(_data, _length);
+    return hasher.digest();
+    }
+
+bool contentHash(const QString& _fileName, uint64_t& _hash)
+    {
+    QFile input(_fileName);
+    if (input.open(QIODevice::ReadOnly) == false)
+        {
+        return false;
+        }
+
+    ContentHasher hasher;
+    QByteArray block;
+    do
+        {
+        block = input.read(HASH_READ_SIZE);
+        hasher.update(block.constData(), block.size());
+        } while (block.size() > 0);
+    _hash = hasher.digest();
+    return true;
+    }
+
+QList<IndexInput> deduplicateInputs(const QStringList& _files, bool _hashContent, DedupStats& _stats, const std::function<bool ()>& _expired)
+    {
+    _stats = DedupStats();
+    _stats.files = _files.size();
+
+    // hard links and repeated paths share a device and inode; grouping them only needs stat()
+    typedef std::pair<uint64_t, uint64_t> FileIdentity;
+    std::map<FileIdentity, int> identities;
+    QList<IndexInput> inputs;
+    bool stopped = false;
+    for (QStringList::const_iterator iter = _files.constBegin(); iter != _files.constEnd(); ++iter)
+        {
+        stopped = stopped || (_expired && _expired());
+        if (stopped)
+            {
+            inputs << IndexInput(*iter);
+            continue;
+            }
+
+        struct stat information;
+        if (stat(QFile::encodeName(*iter).constData(), &information) != 0)
+            {
+            // leave it for the indexer to report
+            inputs << IndexInput(*iter);
+            continue;
+            }
+
+        FileIdentity identity(static_cast<uint64_t>(information.st_dev), static_cast<uint64_t>(information.st_ino));
+        std::map<FileIdentity, int>::iterator known = identities.find(identity);
+        if (known != identities.end())
+            {
+            ++inputs[known->second].occurrences;
+            ++_stats.duplicateFiles;
+            _stats.bytesSkipped += static_cast<uint64_t>(information.st_size);
+            continue;
+            }
+        identities.insert(std::make_pair(identity, inputs.size()));
+        inputs << IndexInput(*iter, static_cast<qint64>(information.st_size));
+        }
+
+    if (!_hashContent || stopped)
+        {
+        return inputs;
+        }
+
+    // only files that share their size with another can be copies; hash just those
+    QHash<qint64, int> sizes;
+    for (int i = 0; i < inputs.size(); ++i)
+        {
+        if (inputs[i].size > 0)
+            {
+            sizes[inputs[i].size] += 1;
+            }
+        }
+    QList<HashCandidate> candidates;
+    for (int i = 0; i < inputs.size(); ++i)
+        {
+        if (inputs[i].size > 0 && sizes.value(inputs[i].size) > 1)
+            {
+            HashCandidate candidate = { i, false, 0 };
+            candidates << candidate;
+            }
+        }
+    if (candidates.isEmpty())
+        {
+        return inputs;
+        }
+    QtConcurrent::blockingMap(candidates, CandidateHasher(inputs));
+
+    // fold each copy into the first file with the same size and hash
+    typedef std::pair<qint64, uint64_t> ContentIdentity;
+    std::map<ContentIdentity, int> contents;
+    std::vector<bool> duplicate(inputs.size(), false);
+    for (QList<HashCandidate>::const_iterator iter = candidates.constBegin(); iter != candidates.constEnd(); ++iter)
+        {
+        if (!iter->hashed)
+            {
+            continue;
+            }
+        const IndexInput& input = inputs[iter->input];
+        ContentIdentity identity(input.size, iter->hash);
+        std::map<ContentIdentity, int>::iterator known = contents.find(identity);
+        if (known == contents.end())
+            {
+            contents.insert(std::make_pair(identity, iter->input));
+            continue;
+            }
+        // the other paths to this file were already counted as skipped by inode
+        inputs[known->second].occurrences += input.occurrences;
+        ++_stats.duplicateFiles;
+        _stats.bytesSkipped += static_cast<uint64_t>(input.size);
+        duplicate[iter->input] = true;
+        }
+
+    QList<IndexInput> unique;
+    for (int i = 0; i < inputs.size(); ++i)
+        {
+        if (!duplicate[i])
+            {
+            unique << inputs[i];
+            }
+        }
+    return unique;
+    }
@@ -1,11 +1,11 @@
 #include <logger.h>
 
 #include <QCoreApplication>
+#include <QMetaObject>
 #include <QtCore/QFile>
 #include <QtCore/QIODevice>
 #include <QtCore/QString>
 #include <QtCore/QStringList>
-#include <QTimer>
 
 Logger::Logger(QObject* _parent): QObject(_parent)
 	{
@@ -83,6 +83,7 @@ void Logger::message(QString _message)
 
 void Logger::closeApplication()
 	{
-	// close the application after 1 second
-	QTimer::singleShot(1000, QCoreApplication::instance(), SLOT(quit())); 
+	// every message sent before this was queued ahead of it and has already been
+	// written, so there is nothing to wait for; quit once the main event loop gets here
+	QMetaObject::invokeMethod(QCoreApplication::instance(), "quit", Qt::QueuedConnection);
 	}
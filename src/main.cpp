@@ -8,27 +8,78 @@ int main(int argc, char* argv[])
 	{
 	QCoreApplication theApplication(argc, argv);
 
-	// check the number of args, if only 1 is specified
+	// split the command-line into options and the files to process
+	QStringList arguments;
+	for (int i=1; i < argc; ++i)
+		{
+		arguments << QString(argv[i]);
+		}
+
+	// "merge" combines the partial results of earlier runs instead of indexing files
+	if (!arguments.isEmpty() && arguments.first() == "merge")
+		{
+		MergeOptions mergeOptions;
+		QString error;
+		if (!parseMergeOptions(arguments.mid(1), mergeOptions, error) || mergeOptions.partials.isEmpty())
+			{
+			std::cerr << "Invalid parameter: " << (error.isEmpty() ? QString("no partial results to merge") : error).toLatin1().data() << std::endl;
+			std::cerr << indexerUsage(argv[0]).toLatin1().data();
+			return 1;
+			}
+		if (!mergePartialResults(mergeOptions, error))
+			{
+			std::cerr << "Merge failed: " << error.toLocal8Bit().data() << std::endl;
+			return 1;
+			}
+		return 0;
+		}
+	// "query" answers lookups from a vocabulary written by an earlier run
+	if (!arguments.isEmpty() && arguments.first() == "query")
+		{
+		QueryOptions queryOptions;
+		QString error;
+		if (!parseQueryOptions(arguments.mid(1), queryOptions, error) || queryOptions.vocabularyFile.isEmpty())
+			{
+			std::cerr << "Invalid parameter: " << (error.isEmpty() ? QString("no vocabulary file to query") : error).toLatin1().data() << std::endl;
+			std::cerr << indexerUsage(argv[0]).toLatin1().data();
+			return 1;
+			}
+		if (!queryVocabulary(queryOptions, error))
+			{
+			std::cerr << "Query failed: " << error.toLocal8Bit().data() << std::endl;
+			return 1;
+			}
+		return 0;
+		}
+	IndexerOptions options;
+	QString error;
+	if (!parseIndexerOptions(arguments, options, error))
+		{
+		std::cerr << "Invalid parameter: " << error.toLatin1().data() << std::endl;
+		std::cerr << indexerUsage(argv[0]).toLatin1().data();
+		return 1;
+		}
+
+	// check the number of files, if none are specified
 	// then generate the usage as the user failed to specify
 	// at least 1 file to process
-	if (argc < 2)
+	if (options.files.isEmpty())
 		{
 		std::cerr << "Invalid parameter" << std::endl;
-		std::cerr << argv[0] << " [<file list>] " << std::endl;
+		std::cerr << indexerUsage(argv[0]).toLatin1().data();
 		return 1;
 		}
 
-	// all args after the first are files to be processed
-	QStringList filesToProcess;
-	for (int i=1; i < argc; ++i)
+	// a full table is the only thing written to stdout; the files are still listed, on stderr
+	std::ostream& notes = (options.tableFormat == TABLE_NONE) ? std::cout : std::cerr;
+	for (QStringList::const_iterator iter = options.files.constBegin(); iter != options.files.constEnd(); ++iter)
 		{
-		filesToProcess << QString(argv[i]);
-		std::cout << "Found file: " << argv[i] << std::endl;
+		notes << "Found file: " << (*iter).toLatin1().data() << std::endl;
 		}
 
 	// create an index of the indexer; it'll start running
 	// as soon as the event loop kicks off
-	FileIndexer main(filesToProcess, NULL);
+	FileIndexer main(options, NULL);
 
 	// and start the event loop
 	return theApplication.exec();
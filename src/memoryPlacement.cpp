@@ -0,0 +1,356 @@
+#include <memoryPlacement.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <QAtomicInt>
+#include <QDir>
+#include <QFile>
+#include <QMutexLocker>
+#include <QStringList>
+#include <QThread>
+
+#include <allocationStats.h>
+
+namespace
+    {
+    //! mode applied to new tables
+    std::atomic<int> currentMode(HUGE_PAGES_OFF);
+
+    //! huge page size on the platforms that have them
+    const size_t HUGE_PAGE_SIZE = HUGE_TABLE_THRESHOLD;
+
+    //! length actually mapped for a large table
+    size_t mappedLength(size_t _bytes)
+        {
+        return (_bytes + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+        }
+
+#ifdef __linux__
+    //! anonymous mapping of a large table starting on a huge page boundary
+    void* mapAligned(size_t _length)
+        {
+        // map an extra huge page and trim both ends back to the aligned block
+        char* mapped = static_cast<char*>(mmap(NULL, _length + HUGE_PAGE_SIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0));
+        if (mapped == MAP_FAILED)
+            {
+            return NULL;
+            }
+        char* aligned = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(mapped) + HUGE_PAGE_SIZE - 1) & ~static_cast<uintptr_t>(HUGE_PAGE_SIZE - 1));
+        if (aligned > mapped)
+            {
+            munmap(mapped, aligned - mapped);
+            }
+        size_t tail = (mapped + _length + HUGE_PAGE_SIZE) - (aligned + _length);
+        if (tail > 0)
+            {
+            munmap(aligned + _length, tail);
+            }
+        return aligned;
+        }
+#endif
+
+    //! tag for each NumaPlacement in the thread-local cache
+    int nextPlacementGeneration()
+        {
+        // generations start at 1 so a fresh thread-local entry never matches
+        static QAtomicInt counter(0);
+        return counter.fetchAndAddOrdered(1) + 1;
+        }
+
+    //! thread-local record of where the calling thread was placed
+    struct ThreadPlacement
+        {
+        int generation;
+        int node;
+        };
+
+    ThreadPlacement& threadPlacement()
+        {
+        static thread_local ThreadPlacement placement = { 0, -1 };
+        return placement;
+        }
+    }
+
+void setHugePageMode(HugePageMode _mode)
+    {
+    currentMode.store(_mode);
+    }
+
+HugePageMode hugePageMode()
+    {
+    return static_cast<HugePageMode>(currentMode.load());
+    }
+
+void* allocateTable(size_t _bytes)
+    {
+#ifdef __linux__
+    if (_bytes >= HUGE_TABLE_THRESHOLD)
+        {
+        size_t length = mappedLength(_bytes);
+        HugePageMode mode = hugePageMode();
+#ifdef MAP_HUGETLB
+        if (mode == HUGE_PAGES_EXPLICIT)
+            {
+            void* reserved = mmap(NULL, length, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+            if (reserved != MAP_FAILED)
+                {
+                countMappedAllocation(length);
+                return reserved;
+                }
+            // the pool is empty or not configured; transparent pages are the next best
+            }
+#endif
+        void* memory = mapAligned(length);
+        if (memory == NULL)
+            {
+            throw std::bad_alloc();
+            }
+#ifdef MADV_HUGEPAGE
+        if (mode != HUGE_PAGES_OFF)
+            {
+            // only advice; the table works the same if the kernel declines
+            madvise(memory, length, MADV_HUGEPAGE);
+            }
+#endif
+        // malloc never sees these, so the allocation statistics are told directly
+        countMappedAllocation(length);
+        return memory;
+        }
+#endif
+    void* memory = malloc((_bytes > 0) ? _bytes : 1);
+    if (memory == NULL)
+        {
+        throw std::bad_alloc();
+        }
+    return memory;
+    }
+
+void releaseTable(void* _memory, size_t _bytes)
+    {
+    if (_memory == NULL)
+        {
+        return;
+        }
+#ifdef __linux__
+    if (_bytes >= HUGE_TABLE_THRESHOLD)
+        {
+        munmap(_memory, mappedLength(_bytes));
+        countMappedRelease(mappedLength(_bytes));
+        return;
+        }
+#endif
+    free(_memory);
+    }
+
+NumaPlacement::NumaPlacement(int _emulatedNodes) : placed(0), generation(nextPlacementGeneration())
+    {
+#ifdef __linux__
+    // only the CPUs the process may run on, f.e inside a container
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    bool restricted = (sched_getaffinity(0, sizeof(allowed), &allowed) == 0);
+
+    // nodes without CPUs only hold memory, and have no workers to place
+    QDir nodeDirectory("/sys/devices/system/node");
+    QStringList nodeNames = nodeDirectory.entryList(QStringList() << "node*", QDir::Dirs);
+    for (QStringList::const_iterator iter = nodeNames.constBegin(); iter != nodeNames.constEnd(); ++iter)
+        {
+        QFile cpuList(nodeDirectory.filePath(*iter + "/cpulist"));
+        std::vector<int> listed;
+        if (!cpuList.open(QIODevice::ReadOnly) || !parseCpuList(QString::fromLatin1(cpuList.readAll()), listed))
+            {
+            continue;
+            }
+        std::vector<int> cpus;
+        for (std::vector<int>::const_iterator cpu = listed.begin(); cpu != listed.end(); ++cpu)
+            {
+            if (!restricted || (*cpu < CPU_SETSIZE && CPU_ISSET(*cpu, &allowed)))
+                {
+                cpus.push_back(*cpu);
+                }
+            }
+        if (!cpus.empty())
+            {
+            nodes.push_back(cpus);
+            }
+        }
+
+    // no topology; everything the process may run on is one node
+    if (nodes.empty() && restricted)
+        {
+        std::vector<int> cpus;
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+            {
+            if (CPU_ISSET(cpu, &allowed))
+                {
+                cpus.push_back(cpu);
+                }
+            }
+        if (!cpus.empty())
+            {
+            nodes.push_back(cpus);
+            }
+        }
+#endif
+
+    if (nodes.empty())
+        {
+        std::vector<int> cpus;
+        for (int cpu = 0; cpu < qMax(1, QThread::idealThreadCount()); ++cpu)
+            {
+            cpus.push_back(cpu);
+            }
+        nodes.push_back(cpus);
+        }
+
+    if (nodes.size() == 1 && _emulatedNodes > 1)
+        {
+        // contiguous slices, as the kernel numbers the CPUs of a socket together
+        std::vector<int> all = nodes.front();
+        int count = qMin(_emulatedNodes, static_cast<int>(all.size()));
+        nodes.assign(count, std::vector<int>());
+        for (size_t i = 0; i < all.size(); ++i)
+            {
+            nodes[(i * count) / all.size()].push_back(all[i]);
+            }
+        }
+    }
+
+NumaPlacement::~NumaPlacement()
+    {
+    release();
+    }
+
+int NumaPlacement::nodeCount() const
+    {
+    return static_cast<int>(nodes.size());
+    }
+
+const std::vector<int>& NumaPlacement::nodeCpus(int _node) const
+    {
+    return nodes[_node];
+    }
+
+int NumaPlacement::placeCurrentThread()
+    {
+    ThreadPlacement& current = threadPlacement();
+    if (current.generation == generation)
+        {
+        return current.node;
+        }
+
+    int node = placed.fetch_add(1) % nodeCount();
+    current.generation = generation;
+    current.node = node;
+    if (nodeCount() > 1 && !pin(node))
+        {
+        current.node = -1;
+        }
+    return current.node;
+    }
+
+void NumaPlacement::release()
+    {
+#ifdef __linux__
+    QMutexLocker locker(&pinnedLock);
+    for (std::vector<PinnedThread>::const_iterator iter = pinned.begin(); iter != pinned.end(); ++iter)
+        {
+        // a pool thread may have expired since; its id could now be another process's thread
+        if (!QDir(QString("/proc/self/task/%1").arg(iter->thread)).exists())
+            {
+            continue;
+            }
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        for (std::vector<int>::const_iterator cpu = iter->cpus.begin(); cpu != iter->cpus.end(); ++cpu)
+            {
+            CPU_SET(*cpu, &cpus);
+            }
+        sched_setaffinity(static_cast<pid_t>(iter->thread), sizeof(cpus), &cpus);
+        }
+    pinned.clear();
+#endif
+    // the threads are placed again if they come back
+    generation = nextPlacementGeneration();
+    }
+
+int NumaPlacement::threadsOn(int _node) const
+    {
+    int total = placed.load();
+    return (total / nodeCount()) + ((_node < (total % nodeCount())) ? 1 : 0);
+    }
+
+bool NumaPlacement::parseCpuList(const QString& _text, std::vector<int>& _cpus)
+    {
+    _cpus.clear();
+    QStringList ranges = _text.trimmed().split(',', QString::SkipEmptyParts);
+    for (QStringList::const_iterator iter = ranges.constBegin(); iter != ranges.constEnd(); ++iter)
+        {
+        bool firstValid = false;
+        bool lastValid = false;
+        int first = iter->section('-', 0, 0).toInt(&firstValid);
+        int last = iter->contains('-') ? iter->section('-', 1, 1).toInt(&lastValid) : first;
+        if (!firstValid || (iter->contains('-') && !lastValid) || first < 0 || last < first)
+            {
+            _cpus.clear();
+            return false;
+            }
+        for (int cpu = first; cpu <= last; ++cpu)
+            {
+            _cpus.push_back(cpu);
+            }
+        }
+    return true;
+    }
+
+bool NumaPlacement::pin(int _node)
+    {
+#ifdef __linux__
+    cpu_set_t previous;
+    CPU_ZERO(&previous);
+    if (pthread_getaffinity_np(pthread_self(), sizeof(previous), &previous) != 0)
+        {
+        return false;
+        }
+
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    for (std::vector<int>::const_iterator iter = nodes[_node].begin(); iter != nodes[_node].end(); ++iter)
+        {
+        if (*iter < CPU_SETSIZE)
+            {
+            CPU_SET(*iter, &cpus);
+            }
+        }
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0)
+        {
+        return false;
+        }
+
+    // remembered so release() can give the CPUs back
+    PinnedThread thread;
+    thread.thread = syscall(SYS_gettid);
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+        {
+        if (CPU_ISSET(cpu, &previous))
+            {
+            thread.cpus.push_back(cpu);
+            }
+        }
+    QMutexLocker locker(&pinnedLock);
+    pinned.push_back(thread);
+    return true;
+#else
+    Q_UNUSED(_node);
+    return false;
+#endif
+    }
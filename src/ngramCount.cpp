@@ -0,0 +1,692 @@
+#include <ngramCount.h>
+
+#include <algorithm>
+
+#include <QStringList>
+
+#include <countRuns.h>
+#include <tokenMatcher.h>
+
+namespace
+    {
+    //! initial slot counts; both tables are powers of two
+    const uint32_t INITIAL_WORD_SLOTS = 1024;
+    const int INITIAL_NGRAM_SHIFT = 64 - 12;
+
+    //! Fibonacci hashing multiplier
+    const uint64_t KEY_MULTIPLIER = 0x9E3779B97F4A7C15ULL;
+
+    //! order phrases by count, then by key so the listing is stable
+    bool higherCount(const NgramTable::Entry& _left, const NgramTable::Entry& _right)
+        {
+        if (_left.count != _right.count)
+            {
+            return _left.count > _right.count;
+            }
+        return _left.key < _right.key;
+        }
+
+    /*! \brief Key Decoding
+     *
+     *  Word ids of a key; a wide trigram key holds the id of its first two
+     *  words in _pairKeys and the third word id
+     *
+     *  \param _key - key from the phrase table
+     *  \param _order - number of words in the phrase
+     *  \param _pairKeys - packed word pairs by id, NULL for packed keys
+     *  \param _ids - receives the word ids of the phrase, in order
+     */
+    void keyIds(NgramKey _key, int _order, const std::vector<NgramKey, TableAllocator<NgramKey> >* _pairKeys, uint32_t* _ids)
+        {
+        if (_pairKeys == NULL)
+            {
+            NgramCount::unpack(_key, _order, _ids);
+            return;
+            }
+        NgramCount::unpack((*_pairKeys)[static_cast<size_t>(_key >> 32)], 2, _ids);
+        _ids[2] = static_cast<uint32_t>(_key & 0xFFFFFFFFU);
+        }
+
+    /*! \brief Phrase Characters
+     *
+     *  Walks the characters of a packed phrase as if its words were joined
+     *  with spaces, without building the string
+     */
+    class PhraseCursor
+        {
+        public:
+            PhraseCursor(const WordInterner& _words, NgramKey _key, int _order, const std::vector<NgramKey, TableAllocator<NgramKey> >* _pairKeys) :
+                words(_words), order(_order), word(0), position(0)
+                {
+                keyIds(_key, order, _pairKeys, ids);
+                data = words.wordData(ids[0]);
+                length = words.wordLength(ids[0]);
+                }
+            //! next character in code point order, -1 at the end
+            int next()
+                {
+                if (position < length)
+                    {
+                    return static_cast<int>(codePointOrder(data[position++].unicode()));
+                    }
+                if ((word + 1) >= order)
+                    {
+                    return -1;
+                    }
+                ++word;
+                data = words.wordData(ids[word]);
+                length = words.wordLength(ids[word]);
+                position = 0;
+                return ' ';
+                }
+        private:
+            const WordInterner& words;
+            uint32_t ids[MAX_NGRAM_ORDER];
+            int order;
+            int word;
+            const QChar* data;
+            int length;
+            int position;
+        };
+
+    /*! \brief Run Order for Phrases
+     *
+     *  Sorts packed phrases the way their text sorts in a run file
+     */
+    class PhraseOrder
+        {
+        public:
+            PhraseOrder(const WordInterner& _words, int _order, const std::vector<NgramKey, TableAllocator<NgramKey> >* _pairKeys) :
+                words(&_words), order(_order), pairKeys(_pairKeys)
+                {
+                }
+            bool operator()(const NgramTable::Entry& _left, const NgramTable::Entry& _right) const
+                {
+                PhraseCursor left(*words, _left.key, order, pairKeys);
+                PhraseCursor right(*words, _right.key, order, pairKeys);
+                for (;;)
+                    {
+                    int l = left.next();
+                    int r = right.next();
+                    if (l != r)
+                        {
+                        return l < r;
+                        }
+                    if (l < 0)
+                        {
+                        return false;
+                        }
+                    }
+                }
+        private:
+            const WordInterner* words;
+            int order;
+            const std::vector<NgramKey, TableAllocator<NgramKey> >* pairKeys;
+        };
+    }
+
+WordInterner::WordInterner()
+    {
+    clear();
+    }
+
+uint32_t WordInterner::hashWord(const QChar* _word, int _length)
+    {
+    uint32_t hash = 2166136261U;
+    for (int i = 0; i < _length; ++i)
+        {
+        hash ^= foldCharacter(_word[i]);
+        hash *= 16777619U;
+        }
+    return hash;
+    }
+
+uint32_t WordInterner::probe(const QChar* _word, int _length, uint32_t _hash, uint32_t& _slot) const
+    {
+    uint32_t mask = static_cast<uint32_t>(slotIds.size() - 1);
+    for (_slot = _hash & mask; ; _slot = (_slot + 1) & mask)
+        {
+        uint32_t id = slotIds[_slot];
+        if (id == 0)
+            {
+            return 0;
+            }
+        if (hashes[id] == _hash && static_cast<int>(offsets[id + 1] - offsets[id]) == _length)
+            {
+            const QChar* stored = &characters[offsets[id]];
+            bool same = true;
+            for (int i = 0; i < _length && same; ++i)
+                {
+                same = (stored[i].unicode() == foldCharacter(_word[i]));
+                }
+            if (same)
+                {
+                return id;
+                }
+            }
+        }
+    }
+
+uint32_t WordInterner::intern(const QChar* _word, int _length, uint32_t _limit)
+    {
+    uint32_t hash = hashWord(_word, _length);
+    uint32_t slot = 0;
+    uint32_t id = probe(_word, _length, hash, slot);
+    if (id != 0)
+        {
+        return id;
+        }
+
+    // new word
+    id = static_cast<uint32_t>(offsets.size() - 1);
+    if (id > _limit)
+        {
+        return 0;
+        }
+    for (int i = 0; i < _length; ++i)
+        {
+        characters.push_back(QChar(foldCharacter(_word[i])));
+        }
+    offsets.push_back(static_cast<uint32_t>(characters.size()));
+    hashes.push_back(hash);
+    slotIds[slot] = id;
+
+    // keep the table at most half full
+    if ((static_cast<size_t>(id) * 2) >= slotIds.size())
+        {
+        grow();
+        }
+    return id;
+    }
+
+uint32_t WordInterner::intern(const QString& _word, uint32_t _limit)
+    {
+    return intern(_word.constData(), _word.length(), _limit);
+    }
+
+QString WordInterner::word(uint32_t _id) const
+    {
+    if (_id == 0 || (_id + 1) >= offsets.size())
+        {
+        return QString();
+        }
+    return QString(&characters[0] + offsets[_id], offsets[_id + 1] - offsets[_id]);
+    }
+
+const QChar* WordInterner::wordData(uint32_t _id) const
+    {
+    if (characters.empty() || (_id + 1) >= offsets.size())
+        {
+        return NULL;
+        }
+    return &characters[0] + offsets[_id];
+    }
+
+int WordInterner::wordLength(uint32_t _id) const
+    {
+    if ((_id + 1) >= offsets.size())
+        {
+        return 0;
+        }
+    return static_cast<int>(offsets[_id + 1] - offsets[_id]);
+    }
+
+uint32_t WordInterner::find(const QString& _word) const
+    {
+    uint32_t slot = 0;
+    return probe(_word.constData(), _word.length(), hashWord(_word.constData(), _word.length()), slot);
+    }
+
+int WordInterner::size() const
+    {
+    return static_cast<int>(offsets.size() - 2);
+    }
+
+uint64_t WordInterner::memoryUsage() const
+    {
+    uint64_t table = slotIds.capacity() * sizeof(uint32_t);
+    uint64_t ids = hashes.capacity() * sizeof(uint32_t);
+    uint64_t positions = offsets.capacity() * sizeof(uint32_t);
+    uint64_t pool = characters.capacity() * sizeof(QChar);
+    // growing any one of them briefly holds the old buffer and one twice its size
+    uint64_t growth = 2 * std::max(std::max(table, ids), std::max(positions, pool));
+    return table + ids + positions + pool + growth;
+    }
+
+void WordInterner::clear()
+    {
+    // fresh vectors, so the memory of a spilled table is actually given back
+    IdVector(INITIAL_WORD_SLOTS, 0).swap(slotIds);
+    // id 0 is reserved and has an empty word
+    IdVector(1, 0).swap(hashes);
+    IdVector(2, 0).swap(offsets);
+    std::vector<QChar, TableAllocator<QChar> >().swap(characters);
+    }
+
+void WordInterner::grow()
+    {
+    IdVector grown(slotIds.size() * 2, 0);
+    uint32_t mask = static_cast<uint32_t>(grown.size() - 1);
+    for (uint32_t id = 1; id < hashes.size(); ++id)
+        {
+        uint32_t slot = hashes[id] & mask;
+        while (grown[slot] != 0)
+            {
+            slot = (slot + 1) & mask;
+            }
+        grown[slot] = id;
+        }
+    slotIds.swap(grown);
+    }
+
+NgramTable::NgramTable()
+    {
+    clear();
+    }
+
+inline uint32_t NgramTable::home(NgramKey _key) const
+    {
+    return static_cast<uint32_t>((_key * KEY_MULTIPLIER) >> shift);
+    }
+
+void NgramTable::add(NgramKey _key, uint64_t _count)
+    {
+    uint32_t mask = static_cast<uint32_t>(table.size() - 1);
+    for (uint32_t slot = home(_key); ; slot = (slot + 1) & mask)
+        {
+        Entry& entry = table[slot];
+        if (entry.key == _key)
+            {
+            entry.count += _count;
+            return;
+            }
+        if (entry.key == 0)
+            {
+            entry.key = _key;
+            entry.count = _count;
+            ++used;
+            // keep the table at most 70% full
+            if ((static_cast<uint64_t>(used) * 10) >= (static_cast<uint64_t>(table.size()) * 7))
+                {
+                grow();
+                }
+            return;
+            }
+        }
+    }
+
+uint64_t NgramTable::value(NgramKey _key) const
+    {
+    uint32_t mask = static_cast<uint32_t>(table.size() - 1);
+    for (uint32_t slot = home(_key); ; slot = (slot + 1) & mask)
+        {
+        const Entry& entry = table[slot];
+        if (entry.key == _key)
+            {
+            return entry.count;
+            }
+        if (entry.key == 0)
+            {
+            return 0;
+            }
+        }
+    }
+
+int NgramTable::size() const
+    {
+    return static_cast<int>(used);
+    }
+
+const NgramTable::Entries& NgramTable::entries() const
+    {
+    return table;
+    }
+
+uint64_t NgramTable::memoryUsage() const
+    {
+    // grow() holds the slots and twice as many new ones at the same time
+    return 3 * table.capacity() * sizeof(Entry);
+    }
+
+void NgramTable::takeEntries(Entries& _entries)
+    {
+    _entries.clear();
+    _entries.swap(table);
+    clear();
+    }
+
+void NgramTable::clear()
+    {
+    shift = INITIAL_NGRAM_SHIFT;
+    Entry empty = { 0, 0 };
+    Entries(static_cast<size_t>(1) << (64 - shift), empty).swap(table);
+    used = 0;
+    }
+
+void NgramTable::grow()
+    {
+    Entries previous;
+    previous.swap(table);
+    --shift;
+    Entry empty = { 0, 0 };
+    table.assign(previous.size() * 2, empty);
+    uint32_t mask = static_cast<uint32_t>(table.size() - 1);
+    for (Entries::const_iterator iter = previous.begin(); iter != previous.end(); ++iter)
+        {
+        if (iter->key == 0)
+            {
+            continue;
+            }
+        uint32_t slot = home(iter->key);
+        while (table[slot].key != 0)
+            {
+            slot = (slot + 1) & mask;
+            }
+        table[slot] = *iter;
+        }
+    }
+
+NgramCount::NgramCount(int _order) : ngramOrder(_order), historyLength(0), wideKeys(false)
+    {
+    if (ngramOrder < 2)
+        {
+        ngramOrder = 2;
+        }
+    if (ngramOrder > MAX_NGRAM_ORDER)
+        {
+        ngramOrder = MAX_NGRAM_ORDER;
+        }
+    }
+
+int NgramCount::order() const
+    {
+    return ngramOrder;
+    }
+
+uint32_t NgramCount::maximumId(int _order)
+    {
+    return (_order == 2) ? 0xFFFFFFFFU : ((1U << 21) - 1);
+    }
+
+NgramKey NgramCount::pack(const uint32_t* _ids, int _order)
+    {
+    int bits = (_order == 2) ? 32 : 21;
+    NgramKey key = 0;
+    for (int i = 0; i < _order; ++i)
+        {
+        key = (key << bits) | _ids[i];
+        }
+    return key;
+    }
+
+void NgramCount::unpack(NgramKey _key, int _order, uint32_t* _ids)
+    {
+    int bits = (_order == 2) ? 32 : 21;
+    NgramKey mask = (static_cast<NgramKey>(1) << bits) - 1;
+    for (int i = _order - 1; i >= 0; --i)
+        {
+        _ids[i] = static_cast<uint32_t>(_key & mask);
+        _key >>= bits;
+        }
+    }
+
+void NgramCount::addToken(const QChar* _word, int _length, uint64_t _count)
+    {
+    uint32_t id = words.intern(_word, _length);
+
+    // slide the window along by one word
+    if (historyLength == ngramOrder)
+        {
+        for (int i = 1; i < ngramOrder; ++i)
+            {
+            history[i - 1] = history[i];
+            }
+        --historyLength;
+        }
+    history[historyLength++] = id;
+
+    if (historyLength == ngramOrder)
+        {
+        addPhrase(history, _count);
+        }
+    }
+
+void NgramCount::addPhrase(const uint32_t* _ids, uint64_t _count)
+    {
+    if (!wideKeys && ngramOrder == 3)
+        {
+        uint32_t limit = maximumId(ngramOrder);
+        if (_ids[0] > limit || _ids[1] > limit || _ids[2] > limit)
+            {
+            widen();
+            }
+        }
+    counts.add(phraseKey(_ids), _count);
+    }
+
+NgramKey NgramCount::phraseKey(const uint32_t* _ids)
+    {
+    if (!wideKeys)
+        {
+        return pack(_ids, ngramOrder);
+        }
+    NgramKey pairKey = pack(_ids, 2);
+    uint64_t pairId = pairs.value(pairKey);
+    if (pairId == 0)
+        {
+        pairId = pairKeys.size();
+        pairKeys.push_back(pairKey);
+        pairs.add(pairKey, pairId);
+        }
+    return (pairId << 32) | _ids[2];
+    }
+
+void NgramCount::phraseIds(NgramKey _key, uint32_t* _ids) const
+    {
+    keyIds(_key, ngramOrder, wideKeys ? &pairKeys : NULL, _ids);
+    }
+
+void NgramCount::widen()
+    {
+    // re-key the phrases counted so far once; a word pair id and a word id take 32 bits each
+    NgramTable::Entries entries;
+    counts.takeEntries(entries);
+    wideKeys = true;
+    pairKeys.assign(1, 0);
+    for (NgramTable::Entries::const_iterator iter = entries.begin(); iter != entries.end(); ++iter)
+        {
+        if (iter->key != 0)
+            {
+            uint32_t ids[MAX_NGRAM_ORDER];
+            unpack(iter->key, ngramOrder, ids);
+            counts.add(phraseKey(ids), iter->count);
+            }
+        }
+    }
+
+void NgramCount::endSequence()
+    {
+    historyLength = 0;
+    }
+
+void NgramCount::merge(const NgramCount& _other)
+    {
+    mergeCounts(_other, false);
+    }
+
+void NgramCount::mergeSquares(const NgramCount& _other)
+    {
+    mergeCounts(_other, true);
+    }
+
+void NgramCount::mergeCounts(const NgramCount& _other, bool _squared)
+    {
+    // a default constructed accumulator takes on the order of the first results it sees
+    if (counts.size() == 0 && words.size() == 0)
+        {
+        ngramOrder = _other.ngramOrder;
+        }
+
+    // translate the other object's word ids into ours once, rather than per phrase
+    std::vector<uint32_t> remap(_other.words.size() + 1, 0);
+    for (uint32_t id = 1; id < remap.size(); ++id)
+        {
+        remap[id] = words.intern(_other.words.word(id));
+        }
+
+    const NgramTable::Entries& entries = _other.counts.entries();
+    for (NgramTable::Entries::const_iterator iter = entries.begin(); iter != entries.end(); ++iter)
+        {
+        if (iter->key == 0)
+            {
+            continue;
+            }
+        uint32_t ids[MAX_NGRAM_ORDER];
+        _other.phraseIds(iter->key, ids);
+        for (int i = 0; i < ngramOrder; ++i)
+            {
+            ids[i] = remap[ids[i]];
+            }
+        addPhrase(ids, _squared ? iter->count * iter->count : iter->count);
+        }
+    }
+
+uint64_t NgramCount::count(const QString& _phrase) const
+    {
+    QStringList phraseWords = _phrase.split(' ');
+    if (phraseWords.size() != ngramOrder)
+        {
+        return 0;
+        }
+
+    uint32_t ids[MAX_NGRAM_ORDER];
+    for (int i = 0; i < ngramOrder; ++i)
+        {
+        ids[i] = words.find(phraseWords[i]);
+        if (ids[i] == 0)
+            {
+            return 0;
+            }
+        }
+    if (!wideKeys)
+        {
+        // a word past the packed range would have widened the keys had it been in a phrase
+        for (int i = 0; i < ngramOrder; ++i)
+            {
+            if (ids[i] > maximumId(ngramOrder))
+                {
+                return 0;
+                }
+            }
+        return counts.value(pack(ids, ngramOrder));
+        }
+    uint64_t pairId = pairs.value(pack(ids, 2));
+    return (pairId == 0) ? 0 : counts.value((pairId << 32) | ids[2]);
+    }
+
+int NgramCount::size() const
+    {
+    return counts.size();
+    }
+
+QString NgramCount::phrase(NgramKey _key) const
+    {
+    uint32_t ids[MAX_NGRAM_ORDER];
+    phraseIds(_key, ids);
+    QString result = words.word(ids[0]);
+    for (int i = 1; i < ngramOrder; ++i)
+        {
+        result += QChar(' ');
+        result += words.word(ids[i]);
+        }
+    return result;
+    }
+
+std::vector<PhraseCount> NgramCount::topPhrases(int _limit) const
+    {
+    // select on the packed keys and only build strings for the phrases reported
+    std::vector<NgramTable::Entry> used;
+    const NgramTable::Entries& entries = counts.entries();
+    for (NgramTable::Entries::const_iterator iter = entries.begin(); iter != entries.end(); ++iter)
+        {
+        if (iter->key != 0)
+            {
+            used.push_back(*iter);
+            }
+        }
+
+    size_t limit = std::min(used.size(), static_cast<size_t>(std::max(_limit, 0)));
+    std::partial_sort(used.begin(), used.begin() + limit, used.end(), higherCount);
+
+    std::vector<PhraseCount> result;
+    for (size_t i = 0; i < limit; ++i)
+        {
+        result.push_back(PhraseCount(used[i].count, phrase(used[i].key)));
+        }
+    return result;
+    }
+
+uint64_t NgramCount::memoryUsage() const
+    {
+    // the pair ids are only in use once the trigram keys have been widened
+    return words.memoryUsage() + counts.memoryUsage() + pairs.memoryUsage() + 3 * pairKeys.capacity() * sizeof(NgramKey);
+    }
+
+bool NgramCount::spillTo(RunWriter& _writer)
+    {
+    // sort the slots themselves rather than a copy of them; the table is emptied anyway
+    NgramTable::Entries entries;
+    counts.takeEntries(entries);
+    NgramTable::Entries::iterator used = entries.begin();
+    for (NgramTable::Entries::const_iterator iter = entries.begin(); iter != entries.end(); ++iter)
+        {
+        if (iter->key != 0)
+            {
+            *used++ = *iter;
+            }
+        }
+    entries.erase(used, entries.end());
+    std::sort(entries.begin(), entries.end(), PhraseOrder(words, ngramOrder, wideKeys ? &pairKeys : NULL));
+
+    for (NgramTable::Entries::const_iterator iter = entries.begin(); iter != entries.end(); ++iter)
+        {
+        uint32_t ids[MAX_NGRAM_ORDER];
+        phraseIds(iter->key, ids);
+        _writer.beginKey();
+        for (int i = 0; i < ngramOrder; ++i)
+            {
+            if (i > 0)
+                {
+                QChar space(' ');
+                _writer.appendKey(&space, 1);
+                }
+            _writer.appendKey(words.wordData(ids[i]), words.wordLength(ids[i]));
+            }
+        _writer.endKey(iter->count);
+        }
+
+    NgramTable::Entries().swap(entries);
+    clear();
+    return true;
+    }
+
+void NgramCount::clear()
+    {
+    // the ids of the phrase in progress are about to become invalid; keep its words
+    QString current[MAX_NGRAM_ORDER];
+    for (int i = 0; i < historyLength; ++i)
+        {
+        current[i] = words.word(history[i]);
+        }
+
+    words.clear();
+    counts.clear();
+    pairs.clear();
+    std::vector<NgramKey, TableAllocator<NgramKey> >().swap(pairKeys);
+    wideKeys = false;
+
+    for (int i = 0; i < historyLength; ++i)
+        {
+        history[i] = words.intern(current[i]);
+        }
+    }
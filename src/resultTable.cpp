@@ -0,0 +1,535 @@
+#include <resultTable.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <limits>
+
+#include <QtGlobal>
+#include <qtconcurrentmap.h>
+
+#include <QAtomicInt>
+#include <QCoreApplication>
+#include <QThreadPool>
+
+namespace
+    {
+    //! size of the write buffer
+    const int TABLE_BUFFER_SIZE = 1 << 20;
+    //! tables smaller than this are sorted on the calling thread
+    const size_t PARALLEL_SORT_THRESHOLD = 1 << 16;
+    //! bits of the count sorted by each pass
+    const int RADIX_BITS = 8;
+    const size_t RADIX_BUCKETS = 1 << RADIX_BITS;
+    //! most runs open at once when merging by count
+    const int TABLE_MERGE_FAN_IN = 64;
+
+    //! one thread's slice of a radix sort pass
+    struct SortSlice
+        {
+        const RankedKey* source;
+        RankedKey* destination;
+        size_t begin;
+        size_t end;
+        int shift;
+        //! digits counted, then where the next row with each digit goes
+        size_t buckets[RADIX_BUCKETS];
+        };
+
+    //! digit of a count for a pass; inverted, so larger counts come first
+    inline size_t countDigit(uint64_t _count, int _shift)
+        {
+        return (RADIX_BUCKETS - 1) - static_cast<size_t>((_count >> _shift) & (RADIX_BUCKETS - 1));
+        }
+
+    void countDigits(SortSlice& _slice)
+        {
+        memset(_slice.buckets, 0, sizeof(_slice.buckets));
+        for (size_t i = _slice.begin; i < _slice.end; ++i)
+            {
+            ++_slice.buckets[countDigit(_slice.source[i].count, _slice.shift)];
+            }
+        }
+
+    void scatterDigits(SortSlice& _slice)
+        {
+        for (size_t i = _slice.begin; i < _slice.end; ++i)
+            {
+            _slice.destination[_slice.buckets[countDigit(_slice.source[i].count, _slice.shift)]++] = _slice.source[i];
+            }
+        }
+
+    bool higherCount(const RankedKey& _left, const RankedKey& _right)
+        {
+        return _left.count > _right.count;
+        }
+
+    //! a run in the merge by count
+    struct CountCursor
+        {
+        RunReader* reader;
+        //! position of the run; later runs hold later keys
+        int run;
+        };
+
+    //! the highest count is on top, and of equal counts the later run, so the later key comes first as in a single sort
+    bool lowerRank(const CountCursor& _left, const CountCursor& _right)
+        {
+        if (_left.reader->count() != _right.reader->count())
+            {
+            return _left.reader->count() < _right.reader->count();
+            }
+        return _left.run < _right.run;
+        }
+
+    //! merge runs that are each in count order into one stream in count order
+    bool mergeByCount(const QStringList& _runs, RunConsumer& _consumer)
+        {
+        std::vector<RunReader> readers(_runs.size());
+        std::vector<CountCursor> heap;
+        for (int i = 0; i < _runs.size(); ++i)
+            {
+            if (!readers[i].open(_runs[i]))
+                {
+                return false;
+                }
+            if (readers[i].next())
+                {
+                CountCursor cursor = { &readers[i], i };
+                heap.push_back(cursor);
+                }
+            else if (readers[i].failed())
+                {
+                return false;
+                }
+            }
+        std::make_heap(heap.begin(), heap.end(), lowerRank);
+
+        while (!heap.empty())
+            {
+            std::pop_heap(heap.begin(), heap.end(), lowerRank);
+            RunReader* reader = heap.back().reader;
+            _consumer.add(reader->key(), reader->count());
+            if (reader->next())
+                {
+                std::push_heap(heap.begin(), heap.end(), lowerRank);
+                }
+            else
+                {
+                heap.pop_back();
+                if (reader->failed())
+                    {
+                    return false;
+                    }
+                }
+            }
+        return true;
+        }
+
+    //! a new run file for the rows of a table
+    QString tableRunName(const QString& _directory)
+        {
+        static QAtomicInt sequence(0);
+        return QString("%1/simpleFileIndexer-%2-table-%3.run").arg(_directory).arg(QCoreApplication::applicationPid())
+            .arg(sequence.fetchAndAddOrdered(1));
+        }
+
+    void appendDecimal(QByteArray& _buffer, uint64_t _value)
+        {
+        char digits[20];
+        int length = 0;
+        do
+            {
+            digits[length++] = static_cast<char>('0' + (_value % 10));
+            _value /= 10;
+            }
+        while (_value > 0);
+        std::reverse(digits, digits + length);
+        _buffer.append(digits, length);
+        }
+
+    //! CSV field, quoted only if it holds a separator, a quote or a line break
+    void appendCsv(QByteArray& _buffer, const char* _text, int _length)
+        {
+        bool quote = false;
+        for (int i = 0; i < _length && !quote; ++i)
+            {
+            quote = (_text[i] == ',' || _text[i] == '"' || _text[i] == '\n' || _text[i] == '\r');
+            }
+        if (!quote)
+            {
+            _buffer.append(_text, _length);
+            return;
+            }
+        _buffer.append('"');
+        for (int i = 0; i < _length; ++i)
+            {
+            if (_text[i] == '"')
+                {
+                _buffer.append('"');
+                }
+            _buffer.append(_text[i]);
+            }
+        _buffer.append('"');
+        }
+
+    //! TSV field; a tab, line break or backslash is written as its escape
+    void appendTsv(QByteArray& _buffer, const char* _text, int _length)
+        {
+        int start = 0;
+        for (int i = 0; i < _length; ++i)
+            {
+            const char* escape = NULL;
+            switch (_text[i])
+                {
+                case '\t':  escape = "\\t";     break;
+                case '\n':  escape = "\\n";     break;
+                case '\r':  escape = "\\r";     break;
+                case '\\':  escape = "\\\\";    break;
+                default:                        break;
+                }
+            if (escape != NULL)
+                {
+                _buffer.append(_text + start, i - start);
+                _buffer.append(escape, 2);
+                start = i + 1;
+                }
+            }
+        _buffer.append(_text + start, _length - start);
+        }
+
+    //! JSON string contents; the keys are already UTF-8
+    void appendJson(QByteArray& _buffer, const char* _text, int _length)
+        {
+        int start = 0;
+        for (int i = 0; i < _length; ++i)
+            {
+            unsigned char byte = static_cast<unsigned char>(_text[i]);
+            if (byte >= 0x20 && byte != '"' && byte != '\\')
+                {
+                continue;
+                }
+            _buffer.append(_text + start, i - start);
+            if (byte == '"' || byte == '\\')
+                {
+                _buffer.append('\\');
+                _buffer.append(static_cast<char>(byte));
+                }
+            else
+                {
+                char escape[8];
+                snprintf(escape, sizeof(escape), "\\u%04x", byte);
+                _buffer.append(escape, 6);
+                }
+            start = i + 1;
+            }
+        _buffer.append(_text + start, _length - start);
+        }
+    }
+
+void sortByCount(std::vector<RankedKey, TableAllocator<RankedKey> >& _rows)
+    {
+    size_t size = _rows.size();
+    if (size < PARALLEL_SORT_THRESHOLD)
+        {
+        std::stable_sort(_rows.begin(), _rows.end(), higherCount);
+        return;
+        }
+
+    uint64_t largest = 0;
+    for (size_t i = 0; i < size; ++i)
+        {
+        largest = std::max(largest, _rows[i].count);
+        }
+
+    int threads = qMax(1, QThreadPool::globalInstance()->maxThreadCount());
+    std::vector<SortSlice> slices(threads);
+    std::vector<RankedKey, TableAllocator<RankedKey> > scratch(size);
+    RankedKey* source = &_rows[0];
+    RankedKey* destination = &scratch[0];
+
+    // most counts are small, so usually only the low bytes need a pass
+    for (int shift = 0; shift < 64 && (largest >> shift) != 0; shift += RADIX_BITS)
+        {
+        for (int i = 0; i < threads; ++i)
+            {
+            slices[i].source = source;
+            slices[i].destination = destination;
+            slices[i].begin = (size * i) / threads;
+            slices[i].end = (size * (i + 1)) / threads;
+            slices[i].shift = shift;
+            }
+        QtConcurrent::blockingMap(slices, countDigits);
+
+        // each slice places its rows of a digit after those of the slices
+        // before it, which keeps the sort stable
+        size_t position = 0;
+        for (size_t bucket = 0; bucket < RADIX_BUCKETS; ++bucket)
+            {
+            for (int i = 0; i < threads; ++i)
+                {
+                size_t rows = slices[i].buckets[bucket];
+                slices[i].buckets[bucket] = position;
+                position += rows;
+                }
+            }
+        QtConcurrent::blockingMap(slices, scatterDigits);
+        std::swap(source, destination);
+        }
+    if (source != &_rows[0])
+        {
+        _rows.swap(scratch);
+        }
+    }
+
+class TableExport::RowWriter : public RunConsumer
+    {
+    public:
+        explicit RowWriter(TableExport& _table) : table(_table)
+            {
+            }
+        void add(const QByteArray& _key, uint64_t _count)
+            {
+            table.writeRow(_key.constData(), _key.size(), _count);
+            }
+    private:
+        TableExport& table;
+    };
+
+TableExport::TableExport() : format(TABLE_CSV), order(TABLE_BY_COUNT), rowCount(0), rowsWritten(0), failed(false), memoryLimit(0)
+    {
+    }
+
+TableExport::~TableExport()
+    {
+    if (output.isOpen())
+        {
+        close();
+        }
+    }
+
+void TableExport::setSortSpill(const QString& _scratchDirectory, uint64_t _memoryLimit)
+    {
+    scratchDirectory = _scratchDirectory;
+    memoryLimit = _memoryLimit;
+    }
+
+bool TableExport::open(const QString& _fileName, TableFormat _format, TableOrder _order, int _ngramOrder)
+    {
+    if (_fileName.isEmpty())
+        {
+        // anything already sent to stdout goes first
+        fflush(stdout);
+        failed = !output.open(stdout, QIODevice::WriteOnly);
+        }
+    else
+        {
+        output.setFileName(_fileName);
+        failed = !output.open(QIODevice::WriteOnly|QIODevice::Truncate);
+        }
+    format = _format;
+    order = _order;
+    keyName = (_ngramOrder > 1) ? "phrase" : "word";
+    rowCount = 0;
+    rowsWritten = 0;
+    keys.clear();
+    keyOffsets.assign(1, 0);
+    ranked.clear();
+
+    buffer.clear();
+    buffer.reserve(TABLE_BUFFER_SIZE + 4096);
+    switch (format)
+        {
+        case TABLE_JSON:    buffer.append("[");                                     break;
+        case TABLE_TSV:     buffer.append(keyName).append("\tcount\n");            break;
+        default:            buffer.append(keyName).append(",count\n");             break;
+        }
+    return !failed;
+    }
+
+void TableExport::add(const QByteArray& _key, uint64_t _count)
+    {
+    if (order == TABLE_BY_KEY)
+        {
+        writeRow(_key.constData(), _key.size(), _count);
+        ++rowCount;
+        return;
+        }
+    if (failed)
+        {
+        return;
+        }
+    if (ranked.size() >= std::numeric_limits<uint32_t>::max())
+        {
+        // more rows than a RankedKey can refer to
+        if (scratchDirectory.isEmpty())
+            {
+            failed = true;
+            return;
+            }
+        spillHeld();
+        }
+    keys.insert(keys.end(), _key.constData(), _key.constData() + _key.size());
+    keyOffsets.push_back(keys.size());
+    RankedKey row = { _count, static_cast<uint32_t>(ranked.size()) };
+    ranked.push_back(row);
+    ++rowCount;
+
+    if (memoryLimit > 0 && !scratchDirectory.isEmpty() && heldBytes() > memoryLimit)
+        {
+        spillHeld();
+        }
+    }
+
+uint64_t TableExport::heldBytes() const
+    {
+    // the sort needs a second copy of the rows
+    return keys.capacity() + keyOffsets.capacity() * sizeof(uint64_t) + (ranked.capacity() + ranked.size()) * sizeof(RankedKey);
+    }
+
+void TableExport::writeHeld()
+    {
+    // the keys arrived in ascending order; reversed, the stable sort
+    // leaves equal counts with the later key first
+    std::reverse(ranked.begin(), ranked.end());
+    sortByCount(ranked);
+    for (std::vector<RankedKey, TableAllocator<RankedKey> >::const_iterator iter = ranked.begin(); iter != ranked.end(); ++iter)
+        {
+        uint64_t start = keyOffsets[iter->key];
+        writeRow(keys.data() + start, static_cast<int>(keyOffsets[iter->key + 1] - start), iter->count);
+        }
+    }
+
+void TableExport::spillHeld()
+    {
+    QString fileName = tableRunName(scratchDirectory);
+    // listed first, so close() removes it even if it was only partly written
+    sortedRuns << fileName;
+
+    std::reverse(ranked.begin(), ranked.end());
+    sortByCount(ranked);
+    RunWriter writer;
+    if (writer.open(fileName))
+        {
+        for (std::vector<RankedKey, TableAllocator<RankedKey> >::const_iterator iter = ranked.begin(); iter != ranked.end(); ++iter)
+            {
+            uint64_t start = keyOffsets[iter->key];
+            writer.add(keys.data() + start, static_cast<int>(keyOffsets[iter->key + 1] - start), iter->count);
+            }
+        failed = !writer.close();
+        }
+    else
+        {
+        failed = true;
+        }
+
+    // a fresh vector gives the memory back
+    std::vector<char, TableAllocator<char> >().swap(keys);
+    std::vector<uint64_t, TableAllocator<uint64_t> >(1, 0).swap(keyOffsets);
+    std::vector<RankedKey, TableAllocator<RankedKey> >().swap(ranked);
+    }
+
+void TableExport::mergeSpilled()
+    {
+    // too many runs to open at once; merging neighbouring runs keeps every
+    // run after the previous in key order, so ties still break the same way
+    QStringList current = sortedRuns;
+    while (!failed && current.size() > TABLE_MERGE_FAN_IN)
+        {
+        QStringList next;
+        for (int first = 0; !failed && first < current.size(); first += TABLE_MERGE_FAN_IN)
+            {
+            QString fileName = tableRunName(scratchDirectory);
+            sortedRuns << fileName;
+            next << fileName;
+            RunWriter writer;
+            bool merged = writer.open(fileName) && mergeByCount(current.mid(first, TABLE_MERGE_FAN_IN), writer);
+            failed = !(writer.close() && merged);
+            }
+        current = next;
+        }
+
+    RowWriter rows(*this);
+    failed = failed || !mergeByCount(current, rows);
+    }
+
+void TableExport::writeRow(const char* _key, int _length, uint64_t _count)
+    {
+    switch (format)
+        {
+        case TABLE_JSON:
+            buffer.append((rowsWritten == 0) ? "\n{\"" : ",\n{\"");
+            buffer.append(keyName);
+            buffer.append("\":\"");
+            appendJson(buffer, _key, _length);
+            buffer.append("\",\"count\":");
+            appendDecimal(buffer, _count);
+            buffer.append('}');
+            break;
+        case TABLE_TSV:
+            appendTsv(buffer, _key, _length);
+            buffer.append('\t');
+            appendDecimal(buffer, _count);
+            buffer.append('\n');
+            break;
+        default:
+            appendCsv(buffer, _key, _length);
+            buffer.append(',');
+            appendDecimal(buffer, _count);
+            buffer.append('\n');
+            break;
+        }
+    ++rowsWritten;
+    if (buffer.size() >= TABLE_BUFFER_SIZE)
+        {
+        flush();
+        }
+    }
+
+void TableExport::flush()
+    {
+    if (!failed && buffer.size() > 0)
+        {
+        failed = (output.write(buffer) != buffer.size());
+        }
+    buffer.resize(0);
+    }
+
+bool TableExport::close()
+    {
+    if (order == TABLE_BY_COUNT && !failed && sortedRuns.isEmpty())
+        {
+        writeHeld();
+        }
+    else if (order == TABLE_BY_COUNT && !failed)
+        {
+        // the rest joins the runs, which are merged by count
+        if (!ranked.empty())
+            {
+            spillHeld();
+            }
+        mergeSpilled();
+        }
+    std::vector<char, TableAllocator<char> >().swap(keys);
+    std::vector<uint64_t, TableAllocator<uint64_t> >().swap(keyOffsets);
+    std::vector<RankedKey, TableAllocator<RankedKey> >().swap(ranked);
+    for (QStringList::const_iterator iter = sortedRuns.constBegin(); iter != sortedRuns.constEnd(); ++iter)
+        {
+        QFile::remove(*iter);
+        }
+    sortedRuns.clear();
+
+    if (format == TABLE_JSON)
+        {
+        buffer.append("\n]\n");
+        }
+    flush();
+    output.close();
+    return !failed;
+    }
+
+uint64_t TableExport::rows() const
+    {
+    return rowCount;
+    }
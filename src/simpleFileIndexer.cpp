@@ -0,0 +1,114 @@
+#include <simpleFileIndexer.h>
+
+#include <QtGlobal>
+#include <qtconcurrentmap.h>
+#include <qtconcurrentrun.h>
+
+#include <threadAccumulators.h>
+#include <wordTally.h>
+
+namespace
+    {
+    // the asynchronous calls run on a copy of the indexer, so the caller's
+    // object does not have to outlive the future
+
+    IndexResult indexFilesTask(SimpleFileIndexer _indexer, QStringList _files)
+        {
+        return _indexer.indexFiles(_files);
+        }
+
+    void indexFilesCallbackTask(SimpleFileIndexer _indexer, QStringList _files, SimpleFileIndexer::ResultCallback _callback)
+        {
+        _callback(_indexer.indexFiles(_files));
+        }
+
+    IndexResult indexBufferTask(SimpleFileIndexer _indexer, QString _text)
+        {
+        return _indexer.indexBuffer(_text);
+        }
+
+    void indexBufferCallbackTask(SimpleFileIndexer _indexer, QString _text, SimpleFileIndexer::ResultCallback _callback)
+        {
+        _callback(_indexer.indexBuffer(_text));
+        }
+    }
+
+IndexResult::IndexResult(int _order) : ngramOrder(_order), phrases(qMax(_order, 2))
+    {
+    }
+
+SimpleFileIndexer::SimpleFileIndexer(const IndexerOptions& _options, int _topCount) :
+    matcher(_options.matcher), stopwords(_options.stopwords), ngramOrder(_options.ngramOrder), dedupContent(_options.dedupContent),
+    topCount(_topCount)
+    {
+    }
+
+void SimpleFileIndexer::setFileLog(const FileLog& _log)
+    {
+    fileLog = _log;
+    }
+
+IndexResult SimpleFileIndexer::indexFiles(const QStringList& _files) const
+    {
+    IndexResult result(ngramOrder);
+
+    // each distinct file is only read once; copies are counted by weight
+    QList<IndexInput> inputs = deduplicateInputs(_files, dedupContent, result.dedup);
+
+    // the accumulators belong to this call alone, so calls may overlap
+    if (ngramOrder > 1)
+        {
+        ThreadAccumulators<NgramCount> accumulators((NgramCount(ngramOrder)));
+        QtConcurrent::blockingMap(inputs, AccumulatingMapper<NgramCount>(accumulators, matcher, stopwords, NULL, NULL, NULL, fileLog));
+        result.phrases = mergeAccumulators(accumulators, ngramOrder);
+        result.top = result.phrases.topPhrases(topCount);
+        }
+    else
+        {
+        ThreadAccumulators<WordTally> accumulators;
+        QtConcurrent::blockingMap(inputs, AccumulatingMapper<WordTally>(accumulators, matcher, stopwords, NULL, NULL, NULL, fileLog));
+        result.words = mergeAccumulators(accumulators);
+        result.top = topWords(result.words, topCount);
+        }
+    return result;
+    }
+
+IndexResult SimpleFileIndexer::indexBuffer(const QString& _text) const
+    {
+    IndexResult result(ngramOrder);
+
+    // the buffer is consumed by the scan, and is the whole input so its last word is complete
+    QString buffer(_text);
+    if (ngramOrder > 1)
+        {
+        processBuffer(QString("<buffer>"), buffer, true, result.phrases, matcher, stopwords, fileLog);
+        result.phrases.endSequence();
+        result.top = result.phrases.topPhrases(topCount);
+        }
+    else
+        {
+        processBuffer(QString("<buffer>"), buffer, true, result.words, matcher, stopwords, fileLog);
+        result.top = topWords(result.words, topCount);
+        }
+    return result;
+    }
+
+QFuture<IndexResult> SimpleFileIndexer::indexFilesAsync(const QStringList& _files) const
+    {
+    return QtConcurrent::run(indexFilesTask, *this, _files);
+    }
+
+QFuture<void> SimpleFileIndexer::indexFilesAsync(const QStringList& _files, const ResultCallback& _callback) const
+    {
+    return QtConcurrent::run(indexFilesCallbackTask, *this, _files, _callback);
+    }
+
+QFuture<IndexResult> SimpleFileIndexer::indexBufferAsync(const QString& _text) const
+    {
+    return QtConcurrent::run(indexBufferTask, *this, _text);
+    }
+
+QFuture<void> SimpleFileIndexer::indexBufferAsync(const QString& _text, const ResultCallback& _callback) const
+    {
+    return QtConcurrent::run(indexBufferCallbackTask, *this, _text, _callback);
+    }
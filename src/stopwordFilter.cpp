@@ -0,0 +1,240 @@
+#include <stopwordFilter.h>
+
+#include <algorithm>
+#include <map>
+
+#include <QFile>
+
+namespace
+    {
+    /*! \brief Built-in Stopwords
+     *
+     *  Common English function words. Contractions are listed as the pieces the
+     *  default token pattern splits them into (f.e "don't" -> "don", "t").
+     */
+    const char* const BUILTIN_STOPWORDS[] =
+        {
+        "a", "about", "above", "after", "again", "against", "all", "am", "an", "and",
+        "any", "are", "as", "at", "be", "because", "been", "before", "being", "below",
+        "between", "both", "but", "by", "can", "could", "d", "did", "do", "does",
+        "doing", "don", "down", "during", "each", "few", "for", "from", "further", "had",
+        "has", "have", "having", "he", "her", "here", "hers", "herself", "him", "himself",
+        "his", "how", "i", "if", "in", "into", "is", "it", "its", "itself",
+        "just", "ll", "m", "me", "more", "most", "my", "myself", "no", "nor",
+        "not", "now", "o", "of", "off", "on", "once", "only", "or", "other",
+        "our", "ours", "ourselves", "out", "over", "own", "re", "s", "same", "she",
+        "should", "so", "some", "such", "t", "than", "that", "the", "their", "theirs",
+        "them", "themselves", "then", "there", "these", "they", "this", "those", "through", "to",
+        "too", "under", "until", "up", "ve", "very", "was", "we", "were", "what",
+        "when", "where", "which", "while", "who", "whom", "why", "will", "with", "would",
+        "you", "your", "yours", "yourself", "yourselves"
+        };
+
+    // hash and displace search limits
+    const uint32_t MAX_DISPLACEMENT = 65536;
+    const int MAX_TABLE_GROWTH = 4;
+
+    uint32_t nextPowerOfTwo(uint32_t _value)
+        {
+        uint32_t power = 1;
+        while (power < _value)
+            {
+            power <<= 1;
+            }
+        return power;
+        }
+
+    //! order buckets largest first; they are the hardest to place
+    bool largerBucket(const std::vector<int>* _left, const std::vector<int>* _right)
+        {
+        return _left->size() > _right->size();
+        }
+    }
+
+StopwordFilter::StopwordFilter() : bucketMask(0), slotMask(0), minimumLength(1), maximumLength(0), wordCount(0)
+    {
+    }
+
+bool StopwordFilter::build(const QStringList& _words)
+    {
+    // unify the words the same way addWord() does, dropping duplicates
+    std::map<QString, int> unique;
+    for (QStringList::const_iterator iter = _words.constBegin(); iter != _words.constEnd(); ++iter)
+        {
+        QString word = (*iter).toLower();
+        if (!word.isEmpty() && word.length() <= 0xFFFF)
+            {
+            unique.insert(std::make_pair(word, 0));
+            }
+        }
+
+    std::vector<QString> words;
+    std::vector<uint64_t> hashes;
+    for (std::map<QString, int>::const_iterator iter = unique.begin(); iter != unique.end(); ++iter)
+        {
+        words.push_back(iter->first);
+        hashes.push_back(hashWord(iter->first.constData(), iter->first.length()));
+        }
+
+    // start over with an empty filter so a failed build never matches anything
+    *this = StopwordFilter();
+    if (words.empty())
+        {
+        return true;
+        }
+
+    uint32_t bucketTotal = nextPowerOfTwo(static_cast<uint32_t>((words.size() + 3) / 4));
+    uint32_t slotTotal = nextPowerOfTwo(static_cast<uint32_t>(words.size() * 2));
+    for (int growth = 0; growth < MAX_TABLE_GROWTH; ++growth, slotTotal <<= 1)
+        {
+        std::vector<std::vector<int> > buckets(bucketTotal);
+        for (size_t word = 0; word < words.size(); ++word)
+            {
+            buckets[static_cast<uint32_t>(hashes[word] >> 40) & (bucketTotal - 1)].push_back(static_cast<int>(word));
+            }
+        std::vector<const std::vector<int>*> order;
+        for (size_t bucket = 0; bucket < buckets.size(); ++bucket)
+            {
+            order.push_back(&buckets[bucket]);
+            }
+        std::stable_sort(order.begin(), order.end(), largerBucket);
+
+        std::vector<uint32_t> bucketDisplacement(bucketTotal, 0);
+        std::vector<int> slotWord(slotTotal, -1);
+        bool placed_all = true;
+        for (size_t index = 0; index < order.size() && placed_all; ++index)
+            {
+            const std::vector<int>& bucket = *order[index];
+            if (bucket.empty())
+                {
+                break;
+                }
+
+            // find a displacement that puts every word of the bucket in a distinct free slot
+            bool placed = false;
+            for (uint32_t displacement = 0; displacement < MAX_DISPLACEMENT && !placed; ++displacement)
+                {
+                std::vector<uint32_t> bucketSlots;
+                placed = true;
+                for (std::vector<int>::const_iterator word = bucket.begin(); word != bucket.end(); ++word)
+                    {
+                    uint64_t hash = hashes[*word];
+                    uint32_t stride = static_cast<uint32_t>(hash >> 20) | 1;
+                    uint32_t slot = (static_cast<uint32_t>(hash) + displacement * stride) & (slotTotal - 1);
+                    if (slotWord[slot] != -1 || std::find(bucketSlots.begin(), bucketSlots.end(), slot) != bucketSlots.end())
+                        {
+                        placed = false;
+                        break;
+                        }
+                    bucketSlots.push_back(slot);
+                    }
+                if (placed)
+                    {
+                    for (size_t word = 0; word < bucket.size(); ++word)
+                        {
+                        slotWord[bucketSlots[word]] = bucket[word];
+                        }
+                    bucketDisplacement[static_cast<uint32_t>(hashes[bucket[0]] >> 40) & (bucketTotal - 1)] = displacement;
+                    }
+                }
+            placed_all = placed;
+            }
+
+        if (!placed_all)
+            {
+            // too crowded; retry with a larger table
+            continue;
+            }
+
+        displacements.swap(bucketDisplacement);
+        bucketMask = bucketTotal - 1;
+        slotMask = slotTotal - 1;
+        slotOffsets.assign(slotTotal, 0);
+        slotLengths.assign(slotTotal, 0);
+        minimumLength = 0xFFFF;
+        maximumLength = 0;
+        for (uint32_t slot = 0; slot < slotTotal; ++slot)
+            {
+            if (slotWord[slot] == -1)
+                {
+                continue;
+                }
+            const QString& word = words[slotWord[slot]];
+            slotOffsets[slot] = static_cast<uint32_t>(characters.size());
+            slotLengths[slot] = static_cast<uint16_t>(word.length());
+            characters.insert(characters.end(), word.constData(), word.constData() + word.length());
+            minimumLength = std::min(minimumLength, word.length());
+            maximumLength = std::max(maximumLength, word.length());
+            }
+        wordCount = static_cast<int>(words.size());
+        return true;
+        }
+    return false;
+    }
+
+bool StopwordFilter::isEmpty() const
+    {
+    return wordCount == 0;
+    }
+
+int StopwordFilter::size() const
+    {
+    return wordCount;
+    }
+
+bool StopwordFilter::contains(const QString& _word) const
+    {
+    return contains(_word.constData(), _word.length());
+    }
+
+QStringList StopwordFilter::builtinWords()
+    {
+    QStringList words;
+    for (size_t i = 0; i < (sizeof(BUILTIN_STOPWORDS) / sizeof(BUILTIN_STOPWORDS[0])); ++i)
+        {
+        words << QString(BUILTIN_STOPWORDS[i]);
+        }
+    return words;
+    }
+
+bool StopwordFilter::readWordFile(const QString& _fileName, QStringList& _words)
+    {
+    QFile wordFile(_fileName);
+    if (wordFile.open(QIODevice::ReadOnly|QIODevice::Text) == false)
+        {
+        return false;
+        }
+
+    QString data = QString::fromLatin1(wordFile.readAll());
+    QString word;
+    bool comment = false;
+    for (int i = 0; i <= data.length(); ++i)
+        {
+        QChar c = (i < data.length()) ? data[i] : QChar('\n');
+        if (c == QChar('#'))
+            {
+            comment = true;
+            }
+        if (comment || c.isSpace())
+            {
+            if (!word.isEmpty())
+                {
+                _words << word;
+                word.clear();
+                }
+            if (c == QChar('\n'))
+                {
+                comment = false;
+                }
+            continue;
+            }
+        word += c;
+        }
+    return true;
+    }
+
+const StopwordFilter& StopwordFilter::none()
+    {
+    static const StopwordFilter filter;
+    return filter;
+    }
@@ -0,0 +1,103 @@
+#ifndef SCRATCH_DIRECTORY_H__
+#define SCRATCH_DIRECTORY_H__
+
+#include <QByteArray>
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QString>
+#include <QStringList>
+
+/*! \brief Test Scratch Directory
+ *
+ *  Temporary directory the files of a test case are written to. Each test
+ *  function's files are removed by clear(), from cleanup(), and the
+ *  directory itself by remove(), from cleanupTestCase().
+ */
+class ScratchDirectory
+    {
+    public:
+        /*! \brief Create the Directory
+         *
+         *  \param _testName - name of the test; the process id is added so
+         *      concurrent runs do not share it
+         *
+         *  \return true if the directory exists
+         */
+        bool create(const QString& _testName)
+            {
+            directory = QString("%1/%2-%3").arg(QDir::tempPath()).arg(_testName).arg(QCoreApplication::applicationPid());
+            return QDir().mkpath(directory);
+            }
+
+        /*! \brief Location
+         *
+         *  \return the directory
+         */
+        QString path() const
+            {
+            return directory;
+            }
+
+        /*! \brief Name a File
+         *
+         *  \param _name - file name within the directory
+         *
+         *  \return the path of the file, which clear() removes
+         */
+        QString fileName(const QString& _name)
+            {
+            QString name = QString("%1/%2").arg(directory).arg(_name);
+            created << name;
+            return name;
+            }
+
+        /*! \brief Write a File
+         *
+         *  \param _name - file name within the directory
+         *  \param _contents - what the file holds
+         *
+         *  \return the path of the file, which clear() removes
+         */
+        QString writeFile(const QString& _name, const QByteArray& _contents)
+            {
+            QString name = fileName(_name);
+            QFile output(name);
+            if (output.open(QIODevice::WriteOnly|QIODevice::Truncate))
+                {
+                output.write(_contents);
+                }
+            return name;
+            }
+
+        /*! \brief Remove the Files
+         *
+         *  Remove every file named so far
+         */
+        void clear()
+            {
+            for (QStringList::const_iterator iter = created.constBegin(); iter != created.constEnd(); ++iter)
+                {
+                QFile::remove(*iter);
+                }
+            created.clear();
+            }
+
+        /*! \brief Remove the Directory
+         *
+         *  Removes the remaining files and then the directory
+         */
+        void remove()
+            {
+            clear();
+            QDir().rmdir(directory);
+            }
+
+    private:
+        //! the directory
+        QString directory;
+        //! files to remove
+        QStringList created;
+    };
+
+#endif //SCRATCH_DIRECTORY_H__
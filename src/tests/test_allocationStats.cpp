@@ -0,0 +1,360 @@
+#include <QtTest/QtTest>
+#include <QFile>
+#include <QString>
+#include <QStringList>
+#include <QtGlobal>
+#include <qtconcurrentmap.h>
+#include <qtconcurrentrun.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include <allocationStats.h>
+#include <fileIndexer.h>
+#include <indexerOptions.h>
+#include <threadAccumulators.h>
+#include <wordTally.h>
+
+#include "scratchDirectory.h"
+
+// This test is always built with ALLOCATION_STATS defined. The ceilings in
+// the *_budget tests are the allocation counts of the fixed workload - per
+// read, per word and per distinct word, as worked out next to each check -
+// plus a margin of a few dozen allocations at most; a change that raises
+// them past that fails here, and should either be fixed or raise the ceiling
+// on purpose.
+
+namespace
+    {
+    // the allocations are made in these functions so that the checks, which
+    // allocate too, are outside of the stage being checked
+
+    //! stage totals of the allocations made since the last reset
+    AllocationCounts counts(AllocationStage _stage)
+        {
+        return allocationReport().stages[_stage];
+        }
+
+    void allocateBlocks(std::vector<void*>& _blocks, size_t _bytes)
+        {
+        AllocationStageScope reading(STAGE_READ);
+        for (size_t i = 0; i < _blocks.size(); ++i)
+            {
+            _blocks[i] = malloc(_bytes);
+            memset(_blocks[i], 1, _bytes);
+            }
+        }
+
+    void releaseBlocks(std::vector<void*>& _blocks)
+        {
+        AllocationStageScope tokenizing(STAGE_TOKENIZE);
+        _blocks[0] = realloc(_blocks[0], 50000);
+        memset(_blocks[0], 2, 50000);
+        for (size_t i = 0; i < _blocks.size(); ++i)
+            {
+            free(_blocks[i]);
+            }
+        char* volatile characters = new char[300];
+        memset(characters, 3, 300);
+        delete[] characters;
+        }
+
+    void allocateAndRelease(size_t _bytes)
+        {
+        // volatile, so the compiler cannot drop the pair
+        void* volatile block = malloc(_bytes);
+        free(block);
+        }
+
+    void allocateFinal()
+        {
+        AllocationStageScope finalizing(STAGE_FINALIZE);
+        allocateAndRelease(10);
+        }
+
+    void allocateNested()
+        {
+        AllocationStageScope reducing(STAGE_REDUCE);
+        allocateAndRelease(10);
+        allocateFinal();
+        allocateAndRelease(10);
+        }
+
+    void allocateInThread()
+        {
+        AllocationStageScope counting(STAGE_COUNT);
+        for (int i = 0; i < 10; ++i)
+            {
+            allocateAndRelease(64);
+            }
+        }
+
+    void* mapTable(size_t _bytes)
+        {
+        AllocationStageScope counting(STAGE_COUNT);
+        return allocateTable(_bytes);
+        }
+
+    void unmapTable(void* _table, size_t _bytes)
+        {
+        AllocationStageScope counting(STAGE_COUNT);
+        releaseTable(_table, _bytes);
+        }
+    }
+
+class TestAllocationStats: public QObject
+    {
+    Q_OBJECT
+    public:
+        TestAllocationStats();
+        ~TestAllocationStats();
+    private slots:
+        void initTestCase();
+        void cleanupTestCase();
+        void init();
+        void cleanup();
+
+        // actual tests
+        void test_counts();
+        void test_nesting();
+        void test_threads();
+        void test_mapped();
+        void test_read_budget();
+        void test_tally_budget();
+        void test_word_count_budget();
+        void test_reduce_budget();
+        void test_options();
+
+    private:
+        ScratchDirectory scratch;
+        QString corpus;
+        //! words in the corpus
+        int tokens;
+        //! distinct words in the corpus
+        int distinct;
+        //! bytes in the corpus
+        qint64 corpusSize;
+    };
+TestAllocationStats::TestAllocationStats() : QObject(NULL), tokens(0), distinct(0), corpusSize(0)
+    {
+    }
+TestAllocationStats::~TestAllocationStats()
+    {
+    }
+void TestAllocationStats::initTestCase()
+    {
+    QVERIFY(scratch.create("test_allocationStats") == true);
+
+    // 200000 words over 1000 distinct ones, ten to a line
+    tokens = 200000;
+    distinct = 1000;
+    corpus = scratch.fileName("corpus.txt");
+    QFile file(corpus);
+    QVERIFY(file.open(QIODevice::WriteOnly) == true);
+    QByteArray text;
+    uint64_t state = 4711;
+    for (int i = 0; i < tokens; ++i)
+        {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        text.append("Word").append(QByteArray::number(static_cast<int>((state >> 33) % distinct), 36));
+        text.append(((i % 10) == 9) ? '\n' : ' ');
+        }
+    QVERIFY(file.write(text) == text.size());
+    file.close();
+    corpusSize = text.size();
+    }
+void TestAllocationStats::cleanupTestCase()
+    {
+    scratch.remove();
+    }
+void TestAllocationStats::init()
+    {
+    resetAllocationStats();
+    }
+void TestAllocationStats::cleanup()
+    {
+    }
+void TestAllocationStats::test_counts()
+    {
+    if (!allocationStatsEnabled())
+        {
+        QSKIP("the counting allocator needs glibc", SkipAll);
+        }
+    int64_t liveBefore = allocationReport().liveBytes;
+
+    std::vector<void*> blocks(100, static_cast<void*>(NULL));
+    allocateBlocks(blocks, 1000);
+    AllocationCounts read = counts(STAGE_READ);
+    QVERIFY(read.allocations == 100);
+    QVERIFY(read.frees == 0);
+    QVERIFY(read.bytes >= 100000);
+    QVERIFY(read.bytes < 110000);
+    QVERIFY(allocationReport().liveBytes - liveBefore >= 100000);
+    QVERIFY(allocationReport().stagePeaks[STAGE_READ] >= static_cast<uint64_t>(liveBefore + 100000));
+
+    // a reallocation is a free and an allocation, operator new is malloc underneath
+    releaseBlocks(blocks);
+    AllocationCounts tokenize = counts(STAGE_TOKENIZE);
+    QVERIFY(tokenize.allocations == 2);
+    QVERIFY(tokenize.frees == 102);
+    QVERIFY(tokenize.bytes >= 50300);
+    QVERIFY(allocationReport().liveBytes - liveBefore < 1000);
+    QVERIFY(counts(STAGE_READ).allocations == 100);
+
+    resetAllocationStats();
+    QVERIFY(counts(STAGE_READ).allocations == 0);
+    QVERIFY(counts(STAGE_TOKENIZE).frees == 0);
+    }
+void TestAllocationStats::test_nesting()
+    {
+    if (!allocationStatsEnabled())
+        {
+        QSKIP("the counting allocator needs glibc", SkipAll);
+        }
+    allocateNested();
+    QVERIFY(counts(STAGE_FINALIZE).allocations == 1);
+    QVERIFY(counts(STAGE_REDUCE).allocations == 2);
+    QVERIFY(counts(STAGE_REDUCE).frees == 2);
+    QVERIFY(QString(allocationStageName(STAGE_TOKENIZE)) == "tokenize");
+    QVERIFY(QString(allocationStageName(STAGE_OTHER)) == "other");
+    }
+void TestAllocationStats::test_threads()
+    {
+    if (!allocationStatsEnabled())
+        {
+        QSKIP("the counting allocator needs glibc", SkipAll);
+        }
+    allocateInThread();
+    QtConcurrent::run(allocateInThread).waitForFinished();
+
+    // both threads counted their own, each with at least the ten blocks
+    AllocationReport report = allocationReport();
+    int busy = 0;
+    for (std::vector<ThreadAllocations>::const_iterator iter = report.threads.begin(); iter != report.threads.end(); ++iter)
+        {
+        if (iter->stages[STAGE_COUNT].allocations >= 10)
+            {
+            ++busy;
+            }
+        }
+    QVERIFY(busy == 2);
+    QVERIFY(report.stages[STAGE_COUNT].allocations >= 20);
+    }
+void TestAllocationStats::test_mapped()
+    {
+    if (!allocationStatsEnabled())
+        {
+        QSKIP("the counting allocator needs glibc", SkipAll);
+        }
+    int64_t liveBefore = allocationReport().liveBytes;
+    void* table = mapTable(HUGE_TABLE_THRESHOLD * 2);
+    QVERIFY(allocationReport().liveBytes - liveBefore >= static_cast<int64_t>(HUGE_TABLE_THRESHOLD * 2));
+    unmapTable(table, HUGE_TABLE_THRESHOLD * 2);
+    QVERIFY(counts(STAGE_COUNT).allocations == 1);
+    QVERIFY(counts(STAGE_COUNT).bytes >= HUGE_TABLE_THRESHOLD * 2);
+    QVERIFY(counts(STAGE_COUNT).frees == 1);
+    QVERIFY(allocationReport().liveBytes == liveBefore);
+    }
+void TestAllocationStats::test_read_budget()
+    {
+    if (!allocationStatsEnabled())
+        {
+        QSKIP("the counting allocator needs glibc", SkipAll);
+        }
+    WordTally tally;
+    indexFileInto(corpus, tally);
+    QVERIFY(tally.size() == distinct);
+
+    // a read is one string for the new text and, when a word was carried
+    // over from the previous read, one more to join them; opening the file
+    // takes a few more, all within the margin of 16. Scanning allocates nothing.
+    qint64 reads = corpusSize / 32767 + 2;
+    AllocationCounts read = counts(STAGE_READ);
+    AllocationCounts tokenize = counts(STAGE_TOKENIZE);
+    QVERIFY(read.allocations > 0);
+    QVERIFY(read.allocations <= static_cast<uint64_t>(reads * 2 + 16));
+    QVERIFY(tokenize.allocations == 0);
+    }
+void TestAllocationStats::test_tally_budget()
+    {
+    if (!allocationStatsEnabled())
+        {
+        QSKIP("the counting allocator needs glibc", SkipAll);
+        }
+    WordTally tally;
+    indexFileInto(corpus, tally);
+    QVERIFY(tally.count(QString("word0")) > 0);
+
+    // counting a word seen before neither allocates nor builds a string; only
+    // the tables of the tally grow, a few dozen times for 1000 distinct words
+    AllocationCounts count = counts(STAGE_COUNT);
+    QVERIFY(count.allocations <= 100);
+    QVERIFY(count.allocations * 1000 < static_cast<uint64_t>(tokens));
+
+    // a second pass over the same words allocates nothing to count them
+    resetAllocationStats();
+    indexFileInto(corpus, tally);
+    QVERIFY(counts(STAGE_COUNT).allocations == 0);
+    }
+void TestAllocationStats::test_word_count_budget()
+    {
+    if (!allocationStatsEnabled())
+        {
+        QSKIP("the counting allocator needs glibc", SkipAll);
+        }
+    QFile file(corpus);
+    QVERIFY(file.open(QIODevice::ReadOnly) == true);
+    QString buffer = QString::fromLatin1(file.readAll());
+    file.close();
+    resetAllocationStats();
+
+    // the QMap form builds the word and its lowercase copy for every word,
+    // and a map node, with its key, for each distinct one; margin of 16
+    WordCount results;
+    processBuffer(corpus, buffer, true, results);
+    QVERIFY(results.size() == distinct);
+    AllocationCounts count = counts(STAGE_COUNT);
+    QVERIFY(count.allocations <= static_cast<uint64_t>(tokens) * 2 + static_cast<uint64_t>(distinct) * 2 + 16);
+    QVERIFY(counts(STAGE_TOKENIZE).allocations == 0);
+    }
+void TestAllocationStats::test_reduce_budget()
+    {
+    if (!allocationStatsEnabled())
+        {
+        QSKIP("the counting allocator needs glibc", SkipAll);
+        }
+    // a tally per worker, each with most of the words
+    ThreadAccumulators<WordTally> accumulators;
+    QStringList files;
+    files << corpus << corpus << corpus << corpus;
+    QtConcurrent::blockingMap(files, AccumulatingMapper<WordTally>(accumulators, TokenMatcher::defaultMatcher(), StopwordFilter::none()));
+    resetAllocationStats();
+    WordCount results = mergeAccumulators(accumulators);
+    QVERIFY(results.size() == distinct);
+
+    // every tally folded into the largest turns its words into strings once;
+    // the tallies share their words, so nothing grows. Then a string and a
+    // map node, with its key, per distinct word; margin of 16. Nothing per
+    // word counted.
+    uint64_t folded = static_cast<uint64_t>(accumulators.size() - 1);
+    AllocationCounts reduce = counts(STAGE_REDUCE);
+    QVERIFY(reduce.allocations > 0);
+    QVERIFY(reduce.allocations <= (folded + 3) * static_cast<uint64_t>(distinct) + 16);
+    }
+void TestAllocationStats::test_options()
+    {
+    QString error;
+    IndexerOptions defaults;
+    QVERIFY(defaults.allocationStats == false);
+
+    IndexerOptions options;
+    bool parsed = parseIndexerOptions(QStringList() << "--stats" << "file.txt", options, error);
+    QVERIFY(parsed == allocationStatsEnabled());
+    QVERIFY(options.allocationStats == allocationStatsEnabled());
+    QVERIFY(error.isEmpty() == allocationStatsEnabled());
+    }
+
+QTEST_MAIN(TestAllocationStats)
+#include "test_allocationStats.moc"
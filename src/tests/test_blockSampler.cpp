@@ -0,0 +1,432 @@
+#include <QtTest/QtTest>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QString>
+#include <QStringList>
+#include <qtconcurrentmap.h>
+
+#include <math.h>
+#include <stdint.h>
+#include <set>
+#include <vector>
+
+#include <blockSampler.h>
+#include <fileIndexer.h>
+#include <indexerOptions.h>
+#include <inputDedup.h>
+#include <threadAccumulators.h>
+#include <wordTally.h>
+
+#include "scratchDirectory.h"
+
+class TestBlockSampler: public QObject
+    {
+    Q_OBJECT
+    public:
+        TestBlockSampler();
+        ~TestBlockSampler();
+    private slots:
+        void initTestCase();
+        void cleanupTestCase();
+        void init();
+        void cleanup();
+
+        // actual tests
+        void test_plan();
+        void test_seed();
+        void test_block_edges();
+        void test_phrase_edges();
+        void test_pattern_edges();
+        void test_sample_tally();
+        void test_estimate();
+        void test_deadline();
+        void test_sampled_run();
+        void test_options();
+
+    private:
+        static QByteArray text(int _words);
+        static QList<IndexInput> inputs(const QStringList& _files);
+
+        ScratchDirectory scratch;
+    };
+TestBlockSampler::TestBlockSampler() : QObject(NULL)
+    {
+    }
+TestBlockSampler::~TestBlockSampler()
+    {
+    }
+void TestBlockSampler::initTestCase()
+    {
+    QVERIFY(scratch.create("test_blockSampler") == true);
+    }
+void TestBlockSampler::cleanupTestCase()
+    {
+    scratch.remove();
+    }
+void TestBlockSampler::init()
+    {
+    }
+void TestBlockSampler::cleanup()
+    {
+    scratch.clear();
+    }
+QByteArray TestBlockSampler::text(int _words)
+    {
+    // words of different lengths and a few stopword-like gaps, so block edges fall everywhere
+    const char* words[] = { "the", "cat", "sat", "on", "a", "mat", "with", "another", "extraordinarily", "cat" };
+    const char* gaps[] = { " ", "  ", "\n", ", ", ". " };
+    QByteArray contents;
+    uint32_t state = 4711;
+    for (int i = 0; i < _words; ++i)
+        {
+        state = state * 1103515245 + 12345;
+        contents += words[(state >> 8) % 10];
+        contents += gaps[(state >> 16) % 5];
+        }
+    return contents;
+    }
+QList<IndexInput> TestBlockSampler::inputs(const QStringList& _files)
+    {
+    DedupStats stats;
+    return deduplicateInputs(_files, false, stats);
+    }
+void TestBlockSampler::test_plan()
+    {
+    QString big = scratch.writeFile("big.txt", QByteArray(10 * SAMPLE_BLOCK_SIZE - 100, 'x'));
+    QString small = scratch.writeFile("small.txt", QByteArray(10, 'y'));
+    QString empty = scratch.writeFile("empty.txt", QByteArray());
+
+    BlockSampler sampler;
+    sampler.plan(inputs(QStringList() << big << empty << small), 0.25, 42, 4);
+    QVERIFY(sampler.inputs().size() == 2);
+    QVERIFY(sampler.totalBlocks() == 11);
+    QVERIFY(sampler.totalBytes() == static_cast<uint64_t>(10 * SAMPLE_BLOCK_SIZE - 90));
+    QVERIFY(sampler.plannedBlocks() == 3);
+
+    // the batches cover the sampling order once, in order
+    uint64_t next = 0;
+    for (std::vector<SampleBatch>::const_iterator iter = sampler.batches().begin(); iter != sampler.batches().end(); ++iter)
+        {
+        QVERIFY(iter->begin == next);
+        QVERIFY(iter->end > iter->begin);
+        next = iter->end;
+        }
+    QVERIFY(next == 3);
+
+    // every block is read at most once, and the short ones are where the files end
+    BlockSampler everything;
+    everything.plan(inputs(QStringList() << big << small), 1.0, 42, 4);
+    QVERIFY(everything.plannedBlocks() == 11);
+    std::set<std::pair<int, qint64> > seen;
+    for (uint64_t position = 0; position < everything.plannedBlocks(); ++position)
+        {
+        SampleBlock block = everything.block(position);
+        QVERIFY(seen.insert(std::make_pair(block.input, block.offset)).second == true);
+        if (block.input == 1)
+            {
+            QVERIFY(block.offset == 0);
+            QVERIFY(block.length == 10);
+            }
+        else if (block.offset == 9 * SAMPLE_BLOCK_SIZE)
+            {
+            QVERIFY(block.length == SAMPLE_BLOCK_SIZE - 100);
+            }
+        else
+            {
+            QVERIFY(block.length == SAMPLE_BLOCK_SIZE);
+            }
+        }
+    }
+void TestBlockSampler::test_seed()
+    {
+    QString big = scratch.writeFile("big.txt", QByteArray(200 * SAMPLE_BLOCK_SIZE, 'x'));
+    BlockSampler first;
+    BlockSampler second;
+    BlockSampler other;
+    first.plan(inputs(QStringList() << big), 0.1, 7, 2);
+    second.plan(inputs(QStringList() << big), 0.1, 7, 2);
+    other.plan(inputs(QStringList() << big), 0.1, 8, 2);
+    QVERIFY(first.plannedBlocks() == 20);
+    bool same = true;
+    bool differs = false;
+    for (uint64_t position = 0; position < first.plannedBlocks(); ++position)
+        {
+        same = same && (first.block(position).offset == second.block(position).offset);
+        differs = differs || (first.block(position).offset != other.block(position).offset);
+        }
+    QVERIFY(same == true);
+    QVERIFY(differs == true);
+    }
+void TestBlockSampler::test_block_edges()
+    {
+    // counting every block, however small, gives the counts of the whole file
+    QByteArray contents = text(2000);
+    QString name = scratch.writeFile("words.txt", contents);
+    WordCount expected = indexFile(name);
+
+    const qint64 lengths[] = { 1, 5, 7, 64, 1000 };
+    for (int i = 0; i < 5; ++i)
+        {
+        WordTally blocks;
+        for (qint64 offset = 0; offset < contents.size(); offset += lengths[i])
+            {
+            indexBlockInto(name, offset, qMin(lengths[i], contents.size() - offset), blocks);
+            }
+        QVERIFY(blocks.size() == expected.size());
+        for (WordCount::const_iterator iter = expected.constBegin(); iter != expected.constEnd(); ++iter)
+            {
+            QVERIFY(blocks.count(iter.key()) == iter.value());
+            }
+        }
+
+    // a block starting inside a word leaves it to the block before
+    QString single = scratch.writeFile("single.txt", QByteArray("extraordinarily cat"));
+    WordTally middle;
+    indexBlockInto(single, 3, 10, middle);
+    QVERIFY(middle.size() == 0);
+    WordTally end;
+    indexBlockInto(single, 10, 9, end);
+    QVERIFY(end.size() == 1);
+    QVERIFY(end.count(QString("cat")) == 1);
+    }
+void TestBlockSampler::test_phrase_edges()
+    {
+    QByteArray contents = text(2000);
+    QString name = scratch.writeFile("phrases.txt", contents);
+    StopwordFilter stopwords;
+    QVERIFY(stopwords.build(QStringList() << "a") == true);
+
+    for (int order = 2; order <= 3; ++order)
+        {
+        NgramCount expected = indexFileNgrams(name, order, TokenMatcher::defaultMatcher(), stopwords);
+        NgramCount blocks(order);
+        for (qint64 offset = 0; offset < contents.size(); offset += 11)
+            {
+            indexBlockInto(name, offset, qMin(static_cast<qint64>(11), contents.size() - offset), blocks, TokenMatcher::defaultMatcher(), stopwords);
+            }
+        QVERIFY(blocks.size() == expected.size());
+        std::vector<PhraseCount> top = expected.topPhrases(expected.size());
+        for (std::vector<PhraseCount>::const_iterator iter = top.begin(); iter != top.end(); ++iter)
+            {
+            QVERIFY(blocks.count(iter->second) == iter->first);
+            }
+        }
+    }
+void TestBlockSampler::test_pattern_edges()
+    {
+    // tokens that hold a separator are split the way a full pass splits them
+    QByteArray contents;
+    for (int i = 0; i < 300; ++i)
+        {
+        contents += (i % 3 == 0) ? "ab-cd-ef " : "xy-z q ";
+        }
+    QString name = scratch.writeFile("hyphens.txt", contents);
+    TokenMatcher matcher("[a-z]+(-[a-z]+)*");
+    QVERIFY(matcher.isValid() == true);
+    QVERIFY(matcher.separates(' ') == true);
+    QVERIFY(matcher.separates('-') == false);
+    QVERIFY(matcher.separates('a') == false);
+    WordCount expected = indexFile(name, matcher);
+    QVERIFY(expected.value("ab-cd-ef") == 100);
+    QVERIFY(expected.contains("cd") == false);
+
+    const qint64 lengths[] = { 1, 4, 7, 64 };
+    for (int i = 0; i < 4; ++i)
+        {
+        WordTally blocks;
+        for (qint64 offset = 0; offset < contents.size(); offset += lengths[i])
+            {
+            indexBlockInto(name, offset, qMin(lengths[i], contents.size() - offset), blocks, matcher);
+            }
+        QVERIFY(blocks.size() == expected.size());
+        for (WordCount::const_iterator iter = expected.constBegin(); iter != expected.constEnd(); ++iter)
+            {
+            QVERIFY(blocks.count(iter.key()) == iter.value());
+            }
+        }
+
+    // a block starting at "cd" further into the file leaves "ab-cd-ef" to the block before
+    qint64 middle = contents.indexOf("ab-cd-ef", 2000) + 3;
+    WordTally inside;
+    indexBlockInto(name, middle, 5, inside, matcher);
+    QVERIFY(inside.size() == 0);
+    }
+void TestBlockSampler::test_sample_tally()
+    {
+    SampleTally<WordTally> tally;
+    tally.block.add("cat", 2);
+    tally.block.add("dog", 1);
+    tally.blockDone();
+    QVERIFY(tally.block.size() == 0);
+    tally.block.add("cat", 3);
+    tally.blockDone();
+    QVERIFY(tally.counts.count(QString("cat")) == 5);
+    QVERIFY(tally.squares.count(QString("cat")) == 13);
+    QVERIFY(tally.squares.count(QString("dog")) == 1);
+
+    SampleTally<NgramCount> phrases(NgramCount(2));
+    QString words[] = { "big", "cat", "big", "cat" };
+    for (int i = 0; i < 4; ++i)
+        {
+        phrases.block.addToken(words[i].constData(), words[i].length());
+        }
+    phrases.blockDone();
+    QVERIFY(phrases.counts.count("big cat") == 2);
+    QVERIFY(phrases.squares.count("big cat") == 4);
+    QVERIFY(phrases.squares.count("cat big") == 1);
+    }
+void TestBlockSampler::test_estimate()
+    {
+    QString big = scratch.writeFile("big.txt", QByteArray(10 * SAMPLE_BLOCK_SIZE - 100, 'x'));
+    BlockSampler sampler;
+    sampler.plan(inputs(QStringList() << big), 0.5, 1, 1);
+    sampler.start(0);
+
+    // nothing read yet
+    SampleEstimate none = sampler.estimate(0, 0);
+    QVERIFY(none.count == 0);
+    QVERIFY(none.margin < 0.0);
+
+    // one block gives a count but no spread
+    sampler.blockRead(SAMPLE_BLOCK_SIZE);
+    SampleEstimate one = sampler.estimate(4, 16);
+    QVERIFY(one.count == 40);
+    QVERIFY(one.margin < 0.0);
+
+    // 4 of 10 blocks with counts summing to 20 and their squares to 110:
+    // a per-block variance of 10/3, with 60% of the blocks unread
+    for (int i = 0; i < 3; ++i)
+        {
+        sampler.blockRead(SAMPLE_BLOCK_SIZE);
+        }
+    SampleEstimate four = sampler.estimate(20, 110);
+    QVERIFY(four.count == 50);
+    QVERIFY(fabs(four.margin - 1.96 * 10.0 * sqrt(0.5)) < 1e-9);
+
+    // the same counts in every block leave no doubt
+    SampleEstimate even = sampler.estimate(20, 100);
+    QVERIFY(even.margin == 0.0);
+
+    // once every block is read the count is exact
+    for (int i = 0; i < 6; ++i)
+        {
+        sampler.blockRead(SAMPLE_BLOCK_SIZE);
+        }
+    SampleEstimate all = sampler.estimate(37, 500);
+    QVERIFY(all.count == 37);
+    QVERIFY(all.margin == 0.0);
+    }
+void TestBlockSampler::test_deadline()
+    {
+    QString big = scratch.writeFile("big.txt", QByteArray(4 * SAMPLE_BLOCK_SIZE, 'x'));
+    BlockSampler sampler;
+    sampler.plan(inputs(QStringList() << big), 1.0, 1, 1);
+
+    sampler.start(0);
+    QVERIFY(sampler.expired() == false);
+
+    sampler.start(0.01);
+    QElapsedTimer timer;
+    timer.start();
+    while (!sampler.expired() && timer.elapsed() < 5000)
+        {
+        }
+    QVERIFY(sampler.expired() == true);
+    QVERIFY(sampler.stoppedEarly() == true);
+    QVERIFY(sampler.blocksRead() == 0);
+
+    // the budget covers the planning; spent before it, no blocks are chosen
+    BlockSampler late;
+    late.start(0.01);
+    timer.restart();
+    while (!late.expired() && timer.elapsed() < 5000)
+        {
+        }
+    late.plan(inputs(QStringList() << big), 1.0, 1, 1);
+    QVERIFY(late.totalBlocks() == 4);
+    QVERIFY(late.plannedBlocks() == 0);
+    QVERIFY(late.batches().empty() == true);
+    QVERIFY(late.stoppedEarly() == true);
+    }
+void TestBlockSampler::test_sampled_run()
+    {
+    QStringList files;
+    WordTally expected;
+    for (int i = 0; i < 6; ++i)
+        {
+        QByteArray contents = text(20000 + 3000 * i);
+        files << scratch.writeFile(QString("file%1.txt").arg(i), contents);
+        indexFileInto(files.back(), expected);
+        }
+
+    // every block, read by several workers, gives the exact counts
+    BlockSampler sampler;
+    sampler.plan(inputs(files), 1.0, 3, 4);
+    QVERIFY(sampler.totalBlocks() > 6);
+    sampler.start(0);
+    ThreadAccumulators<SampleTally<WordTally> > accumulators;
+    QtConcurrent::blockingMap(sampler.batches(), SamplingMapper<WordTally>(accumulators, sampler, TokenMatcher::defaultMatcher(), StopwordFilter::none()));
+    QVERIFY(sampler.blocksRead() == sampler.totalBlocks());
+    QVERIFY(sampler.bytesRead() == sampler.totalBytes());
+    for (int i = 1; i < accumulators.size(); ++i)
+        {
+        accumulators.at(0).merge(accumulators.at(i));
+        }
+    const WordTally& counts = accumulators.at(0).counts;
+    QVERIFY(counts.size() == expected.size());
+    for (uint32_t id = 1; id <= static_cast<uint32_t>(expected.size()); ++id)
+        {
+        QVERIFY(counts.count(expected.word(id)) == expected.count(id));
+        }
+
+    // half of the blocks estimate the counts within their margins
+    BlockSampler half;
+    half.plan(inputs(files), 0.5, 3, 4);
+    half.start(0);
+    ThreadAccumulators<SampleTally<WordTally> > sampled;
+    QtConcurrent::blockingMap(half.batches(), SamplingMapper<WordTally>(sampled, half, TokenMatcher::defaultMatcher(), StopwordFilter::none()));
+    QVERIFY(half.blocksRead() == half.plannedBlocks());
+    for (int i = 1; i < sampled.size(); ++i)
+        {
+        sampled.at(0).merge(sampled.at(i));
+        }
+    SampleEstimate cat = half.estimate(sampled.at(0).counts.count(QString("cat")), sampled.at(0).squares.count(QString("cat")));
+    QVERIFY(cat.margin > 0.0);
+    QVERIFY(fabs(static_cast<double>(cat.count) - static_cast<double>(expected.count(QString("cat")))) <= 2.0 * cat.margin);
+    }
+void TestBlockSampler::test_options()
+    {
+    QString error;
+    IndexerOptions defaults;
+    QVERIFY(defaults.sampleRate == 1.0);
+    QVERIFY(defaults.timeBudget == 0.0);
+    QVERIFY(defaults.sampleSeed == 0);
+
+    IndexerOptions rate;
+    QVERIFY(parseIndexerOptions(QStringList() << "--sample-rate=0.05" << "--sample-seed" << "9" << "file.txt", rate, error) == true);
+    QVERIFY(fabs(rate.sampleRate - 0.05) < 1e-12);
+    QVERIFY(rate.sampleSeed == 9);
+    QVERIFY(rate.files == QStringList() << "file.txt");
+
+    IndexerOptions percent;
+    QVERIFY(parseIndexerOptions(QStringList() << "--sample-rate=2.5%" << "--time-budget=1.5" << "file.txt", percent, error) == true);
+    QVERIFY(fabs(percent.sampleRate - 0.025) < 1e-12);
+    QVERIFY(percent.timeBudget == 1.5);
+
+    IndexerOptions bad;
+    QVERIFY(parseIndexerOptions(QStringList() << "--sample-rate=0" << "file.txt", bad, error) == false);
+    QVERIFY(parseIndexerOptions(QStringList() << "--sample-rate=150%" << "file.txt", bad, error) == false);
+    QVERIFY(parseIndexerOptions(QStringList() << "--time-budget=-1" << "file.txt", bad, error) == false);
+    QVERIFY(parseIndexerOptions(QStringList() << "--sample-seed=0" << "file.txt", bad, error) == false);
+
+    // a sample cannot feed the outputs that promise exact counts
+    error.clear();
+    IndexerOptions partial;
+    QVERIFY(parseIndexerOptions(QStringList() << "--time-budget=5" << "--emit-partial=x.sfi" << "file.txt", partial, error) == false);
+    QVERIFY(error.isEmpty() == false);
+    IndexerOptions table;
+    QVERIFY(parseIndexerOptions(QStringList() << "--output=csv" << "--sample-rate=1%" << "file.txt", table, error) == false);
+    }
+
+QTEST_MAIN(TestBlockSampler)
+#include "test_blockSampler.moc"
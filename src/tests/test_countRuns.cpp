@@ -0,0 +1,517 @@
+#include <QtTest/QtTest>
+#include <QDir>
+#include <QFile>
+#include <QList>
+#include <QPair>
+#include <QStringList>
+#include <QtGlobal>
+
+#include <limits>
+
+#include <countRuns.h>
+#include <fileIndexer.h>
+
+#include "scratchDirectory.h"
+
+namespace
+    {
+    //! keeps every merged record
+    class CollectRecords : public RunConsumer
+        {
+        public:
+            void add(const QByteArray& _key, uint64_t _count)
+                {
+                records.append(qMakePair(_key, _count));
+                }
+            QList< QPair<QByteArray, uint64_t> > records;
+        };
+    }
+
+class TestCountRuns: public QObject
+    {
+    Q_OBJECT
+    public:
+        TestCountRuns();
+        ~TestCountRuns();
+    private slots:
+        void initTestCase();
+        void cleanupTestCase();
+        void init();
+        void cleanup();
+
+        // actual tests
+        void test_round_trip();
+        void test_merge();
+        void test_multi_pass_merge();
+        void test_top_counts();
+        void test_corrupt_runs();
+        void test_word_spill_order();
+        void test_phrase_spill_order();
+        void test_spilled_indexing();
+        void test_spill_releases_memory();
+        void test_failed_spill();
+        void test_partial_results();
+        void test_merge_outputs();
+
+    private:
+        QString writeRun(const QString& _name, const QList< QPair<QByteArray, uint64_t> >& _records);
+        QList< QPair<QByteArray, uint64_t> > readRun(const QString& _name);
+
+        ScratchDirectory scratch;
+    };
+TestCountRuns::TestCountRuns() : QObject(NULL)
+    {
+    }
+TestCountRuns::~TestCountRuns()
+    {
+    }
+void TestCountRuns::initTestCase()
+    {
+    QVERIFY(scratch.create("test_countRuns") == true);
+    }
+void TestCountRuns::cleanupTestCase()
+    {
+    scratch.remove();
+    }
+void TestCountRuns::init()
+    {
+    }
+void TestCountRuns::cleanup()
+    {
+    scratch.clear();
+    }
+QString TestCountRuns::writeRun(const QString& _name, const QList< QPair<QByteArray, uint64_t> >& _records)
+    {
+    QString name = scratch.fileName(_name);
+    RunWriter writer;
+    if (writer.open(name))
+        {
+        for (int i = 0; i < _records.size(); ++i)
+            {
+            writer.add(_records[i].first, _records[i].second);
+            }
+        writer.close();
+        }
+    return name;
+    }
+QList< QPair<QByteArray, uint64_t> > TestCountRuns::readRun(const QString& _name)
+    {
+    QList< QPair<QByteArray, uint64_t> > records;
+    RunReader reader;
+    if (reader.open(_name))
+        {
+        while (reader.next())
+            {
+            records.append(qMakePair(reader.key(), reader.count()));
+            }
+        }
+    return records;
+    }
+void TestCountRuns::test_round_trip()
+    {
+    QList< QPair<QByteArray, uint64_t> > records;
+    records.append(qMakePair(QByteArray("a"), Q_UINT64_C(1)));
+    records.append(qMakePair(QByteArray("ab"), Q_UINT64_C(300)));
+    records.append(qMakePair(QByteArray("abc"), Q_UINT64_C(1) << 40));
+    records.append(qMakePair(QByteArray("b"), Q_UINT64_C(7)));
+    records.append(qMakePair(QString::fromUtf8("\xc3\xa9t\xc3\xa9").toUtf8(), Q_UINT64_C(2)));
+
+    QString name = scratch.fileName("round.run");
+    RunWriter writer;
+    QVERIFY(writer.open(name) == true);
+    for (int i = 0; i < records.size(); ++i)
+        {
+        writer.add(records[i].first, records[i].second);
+        }
+    QVERIFY(writer.close() == true);
+    QVERIFY(writer.records() == 5);
+
+    QVERIFY(readRun(name) == records);
+
+    // an empty run is still a valid run
+    QString empty = writeRun("empty.run", QList< QPair<QByteArray, uint64_t> >());
+    RunReader reader;
+    QVERIFY(reader.open(empty) == true);
+    QVERIFY(reader.next() == false);
+    QVERIFY(reader.failed() == false);
+    }
+void TestCountRuns::test_merge()
+    {
+    QList< QPair<QByteArray, uint64_t> > first;
+    first.append(qMakePair(QByteArray("apple"), Q_UINT64_C(1)));
+    first.append(qMakePair(QByteArray("cherry"), Q_UINT64_C(2)));
+    QList< QPair<QByteArray, uint64_t> > second;
+    second.append(qMakePair(QByteArray("banana"), Q_UINT64_C(3)));
+    second.append(qMakePair(QByteArray("cherry"), Q_UINT64_C(4)));
+    second.append(qMakePair(QByteArray("date"), Q_UINT64_C(5)));
+    QList< QPair<QByteArray, uint64_t> > third;
+    third.append(qMakePair(QByteArray("apple"), Q_UINT64_C(10)));
+
+    QStringList runs;
+    runs << writeRun("first.run", first) << writeRun("second.run", second) << writeRun("third.run", third);
+
+    CollectRecords merged;
+    QString error;
+    QVERIFY(mergeRuns(runs, merged, error) == true);
+    QVERIFY(merged.records.size() == 4);
+    QVERIFY(merged.records[0] == qMakePair(QByteArray("apple"), Q_UINT64_C(11)));
+    QVERIFY(merged.records[1] == qMakePair(QByteArray("banana"), Q_UINT64_C(3)));
+    QVERIFY(merged.records[2] == qMakePair(QByteArray("cherry"), Q_UINT64_C(6)));
+    QVERIFY(merged.records[3] == qMakePair(QByteArray("date"), Q_UINT64_C(5)));
+    }
+void TestCountRuns::test_multi_pass_merge()
+    {
+    // more runs than are merged at once, so intermediate runs are needed
+    const int RUN_COUNT = 130;
+    QStringList runs;
+    for (int i = 0; i < RUN_COUNT; ++i)
+        {
+        QList< QPair<QByteArray, uint64_t> > records;
+        records.append(qMakePair(QString("key%1").arg(i, 3, 10, QChar('0')).toUtf8(), static_cast<uint64_t>(i + 1)));
+        records.append(qMakePair(QByteArray("shared"), Q_UINT64_C(1)));
+        runs << writeRun(QString("pass%1.run").arg(i), records);
+        }
+
+    CollectRecords merged;
+    QString error;
+    QVERIFY(mergeRuns(runs, merged, error, scratch.path()) == true);
+    QVERIFY(merged.records.size() == (RUN_COUNT + 1));
+    for (int i = 0; i < RUN_COUNT; ++i)
+        {
+        QVERIFY(merged.records[i].first == QString("key%1").arg(i, 3, 10, QChar('0')).toUtf8());
+        QVERIFY(merged.records[i].second == static_cast<uint64_t>(i + 1));
+        }
+    QVERIFY(merged.records[RUN_COUNT] == qMakePair(QByteArray("shared"), static_cast<uint64_t>(RUN_COUNT)));
+
+    // the intermediate runs are cleaned up; only the inputs are left
+    for (int i = 0; i < RUN_COUNT; ++i)
+        {
+        QVERIFY(QFile::exists(runs[i]) == true);
+        }
+    }
+void TestCountRuns::test_top_counts()
+    {
+    TopCounts top(3);
+    top.add("alpha", 5);
+    top.add("beta", 9);
+    top.add("delta", 5);
+    top.add("gamma", 1);
+    top.add("omega", 5);
+    QVERIFY(top.distinct() == 5);
+
+    // ties are listed later keys first, as the in-memory listing does
+    std::vector<PhraseCount> result = top.top();
+    QVERIFY(result.size() == 3);
+    QVERIFY(result[0] == PhraseCount(9, "beta"));
+    QVERIFY(result[1] == PhraseCount(5, "omega"));
+    QVERIFY(result[2] == PhraseCount(5, "delta"));
+
+    TopCounts none(10);
+    QVERIFY(none.top().empty() == true);
+    }
+void TestCountRuns::test_corrupt_runs()
+    {
+    // not a run file at all
+    QString bogus = scratch.fileName("bogus.run");
+    QFile output(bogus);
+    QVERIFY(output.open(QIODevice::WriteOnly|QIODevice::Truncate) == true);
+    output.write("not a run");
+    output.close();
+    RunReader reader;
+    QVERIFY(reader.open(bogus) == false);
+
+    // a run cut off in the middle of a record
+    QList< QPair<QByteArray, uint64_t> > records;
+    records.append(qMakePair(QByteArray("complete"), Q_UINT64_C(1)));
+    records.append(qMakePair(QByteArray("truncated"), Q_UINT64_C(2)));
+    QString truncated = writeRun("truncated.run", records);
+    QVERIFY(QFile::resize(truncated, QFile(truncated).size() - 3) == true);
+
+    RunReader partial;
+    QVERIFY(partial.open(truncated) == true);
+    QVERIFY(partial.next() == true);
+    QVERIFY(partial.key() == "complete");
+    QVERIFY(partial.next() == false);
+    QVERIFY(partial.failed() == true);
+
+    CollectRecords merged;
+    QString error;
+    QVERIFY(mergeRuns(QStringList() << truncated, merged, error) == false);
+    QVERIFY(error.isEmpty() == false);
+    QVERIFY(mergeRuns(QStringList() << scratch.fileName("missing.run"), merged, error) == false);
+    }
+void TestCountRuns::test_word_spill_order()
+    {
+    WordTally words;
+    words.add("zeta", 2);
+    words.add("alpha");
+    words.add(QString::fromUtf8("\xc3\xa9t\xc3\xa9"), 3);
+    words.add("alphabet");
+    words.add(QString::fromUtf8("\xef\xbd\x81"));        // fullwidth a, U+FF41
+    words.add(QString::fromUtf8("\xf0\x9d\x90\x80"));    // U+1D400, a surrogate pair in UTF-16
+    words.add("alpha", 4);
+
+    QString name = scratch.fileName("words.run");
+    RunWriter writer;
+    QVERIFY(writer.open(name) == true);
+    QVERIFY(words.spillTo(writer) == true);
+    QVERIFY(writer.close() == true);
+    QVERIFY(words.size() == 0);
+
+    // code point order, which puts the surrogate pair last
+    QList< QPair<QByteArray, uint64_t> > records = readRun(name);
+    QVERIFY(records.size() == 6);
+    QVERIFY(records[0] == qMakePair(QByteArray("alpha"), Q_UINT64_C(5)));
+    QVERIFY(records[1] == qMakePair(QByteArray("alphabet"), Q_UINT64_C(1)));
+    QVERIFY(records[2] == qMakePair(QByteArray("zeta"), Q_UINT64_C(2)));
+    QVERIFY(records[3] == qMakePair(QByteArray("\xc3\xa9t\xc3\xa9"), Q_UINT64_C(3)));
+    QVERIFY(records[4].first == QByteArray("\xef\xbd\x81"));
+    QVERIFY(records[5].first == QByteArray("\xf0\x9d\x90\x80"));
+    }
+void TestCountRuns::test_phrase_spill_order()
+    {
+    NgramCount phrases(2);
+    QString text[] = { "ab", "c", "a", "bc", "ab", "c" };
+    for (int i = 0; i < 6; ++i)
+        {
+        phrases.addToken(text[i].constData(), text[i].length());
+        }
+
+    QString name = scratch.fileName("phrases.run");
+    RunWriter writer;
+    QVERIFY(writer.open(name) == true);
+    QVERIFY(phrases.spillTo(writer) == true);
+    QVERIFY(writer.close() == true);
+    QVERIFY(phrases.size() == 0);
+
+    // "a bc" sorts before "ab c" because the space sorts before the letters
+    QList< QPair<QByteArray, uint64_t> > records = readRun(name);
+    QVERIFY(records.size() == 4);
+    QVERIFY(records[0] == qMakePair(QByteArray("a bc"), Q_UINT64_C(1)));
+    QVERIFY(records[1] == qMakePair(QByteArray("ab c"), Q_UINT64_C(2)));
+    QVERIFY(records[2] == qMakePair(QByteArray("bc ab"), Q_UINT64_C(1)));
+    QVERIFY(records[3] == qMakePair(QByteArray("c a"), Q_UINT64_C(1)));
+
+    // the phrase in progress carries on after the spill
+    QString next("d");
+    phrases.addToken(next.constData(), next.length());
+    QVERIFY(phrases.count("c d") == 1);
+    }
+void TestCountRuns::test_spilled_indexing()
+    {
+    // several read blocks, so the budget is checked more than once
+    QByteArray contents;
+    for (int i = 0; i < 20000; ++i)
+        {
+        contents += QString("word%1 common ").arg(i % 997).toLatin1();
+        }
+    QString input = scratch.fileName("input.txt");
+    QFile output(input);
+    QVERIFY(output.open(QIODevice::WriteOnly|QIODevice::Truncate) == true);
+    output.write(contents);
+    output.close();
+
+    WordTally expected;
+    indexFileInto(input, expected);
+
+    // a budget so small every block is written out
+    WordTally tally;
+    CollectRecords merged;
+    QString error;
+        {
+        RunSpiller spiller(scratch.path(), 1);
+        indexFileInto(input, tally, TokenMatcher::defaultMatcher(), StopwordFilter::none(), 1, &spiller);
+        QVERIFY(spiller.runs().size() > 1);
+        QVERIFY(spiller.spill(tally) == true);
+        QVERIFY(mergeRuns(spiller.runs(), merged, error, scratch.path()) == true);
+        }
+
+    QVERIFY(merged.records.size() == expected.size());
+    for (int i = 0; i < merged.records.size(); ++i)
+        {
+        QVERIFY(merged.records[i].second == expected.count(QString::fromUtf8(merged.records[i].first.constData(), merged.records[i].first.size())));
+        }
+    }
+void TestCountRuns::test_spill_releases_memory()
+    {
+    // every word new, over many read blocks
+    QByteArray contents;
+    for (int i = 0; i < 200000; ++i)
+        {
+        contents += QString("w%1 ").arg(i).toLatin1();
+        }
+    QString input = scratch.fileName("distinct.txt");
+    QFile output(input);
+    QVERIFY(output.open(QIODevice::WriteOnly|QIODevice::Truncate) == true);
+    output.write(contents);
+    output.close();
+    int blocks = contents.size() / 32768;
+
+    // a spilled accumulator is as small as a new one
+    WordTally tally;
+    NgramCount phrases(2);
+    uint64_t emptyWords = tally.memoryUsage();
+    uint64_t emptyPhrases = phrases.memoryUsage();
+    for (int i = 0; i < 5000; ++i)
+        {
+        QString word = QString("w%1").arg(i);
+        tally.addToken(word.constData(), word.length());
+        phrases.addToken(word.constData(), word.length());
+        }
+    phrases.endSequence();
+    QVERIFY(tally.memoryUsage() > emptyWords);
+        {
+        RunSpiller spiller(scratch.path(), std::numeric_limits<uint64_t>::max());
+        QVERIFY(spiller.spill(tally) == true);
+        QVERIFY(spiller.spill(phrases) == true);
+        }
+    QVERIFY(tally.memoryUsage() == emptyWords);
+    QVERIFY(phrases.memoryUsage() == emptyPhrases);
+
+    // with a budget that holds many blocks the runs stay few; if spilling
+    // kept the memory every block after the first would be a run of its own
+    uint64_t limit = 4 * 1024 * 1024;
+    CollectRecords merged;
+    QString error;
+        {
+        RunSpiller spiller(scratch.path(), limit);
+        indexFileInto(input, tally, TokenMatcher::defaultMatcher(), StopwordFilter::none(), 1, &spiller);
+        QVERIFY(spiller.runs().size() > 1);
+        QVERIFY(spiller.runs().size() < (blocks / 4));
+        QVERIFY(tally.memoryUsage() <= limit);
+        QVERIFY(spiller.spill(tally) == true);
+        QVERIFY(mergeRuns(spiller.runs(), merged, error, scratch.path()) == true);
+        }
+    QVERIFY(merged.records.size() == 200000);
+    }
+
+void TestCountRuns::test_failed_spill()
+    {
+    QByteArray contents;
+    for (int i = 0; i < 200000; ++i)
+        {
+        contents += QString("w%1 ").arg(i).toLatin1();
+        }
+    QString input = scratch.fileName("distinct.txt");
+    QFile output(input);
+    QVERIFY(output.open(QIODevice::WriteOnly|QIODevice::Truncate) == true);
+    output.write(contents);
+    output.close();
+
+    // no run can be written to a directory that is not there; the tally is
+    // emptied whenever it outgrows the budget rather than growing without one
+    uint64_t limit = 1024 * 1024;
+    RunSpiller spiller(scratch.fileName("missing"), limit);
+    WordTally tally;
+    indexFileInto(input, tally, TokenMatcher::defaultMatcher(), StopwordFilter::none(), 1, &spiller);
+    QVERIFY(spiller.failed() == true);
+    QVERIFY(spiller.runs().isEmpty());
+    QVERIFY(tally.memoryUsage() <= limit);
+
+    // and the workers skip the files still to come
+    ThreadAccumulators<WordTally> accumulators;
+    AccumulatingMapper<WordTally> mapper(accumulators, TokenMatcher::defaultMatcher(), StopwordFilter::none(), &spiller);
+    mapper(input);
+    QVERIFY(accumulators.local().size() == 0);
+    }
+
+void TestCountRuns::test_partial_results()
+    {
+    QList< QPair<QByteArray, uint64_t> > first;
+    first.append(qMakePair(QByteArray("alpha beta"), Q_UINT64_C(3)));
+    first.append(qMakePair(QByteArray("beta gamma"), Q_UINT64_C(1)));
+    QList< QPair<QByteArray, uint64_t> > second;
+    second.append(qMakePair(QByteArray("beta gamma"), Q_UINT64_C(5)));
+
+    QString firstName = scratch.fileName("first.sfi");
+    QString secondName = scratch.fileName("second.sfi");
+    RunWriter writer;
+    QVERIFY(writer.open(firstName, 2) == true);
+    writer.add(first[0].first, first[0].second);
+    writer.add(first[1].first, first[1].second);
+    QVERIFY(writer.close() == true);
+    QVERIFY(writer.open(secondName, 2) == true);
+    writer.add(second[0].first, second[0].second);
+    QVERIFY(writer.close() == true);
+
+    // a partial reads like any other run
+    RunReader reader;
+    QVERIFY(reader.open(firstName) == true);
+    QVERIFY(reader.order() == 2);
+    QVERIFY(reader.next() == true);
+    QVERIFY(reader.key() == "alpha beta");
+
+    // the full merge and its top-K come out of the same pass
+    CollectRecords merged;
+    TopCounts top(1);
+    SplitConsumer both(merged, top);
+    int order = 0;
+    QString error;
+    QVERIFY(mergePartials(QStringList() << firstName << secondName, both, order, error) == true);
+    QVERIFY(order == 2);
+    QVERIFY(merged.records.size() == 2);
+    QVERIFY(merged.records[1] == qMakePair(QByteArray("beta gamma"), Q_UINT64_C(6)));
+    QVERIFY(top.top().size() == 1);
+    QVERIFY(top.top()[0] == PhraseCount(6, "beta gamma"));
+
+    // partials of different kinds, or scratch runs, are refused
+    QString words = scratch.fileName("words.sfi");
+    QVERIFY(writer.open(words, 1) == true);
+    writer.add("alpha", 1);
+    QVERIFY(writer.close() == true);
+    QString scratchRun = writeRun("scratch.run", first);
+    CollectRecords refused;
+    QVERIFY(mergePartials(QStringList() << firstName << words, refused, order, error) == false);
+    QVERIFY(mergePartials(QStringList() << scratchRun, refused, order, error) == false);
+    QVERIFY(refused.records.isEmpty() == true);
+    }
+
+void TestCountRuns::test_merge_outputs()
+    {
+    QString phrases = scratch.fileName("phrases.sfi");
+    RunWriter writer;
+    QVERIFY(writer.open(phrases, 2) == true);
+    writer.add("alpha beta", 3);
+    QVERIFY(writer.close() == true);
+    QString words = scratch.fileName("words.sfi");
+    QVERIFY(writer.open(words, 1) == true);
+    writer.add("alpha", 1);
+    QVERIFY(writer.close() == true);
+
+    QString existing = scratch.fileName("existing.sfi");
+    QFile earlier(existing);
+    QVERIFY(earlier.open(QIODevice::WriteOnly|QIODevice::Truncate) == true);
+    earlier.write("earlier result");
+    earlier.close();
+
+    // a bad input is found before the earlier output is touched
+    MergeOptions options;
+    options.partials << phrases << words;
+    options.partialFile = existing;
+    QString error;
+    QVERIFY(mergePartialResults(options, error) == false);
+    QVERIFY(earlier.open(QIODevice::ReadOnly) == true);
+    QVERIFY(earlier.readAll() == "earlier result");
+    earlier.close();
+
+    // an input is never an output
+    options.partials = QStringList() << phrases;
+    options.partialFile = phrases;
+    QVERIFY(mergePartialResults(options, error) == false);
+    RunReader reader;
+    QVERIFY(reader.open(phrases) == true);
+    QVERIFY(reader.next() == true);
+    QVERIFY(reader.key() == "alpha beta");
+
+    // a complete merge replaces the earlier output and leaves nothing behind
+    options.partialFile = existing;
+    QVERIFY(mergePartialResults(options, error) == true);
+    QVERIFY(reader.open(existing) == true);
+    QVERIFY(reader.order() == 2);
+    QVERIFY(reader.next() == true);
+    QVERIFY(reader.count() == 3);
+    QVERIFY(QDir(scratch.path()).entryList(QStringList() << "*.tmp").isEmpty() == true);
+    }
+
+QTEST_MAIN(TestCountRuns)
+#include "test_countRuns.moc"
@@ -1,6 +1,7 @@
 #include <QtTest/QtTest>
 #include <QStringList>
 #include <QtGlobal>
+#include <qtconcurrentmap.h>
 
 #include <fileIndexer.h>
 
@@ -42,6 +43,20 @@ void combine_counts(WordCount& destination, const WordCount& source)
         }
     }
 
+class CountIntoAccumulator
+    {
+    public:
+        CountIntoAccumulator(ThreadAccumulators<WordTally>& _accumulators) : accumulators(&_accumulators)
+            {
+            }
+        void operator()(const QString& word) const
+            {
+            accumulators->local().add(word);
+            }
+    private:
+        ThreadAccumulators<WordTally>* accumulators;
+    };
+
 class TestIndexer: public QObject
     {
     Q_OBJECT
@@ -68,6 +83,7 @@ class TestIndexer: public QObject
         void test_counter();
         void test_reducer();
         void test_capitalization();
+        void test_thread_accumulators();
     };
 TestIndexer::TestIndexer() : QObject(NULL)
     {
@@ -305,6 +321,37 @@ void TestIndexer::test_capitalization()
     QVERIFY(checker.contains("alpha") == true);
     QVERIFY(checker["alpha"] == total);
     }
+void TestIndexer::test_thread_accumulators()
+    {
+    // testing word list
+    QStringList words;
+    for (int i = 0; i < 2000; ++i)
+        {
+        words << QString((i % 2) ? "Word%1" : "word%1").arg(i % 7);
+        }
+
+    ThreadAccumulators<WordTally> accumulators;
+    QVERIFY(mergeAccumulators(accumulators).size() == 0);
+
+    QtConcurrent::blockingMap(words, CountIntoAccumulator(accumulators));
+    QVERIFY(accumulators.size() >= 1);
+
+    WordCount finalCount = mergeAccumulators(accumulators);
+    QVERIFY(finalCount.size() == 7);
+    uint64_t total = 0;
+    for (WordCount::const_iterator i = finalCount.constBegin(); i != finalCount.constEnd(); ++i)
+        {
+        total += i.value();
+        }
+    QVERIFY(total == 2000);
+    QVERIFY(finalCount["word0"] == 286);
+
+    // a reset starts every thread over from an empty accumulator
+    accumulators.clear();
+    QVERIFY(accumulators.size() == 0);
+    QtConcurrent::blockingMap(words, CountIntoAccumulator(accumulators));
+    QVERIFY(mergeAccumulators(accumulators)["word6"] == 285);
+    }
 
 QTEST_MAIN(TestIndexer)
 #include "test_index.moc"
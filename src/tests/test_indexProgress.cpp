@@ -0,0 +1,208 @@
+#include <QtTest/QtTest>
+#include <QFuture>
+#include <QString>
+#include <QStringList>
+#include <QtGlobal>
+#include <qtconcurrentmap.h>
+
+#include <fileIndexer.h>
+#include <indexerOptions.h>
+#include <indexProgress.h>
+#include <inputDedup.h>
+#include <threadAccumulators.h>
+#include <wordTally.h>
+
+#include "scratchDirectory.h"
+
+class TestIndexProgress: public QObject
+    {
+    Q_OBJECT
+    public:
+        TestIndexProgress();
+        ~TestIndexProgress();
+    private slots:
+        void initTestCase();
+        void cleanupTestCase();
+        void init();
+        void cleanup();
+
+        // actual tests
+        void test_empty_report();
+        void test_single_worker();
+        void test_phrases();
+        void test_concurrent_workers();
+        void test_option();
+
+    private:
+        static void addWords(WordTally& _tally, const QString& _text);
+
+        ScratchDirectory scratch;
+    };
+TestIndexProgress::TestIndexProgress() : QObject(NULL)
+    {
+    }
+TestIndexProgress::~TestIndexProgress()
+    {
+    }
+void TestIndexProgress::initTestCase()
+    {
+    QVERIFY(scratch.create("test_indexProgress") == true);
+    }
+void TestIndexProgress::cleanupTestCase()
+    {
+    scratch.remove();
+    }
+void TestIndexProgress::init()
+    {
+    }
+void TestIndexProgress::cleanup()
+    {
+    scratch.clear();
+    }
+void TestIndexProgress::addWords(WordTally& _tally, const QString& _text)
+    {
+    QStringList words = _text.split(' ');
+    for (QStringList::const_iterator iter = words.constBegin(); iter != words.constEnd(); ++iter)
+        {
+        _tally.addToken(iter->constData(), iter->length());
+        }
+    }
+void TestIndexProgress::test_empty_report()
+    {
+    IndexProgress progress;
+    ProgressReport report = progress.report();
+    QVERIFY(report.filesDone == 0);
+    QVERIFY(report.filesTotal == 0);
+    QVERIFY(report.bytesDone == 0);
+    QVERIFY(report.bytesPerSecond == 0.0);
+    QVERIFY(report.top.empty() == true);
+    }
+void TestIndexProgress::test_single_worker()
+    {
+    IndexProgress progress(2);
+    progress.start(3);
+
+    // the first block always publishes
+    WordTally tally;
+    addWords(tally, "red red green");
+    progress.blockDone(tally, 100);
+    ProgressReport first = progress.report();
+    QVERIFY(first.filesTotal == 3);
+    QVERIFY(first.filesDone == 0);
+    QVERIFY(first.bytesDone == 100);
+    QVERIFY(first.top.size() == 2);
+    QVERIFY(first.top[0] == PhraseCount(2, "red"));
+    QVERIFY(first.top[1] == PhraseCount(1, "green"));
+
+    // the report asked for a new snapshot, which the next block publishes;
+    // the block after that is already in the same epoch and only adds bytes
+    addWords(tally, "blue blue blue");
+    progress.blockDone(tally, 50);
+    progress.fileDone();
+    addWords(tally, "green green green green");
+    progress.blockDone(tally, 25);
+    ProgressReport second = progress.report();
+    QVERIFY(second.filesDone == 1);
+    QVERIFY(second.bytesDone == 175);
+    QVERIFY(second.top.size() == 2);
+    QVERIFY(second.top[0] == PhraseCount(3, "blue"));
+    QVERIFY(second.top[1] == PhraseCount(2, "red"));
+
+    // and the one after that catches up
+    progress.blockDone(tally, 0);
+    ProgressReport third = progress.report();
+    QVERIFY(third.bytesDone == 175);
+    QVERIFY(third.top[0] == PhraseCount(5, "green"));
+    }
+void TestIndexProgress::test_phrases()
+    {
+    IndexProgress progress(1);
+    progress.start(1);
+
+    NgramCount phrases(2);
+    QStringList words = QString("big cat big cat").split(' ');
+    for (QStringList::const_iterator iter = words.constBegin(); iter != words.constEnd(); ++iter)
+        {
+        phrases.addToken(iter->constData(), iter->length());
+        }
+    progress.blockDone(phrases, 16);
+    ProgressReport report = progress.report();
+    QVERIFY(report.bytesDone == 16);
+    QVERIFY(report.top.size() == 1);
+    QVERIFY(report.top[0] == PhraseCount(2, "big cat"));
+    }
+void TestIndexProgress::test_concurrent_workers()
+    {
+    QStringList files;
+    uint64_t totalBytes = 0;
+    for (int i = 0; i < 40; ++i)
+        {
+        QByteArray contents;
+        for (int line = 0; line < 200; ++line)
+            {
+            contents += "apple banana apple cherry\n";
+            }
+        contents += QString("word%1\n").arg(i).toLatin1();
+        totalBytes += contents.size();
+        files << scratch.writeFile(QString("file%1.txt").arg(i), contents);
+        }
+    DedupStats stats;
+    QList<IndexInput> inputs = deduplicateInputs(files, false, stats);
+
+    IndexProgress progress(3);
+    progress.start(inputs.size());
+    ThreadAccumulators<WordTally> accumulators;
+    QFuture<void> done = QtConcurrent::map(inputs, AccumulatingMapper<WordTally>(accumulators, TokenMatcher::defaultMatcher(),
+                                                                                 StopwordFilter::none(), NULL, &progress));
+
+    // reports never go backwards while the workers are counting
+    uint64_t lastBytes = 0;
+    uint64_t lastFiles = 0;
+    while (!done.isFinished())
+        {
+        ProgressReport report = progress.report();
+        QVERIFY(report.bytesDone >= lastBytes);
+        QVERIFY(report.filesDone >= lastFiles);
+        QVERIFY(report.top.size() <= 3);
+        lastBytes = report.bytesDone;
+        lastFiles = report.filesDone;
+        }
+    done.waitForFinished();
+
+    ProgressReport last = progress.report();
+    QVERIFY(last.filesDone == 40);
+    QVERIFY(last.filesTotal == 40);
+    QVERIFY(last.bytesDone == totalBytes);
+
+    // the snapshots lag, but the final counts do not
+    QVERIFY(last.top.empty() == false);
+    QVERIFY(last.top[0].second == QString("apple"));
+    WordCount results = mergeAccumulators(accumulators);
+    QVERIFY(results["apple"] == 40 * 400);
+    QVERIFY(results["cherry"] == 40 * 200);
+    }
+void TestIndexProgress::test_option()
+    {
+    QString error;
+    IndexerOptions defaults;
+    QVERIFY(defaults.progressInterval == 0);
+
+    IndexerOptions plain;
+    QVERIFY(parseIndexerOptions(QStringList() << "--progress" << "file.txt", plain, error) == true);
+    QVERIFY(plain.progressInterval == 5);
+    QVERIFY(plain.files == QStringList() << "file.txt");
+
+    IndexerOptions interval;
+    QVERIFY(parseIndexerOptions(QStringList() << "--progress=30", interval, error) == true);
+    QVERIFY(interval.progressInterval == 30);
+
+    IndexerOptions zero;
+    QVERIFY(parseIndexerOptions(QStringList() << "--progress=0", zero, error) == false);
+    QVERIFY(error.isEmpty() == false);
+
+    IndexerOptions bad;
+    QVERIFY(parseIndexerOptions(QStringList() << "--progress=soon", bad, error) == false);
+    }
+
+QTEST_MAIN(TestIndexProgress)
+#include "test_indexProgress.moc"
@@ -0,0 +1,153 @@
+#include <QtTest/QtTest>
+#include <QFile>
+#include <QStringList>
+#include <QtGlobal>
+
+#include <unistd.h>
+
+#include <fileIndexer.h>
+#include <inputDedup.h>
+
+#include "scratchDirectory.h"
+
+class TestInputDedup: public QObject
+    {
+    Q_OBJECT
+    public:
+        TestInputDedup();
+        ~TestInputDedup();
+    private slots:
+        void initTestCase();
+        void cleanupTestCase();
+        void init();
+        void cleanup();
+
+        // actual tests
+        void test_hash_vectors();
+        void test_file_hash();
+        void test_inode_grouping();
+        void test_content_grouping();
+        void test_weighted_counts();
+
+    private:
+
+        ScratchDirectory scratch;
+    };
+TestInputDedup::TestInputDedup() : QObject(NULL)
+    {
+    }
+TestInputDedup::~TestInputDedup()
+    {
+    }
+void TestInputDedup::initTestCase()
+    {
+    QVERIFY(scratch.create("test_inputDedup") == true);
+    }
+void TestInputDedup::cleanupTestCase()
+    {
+    scratch.remove();
+    }
+void TestInputDedup::init()
+    {
+    }
+void TestInputDedup::cleanup()
+    {
+    scratch.clear();
+    }
+void TestInputDedup::test_hash_vectors()
+    {
+    // reference values for XXH64 with seed 0
+    QVERIFY(contentHash("", 0) == 0xEF46DB3751D8E999ULL);
+    QVERIFY(contentHash("a", 1) == 0xD24EC4F1A98C6E5BULL);
+    QVERIFY(contentHash("abc", 3) == 0x44BC2CF5AD770999ULL);
+    }
+void TestInputDedup::test_file_hash()
+    {
+    // longer than a stripe and not a multiple of one
+    QByteArray contents;
+    for (int i = 0; i < 1000; ++i)
+        {
+        contents += "line of text ";
+        }
+    QString fileName = scratch.writeFile("hashed.txt", contents);
+
+    uint64_t hash = 0;
+    QVERIFY(contentHash(fileName, hash) == true);
+    QVERIFY(hash == contentHash(contents.constData(), contents.size()));
+    QVERIFY(contentHash(QString("%1/missing.txt").arg(scratch.path()), hash) == false);
+    }
+void TestInputDedup::test_inode_grouping()
+    {
+    QString original = scratch.writeFile("original.txt", "alpha beta\n");
+    QString linked = scratch.fileName("linked.txt");
+    QVERIFY(link(QFile::encodeName(original).constData(), QFile::encodeName(linked).constData()) == 0);
+    QString copy = scratch.writeFile("copy.txt", "alpha beta\n");
+    QString missing = QString("%1/missing.txt").arg(scratch.path());
+
+    QStringList files;
+    files << original << linked << copy << original << missing;
+
+    DedupStats stats;
+    QList<IndexInput> inputs = deduplicateInputs(files, false, stats);
+    QVERIFY(stats.files == 5);
+    QVERIFY(stats.duplicateFiles == 2);
+    QVERIFY(stats.bytesSkipped == 22);
+
+    // the copy is a different file and is only found by content
+    QVERIFY(inputs.size() == 3);
+    QVERIFY(inputs[0].fileName == original);
+    QVERIFY(inputs[0].occurrences == 3);
+    QVERIFY(inputs[1].fileName == copy);
+    QVERIFY(inputs[1].occurrences == 1);
+    QVERIFY(inputs[2].fileName == missing);
+    QVERIFY(inputs[2].size == -1);
+
+    // past a deadline the rest of the files are kept without being examined
+    int asked = 0;
+    inputs = deduplicateInputs(files, true, stats, [&asked]() { return ++asked > 2; });
+    QVERIFY(stats.files == 5);
+    QVERIFY(stats.duplicateFiles == 1);
+    QVERIFY(inputs.size() == 4);
+    QVERIFY(inputs[0].occurrences == 2);
+    QVERIFY(inputs[1].fileName == copy);
+    QVERIFY(inputs[1].size == -1);
+    QVERIFY(inputs[3].fileName == missing);
+    }
+void TestInputDedup::test_content_grouping()
+    {
+    QString first = scratch.writeFile("first.txt", "gamma delta\n");
+    QString second = scratch.writeFile("second.txt", "gamma delta\n");
+    QString sameSize = scratch.writeFile("samesize.txt", "gamma DELTA\n");
+    QString other = scratch.writeFile("other.txt", "epsilon\n");
+
+    QStringList files;
+    files << first << other << second << sameSize << second;
+
+    DedupStats stats;
+    QList<IndexInput> inputs = deduplicateInputs(files, true, stats);
+    QVERIFY(inputs.size() == 3);
+    QVERIFY(inputs[0].fileName == first);
+    QVERIFY(inputs[0].occurrences == 3);
+    QVERIFY(inputs[1].fileName == other);
+    QVERIFY(inputs[2].fileName == sameSize);
+    QVERIFY(inputs[2].occurrences == 1);
+    QVERIFY(stats.duplicateFiles == 2);
+    QVERIFY(stats.bytesSkipped == 24);
+    }
+void TestInputDedup::test_weighted_counts()
+    {
+    QString fileName = scratch.writeFile("weighted.txt", "one two one\n");
+
+    WordTally words;
+    indexFileInto(fileName, words, TokenMatcher::defaultMatcher(), StopwordFilter::none(), 3);
+    QVERIFY(words.count(QString("one")) == 6);
+    QVERIFY(words.count(QString("two")) == 3);
+
+    NgramCount phrases(2);
+    indexFileInto(fileName, phrases, TokenMatcher::defaultMatcher(), StopwordFilter::none(), 4);
+    QVERIFY(phrases.count("one two") == 4);
+    QVERIFY(phrases.count("two one") == 4);
+    }
+
+QTEST_MAIN(TestInputDedup)
+#include "test_inputDedup.moc"
@@ -0,0 +1,274 @@
+#include <QtTest/QtTest>
+#include <QString>
+#include <QStringList>
+#include <QtGlobal>
+#include <qtconcurrentmap.h>
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include <fileIndexer.h>
+#include <indexerOptions.h>
+#include <memoryPlacement.h>
+#include <ngramCount.h>
+#include <threadAccumulators.h>
+#include <wordTally.h>
+
+#include "scratchDirectory.h"
+
+class TestMemoryPlacement: public QObject
+    {
+    Q_OBJECT
+    public:
+        TestMemoryPlacement();
+        ~TestMemoryPlacement();
+    private slots:
+        void initTestCase();
+        void cleanupTestCase();
+        void init();
+        void cleanup();
+
+        // actual tests
+        void test_allocate_table();
+        void test_table_allocator();
+        void test_counts_on_huge_pages();
+        void test_cpu_list();
+        void test_options();
+        void test_worker_placement();
+
+    private:
+        ScratchDirectory scratch;
+    };
+TestMemoryPlacement::TestMemoryPlacement() : QObject(NULL)
+    {
+    }
+TestMemoryPlacement::~TestMemoryPlacement()
+    {
+    }
+void TestMemoryPlacement::initTestCase()
+    {
+    QVERIFY(scratch.create("test_memoryPlacement") == true);
+    }
+void TestMemoryPlacement::cleanupTestCase()
+    {
+    scratch.remove();
+    }
+void TestMemoryPlacement::init()
+    {
+    }
+void TestMemoryPlacement::cleanup()
+    {
+    setHugePageMode(HUGE_PAGES_OFF);
+    scratch.clear();
+    }
+void TestMemoryPlacement::test_allocate_table()
+    {
+    HugePageMode modes[] = { HUGE_PAGES_OFF, HUGE_PAGES_TRANSPARENT, HUGE_PAGES_EXPLICIT };
+    size_t sizes[] = { 0, 100, HUGE_TABLE_THRESHOLD - 1, HUGE_TABLE_THRESHOLD, HUGE_TABLE_THRESHOLD * 3 + 12345 };
+    for (size_t mode = 0; mode < sizeof(modes) / sizeof(modes[0]); ++mode)
+        {
+        setHugePageMode(modes[mode]);
+        QVERIFY(hugePageMode() == modes[mode]);
+        for (size_t size = 0; size < sizeof(sizes) / sizeof(sizes[0]); ++size)
+            {
+            char* memory = static_cast<char*>(allocateTable(sizes[size]));
+            QVERIFY(memory != NULL);
+            // the whole block is usable
+            memset(memory, 0x5A, sizes[size]);
+            if (sizes[size] > 0)
+                {
+                QVERIFY(memory[sizes[size] - 1] == 0x5A);
+                }
+#ifdef __linux__
+            // large tables start on a huge page boundary
+            if (sizes[size] >= HUGE_TABLE_THRESHOLD)
+                {
+                QVERIFY((reinterpret_cast<uintptr_t>(memory) % HUGE_TABLE_THRESHOLD) == 0);
+                }
+#endif
+            releaseTable(memory, sizes[size]);
+            }
+        }
+    releaseTable(NULL, 100);
+    }
+void TestMemoryPlacement::test_table_allocator()
+    {
+    setHugePageMode(HUGE_PAGES_TRANSPARENT);
+
+    // grows from the heap onto mapped blocks and back again
+    std::vector<uint64_t, TableAllocator<uint64_t> > values;
+    for (uint64_t i = 0; i < 1000000; ++i)
+        {
+        values.push_back(i * 3);
+        }
+    QVERIFY(values.size() == 1000000);
+    QVERIFY(values[0] == 0);
+    QVERIFY(values[999999] == 2999997);
+
+    std::vector<uint64_t, TableAllocator<uint64_t> > copy(values);
+    QVERIFY(copy == values);
+    values.swap(copy);
+    values.resize(10);
+    std::vector<uint64_t, TableAllocator<uint64_t> >(values).swap(values);
+    QVERIFY(values.size() == 10);
+    QVERIFY(values[9] == 27);
+    QVERIFY(TableAllocator<int>() == TableAllocator<char>());
+    }
+void TestMemoryPlacement::test_counts_on_huge_pages()
+    {
+    // enough words that the tables are mapped rather than on the heap
+    QStringList words;
+    for (int i = 0; i < 300000; ++i)
+        {
+        int word = static_cast<int>((static_cast<qint64>(i) * 7919) % 200000);
+        words << QString("w%1").arg(word, 0, 36);
+        }
+
+    HugePageMode modes[] = { HUGE_PAGES_OFF, HUGE_PAGES_TRANSPARENT, HUGE_PAGES_EXPLICIT };
+    std::vector<PhraseCount> expectedWords;
+    std::vector<PhraseCount> expectedPhrases;
+    for (size_t mode = 0; mode < sizeof(modes) / sizeof(modes[0]); ++mode)
+        {
+        setHugePageMode(modes[mode]);
+        WordTally tally;
+        NgramCount phrases(2);
+        for (QStringList::const_iterator iter = words.constBegin(); iter != words.constEnd(); ++iter)
+            {
+            tally.addToken(iter->constData(), iter->length());
+            phrases.addToken(iter->constData(), iter->length());
+            }
+        QVERIFY(tally.size() == 200000);
+        QVERIFY(tally.memoryUsage() >= HUGE_TABLE_THRESHOLD);
+        QVERIFY(phrases.memoryUsage() >= HUGE_TABLE_THRESHOLD);
+        if (mode == 0)
+            {
+            expectedWords = tally.topWords(5);
+            expectedPhrases = phrases.topPhrases(5);
+            }
+        QVERIFY(tally.topWords(5) == expectedWords);
+        QVERIFY(phrases.topPhrases(5) == expectedPhrases);
+        }
+    QVERIFY(expectedWords.size() == 5);
+    QVERIFY(expectedWords[0].first == 2);
+    }
+void TestMemoryPlacement::test_cpu_list()
+    {
+    std::vector<int> cpus;
+    QVERIFY(NumaPlacement::parseCpuList("0-3,8-11\n", cpus) == true);
+    QVERIFY(cpus.size() == 8);
+    QVERIFY(cpus[0] == 0);
+    QVERIFY(cpus[3] == 3);
+    QVERIFY(cpus[4] == 8);
+    QVERIFY(cpus[7] == 11);
+
+    QVERIFY(NumaPlacement::parseCpuList("5", cpus) == true);
+    QVERIFY(cpus.size() == 1);
+    QVERIFY(cpus[0] == 5);
+
+    // a memory-only node lists no CPUs
+    QVERIFY(NumaPlacement::parseCpuList("\n", cpus) == true);
+    QVERIFY(cpus.empty() == true);
+
+    QVERIFY(NumaPlacement::parseCpuList("3-1", cpus) == false);
+    QVERIFY(NumaPlacement::parseCpuList("0-", cpus) == false);
+    QVERIFY(NumaPlacement::parseCpuList("one", cpus) == false);
+    QVERIFY(cpus.empty() == true);
+    }
+void TestMemoryPlacement::test_options()
+    {
+    QString error;
+    IndexerOptions defaults;
+    QVERIFY(defaults.numaPlacement == false);
+    QVERIFY(defaults.hugePages == HUGE_PAGES_OFF);
+
+    IndexerOptions selected;
+    QVERIFY(parseIndexerOptions(QStringList() << "--numa" << "--huge-pages" << "file.txt", selected, error) == true);
+    QVERIFY(selected.numaPlacement == true);
+    QVERIFY(selected.hugePages == HUGE_PAGES_TRANSPARENT);
+    QVERIFY(selected.files == QStringList() << "file.txt");
+
+    IndexerOptions reserved;
+    QVERIFY(parseIndexerOptions(QStringList() << "--huge-pages=explicit", reserved, error) == true);
+    QVERIFY(reserved.hugePages == HUGE_PAGES_EXPLICIT);
+
+    IndexerOptions bad;
+    QVERIFY(parseIndexerOptions(QStringList() << "--huge-pages=1G", bad, error) == false);
+    QVERIFY(error.isEmpty() == false);
+    }
+void TestMemoryPlacement::test_worker_placement()
+    {
+#ifdef __linux__
+    // the CPUs of this thread before it may have been pinned as one of the workers
+    cpu_set_t before;
+    CPU_ZERO(&before);
+    QVERIFY(sched_getaffinity(0, sizeof(before), &before) == 0);
+#endif
+
+    // emulated nodes, so the spreading is exercised on any machine
+    NumaPlacement placement(2);
+    QVERIFY(placement.nodeCount() >= 1);
+    int cpus = 0;
+    for (int node = 0; node < placement.nodeCount(); ++node)
+        {
+        QVERIFY(placement.nodeCpus(node).empty() == false);
+        cpus += static_cast<int>(placement.nodeCpus(node).size());
+        }
+    QVERIFY(cpus >= placement.nodeCount());
+
+    QStringList files;
+    for (int i = 0; i < 40; ++i)
+        {
+        files << scratch.writeFile(QString("file%1.txt").arg(i), "apple banana apple\n");
+        }
+
+    // placement does not change what is counted; each worker is placed once
+    ThreadAccumulators<WordTally> accumulators;
+    QtConcurrent::blockingMap(files, AccumulatingMapper<WordTally>(accumulators, TokenMatcher::defaultMatcher(), StopwordFilter::none(),
+                                                                   NULL, NULL, &placement));
+    WordCount results = mergeAccumulators(accumulators);
+    QVERIFY(results.size() == 2);
+    QVERIFY(results["apple"] == 80);
+    QVERIFY(results["banana"] == 40);
+
+    int placed = 0;
+    for (int node = 0; node < placement.nodeCount(); ++node)
+        {
+        placed += placement.threadsOn(node);
+        }
+    QVERIFY(placed == accumulators.size());
+
+    // the calling thread keeps the node it was given
+    int node = placement.placeCurrentThread();
+    QVERIFY(node >= 0 && node < placement.nodeCount());
+    QVERIFY(placement.placeCurrentThread() == node);
+
+    // until it is released, which gives back its CPUs and places it again next time
+    placement.release();
+#ifdef __linux__
+    cpu_set_t after;
+    CPU_ZERO(&after);
+    QVERIFY(sched_getaffinity(0, sizeof(after), &after) == 0);
+    QVERIFY(CPU_EQUAL(&before, &after));
+#endif
+    placed = 0;
+    for (int i = 0; i < placement.nodeCount(); ++i)
+        {
+        placed += placement.threadsOn(i);
+        }
+    QVERIFY(placement.placeCurrentThread() >= 0);
+    int replaced = 0;
+    for (int i = 0; i < placement.nodeCount(); ++i)
+        {
+        replaced += placement.threadsOn(i);
+        }
+    QVERIFY(replaced == placed + 1);
+    placement.release();
+    }
+
+QTEST_MAIN(TestMemoryPlacement)
+#include "test_memoryPlacement.moc"
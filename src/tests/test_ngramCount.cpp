@@ -0,0 +1,234 @@
+#include <QtTest/QtTest>
+#include <QStringList>
+#include <QtGlobal>
+
+#include <fileIndexer.h>
+#include <ngramCount.h>
+
+class TestNgramCount: public QObject
+    {
+    Q_OBJECT
+    public:
+        TestNgramCount();
+        ~TestNgramCount();
+    private slots:
+        void initTestCase();
+        void cleanupTestCase();
+        void init();
+        void cleanup();
+
+        // actual tests
+        void test_interner();
+        void test_key_packing();
+        void test_table_growth();
+        void test_bigrams();
+        void test_trigrams_across_buffers();
+        void test_stopwords_break_phrases();
+        void test_reducer();
+        void test_top_phrases();
+        void test_wide_trigram_keys();
+    };
+TestNgramCount::TestNgramCount() : QObject(NULL)
+    {
+    }
+TestNgramCount::~TestNgramCount()
+    {
+    }
+void TestNgramCount::initTestCase()
+    {
+    }
+void TestNgramCount::cleanupTestCase()
+    {
+    }
+void TestNgramCount::init()
+    {
+    }
+void TestNgramCount::cleanup()
+    {
+    }
+void TestNgramCount::test_interner()
+    {
+    WordInterner words;
+    QVERIFY(words.size() == 0);
+
+    uint32_t hello = words.intern(QString("Hello"));
+    QVERIFY(hello != 0);
+    QVERIFY(words.intern(QString("hELLO")) == hello);
+    QVERIFY(words.word(hello) == QString("hello"));
+    QVERIFY(words.find(QString("HELLO")) == hello);
+    QVERIFY(words.find(QString("world")) == 0);
+
+    // enough words to force the slot table to grow a few times
+    for (int i = 0; i < 5000; ++i)
+        {
+        words.intern(QString("word%1").arg(i));
+        }
+    QVERIFY(words.size() == 5001);
+    QVERIFY(words.find(QString("word4999")) != 0);
+    QVERIFY(words.word(words.find(QString("word1234"))) == QString("word1234"));
+    QVERIFY(words.intern(QString("hello")) == hello);
+
+    // no new ids past the limit
+    QVERIFY(words.intern(QString("brand-new"), 10) == 0);
+    QVERIFY(words.find(QString("brand-new")) == 0);
+    }
+void TestNgramCount::test_key_packing()
+    {
+    uint32_t bigram[2] = { 0xFFFFFFFFU, 7 };
+    uint32_t unpacked[MAX_NGRAM_ORDER];
+    NgramCount::unpack(NgramCount::pack(bigram, 2), 2, unpacked);
+    QVERIFY(unpacked[0] == bigram[0]);
+    QVERIFY(unpacked[1] == bigram[1]);
+
+    uint32_t trigram[3] = { NgramCount::maximumId(3), 1, 12345 };
+    NgramCount::unpack(NgramCount::pack(trigram, 3), 3, unpacked);
+    QVERIFY(unpacked[0] == trigram[0]);
+    QVERIFY(unpacked[1] == trigram[1]);
+    QVERIFY(unpacked[2] == trigram[2]);
+    }
+void TestNgramCount::test_table_growth()
+    {
+    NgramTable table;
+    for (NgramKey key = 1; key <= 100000; ++key)
+        {
+        table.add(key, key);
+        }
+    table.add(5, 1);
+    QVERIFY(table.size() == 100000);
+    QVERIFY(table.value(5) == 6);
+    QVERIFY(table.value(100000) == 100000);
+    QVERIFY(table.value(100001) == 0);
+    }
+void TestNgramCount::test_bigrams()
+    {
+    QString data = "the cat sat on the cat mat\n";
+    NgramCount results(2);
+    processBuffer("testing", data, false, results);
+    QVERIFY(results.size() == 5);
+    QVERIFY(results.count("the cat") == 2);
+    QVERIFY(results.count("cat sat") == 1);
+    QVERIFY(results.count("cat mat") == 1);
+    QVERIFY(results.count("mat the") == 0);
+    QVERIFY(results.count("the") == 0);
+    }
+void TestNgramCount::test_trigrams_across_buffers()
+    {
+    // the phrase and one of its words are split over three reads
+    NgramCount results(3);
+    QString data = "Alpha Be";
+    processBuffer("testing", data, false, results);
+    QVERIFY(results.size() == 0);
+    QVERIFY(data == QString("Be"));
+
+    data += "ta ";
+    processBuffer("testing", data, false, results);
+    data += "gamma alpha";
+    processBuffer("testing", data, true, results);
+    QVERIFY(results.size() == 2);
+    QVERIFY(results.count("alpha beta gamma") == 1);
+    QVERIFY(results.count("beta gamma alpha") == 1);
+    QVERIFY(results.count("gamma alpha beta") == 0);
+    }
+void TestNgramCount::test_stopwords_break_phrases()
+    {
+    StopwordFilter filter;
+    QVERIFY(filter.build(StopwordFilter::builtinWords()) == true);
+
+    QString data = "red fox and the brown dog\n";
+    NgramCount results(2);
+    processBuffer("testing", data, false, results, TokenMatcher::defaultMatcher(), filter);
+    QVERIFY(results.size() == 2);
+    QVERIFY(results.count("red fox") == 1);
+    QVERIFY(results.count("brown dog") == 1);
+    QVERIFY(results.count("fox brown") == 0);
+    }
+void TestNgramCount::test_reducer()
+    {
+    // the two workers see the words in a different order so their ids differ
+    NgramCount worker1(2);
+    QString data1 = "one two three one two\n";
+    processBuffer("first", data1, false, worker1);
+
+    NgramCount worker2(2);
+    QString data2 = "three one two two three\n";
+    processBuffer("second", data2, false, worker2);
+
+    NgramCount finalCount;
+    ngramIndexReducer(finalCount, worker1);
+    ngramIndexReducer(finalCount, worker2);
+    QVERIFY(finalCount.order() == 2);
+    QVERIFY(finalCount.count("one two") == 3);
+    QVERIFY(finalCount.count("two three") == 2);
+    QVERIFY(finalCount.count("three one") == 2);
+    QVERIFY(finalCount.count("two two") == 1);
+    QVERIFY(finalCount.size() == 4);
+    }
+void TestNgramCount::test_top_phrases()
+    {
+    QString data;
+    for (int i = 0; i < 5; ++i)
+        {
+        data += "new york ";
+        }
+    data += "los angeles los angeles san francisco\n";
+
+    NgramCount results(2);
+    processBuffer("testing", data, false, results);
+
+    std::vector<PhraseCount> top = results.topPhrases(2);
+    QVERIFY(top.size() == 2);
+    QVERIFY(top[0].second == QString("new york"));
+    QVERIFY(top[0].first == 5);
+    QVERIFY(top[1].first == 4);
+
+    QVERIFY(results.topPhrases(100).size() == static_cast<size_t>(results.size()));
+    }
+
+QTEST_MAIN(TestNgramCount)
+void TestNgramCount::test_wide_trigram_keys()
+    {
+    NgramCount results(3);
+    QString a("alpha"), b("beta"), c("gamma");
+    for (int i = 0; i < 2; ++i)
+        {
+        results.addToken(a.constData(), a.length());
+        results.addToken(b.constData(), b.length());
+        results.addToken(c.constData(), c.length());
+        results.endSequence();
+        }
+
+    // intern words until the ids no longer fit the packed trigram key
+    QString last;
+    for (uint32_t i = 0; i < NgramCount::maximumId(3); ++i)
+        {
+        last = QString("w%1").arg(i);
+        results.addToken(last.constData(), last.length());
+        results.endSequence();
+        }
+    results.addToken(a.constData(), a.length());
+    results.addToken(b.constData(), b.length());
+    results.addToken(last.constData(), last.length());
+    results.addToken(a.constData(), a.length());
+    results.addToken(b.constData(), b.length());
+    results.addToken(c.constData(), c.length());
+    results.endSequence();
+
+    // the phrases counted before the keys were widened are all still there
+    QVERIFY(results.size() == 4);
+    QVERIFY(results.count("alpha beta gamma") == 3);
+    QVERIFY(results.count(QString("alpha beta %1").arg(last)) == 1);
+    QVERIFY(results.count(QString("beta %1 alpha").arg(last)) == 1);
+    QVERIFY(results.count(QString("%1 alpha beta").arg(last)) == 1);
+    QVERIFY(results.count("gamma alpha beta") == 0);
+
+    NgramCount merged;
+    merged.merge(results);
+    QVERIFY(merged.size() == 4);
+    QVERIFY(merged.count("alpha beta gamma") == 3);
+    QVERIFY(merged.count(QString("%1 alpha beta").arg(last)) == 1);
+    std::vector<PhraseCount> top = merged.topPhrases(1);
+    QVERIFY(top.size() == 1);
+    QVERIFY(top[0].first == 3);
+    QVERIFY(top[0].second == QString("alpha beta gamma"));
+    }
+#include "test_ngramCount.moc"
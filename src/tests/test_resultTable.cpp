@@ -0,0 +1,299 @@
+#include <QtTest/QtTest>
+#include <QByteArray>
+#include <QDir>
+#include <QFile>
+#include <QString>
+#include <QStringList>
+
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+
+#include <countRuns.h>
+#include <indexerOptions.h>
+#include <resultTable.h>
+
+#include "scratchDirectory.h"
+
+class TestResultTable: public QObject
+    {
+    Q_OBJECT
+    public:
+        TestResultTable();
+        ~TestResultTable();
+    private slots:
+        void initTestCase();
+        void cleanupTestCase();
+        void init();
+        void cleanup();
+
+        // actual tests
+        void test_sort_small();
+        void test_sort_large();
+        void test_csv();
+        void test_tsv();
+        void test_json();
+        void test_order();
+        void test_spilled_order();
+        void test_from_merge();
+        void test_options();
+
+    private:
+        typedef std::vector<RankedKey, TableAllocator<RankedKey> > Rows;
+
+        QByteArray readAll(const QString& _fileName);
+        static Rows generate(size_t _rows, uint64_t _largest);
+        static bool higherCount(const RankedKey& _left, const RankedKey& _right);
+        static bool sameRows(const Rows& _left, const Rows& _right);
+
+        ScratchDirectory scratch;
+    };
+TestResultTable::TestResultTable() : QObject(NULL)
+    {
+    }
+TestResultTable::~TestResultTable()
+    {
+    }
+void TestResultTable::initTestCase()
+    {
+    QVERIFY(scratch.create("test_resultTable") == true);
+    }
+void TestResultTable::cleanupTestCase()
+    {
+    scratch.remove();
+    }
+void TestResultTable::init()
+    {
+    }
+void TestResultTable::cleanup()
+    {
+    scratch.clear();
+    }
+QByteArray TestResultTable::readAll(const QString& _fileName)
+    {
+    QFile file(_fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        {
+        return QByteArray();
+        }
+    return file.readAll();
+    }
+TestResultTable::Rows TestResultTable::generate(size_t _rows, uint64_t _largest)
+    {
+    Rows rows;
+    uint64_t state = 4711;
+    for (size_t i = 0; i < _rows; ++i)
+        {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        RankedKey row = { (state >> 20) % _largest, static_cast<uint32_t>(i) };
+        rows.push_back(row);
+        }
+    return rows;
+    }
+bool TestResultTable::higherCount(const RankedKey& _left, const RankedKey& _right)
+    {
+    return _left.count > _right.count;
+    }
+bool TestResultTable::sameRows(const Rows& _left, const Rows& _right)
+    {
+    if (_left.size() != _right.size())
+        {
+        return false;
+        }
+    for (size_t i = 0; i < _left.size(); ++i)
+        {
+        if (_left[i].count != _right[i].count || _left[i].key != _right[i].key)
+            {
+            return false;
+            }
+        }
+    return true;
+    }
+void TestResultTable::test_sort_small()
+    {
+    Rows rows = generate(1000, 20);
+    Rows expected = rows;
+    std::stable_sort(expected.begin(), expected.end(), higherCount);
+    sortByCount(rows);
+    QVERIFY(sameRows(rows, expected) == true);
+
+    Rows empty;
+    sortByCount(empty);
+    QVERIFY(empty.empty() == true);
+    }
+void TestResultTable::test_sort_large()
+    {
+    // enough rows for the parallel radix sort; an odd number of byte
+    // passes, many ties, and counts past 32 bits
+    const uint64_t largest[] = { 50, 70000, 1ULL << 40 };
+    for (int i = 0; i < 3; ++i)
+        {
+        Rows rows = generate(300000, largest[i]);
+        Rows expected = rows;
+        std::stable_sort(expected.begin(), expected.end(), higherCount);
+        sortByCount(rows);
+        QVERIFY(sameRows(rows, expected) == true);
+        }
+
+    // every count the same keeps the input order
+    Rows flat;
+    for (uint32_t i = 0; i < 100000; ++i)
+        {
+        RankedKey row = { 3, i };
+        flat.push_back(row);
+        }
+    sortByCount(flat);
+    QVERIFY(flat.front().key == 0);
+    QVERIFY(flat.back().key == 99999);
+    }
+void TestResultTable::test_csv()
+    {
+    QString name = scratch.fileName("words.csv");
+    TableExport table;
+    QVERIFY(table.open(name, TABLE_CSV, TABLE_BY_KEY) == true);
+    table.add(QByteArray("plain"), 3);
+    table.add(QByteArray("say \"hi\""), 2);
+    table.add(QByteArray("with,comma"), 18446744073709551615ULL);
+    QVERIFY(table.close() == true);
+    QVERIFY(table.rows() == 3);
+    QCOMPARE(readAll(name), QByteArray("word,count\nplain,3\n\"say \"\"hi\"\"\",2\n\"with,comma\",18446744073709551615\n"));
+    }
+void TestResultTable::test_tsv()
+    {
+    QString name = scratch.fileName("phrases.tsv");
+    TableExport table;
+    QVERIFY(table.open(name, TABLE_TSV, TABLE_BY_KEY, 2) == true);
+    table.add(QByteArray("a\tb"), 1);
+    table.add(QByteArray("back\\slash"), 2);
+    table.add(QByteArray("new line"), 0);
+    QVERIFY(table.close() == true);
+    QCOMPARE(readAll(name), QByteArray("phrase\tcount\na\\tb\t1\nback\\\\slash\t2\nnew line\t0\n"));
+    }
+void TestResultTable::test_json()
+    {
+    QString name = scratch.fileName("words.json");
+    TableExport table;
+    QVERIFY(table.open(name, TABLE_JSON, TABLE_BY_KEY) == true);
+    table.add(QByteArray("caf\xc3\xa9"), 4);
+    table.add(QByteArray("q\"uote\\"), 1);
+    table.add(QByteArray("tab\t"), 2);
+    QVERIFY(table.close() == true);
+    QCOMPARE(readAll(name), QByteArray("[\n{\"word\":\"caf\xc3\xa9\",\"count\":4},\n{\"word\":\"q\\\"uote\\\\\",\"count\":1},\n"
+                                       "{\"word\":\"tab\\u0009\",\"count\":2}\n]\n"));
+
+    // an empty table is still a valid document
+    TableExport empty;
+    QVERIFY(empty.open(name, TABLE_JSON, TABLE_BY_COUNT) == true);
+    QVERIFY(empty.close() == true);
+    QCOMPARE(readAll(name), QByteArray("[\n]\n"));
+    }
+void TestResultTable::test_order()
+    {
+    // by count, equal counts list the later key first, as the top 10 does
+    QString name = scratch.fileName("ranked.csv");
+    TableExport table;
+    QVERIFY(table.open(name, TABLE_CSV, TABLE_BY_COUNT) == true);
+    table.add(QByteArray("apple"), 2);
+    table.add(QByteArray("banana"), 5);
+    table.add(QByteArray("cherry"), 2);
+    table.add(QByteArray("date"), 7);
+    QVERIFY(table.close() == true);
+    QVERIFY(table.rows() == 4);
+    QCOMPARE(readAll(name), QByteArray("word,count\ndate,7\nbanana,5\ncherry,2\napple,2\n"));
+
+    // enough rows for the parallel sort, checked against the expected order
+    TableExport large;
+    QVERIFY(large.open(name, TABLE_TSV, TABLE_BY_COUNT) == true);
+    for (int i = 0; i < 100000; ++i)
+        {
+        large.add(QByteArray::number(1000000 + i), static_cast<uint64_t>(i % 7));
+        }
+    QVERIFY(large.close() == true);
+    QList<QByteArray> lines = readAll(name).split('\n');
+    QVERIFY(lines.size() == 100002);
+    QCOMPARE(lines[1], QByteArray("1099994\t6"));
+    QCOMPARE(lines[2], QByteArray("1099987\t6"));
+    QCOMPARE(lines[100000], QByteArray("1000000\t0"));
+    }
+void TestResultTable::test_spilled_order()
+    {
+    // held in memory, the reference order
+    QString expectedName = scratch.fileName("held.tsv");
+    TableExport held;
+    QVERIFY(held.open(expectedName, TABLE_TSV, TABLE_BY_COUNT) == true);
+    for (int i = 0; i < 100000; ++i)
+        {
+        held.add(QByteArray::number(1000000 + i), static_cast<uint64_t>((i * 7919) % 1013));
+        }
+    QVERIFY(held.close() == true);
+
+    // a limit this small spills well over the runs one merge can open, so
+    // they are merged in passes; ties must still break as in a single sort
+    QString name = scratch.fileName("spilled.tsv");
+    TableExport spilled;
+    spilled.setSortSpill(scratch.path(), 16 * 1024);
+    QVERIFY(spilled.open(name, TABLE_TSV, TABLE_BY_COUNT) == true);
+    for (int i = 0; i < 100000; ++i)
+        {
+        spilled.add(QByteArray::number(1000000 + i), static_cast<uint64_t>((i * 7919) % 1013));
+        }
+    QVERIFY(QDir(scratch.path()).entryList(QStringList() << "*-table-*.run").size() > 64);
+    QVERIFY(spilled.close() == true);
+    QVERIFY(spilled.rows() == 100000);
+    QCOMPARE(readAll(name), readAll(expectedName));
+
+    // the runs are gone once the table is written
+    QVERIFY(QDir(scratch.path()).entryList(QStringList() << "*-table-*.run").isEmpty());
+    }
+void TestResultTable::test_from_merge()
+    {
+    // two sorted runs merged straight into the table, as --output does
+    QString first = scratch.fileName("first.run");
+    QString second = scratch.fileName("second.run");
+    RunWriter writer;
+    QVERIFY(writer.open(first) == true);
+    writer.add(QByteArray("apple"), 2);
+    writer.add(QByteArray("banana"), 5);
+    QVERIFY(writer.close() == true);
+    QVERIFY(writer.open(second) == true);
+    writer.add(QByteArray("apple"), 3);
+    writer.add(QByteArray("cherry"), 4);
+    QVERIFY(writer.close() == true);
+
+    QString name = scratch.fileName("merged.csv");
+    TableExport table;
+    QVERIFY(table.open(name, TABLE_CSV, TABLE_BY_COUNT) == true);
+    QString error;
+    QVERIFY(mergeRuns(QStringList() << first << second, table, error) == true);
+    QVERIFY(table.close() == true);
+    QCOMPARE(readAll(name), QByteArray("word,count\nbanana,5\napple,5\ncherry,4\n"));
+    }
+void TestResultTable::test_options()
+    {
+    QString error;
+    IndexerOptions defaults;
+    QVERIFY(defaults.tableFormat == TABLE_NONE);
+    QVERIFY(defaults.tableOrder == TABLE_BY_COUNT);
+
+    IndexerOptions indexing;
+    QVERIFY(parseIndexerOptions(QStringList() << "--output=json" << "--sort" << "word" << "file.txt", indexing, error) == true);
+    QVERIFY(indexing.tableFormat == TABLE_JSON);
+    QVERIFY(indexing.tableOrder == TABLE_BY_KEY);
+    QVERIFY(indexing.files == QStringList() << "file.txt");
+
+    MergeOptions merging;
+    QVERIFY(parseMergeOptions(QStringList() << "--output" << "tsv" << "--sort=count" << "a.sfi", merging, error) == true);
+    QVERIFY(merging.tableFormat == TABLE_TSV);
+    QVERIFY(merging.tableOrder == TABLE_BY_COUNT);
+    QVERIFY(merging.partials == QStringList() << "a.sfi");
+
+    IndexerOptions bad;
+    QVERIFY(parseIndexerOptions(QStringList() << "--output=xml" << "file.txt", bad, error) == false);
+    QVERIFY(error.isEmpty() == false);
+    error.clear();
+    QVERIFY(parseIndexerOptions(QStringList() << "--sort=size" << "file.txt", bad, error) == false);
+    QVERIFY(error.isEmpty() == false);
+    }
+
+QTEST_MAIN(TestResultTable)
+#include "test_resultTable.moc"
@@ -0,0 +1,254 @@
+#include <QtTest/QtTest>
+#include <QFuture>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QStringList>
+#include <QtGlobal>
+
+#include <atomic>
+
+#include <simpleFileIndexer.h>
+
+#include "scratchDirectory.h"
+
+namespace
+    {
+    //! collects the results handed to a callback
+    class ResultCollector
+        {
+        public:
+            ResultCollector() : calls(0)
+                {
+                }
+            void operator()(const IndexResult& _result)
+                {
+                QMutexLocker lock(&guard);
+                ++calls;
+                last = _result;
+                }
+            QMutex guard;
+            int calls;
+            IndexResult last;
+        };
+
+    //! forwards to a collector that outlives the callback copies
+    class CollectInto
+        {
+        public:
+            CollectInto(ResultCollector& _collector) : collector(&_collector)
+                {
+                }
+            void operator()(const IndexResult& _result) const
+                {
+                (*collector)(_result);
+                }
+        private:
+            ResultCollector* collector;
+        };
+
+    //! collects the files named in progress messages
+    class MessageCollector
+        {
+        public:
+            void operator()(const QString& _fileName, const QString&)
+                {
+                QMutexLocker lock(&guard);
+                files << _fileName;
+                }
+            QMutex guard;
+            QStringList files;
+        };
+
+    //! messages that reached the Qt message handler
+    std::atomic<int> handledMessages(0);
+
+    void countMessages(QtMsgType, const char*)
+        {
+        ++handledMessages;
+        }
+    }
+
+class TestSimpleFileIndexer: public QObject
+    {
+    Q_OBJECT
+    public:
+        TestSimpleFileIndexer();
+        ~TestSimpleFileIndexer();
+    private slots:
+        void initTestCase();
+        void cleanupTestCase();
+        void init();
+        void cleanup();
+
+        // actual tests
+        void test_index_files();
+        void test_index_phrases();
+        void test_index_buffer();
+        void test_future();
+        void test_callback();
+        void test_concurrent_calls();
+        void test_file_log();
+
+    private:
+
+        ScratchDirectory scratch;
+    };
+TestSimpleFileIndexer::TestSimpleFileIndexer() : QObject(NULL)
+    {
+    }
+TestSimpleFileIndexer::~TestSimpleFileIndexer()
+    {
+    }
+void TestSimpleFileIndexer::initTestCase()
+    {
+    QVERIFY(scratch.create("test_simpleFileIndexer") == true);
+    }
+void TestSimpleFileIndexer::cleanupTestCase()
+    {
+    scratch.remove();
+    }
+void TestSimpleFileIndexer::init()
+    {
+    }
+void TestSimpleFileIndexer::cleanup()
+    {
+    scratch.clear();
+    }
+void TestSimpleFileIndexer::test_index_files()
+    {
+    QStringList files;
+    files << scratch.writeFile("one.txt", "the cat and the dog\n");
+    files << scratch.writeFile("two.txt", "The end\n");
+    files << files[0];
+
+    SimpleFileIndexer indexer(IndexerOptions(), 2);
+    IndexResult result = indexer.indexFiles(files);
+    QVERIFY(result.ngramOrder == 1);
+    QVERIFY(result.words.size() == 5);
+    QVERIFY(result.words["the"] == 5);
+    QVERIFY(result.words["cat"] == 2);
+    QVERIFY(result.dedup.files == 3);
+    QVERIFY(result.dedup.duplicateFiles == 1);
+
+    QVERIFY(result.top.size() == 2);
+    QVERIFY(result.top[0] == PhraseCount(5, "the"));
+    QVERIFY(result.top[1] == PhraseCount(2, "dog"));
+
+    // nothing to read is not an error
+    IndexResult empty = indexer.indexFiles(QStringList() << QString("%1/missing.txt").arg(scratch.path()));
+    QVERIFY(empty.words.isEmpty() == true);
+    QVERIFY(empty.top.empty() == true);
+    }
+void TestSimpleFileIndexer::test_index_phrases()
+    {
+    IndexerOptions options;
+    options.ngramOrder = 2;
+    QVERIFY(options.stopwords.build(QStringList() << "and") == true);
+
+    SimpleFileIndexer indexer(options);
+    IndexResult result = indexer.indexFiles(QStringList() << scratch.writeFile("phrases.txt", "big cat and big cat\n"));
+    QVERIFY(result.ngramOrder == 2);
+    QVERIFY(result.words.isEmpty() == true);
+    QVERIFY(result.phrases.count("big cat") == 2);
+    QVERIFY(result.phrases.count("cat big") == 0);
+    QVERIFY(result.top.size() == 1);
+    QVERIFY(result.top[0] == PhraseCount(2, "big cat"));
+    }
+void TestSimpleFileIndexer::test_index_buffer()
+    {
+    SimpleFileIndexer indexer;
+    IndexResult result = indexer.indexBuffer("Alpha beta, alpha; BETA alpha");
+    QVERIFY(result.words.size() == 2);
+    QVERIFY(result.words["alpha"] == 3);
+    QVERIFY(result.words["beta"] == 2);
+    QVERIFY(result.top[0] == PhraseCount(3, "alpha"));
+    QVERIFY(result.dedup.files == 0);
+
+    // the last word of the buffer counts, and phrases end with it
+    IndexerOptions options;
+    options.ngramOrder = 3;
+    IndexResult phrases = SimpleFileIndexer(options).indexBuffer("one two three four");
+    QVERIFY(phrases.phrases.size() == 2);
+    QVERIFY(phrases.phrases.count("two three four") == 1);
+    }
+void TestSimpleFileIndexer::test_future()
+    {
+    QString fileName = scratch.writeFile("future.txt", "red green red\n");
+
+    QFuture<IndexResult> files = SimpleFileIndexer().indexFilesAsync(QStringList() << fileName);
+    QFuture<IndexResult> buffer = SimpleFileIndexer().indexBufferAsync("blue blue");
+    files.waitForFinished();
+    buffer.waitForFinished();
+    QVERIFY(files.result().words["red"] == 2);
+    QVERIFY(buffer.result().words["blue"] == 2);
+    }
+void TestSimpleFileIndexer::test_callback()
+    {
+    QString fileName = scratch.writeFile("callback.txt", "red green red\n");
+
+    ResultCollector collector;
+    SimpleFileIndexer indexer;
+    QFuture<void> done = indexer.indexFilesAsync(QStringList() << fileName, CollectInto(collector));
+    done.waitForFinished();
+    QVERIFY(collector.calls == 1);
+    QVERIFY(collector.last.words["green"] == 1);
+
+    done = indexer.indexBufferAsync("yellow", CollectInto(collector));
+    done.waitForFinished();
+    QVERIFY(collector.calls == 2);
+    QVERIFY(collector.last.words["yellow"] == 1);
+    }
+void TestSimpleFileIndexer::test_concurrent_calls()
+    {
+    QStringList first;
+    QStringList second;
+    for (int i = 0; i < 20; ++i)
+        {
+        first << scratch.writeFile(QString("first%1.txt").arg(i), "apple banana apple\n");
+        second << scratch.writeFile(QString("second%1.txt").arg(i), QString("cherry word%1\n").arg(i).toLatin1());
+        }
+
+    // overlapping calls share the thread pool but never each other's counts
+    SimpleFileIndexer indexer;
+    QFuture<IndexResult> firstResult = indexer.indexFilesAsync(first);
+    QFuture<IndexResult> secondResult = indexer.indexFilesAsync(second);
+    IndexResult one = firstResult.result();
+    IndexResult two = secondResult.result();
+    QVERIFY(one.words.size() == 2);
+    QVERIFY(one.words["apple"] == 40);
+    QVERIFY(one.words["banana"] == 20);
+    QVERIFY(two.words.size() == 21);
+    QVERIFY(two.words["cherry"] == 20);
+    QVERIFY(two.words.contains("apple") == false);
+    }
+
+void TestSimpleFileIndexer::test_file_log()
+    {
+    QString fileName = scratch.writeFile("logged.txt", "quiet words\n");
+
+    // nothing reaches the process' message handler unless a log is set
+    handledMessages = 0;
+    QtMsgHandler previous = qInstallMsgHandler(countMessages);
+    SimpleFileIndexer indexer;
+    IndexResult files = indexer.indexFiles(QStringList() << fileName);
+    IndexResult buffer = indexer.indexBuffer("quiet");
+    qInstallMsgHandler(previous);
+    QVERIFY(handledMessages == 0);
+    QVERIFY(files.words["quiet"] == 1);
+    QVERIFY(buffer.words["quiet"] == 1);
+
+    MessageCollector collector;
+    indexer.setFileLog([&collector](const QString& _fileName, const QString& _message) { collector(_fileName, _message); });
+    indexer.indexFiles(QStringList() << fileName);
+    QVERIFY(collector.files.isEmpty() == false);
+    QVERIFY(collector.files.count(fileName) == collector.files.size());
+
+    // and an empty one turns them off again
+    collector.files.clear();
+    indexer.setFileLog(FileLog());
+    indexer.indexFiles(QStringList() << fileName);
+    QVERIFY(collector.files.isEmpty() == true);
+    }
+
+QTEST_MAIN(TestSimpleFileIndexer)
+#include "test_simpleFileIndexer.moc"
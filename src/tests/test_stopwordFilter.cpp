@@ -0,0 +1,128 @@
+#include <QtTest/QtTest>
+#include <QFile>
+#include <QStringList>
+#include <QtGlobal>
+
+#include <fileIndexer.h>
+#include <stopwordFilter.h>
+
+class TestStopwordFilter: public QObject
+    {
+    Q_OBJECT
+    public:
+        TestStopwordFilter();
+        ~TestStopwordFilter();
+    private slots:
+        void initTestCase();
+        void cleanupTestCase();
+        void init();
+        void cleanup();
+
+        // actual tests
+        void test_empty_filter();
+        void test_builtin_words();
+        void test_large_word_list();
+        void test_buffer_filtering();
+        void test_word_file();
+    };
+TestStopwordFilter::TestStopwordFilter() : QObject(NULL)
+    {
+    }
+TestStopwordFilter::~TestStopwordFilter()
+    {
+    }
+void TestStopwordFilter::initTestCase()
+    {
+    }
+void TestStopwordFilter::cleanupTestCase()
+    {
+    }
+void TestStopwordFilter::init()
+    {
+    }
+void TestStopwordFilter::cleanup()
+    {
+    }
+void TestStopwordFilter::test_empty_filter()
+    {
+    const StopwordFilter& filter = StopwordFilter::none();
+    QVERIFY(filter.isEmpty() == true);
+    QVERIFY(filter.size() == 0);
+    QVERIFY(filter.contains(QString("the")) == false);
+    QVERIFY(filter.contains(QString("")) == false);
+    }
+void TestStopwordFilter::test_builtin_words()
+    {
+    StopwordFilter filter;
+    QStringList words = StopwordFilter::builtinWords();
+    QVERIFY(filter.build(words) == true);
+    QVERIFY(filter.size() == words.size());
+
+    for (QStringList::const_iterator i = words.constBegin(); i != words.constEnd(); ++i)
+        {
+        QVERIFY(filter.contains(*i) == true);
+        QVERIFY(filter.contains((*i).toUpper()) == true);
+        }
+    QVERIFY(filter.contains(QString("The")) == true);
+    QVERIFY(filter.contains(QString("thee")) == false);
+    QVERIFY(filter.contains(QString("th")) == false);
+    QVERIFY(filter.contains(QString("gutenberg")) == false);
+    }
+void TestStopwordFilter::test_large_word_list()
+    {
+    QStringList words;
+    for (int i = 0; i < 5000; ++i)
+        {
+        words << QString("word%1").arg(i * 2);
+        }
+    // duplicates are only stored once
+    words << "WORD0" << "word2";
+
+    StopwordFilter filter;
+    QVERIFY(filter.build(words) == true);
+    QVERIFY(filter.size() == 5000);
+    for (int i = 0; i < 5000; ++i)
+        {
+        QVERIFY(filter.contains(QString("word%1").arg(i * 2)) == true);
+        QVERIFY(filter.contains(QString("word%1").arg((i * 2) + 1)) == false);
+        }
+    }
+void TestStopwordFilter::test_buffer_filtering()
+    {
+    StopwordFilter filter;
+    QVERIFY(filter.build(StopwordFilter::builtinWords()) == true);
+
+    QString data = "The cat and THE hat of the town\n";
+    WordCount results;
+    processBuffer("testing", data, false, results, TokenMatcher::defaultMatcher(), filter);
+    QVERIFY(results.size() == 3);
+    QVERIFY(results["cat"] == 1);
+    QVERIFY(results["hat"] == 1);
+    QVERIFY(results["town"] == 1);
+    QVERIFY(results.contains("the") == false);
+    }
+void TestStopwordFilter::test_word_file()
+    {
+    QString fileName = "test_stopwords.txt";
+    QFile wordFile(fileName);
+    QVERIFY(wordFile.open(QIODevice::WriteOnly|QIODevice::Text) == true);
+    wordFile.write("# project specific noise\nlorem ipsum\tdolor # trailing comment\n\nSIT\n");
+    wordFile.close();
+
+    QStringList words;
+    QVERIFY(StopwordFilter::readWordFile(fileName, words) == true);
+    QFile::remove(fileName);
+    QVERIFY(words.size() == 4);
+    QVERIFY(words.contains("dolor") == true);
+    QVERIFY(words.contains("comment") == false);
+
+    StopwordFilter filter;
+    QVERIFY(filter.build(words) == true);
+    QVERIFY(filter.contains(QString("sit")) == true);
+
+    QStringList missing;
+    QVERIFY(StopwordFilter::readWordFile("no-such-stopword-file.txt", missing) == false);
+    }
+
+QTEST_MAIN(TestStopwordFilter)
+#include "test_stopwordFilter.moc"
@@ -0,0 +1,267 @@
+#include <QtTest/QtTest>
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QtGlobal>
+
+#include <fileIndexer.h>
+#include <tokenMatcher.h>
+
+class TestTokenMatcher: public QObject
+    {
+    Q_OBJECT
+    public:
+        TestTokenMatcher();
+        ~TestTokenMatcher();
+    private slots:
+        void initTestCase();
+        void cleanupTestCase();
+        void init();
+        void cleanup();
+
+        // actual tests
+        void test_default_pattern();
+        void test_invalid_patterns();
+        void test_leftmost_longest();
+        void test_case_insensitive();
+        void test_custom_pattern_buffer();
+        void test_custom_pattern_carry_over();
+        void test_bounded_repeat();
+        void test_linear_scan();
+        void test_memo_results();
+        void test_options();
+    };
+TestTokenMatcher::TestTokenMatcher() : QObject(NULL)
+    {
+    }
+TestTokenMatcher::~TestTokenMatcher()
+    {
+    }
+void TestTokenMatcher::initTestCase()
+    {
+    }
+void TestTokenMatcher::cleanupTestCase()
+    {
+    }
+void TestTokenMatcher::init()
+    {
+    }
+void TestTokenMatcher::cleanup()
+    {
+    }
+void TestTokenMatcher::test_default_pattern()
+    {
+    const TokenMatcher& matcher = TokenMatcher::defaultMatcher();
+    QVERIFY(matcher.isValid() == true);
+    QVERIFY(matcher.pattern() == QString(DEFAULT_TOKEN_PATTERN));
+    // dead, start and accepting states over word and non-word classes
+    QVERIFY(matcher.stateCount() == 3);
+    QVERIFY(matcher.classCount() == 2);
+    }
+void TestTokenMatcher::test_invalid_patterns()
+    {
+    QStringList patterns;
+    patterns << "" << "a*" << "(ab" << "ab)" << "[a-" << "[z-a]" << "*a" << "a{3,1}" << "\\q" << "a|";
+
+    for (QStringList::const_iterator i = patterns.constBegin(); i != patterns.constEnd(); ++i)
+        {
+        TokenMatcher matcher;
+        QString error;
+        QVERIFY(matcher.compile(*i, &error) == false);
+        QVERIFY(error.isEmpty() == false);
+        QVERIFY(matcher.isValid() == false);
+        }
+    }
+void TestTokenMatcher::test_leftmost_longest()
+    {
+    TokenMatcher matcher("ab|abcd|x");
+    QVERIFY(matcher.isValid() == true);
+
+    QString data = "--abcdx abc";
+    TokenMatch match;
+    QVERIFY(matcher.findToken(data.constData(), data.length(), 0, match) == true);
+    QVERIFY(match.start == 2);
+    QVERIFY(match.length == 4);
+    QVERIFY(match.open == false);
+
+    QVERIFY(matcher.findToken(data.constData(), data.length(), 6, match) == true);
+    QVERIFY(match.start == 6);
+    QVERIFY(match.length == 1);
+
+    // "abc" could still become "abcd" with more data
+    QVERIFY(matcher.findToken(data.constData(), data.length(), 7, match) == true);
+    QVERIFY(match.start == 8);
+    QVERIFY(match.length == 2);
+    QVERIFY(match.open == true);
+    }
+void TestTokenMatcher::test_case_insensitive()
+    {
+    TokenMatcher matcher("0x[0-9a-f]+");
+    QVERIFY(matcher.isValid() == true);
+
+    QString data = "id 0XDEADbeef; ";
+    WordCount results;
+    processBuffer("testing", data, false, results, matcher);
+    QVERIFY(results.size() == 1);
+    QVERIFY(results.contains("0xdeadbeef") == true);
+    QVERIFY(results["0xdeadbeef"] == 1);
+    }
+void TestTokenMatcher::test_custom_pattern_buffer()
+    {
+    TokenMatcher matcher("[a-z0-9_]+(\\.[a-z0-9_]+)*");
+    QVERIFY(matcher.isValid() == true);
+
+    QString data = "foo_bar ip.addr, foo_bar. ip.addr.v4\n";
+    WordCount results;
+    processBuffer("testing", data, false, results, matcher);
+    QVERIFY(results.size() == 3);
+    QVERIFY(results["foo_bar"] == 2);
+    QVERIFY(results["ip.addr"] == 1);
+    QVERIFY(results["ip.addr.v4"] == 1);
+    QVERIFY(data.isEmpty() == true);
+    }
+void TestTokenMatcher::test_custom_pattern_carry_over()
+    {
+    TokenMatcher matcher("ip\\.addr");
+    QVERIFY(matcher.isValid() == true);
+
+    // the token is split across two reads
+    QString data = "x ip.ad";
+    WordCount results;
+    processBuffer("testing", data, false, results, matcher);
+    QVERIFY(results.size() == 0);
+    QVERIFY(data == QString("ip.ad"));
+
+    data += "dr ip.";
+    processBuffer("testing", data, false, results, matcher);
+    QVERIFY(results["ip.addr"] == 1);
+    QVERIFY(data == QString("ip."));
+
+    // at the end of the file a partial token is simply dropped
+    processBuffer("testing", data, true, results, matcher);
+    QVERIFY(results.size() == 1);
+    QVERIFY(results["ip.addr"] == 1);
+    QVERIFY(data.isEmpty() == true);
+    }
+void TestTokenMatcher::test_bounded_repeat()
+    {
+    TokenMatcher matcher("[0-9a-f]{4}(-[0-9a-f]{4}){1,2}");
+    QVERIFY(matcher.isValid() == true);
+
+    QString data = "12ab-cd34 1234 0000-1111-2222-3333 ";
+    WordCount results;
+    processBuffer("testing", data, true, results, matcher);
+    QVERIFY(results.size() == 2);
+    QVERIFY(results["12ab-cd34"] == 1);
+    QVERIFY(results["0000-1111-2222"] == 1);
+    QVERIFY(results.contains("3333") == false);
+    QVERIFY(results.contains("1234") == false);
+    }
+void TestTokenMatcher::test_linear_scan()
+    {
+    // every start in the run of letters reads to its end before failing; read
+    // again from each start that is some 10^10 steps
+    TokenMatcher dotted("[a-z]+\\.[a-z]+");
+    QVERIFY(dotted.isValid() == true);
+    QString data = QString(200000, QChar('a')) + QString(" x.y ");
+
+    QElapsedTimer timer;
+    timer.start();
+    TokenMatch match;
+    QVERIFY(dotted.findToken(data.constData(), data.length(), 0, match) == true);
+    QVERIFY(match.start == 200001);
+    QVERIFY(match.length == 3);
+    QVERIFY(match.open == false);
+
+    // each "a" is a token, but only reading to the "c" shows it is not the start of "a...ab"
+    TokenMatcher longest("a|a*b");
+    QVERIFY(longest.isValid() == true);
+    QString run = QString(200000, QChar('a')) + QString("c");
+    TokenScanMemo memo;
+    int tokens = 0;
+    int position = 0;
+    while (longest.findToken(run.constData(), run.length(), position, match, &memo))
+        {
+        QVERIFY(match.start == position);
+        QVERIFY(match.length == 1);
+        ++tokens;
+        position = match.start + match.length;
+        }
+    QVERIFY(tokens == 200000);
+
+    // the same with the end of the data, where every scan is still open
+    QString end = QString(200000, QChar('a'));
+    memo.reset();
+    tokens = 0;
+    position = 0;
+    while (longest.findToken(end.constData(), end.length(), position, match, &memo))
+        {
+        QVERIFY(match.open == true);
+        QVERIFY(match.length == 1);
+        ++tokens;
+        position = match.start + match.length;
+        }
+    QVERIFY(tokens == 200000);
+
+    // linear is a few milliseconds; quadratic would be minutes
+    QVERIFY(timer.elapsed() < 5000);
+    }
+void TestTokenMatcher::test_memo_results()
+    {
+    // a memo kept across the calls must find exactly what separate calls find
+    QStringList patterns;
+    patterns << "[a-z]+\\.[a-z]+" << "a|a*b" << "ab|abcd|x" << "(ab)+c?" << "[0-9a-f]{4}(-[0-9a-f]{4}){1,2}";
+    const char alphabet[] = "abcdx.-0 ";
+    uint32_t state = 12345;
+    for (QStringList::const_iterator pattern = patterns.constBegin(); pattern != patterns.constEnd(); ++pattern)
+        {
+        TokenMatcher matcher(*pattern);
+        QVERIFY(matcher.isValid() == true);
+        for (int round = 0; round < 50; ++round)
+            {
+            QString data;
+            for (int i = 0; i < 200; ++i)
+                {
+                state = state * 1103515245 + 12345;
+                data += QChar(alphabet[(state >> 16) % (sizeof(alphabet) - 1)]);
+                }
+
+            TokenScanMemo memo;
+            TokenMatch kept;
+            TokenMatch fresh;
+            int position = 0;
+            bool found = true;
+            while (found)
+                {
+                found = matcher.findToken(data.constData(), data.length(), position, kept, &memo);
+                QVERIFY(matcher.findToken(data.constData(), data.length(), position, fresh) == found);
+                if (found)
+                    {
+                    QVERIFY(kept.start == fresh.start);
+                    QVERIFY(kept.length == fresh.length);
+                    QVERIFY(kept.open == fresh.open);
+                    position = kept.start + qMax(kept.length, 1);
+                    }
+                }
+            }
+        }
+    }
+void TestTokenMatcher::test_options()
+    {
+    QStringList arguments;
+    arguments << "first.txt" << "--token-pattern" << "[a-z_]+" << "second.txt";
+
+    IndexerOptions options;
+    QString error;
+    QVERIFY(parseIndexerOptions(arguments, options, error) == true);
+    QVERIFY(options.files.size() == 2);
+    QVERIFY(options.matcher.pattern() == QString("[a-z_]+"));
+
+    IndexerOptions badOptions;
+    QStringList badArguments;
+    badArguments << "--token-pattern=(";
+    QVERIFY(parseIndexerOptions(badArguments, badOptions, error) == false);
+    QVERIFY(error.isEmpty() == false);
+    }
+
+QTEST_MAIN(TestTokenMatcher)
+#include "test_tokenMatcher.moc"
@@ -0,0 +1,357 @@
+#include <QtTest/QtTest>
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+#include <QStringList>
+
+#include <stdint.h>
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <countRuns.h>
+#include <indexerOptions.h>
+#include <vocabularyTrie.h>
+
+#include "scratchDirectory.h"
+
+class TestVocabularyTrie: public QObject
+    {
+    Q_OBJECT
+    public:
+        TestVocabularyTrie();
+        ~TestVocabularyTrie();
+    private slots:
+        void initTestCase();
+        void cleanupTestCase();
+        void init();
+        void cleanup();
+
+        // actual tests
+        void test_lookup();
+        void test_prefix_entries();
+        void test_top_within_prefix();
+        void test_compact();
+        void test_from_merge();
+        void test_bad_input();
+        void test_options();
+
+    private:
+        typedef std::vector<std::pair<std::string, uint64_t> > Records;
+
+        //! receives the records of an enumeration
+        class Collector : public RunConsumer
+            {
+            public:
+                void add(const QByteArray& _key, uint64_t _count)
+                    {
+                    records.push_back(std::make_pair(std::string(_key.constData(), _key.size()), _count));
+                    }
+                Records records;
+            };
+
+        bool writeVocabulary(const QString& _fileName, const Records& _records);
+        static Records generate(int _words);
+
+        ScratchDirectory scratch;
+    };
+TestVocabularyTrie::TestVocabularyTrie() : QObject(NULL)
+    {
+    }
+TestVocabularyTrie::~TestVocabularyTrie()
+    {
+    }
+void TestVocabularyTrie::initTestCase()
+    {
+    QVERIFY(scratch.create("test_vocabularyTrie") == true);
+    }
+void TestVocabularyTrie::cleanupTestCase()
+    {
+    scratch.remove();
+    }
+void TestVocabularyTrie::init()
+    {
+    }
+void TestVocabularyTrie::cleanup()
+    {
+    scratch.clear();
+    }
+bool TestVocabularyTrie::writeVocabulary(const QString& _fileName, const Records& _records)
+    {
+    VocabularyWriter writer;
+    if (!writer.open(_fileName))
+        {
+        return false;
+        }
+    for (Records::const_iterator iter = _records.begin(); iter != _records.end(); ++iter)
+        {
+        writer.add(QByteArray(iter->first.data(), static_cast<int>(iter->first.size())), iter->second);
+        }
+    return writer.close() && writer.records() == _records.size();
+    }
+TestVocabularyTrie::Records TestVocabularyTrie::generate(int _words)
+    {
+    // words built from a few stems and endings, so many share prefixes
+    const char* stems[] = { "connect", "con", "cat", "catalog", "index", "in", "run", "runner", "zebra" };
+    const char* endings[] = { "", "s", "ed", "ing", "ion", "ions", "er", "ers", "ly", "ness" };
+    std::vector<std::string> words;
+    uint32_t state = 4711;
+    for (int i = 0; i < _words; ++i)
+        {
+        state = state * 1103515245 + 12345;
+        std::string word = stems[(state >> 8) % 9];
+        word += endings[(state >> 16) % 10];
+        word += static_cast<char>('a' + (i % 26));
+        if (i % 3 == 0)
+            {
+            word += static_cast<char>('a' + ((i / 26) % 26));
+            }
+        words.push_back(word);
+        }
+    std::sort(words.begin(), words.end());
+    words.erase(std::unique(words.begin(), words.end()), words.end());
+
+    Records records;
+    for (size_t i = 0; i < words.size(); ++i)
+        {
+        // plenty of equal counts, to check the order of ties
+        state = state * 1103515245 + 12345;
+        records.push_back(std::make_pair(words[i], static_cast<uint64_t>(1 + ((state >> 8) % 50))));
+        }
+    return records;
+    }
+void TestVocabularyTrie::test_lookup()
+    {
+    Records records;
+    records.push_back(std::make_pair(std::string("a"), 7));
+    records.push_back(std::make_pair(std::string("cat"), 3));
+    records.push_back(std::make_pair(std::string("connect"), 10));
+    records.push_back(std::make_pair(std::string("connected"), 4));
+    records.push_back(std::make_pair(std::string("connection"), 12));
+    records.push_back(std::make_pair(std::string("connections"), 2));
+    records.push_back(std::make_pair(std::string("connector"), 1));
+    records.push_back(std::make_pair(std::string("na\xc3\xafve"), 5));
+    QString name = scratch.fileName("lookup.sfv");
+    QVERIFY(writeVocabulary(name, records) == true);
+
+    Vocabulary vocabulary;
+    QVERIFY(vocabulary.open(name) == true);
+    QVERIFY(vocabulary.order() == 1);
+    QVERIFY(vocabulary.size() == 8);
+    for (Records::const_iterator iter = records.begin(); iter != records.end(); ++iter)
+        {
+        QVERIFY(vocabulary.count(QString::fromUtf8(iter->first.data())) == iter->second);
+        }
+    QVERIFY(vocabulary.count(QString::fromUtf8("na\xc3\xafve")) == 5);
+
+    // prefixes of keys, and keys running past them, are not keys
+    QVERIFY(vocabulary.count("") == 0);
+    QVERIFY(vocabulary.count("conn") == 0);
+    QVERIFY(vocabulary.count("connecte") == 0);
+    QVERIFY(vocabulary.count("connectionss") == 0);
+    QVERIFY(vocabulary.count("b") == 0);
+    QVERIFY(vocabulary.count("zzz") == 0);
+    QVERIFY(vocabulary.failed() == false);
+
+    // an empty vocabulary is still a valid one
+    QString emptyName = scratch.fileName("empty.sfv");
+    QVERIFY(writeVocabulary(emptyName, Records()) == true);
+    Vocabulary empty;
+    QVERIFY(empty.open(emptyName) == true);
+    QVERIFY(empty.size() == 0);
+    QVERIFY(empty.count("a") == 0);
+    QVERIFY(empty.top("", 10).empty() == true);
+    }
+void TestVocabularyTrie::test_prefix_entries()
+    {
+    Records records = generate(3000);
+    QString name = scratch.fileName("entries.sfv");
+    QVERIFY(writeVocabulary(name, records) == true);
+    Vocabulary vocabulary;
+    QVERIFY(vocabulary.open(name) == true);
+    QVERIFY(vocabulary.size() == records.size());
+
+    // everything, in order
+    Collector all;
+    QVERIFY(vocabulary.entries("", all) == true);
+    QVERIFY(all.records == records);
+
+    // the prefix may end at a node, part way along an edge, or match nothing
+    QStringList prefixes = QStringList() << "c" << "con" << "conn" << "connection" << "catalo" << "in" << "zebra" << "q" << "runnerx";
+    for (QStringList::const_iterator prefix = prefixes.constBegin(); prefix != prefixes.constEnd(); ++prefix)
+        {
+        std::string start = prefix->toLatin1().data();
+        Records expected;
+        for (Records::const_iterator iter = records.begin(); iter != records.end(); ++iter)
+            {
+            if (iter->first.compare(0, start.size(), start) == 0)
+                {
+                expected.push_back(*iter);
+                }
+            }
+        Collector found;
+        QVERIFY(vocabulary.entries(*prefix, found) == true);
+        QVERIFY(found.records == expected);
+        }
+    }
+void TestVocabularyTrie::test_top_within_prefix()
+    {
+    Records records = generate(5000);
+    QString name = scratch.fileName("top.sfv");
+    QVERIFY(writeVocabulary(name, records) == true);
+    Vocabulary vocabulary;
+    QVERIFY(vocabulary.open(name) == true);
+
+    QStringList prefixes = QStringList() << "" << "c" << "conn" << "cat" << "runn" << "zebraly" << "q";
+    int limits[] = { 1, 5, 10, 100000 };
+    for (QStringList::const_iterator prefix = prefixes.constBegin(); prefix != prefixes.constEnd(); ++prefix)
+        {
+        std::string start = prefix->toLatin1().data();
+        std::vector<std::pair<uint64_t, std::string> > ranked;
+        for (Records::const_iterator iter = records.begin(); iter != records.end(); ++iter)
+            {
+            if (iter->first.compare(0, start.size(), start) == 0)
+                {
+                ranked.push_back(std::make_pair(iter->second, iter->first));
+                }
+            }
+        // most frequent first, ties with the later key first
+        std::sort(ranked.rbegin(), ranked.rend());
+
+        for (size_t limit = 0; limit < sizeof(limits) / sizeof(limits[0]); ++limit)
+            {
+            std::vector<PhraseCount> top = vocabulary.top(*prefix, limits[limit]);
+            QVERIFY(top.size() == std::min(ranked.size(), static_cast<size_t>(limits[limit])));
+            for (size_t i = 0; i < top.size(); ++i)
+                {
+                QVERIFY(top[i].first == ranked[i].first);
+                QVERIFY(top[i].second == QString::fromLatin1(ranked[i].second.c_str()));
+                }
+            }
+        }
+    QVERIFY(vocabulary.top("c", 0).empty() == true);
+    QVERIFY(vocabulary.failed() == false);
+    }
+void TestVocabularyTrie::test_compact()
+    {
+    Records records = generate(20000);
+    QString name = scratch.fileName("compact.sfv");
+    QVERIFY(writeVocabulary(name, records) == true);
+
+    // a flat table: every key with a terminator and a 64-bit count
+    uint64_t flat = 0;
+    for (Records::const_iterator iter = records.begin(); iter != records.end(); ++iter)
+        {
+        flat += iter->first.size() + 1 + sizeof(uint64_t);
+        }
+    QVERIFY(static_cast<uint64_t>(QFile(name).size()) < flat / 2);
+    }
+void TestVocabularyTrie::test_from_merge()
+    {
+    // two sorted runs merged straight into a vocabulary, as --emit-vocabulary does
+    QString first = scratch.fileName("first.run");
+    QString second = scratch.fileName("second.run");
+    RunWriter writer;
+    QVERIFY(writer.open(first) == true);
+    writer.add(QByteArray("apple"), 2);
+    writer.add(QByteArray("apples"), 1);
+    writer.add(QByteArray("banana"), 5);
+    QVERIFY(writer.close() == true);
+    QVERIFY(writer.open(second) == true);
+    writer.add(QByteArray("apple"), 3);
+    writer.add(QByteArray("cherry"), 4);
+    QVERIFY(writer.close() == true);
+
+    QString name = scratch.fileName("merged.sfv");
+    VocabularyWriter vocabularyWriter;
+    QVERIFY(vocabularyWriter.open(name, 2) == true);
+    QString error;
+    QVERIFY(mergeRuns(QStringList() << first << second, vocabularyWriter, error) == true);
+    QVERIFY(vocabularyWriter.close() == true);
+    QVERIFY(vocabularyWriter.records() == 4);
+    QVERIFY(vocabularyWriter.size() == static_cast<uint64_t>(QFile(name).size()));
+
+    Vocabulary vocabulary;
+    QVERIFY(vocabulary.open(name) == true);
+    QVERIFY(vocabulary.order() == 2);
+    QVERIFY(vocabulary.count("apple") == 5);
+    QVERIFY(vocabulary.count("apples") == 1);
+    QVERIFY(vocabulary.count("banana") == 5);
+    QVERIFY(vocabulary.count("cherry") == 4);
+    std::vector<PhraseCount> top = vocabulary.top("", 2);
+    QVERIFY(top.size() == 2);
+    QVERIFY(top[0] == PhraseCount(5, "banana"));
+    QVERIFY(top[1] == PhraseCount(5, "apple"));
+    }
+void TestVocabularyTrie::test_bad_input()
+    {
+    // keys out of order, or repeated, fail the vocabulary
+    QString name = scratch.fileName("unordered.sfv");
+    VocabularyWriter writer;
+    QVERIFY(writer.open(name) == true);
+    writer.add(QByteArray("b"), 1);
+    writer.add(QByteArray("a"), 1);
+    QVERIFY(writer.close() == false);
+    QVERIFY(writer.open(name) == true);
+    writer.add(QByteArray("a"), 1);
+    writer.add(QByteArray("a"), 1);
+    QVERIFY(writer.close() == false);
+
+    // other files are not vocabularies
+    Vocabulary vocabulary;
+    QVERIFY(vocabulary.open(scratch.fileName("missing.sfv")) == false);
+    QString partial = scratch.fileName("partial.sfi");
+    RunWriter partialWriter;
+    QVERIFY(partialWriter.open(partial, 1) == true);
+    partialWriter.add(QByteArray("apple"), 2);
+    QVERIFY(partialWriter.close() == true);
+    QVERIFY(vocabulary.open(partial) == false);
+    QVERIFY(vocabulary.count("apple") == 0);
+
+    // a truncated vocabulary is refused, or fails its queries, but never reads past the end
+    Records records = generate(500);
+    QString truncated = scratch.fileName("truncated.sfv");
+    QVERIFY(writeVocabulary(truncated, records) == true);
+    QVERIFY(QFile::resize(truncated, QFile(truncated).size() / 2) == true);
+    if (vocabulary.open(truncated))
+        {
+        Collector all;
+        vocabulary.entries("", all);
+        vocabulary.top("", 10);
+        QVERIFY(all.records.size() < records.size() || vocabulary.failed() == true);
+        }
+    }
+void TestVocabularyTrie::test_options()
+    {
+    QString error;
+    IndexerOptions indexing;
+    QVERIFY(parseIndexerOptions(QStringList() << "--emit-vocabulary=words.sfv" << "file.txt", indexing, error) == true);
+    QVERIFY(indexing.vocabularyFile == "words.sfv");
+    QVERIFY(indexing.files == QStringList() << "file.txt");
+
+    MergeOptions merging;
+    QVERIFY(parseMergeOptions(QStringList() << "--emit-vocabulary" << "all.sfv" << "a.sfi", merging, error) == true);
+    QVERIFY(merging.vocabularyFile == "all.sfv");
+    QVERIFY(merging.partials == QStringList() << "a.sfi");
+
+    QueryOptions defaults;
+    QVERIFY(defaults.listPrefix == false);
+    QVERIFY(defaults.topCount == 0);
+
+    QueryOptions query;
+    QVERIFY(parseQueryOptions(QStringList() << "words.sfv" << "--prefix=con" << "--top=5" << "apple" << "pear", query, error) == true);
+    QVERIFY(query.vocabularyFile == "words.sfv");
+    QVERIFY(query.keys == QStringList() << "apple" << "pear");
+    QVERIFY(query.prefix == "con");
+    QVERIFY(query.listPrefix == true);
+    QVERIFY(query.topCount == 5);
+
+    QueryOptions bad;
+    QVERIFY(parseQueryOptions(QStringList() << "words.sfv" << "--top=0", bad, error) == false);
+    QVERIFY(error.isEmpty() == false);
+    QVERIFY(parseQueryOptions(QStringList() << "--emit-partial=x", bad, error) == false);
+    }
+
+QTEST_MAIN(TestVocabularyTrie)
+#include "test_vocabularyTrie.moc"
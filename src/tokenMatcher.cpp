@@ -0,0 +1,1125 @@
+#include <tokenMatcher.h>
+
+#include <algorithm>
+#include <bitset>
+#include <map>
+#include <set>
+#include <vector>
+
+namespace
+    {
+    // input alphabet: 0-255 are the Latin-1 characters, the last symbol stands in
+    // for every character outside of Latin-1
+    const int SYMBOL_COUNT = 257;
+    const int WIDE_SYMBOL = 256;
+
+    // limits to keep a hostile pattern from eating the machine at startup
+    const int MAX_REPEAT = 255;
+    const int MAX_NFA_STATES = 65536;
+    const int MAX_DFA_STATES = 4096;
+
+    // a scan that reads no further than this past its last accepting state is not
+    // worth remembering; it costs at most this much again from each start
+    const int MEMO_MIN_TAIL = 4;
+
+    typedef std::bitset<SYMBOL_COUNT> SymbolSet;
+
+    /*! \brief Parsed Pattern Element
+     */
+    struct PatternNode
+        {
+        enum NodeType
+            {
+            Symbols,
+            Concat,
+            Alternate,
+            Repeat
+            };
+
+        NodeType type;
+        //! characters matched by a Symbols node
+        SymbolSet symbols;
+        //! sub-expressions of Concat, Alternate and Repeat nodes
+        std::vector<int> children;
+        //! repetition bounds; maxRepeat of -1 is unbounded
+        int minRepeat;
+        int maxRepeat;
+        };
+
+    /*! \brief Fold ASCII and Latin-1 letters so both cases are matched
+     */
+    void foldCase(SymbolSet& _symbols)
+        {
+        SymbolSet folded = _symbols;
+        for (int c = 0; c < 256; ++c)
+            {
+            if (!_symbols.test(c))
+                {
+                continue;
+                }
+            if (c >= 'A' && c <= 'Z')
+                {
+                folded.set(c + 0x20);
+                }
+            else if (c >= 'a' && c <= 'z')
+                {
+                folded.set(c - 0x20);
+                }
+            else if (c >= 0xC0 && c <= 0xDE && c != 0xD7)
+                {
+                folded.set(c + 0x20);
+                }
+            else if (c >= 0xE0 && c <= 0xFE && c != 0xF7)
+                {
+                folded.set(c - 0x20);
+                }
+            }
+        _symbols = folded;
+        }
+
+    /*! \brief Recursive Descent Pattern Parser
+     *
+     *  alternate := concat ('|' concat)*
+     *  concat    := repeat*
+     *  repeat    := atom ('*' | '+' | '?' | '{m}' | '{m,}' | '{m,n}')*
+     *  atom      := literal | '.' | class | escape | '(' alternate ')'
+     */
+    class PatternParser
+        {
+        public:
+            PatternParser(const QString& _pattern, std::vector<PatternNode>& _nodes) :
+                pattern(_pattern), position(0), nodes(_nodes)
+                {
+                }
+
+            int parse(QString& _error)
+                {
+                int root = parseAlternate();
+                if (root != -1 && position != pattern.length())
+                    {
+                    fail(QString("unexpected '%1'").arg(pattern[position]));
+                    root = -1;
+                    }
+                _error = error;
+                return (error.isEmpty() ? root : -1);
+                }
+
+        private:
+            const QString& pattern;
+            int position;
+            std::vector<PatternNode>& nodes;
+            QString error;
+
+            bool atEnd() const
+                {
+                return position >= pattern.length();
+                }
+            ushort peek() const
+                {
+                return pattern[position].unicode();
+                }
+            void fail(const QString& _message)
+                {
+                if (error.isEmpty())
+                    {
+                    error = QString("%1 at offset %2").arg(_message).arg(position);
+                    }
+                }
+
+            int addNode(PatternNode::NodeType _type)
+                {
+                PatternNode node;
+                node.type = _type;
+                node.minRepeat = 0;
+                node.maxRepeat = 0;
+                nodes.push_back(node);
+                return static_cast<int>(nodes.size() - 1);
+                }
+            int addSymbols(const SymbolSet& _symbols)
+                {
+                int index = addNode(PatternNode::Symbols);
+                nodes[index].symbols = _symbols;
+                return index;
+                }
+
+            int parseAlternate()
+                {
+                int first = parseConcat();
+                if (first == -1 || atEnd() || peek() != '|')
+                    {
+                    return first;
+                    }
+                int alternate = addNode(PatternNode::Alternate);
+                nodes[alternate].children.push_back(first);
+                while (!atEnd() && peek() == '|')
+                    {
+                    ++position;
+                    int next = parseConcat();
+                    if (next == -1)
+                        {
+                        return -1;
+                        }
+                    nodes[alternate].children.push_back(next);
+                    }
+                return alternate;
+                }
+
+            int parseConcat()
+                {
+                int concat = addNode(PatternNode::Concat);
+                while (!atEnd() && peek() != '|' && peek() != ')')
+                    {
+                    int next = parseRepeat();
+                    if (next == -1)
+                        {
+                        return -1;
+                        }
+                    nodes[concat].children.push_back(next);
+                    }
+                return concat;
+                }
+
+            bool parseNumber(int& _value)
+                {
+                int start = position;
+                _value = 0;
+                while (!atEnd() && peek() >= '0' && peek() <= '9')
+                    {
+                    _value = (_value * 10) + (peek() - '0');
+                    if (_value > MAX_REPEAT)
+                        {
+                        fail(QString("repeat count larger than %1").arg(MAX_REPEAT));
+                        return false;
+                        }
+                    ++position;
+                    }
+                return position != start;
+                }
+
+            int parseRepeat()
+                {
+                int atom = parseAtom();
+                while (atom != -1 && !atEnd())
+                    {
+                    int minimum = 0;
+                    int maximum = -1;
+                    ushort c = peek();
+                    if (c == '*')
+                        {
+                        ++position;
+                        }
+                    else if (c == '+')
+                        {
+                        minimum = 1;
+                        ++position;
+                        }
+                    else if (c == '?')
+                        {
+                        maximum = 1;
+                        ++position;
+                        }
+                    else if (c == '{')
+                        {
+                        ++position;
+                        if (!parseNumber(minimum))
+                            {
+                            fail("expected repeat count");
+                            return -1;
+                            }
+                        maximum = minimum;
+                        if (!atEnd() && peek() == ',')
+                            {
+                            ++position;
+                            maximum = -1;
+                            if (!atEnd() && peek() != '}' && !parseNumber(maximum))
+                                {
+                                fail("expected repeat count");
+                                return -1;
+                                }
+                            }
+                        if (atEnd() || peek() != '}')
+                            {
+                            fail("expected '}'");
+                            return -1;
+                            }
+                        ++position;
+                        if (maximum != -1 && maximum < minimum)
+                            {
+                            fail("repeat maximum is less than its minimum");
+                            return -1;
+                            }
+                        }
+                    else
+                        {
+                        break;
+                        }
+
+                    int repeat = addNode(PatternNode::Repeat);
+                    nodes[repeat].children.push_back(atom);
+                    nodes[repeat].minRepeat = minimum;
+                    nodes[repeat].maxRepeat = maximum;
+                    atom = repeat;
+                    }
+                return atom;
+                }
+
+            bool parseHex(int& _value)
+                {
+                _value = 0;
+                for (int digit = 0; digit < 2; ++digit)
+                    {
+                    if (atEnd())
+                        {
+                        return false;
+                        }
+                    ushort c = peek();
+                    int nibble = -1;
+                    if (c >= '0' && c <= '9') nibble = c - '0';
+                    else if (c >= 'a' && c <= 'f') nibble = c - 'a' + 10;
+                    else if (c >= 'A' && c <= 'F') nibble = c - 'A' + 10;
+                    if (nibble == -1)
+                        {
+                        return false;
+                        }
+                    _value = (_value << 4) | nibble;
+                    ++position;
+                    }
+                return true;
+                }
+
+            // parse the character after a '\'; returns the single character
+            // it stands for, or -1 with _symbols filled in for a shorthand class
+            bool parseEscape(int& _character, SymbolSet& _symbols)
+                {
+                if (atEnd())
+                    {
+                    fail("trailing '\\'");
+                    return false;
+                    }
+                ushort c = peek();
+                ++position;
+                _character = -1;
+                _symbols.reset();
+                switch (c)
+                    {
+                    case 'd':
+                    case 'D':
+                        for (int i = '0'; i <= '9'; ++i) _symbols.set(i);
+                        break;
+                    case 'w':
+                    case 'W':
+                        for (int i = '0'; i <= '9'; ++i) _symbols.set(i);
+                        for (int i = 'a'; i <= 'z'; ++i) _symbols.set(i);
+                        for (int i = 'A'; i <= 'Z'; ++i) _symbols.set(i);
+                        _symbols.set('_');
+                        break;
+                    case 's':
+                    case 'S':
+                        _symbols.set(' ');
+                        for (int i = '\t'; i <= '\r'; ++i) _symbols.set(i);
+                        break;
+                    case 't': _character = '\t'; break;
+                    case 'n': _character = '\n'; break;
+                    case 'r': _character = '\r'; break;
+                    case 'f': _character = '\f'; break;
+                    case 'v': _character = '\v'; break;
+                    case 'x':
+                        if (!parseHex(_character))
+                            {
+                            fail("expected two hex digits");
+                            return false;
+                            }
+                        break;
+                    default:
+                        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9'))
+                            {
+                            fail(QString("unsupported escape '\\%1'").arg(QChar(c)));
+                            return false;
+                            }
+                        _character = c;
+                        break;
+                    };
+                if (c == 'D' || c == 'W' || c == 'S')
+                    {
+                    _symbols.flip();
+                    }
+                if (_character > 255)
+                    {
+                    fail("only Latin-1 characters are supported");
+                    return false;
+                    }
+                return true;
+                }
+
+            bool parseClass(SymbolSet& _symbols)
+                {
+                // the '[' has already been consumed
+                bool negate = false;
+                if (!atEnd() && peek() == '^')
+                    {
+                    negate = true;
+                    ++position;
+                    }
+                _symbols.reset();
+                bool first = true;
+                while (!atEnd() && (peek() != ']' || first))
+                    {
+                    first = false;
+                    int low = peek();
+                    ++position;
+                    if (low == '\\')
+                        {
+                        SymbolSet shorthand;
+                        if (!parseEscape(low, shorthand))
+                            {
+                            return false;
+                            }
+                        if (low == -1)
+                            {
+                            _symbols |= shorthand;
+                            continue;
+                            }
+                        }
+                    int high = low;
+                    if (position + 1 < pattern.length() && peek() == '-' && pattern[position + 1] != QChar(']'))
+                        {
+                        ++position;
+                        high = peek();
+                        ++position;
+                        if (high == '\\')
+                            {
+                            SymbolSet shorthand;
+                            if (!parseEscape(high, shorthand) || high == -1)
+                                {
+                                fail("invalid range");
+                                return false;
+                                }
+                            }
+                        }
+                    if (low > 255 || high > 255)
+                        {
+                        fail("only Latin-1 characters are supported");
+                        return false;
+                        }
+                    if (high < low)
+                        {
+                        fail("invalid range");
+                        return false;
+                        }
+                    for (int c = low; c <= high; ++c)
+                        {
+                        _symbols.set(c);
+                        }
+                    }
+                if (atEnd())
+                    {
+                    fail("expected ']'");
+                    return false;
+                    }
+                ++position;
+                foldCase(_symbols);
+                if (negate)
+                    {
+                    _symbols.flip();
+                    }
+                return true;
+                }
+
+            int parseAtom()
+                {
+                ushort c = peek();
+                ++position;
+                SymbolSet symbols;
+                switch (c)
+                    {
+                    case '(':
+                        {
+                        if (position + 1 < pattern.length() && peek() == '?' && pattern[position + 1] == QChar(':'))
+                            {
+                            position += 2;
+                            }
+                        int group = parseAlternate();
+                        if (group == -1)
+                            {
+                            return -1;
+                            }
+                        if (atEnd() || peek() != ')')
+                            {
+                            fail("expected ')'");
+                            return -1;
+                            }
+                        ++position;
+                        return group;
+                        }
+                    case '[':
+                        if (!parseClass(symbols))
+                            {
+                            return -1;
+                            }
+                        return addSymbols(symbols);
+                    case '.':
+                        symbols.set();
+                        symbols.reset('\n');
+                        return addSymbols(symbols);
+                    case '\\':
+                        {
+                        int character = -1;
+                        if (!parseEscape(character, symbols))
+                            {
+                            return -1;
+                            }
+                        if (character != -1)
+                            {
+                            symbols.set(character);
+                            foldCase(symbols);
+                            }
+                        return addSymbols(symbols);
+                        }
+                    case '*':
+                    case '+':
+                    case '?':
+                    case '{':
+                        --position;
+                        fail("nothing to repeat");
+                        return -1;
+                    case ')':
+                        --position;
+                        fail("unbalanced ')'");
+                        return -1;
+                    default:
+                        if (c > 255)
+                            {
+                            --position;
+                            fail("only Latin-1 characters are supported");
+                            return -1;
+                            }
+                        symbols.set(c);
+                        foldCase(symbols);
+                        return addSymbols(symbols);
+                    };
+                }
+        };
+
+    /*! \brief Thompson NFA
+     *
+     *  Each state has at most one symbol edge plus any number of epsilon edges
+     */
+    class Nfa
+        {
+        public:
+            struct State
+                {
+                //! index into symbolSets of the symbol edge, -1 if there is none
+                int symbolSet;
+                //! target of the symbol edge
+                int next;
+                //! epsilon edges
+                std::vector<int> epsilon;
+                };
+            struct Fragment
+                {
+                int start;
+                int end;
+                };
+
+            std::vector<State> states;
+            std::vector<SymbolSet> symbolSets;
+
+            Nfa(const std::vector<PatternNode>& _nodes) : nodes(_nodes), overflow(false)
+                {
+                }
+
+            bool build(int _root, Fragment& _result)
+                {
+                _result = generate(_root);
+                return !overflow;
+                }
+
+        private:
+            const std::vector<PatternNode>& nodes;
+            bool overflow;
+
+            int addState()
+                {
+                if (static_cast<int>(states.size()) >= MAX_NFA_STATES)
+                    {
+                    overflow = true;
+                    // keep handing back a valid index; the result is discarded anyway
+                    return 0;
+                    }
+                State state;
+                state.symbolSet = -1;
+                state.next = -1;
+                states.push_back(state);
+                return static_cast<int>(states.size() - 1);
+                }
+            void link(int _from, int _to)
+                {
+                if (!overflow)
+                    {
+                    states[_from].epsilon.push_back(_to);
+                    }
+                }
+            Fragment empty()
+                {
+                Fragment fragment;
+                fragment.start = addState();
+                fragment.end = fragment.start;
+                return fragment;
+                }
+            Fragment optional(const Fragment& _inner, bool _loop)
+                {
+                Fragment fragment;
+                fragment.start = addState();
+                fragment.end = addState();
+                link(fragment.start, _inner.start);
+                link(fragment.start, fragment.end);
+                link(_inner.end, fragment.end);
+                if (_loop)
+                    {
+                    link(_inner.end, _inner.start);
+                    }
+                return fragment;
+                }
+
+            Fragment generate(int _index)
+                {
+                const PatternNode& node = nodes[_index];
+                if (overflow)
+                    {
+                    return empty();
+                    }
+                switch (node.type)
+                    {
+                    case PatternNode::Symbols:
+                        {
+                        Fragment fragment;
+                        fragment.start = addState();
+                        fragment.end = addState();
+                        if (!overflow)
+                            {
+                            symbolSets.push_back(node.symbols);
+                            states[fragment.start].symbolSet = static_cast<int>(symbolSets.size() - 1);
+                            states[fragment.start].next = fragment.end;
+                            }
+                        return fragment;
+                        }
+                    case PatternNode::Concat:
+                        {
+                        Fragment fragment = empty();
+                        for (std::vector<int>::const_iterator iter = node.children.begin(); iter != node.children.end(); ++iter)
+                            {
+                            Fragment next = generate(*iter);
+                            link(fragment.end, next.start);
+                            fragment.end = next.end;
+                            }
+                        return fragment;
+                        }
+                    case PatternNode::Alternate:
+                        {
+                        Fragment fragment;
+                        fragment.start = addState();
+                        fragment.end = addState();
+                        for (std::vector<int>::const_iterator iter = node.children.begin(); iter != node.children.end(); ++iter)
+                            {
+                            Fragment next = generate(*iter);
+                            link(fragment.start, next.start);
+                            link(next.end, fragment.end);
+                            }
+                        return fragment;
+                        }
+                    case PatternNode::Repeat:
+                    default:
+                        {
+                        // expand x{m,n} into m required copies followed by the optional ones
+                        Fragment fragment = empty();
+                        for (int i = 0; i < node.minRepeat; ++i)
+                            {
+                            Fragment next = generate(node.children[0]);
+                            link(fragment.end, next.start);
+                            fragment.end = next.end;
+                            }
+                        if (node.maxRepeat == -1)
+                            {
+                            Fragment next = optional(generate(node.children[0]), true);
+                            link(fragment.end, next.start);
+                            fragment.end = next.end;
+                            }
+                        else
+                            {
+                            for (int i = node.minRepeat; i < node.maxRepeat; ++i)
+                                {
+                                Fragment next = optional(generate(node.children[0]), false);
+                                link(fragment.end, next.start);
+                                fragment.end = next.end;
+                                }
+                            }
+                        return fragment;
+                        }
+                    };
+                }
+        };
+
+    typedef std::vector<int> NfaStateSet;
+
+    void epsilonClosure(const Nfa& _nfa, NfaStateSet& _states)
+        {
+        std::vector<uint8_t> seen(_nfa.states.size(), 0);
+        std::vector<int> pending(_states);
+        for (NfaStateSet::const_iterator iter = _states.begin(); iter != _states.end(); ++iter)
+            {
+            seen[*iter] = 1;
+            }
+        while (!pending.empty())
+            {
+            int state = pending.back();
+            pending.pop_back();
+            const std::vector<int>& edges = _nfa.states[state].epsilon;
+            for (std::vector<int>::const_iterator iter = edges.begin(); iter != edges.end(); ++iter)
+                {
+                if (!seen[*iter])
+                    {
+                    seen[*iter] = 1;
+                    pending.push_back(*iter);
+                    }
+                }
+            }
+        _states.clear();
+        for (int state = 0; state < static_cast<int>(seen.size()); ++state)
+            {
+            if (seen[state])
+                {
+                _states.push_back(state);
+                }
+            }
+        }
+    }
+
+TokenMatcher::TokenMatcher() : classes(0), startState(0)
+    {
+    compile(QString(DEFAULT_TOKEN_PATTERN));
+    }
+
+TokenMatcher::TokenMatcher(const QString& _pattern) : classes(0), startState(0)
+    {
+    compile(_pattern);
+    }
+
+bool TokenMatcher::compile(const QString& _pattern, QString* _error)
+    {
+    // start from an invalid scanner so a failed compile never leaves a half-built table
+    symbolClass.clear();
+    transitions.clear();
+    accepting.clear();
+    startable.clear();
+    separating.clear();
+    classes = 0;
+    startState = 0;
+    sourcePattern = _pattern;
+
+    QString error;
+    std::vector<PatternNode> nodes;
+    int root = -1;
+    if (_pattern.isEmpty())
+        {
+        error = "empty pattern";
+        }
+    else
+        {
+        PatternParser parser(_pattern, nodes);
+        root = parser.parse(error);
+        }
+
+    Nfa nfa(nodes);
+    Nfa::Fragment fragment;
+    if (error.isEmpty() && !nfa.build(root, fragment))
+        {
+        error = "pattern is too large";
+        }
+    if (!error.isEmpty())
+        {
+        if (_error != NULL)
+            {
+            *_error = error;
+            }
+        return false;
+        }
+
+    // compress the alphabet: symbols that appear in exactly the same symbol
+    // sets can never be told apart by the automaton and share a class
+    symbolClass.resize(SYMBOL_COUNT);
+    std::map<std::vector<bool>, int> signatures;
+    std::vector<int> classSymbol;
+    for (int symbol = 0; symbol < SYMBOL_COUNT; ++symbol)
+        {
+        std::vector<bool> signature(nfa.symbolSets.size());
+        for (size_t set = 0; set < nfa.symbolSets.size(); ++set)
+            {
+            signature[set] = nfa.symbolSets[set].test(symbol);
+            }
+        std::map<std::vector<bool>, int>::const_iterator found = signatures.find(signature);
+        if (found == signatures.end())
+            {
+            int newClass = static_cast<int>(classSymbol.size());
+            signatures.insert(std::make_pair(signature, newClass));
+            classSymbol.push_back(symbol);
+            symbolClass[symbol] = static_cast<uint16_t>(newClass);
+            }
+        else
+            {
+            symbolClass[symbol] = static_cast<uint16_t>(found->second);
+            }
+        }
+    classes = static_cast<int>(classSymbol.size());
+
+    // subset construction; DFA state 0 is the dead state
+    std::map<NfaStateSet, int32_t> dfaStates;
+    std::vector<NfaStateSet> pending;
+    transitions.assign(classes, 0);
+    accepting.push_back(0);
+
+    NfaStateSet initial(1, fragment.start);
+    epsilonClosure(nfa, initial);
+    dfaStates.insert(std::make_pair(initial, 1));
+    pending.push_back(initial);
+    transitions.resize(2 * classes, 0);
+    accepting.push_back(std::binary_search(initial.begin(), initial.end(), fragment.end) ? 1 : 0);
+    startState = 1;
+
+    for (size_t current = 0; current < pending.size(); ++current)
+        {
+        int32_t currentState = static_cast<int32_t>(current + 1);
+        for (int byteClass = 0; byteClass < classes; ++byteClass)
+            {
+            int symbol = classSymbol[byteClass];
+            std::set<int> targets;
+            for (NfaStateSet::const_iterator iter = pending[current].begin(); iter != pending[current].end(); ++iter)
+                {
+                const Nfa::State& state = nfa.states[*iter];
+                if (state.symbolSet != -1 && nfa.symbolSets[state.symbolSet].test(symbol))
+                    {
+                    targets.insert(state.next);
+                    }
+                }
+            if (targets.empty())
+                {
+                continue;
+                }
+
+            NfaStateSet next(targets.begin(), targets.end());
+            epsilonClosure(nfa, next);
+            std::map<NfaStateSet, int32_t>::const_iterator found = dfaStates.find(next);
+            int32_t nextState = 0;
+            if (found == dfaStates.end())
+                {
+                nextState = static_cast<int32_t>(pending.size() + 1);
+                if (nextState >= MAX_DFA_STATES)
+                    {
+                    error = QString("pattern needs more than %1 DFA states").arg(MAX_DFA_STATES);
+                    break;
+                    }
+                dfaStates.insert(std::make_pair(next, nextState));
+                pending.push_back(next);
+                transitions.resize((nextState + 1) * classes, 0);
+                accepting.push_back(std::binary_search(next.begin(), next.end(), fragment.end) ? 1 : 0);
+                }
+            else
+                {
+                nextState = found->second;
+                }
+            transitions[currentState * classes + byteClass] = nextState;
+            }
+        if (!error.isEmpty())
+            {
+            break;
+            }
+        }
+
+    if (error.isEmpty() && accepting[startState])
+        {
+        error = "pattern matches an empty token";
+        }
+    if (!error.isEmpty())
+        {
+        symbolClass.clear();
+        transitions.clear();
+        accepting.clear();
+        classes = 0;
+        startState = 0;
+        if (_error != NULL)
+            {
+            *_error = error;
+            }
+        return false;
+        }
+
+    // minimize by refining the accepting/non-accepting partition until no two
+    // states in a block disagree on where a byte class takes them; numbering
+    // blocks in state order keeps the dead state at 0
+    int stateTotal = static_cast<int>(accepting.size());
+    std::vector<int32_t> block(stateTotal);
+    int blockTotal = 0;
+    for (int refined = -1; refined != blockTotal; )
+        {
+        refined = blockTotal;
+        std::map<std::vector<int32_t>, int32_t> signatures;
+        std::vector<int32_t> nextBlock(stateTotal);
+        for (int state = 0; state < stateTotal; ++state)
+            {
+            std::vector<int32_t> signature;
+            signature.reserve(classes + 1);
+            signature.push_back((blockTotal == 0) ? ((state == 0) ? -1 : accepting[state]) : block[state]);
+            for (int byteClass = 0; byteClass < classes && blockTotal != 0; ++byteClass)
+                {
+                signature.push_back(block[transitions[state * classes + byteClass]]);
+                }
+            std::map<std::vector<int32_t>, int32_t>::const_iterator found = signatures.find(signature);
+            if (found == signatures.end())
+                {
+                found = signatures.insert(std::make_pair(signature, static_cast<int32_t>(signatures.size()))).first;
+                }
+            nextBlock[state] = found->second;
+            }
+        block.swap(nextBlock);
+        blockTotal = static_cast<int>(signatures.size());
+        }
+
+    std::vector<int32_t> minimalTransitions(blockTotal * classes, 0);
+    std::vector<uint8_t> minimalAccepting(blockTotal, 0);
+    for (int state = 0; state < stateTotal; ++state)
+        {
+        for (int byteClass = 0; byteClass < classes; ++byteClass)
+            {
+            minimalTransitions[block[state] * classes + byteClass] = block[transitions[state * classes + byteClass]];
+            }
+        minimalAccepting[block[state]] = accepting[state];
+        }
+    transitions.swap(minimalTransitions);
+    accepting.swap(minimalAccepting);
+    startState = block[startState];
+
+    // classes a token can begin with, so the scanner can skip separators cheaply
+    startable.resize(classes);
+    for (int byteClass = 0; byteClass < classes; ++byteClass)
+        {
+        startable[byteClass] = (transitions[startState * classes + byteClass] != 0) ? 1 : 0;
+        }
+
+    // classes no state moves on except to the dead state; the minimal DFA has
+    // every state that cannot reach a match folded into it
+    separating.assign(classes, 1);
+    for (int state = 1; state < blockTotal; ++state)
+        {
+        for (int byteClass = 0; byteClass < classes; ++byteClass)
+            {
+            if (transitions[state * classes + byteClass] != 0)
+                {
+                separating[byteClass] = 0;
+                }
+            }
+        }
+    return true;
+    }
+
+bool TokenMatcher::isValid() const
+    {
+    return startState != 0;
+    }
+
+QString TokenMatcher::pattern() const
+    {
+    return sourcePattern;
+    }
+
+int TokenMatcher::stateCount() const
+    {
+    return static_cast<int>(accepting.size());
+    }
+
+int TokenMatcher::classCount() const
+    {
+    return classes;
+    }
+
+bool TokenMatcher::separates(QChar _character) const
+    {
+    if (!isValid())
+        {
+        return true;
+        }
+    ushort symbol = _character.unicode();
+    return separating[symbolClass[(symbol < WIDE_SYMBOL) ? symbol : WIDE_SYMBOL]] != 0;
+    }
+
+bool TokenMatcher::findToken(const QChar* _data, int _length, int _from, TokenMatch& _match, TokenScanMemo* _memo) const
+    {
+    if (!isValid())
+        {
+        return false;
+        }
+
+    // without a memo from the caller the call still keeps its own, so a single
+    // search does not read the data again from every start it tries
+    if (_memo == NULL)
+        {
+        TokenScanMemo local;
+        return findToken(_data, _length, _from, _match, &local);
+        }
+    TokenScanMemo& memo = *_memo;
+    if (memo.length != _length || memo.states != static_cast<int>(accepting.size()))
+        {
+        memo.prepare(_length, static_cast<int>(accepting.size()));
+        }
+    // positions past the horizon have never been remembered
+    int horizon = memo.horizon;
+
+    const uint16_t* classOf = &symbolClass[0];
+    const int32_t* table = &transitions[0];
+    const uint8_t* isAccepting = &accepting[0];
+    const uint8_t* canStart = &startable[0];
+
+    for (int start = _from; start < _length; ++start)
+        {
+        ushort first = _data[start].unicode();
+        if (!canStart[classOf[(first < WIDE_SYMBOL) ? first : WIDE_SYMBOL]])
+            {
+            continue;
+            }
+
+        // run the DFA as far as it goes, remembering the last accepting position;
+        // a pair already known to find nothing more ends it
+        int32_t state = startState;
+        int lastAccept = -1;
+        int position = start;
+        bool known = false;
+        bool open = false;
+        // only the part already walked by earlier scans needs the memo
+        int remembered = qMin(_length, horizon + 1);
+        for (; position < remembered; ++position)
+            {
+            if (memo.known(state, position, open))
+                {
+                known = true;
+                break;
+                }
+            ushort c = _data[position].unicode();
+            state = table[state * classes + classOf[(c < WIDE_SYMBOL) ? c : WIDE_SYMBOL]];
+            if (state == 0)
+                {
+                break;
+                }
+            if (isAccepting[state])
+                {
+                lastAccept = position + 1;
+                }
+            }
+        if (!known && state != 0)
+            {
+            for (; position < _length; ++position)
+                {
+                ushort c = _data[position].unicode();
+                state = table[state * classes + classOf[(c < WIDE_SYMBOL) ? c : WIDE_SYMBOL]];
+                if (state == 0)
+                    {
+                    break;
+                    }
+                if (isAccepting[state])
+                    {
+                    lastAccept = position + 1;
+                    }
+                }
+            }
+
+        // still alive at the end of the data means more input could extend the token
+        if (!known)
+            {
+            open = (position == _length && state != 0);
+            }
+
+        // nothing after the last accepting position led anywhere; remember the pairs
+        // walked since, up to and including the one the DFA died from
+        int tailStart = (lastAccept == -1) ? start : lastAccept;
+        int tailEnd = (!known && state == 0) ? position + 1 : position;
+        if (tailEnd - tailStart > MEMO_MIN_TAIL)
+            {
+            int32_t walk = startState;
+            for (int k = start; k < tailEnd; ++k)
+                {
+                if (k >= tailStart)
+                    {
+                    memo.remember(walk, k, open);
+                    }
+                ushort c = _data[k].unicode();
+                walk = table[walk * classes + classOf[(c < WIDE_SYMBOL) ? c : WIDE_SYMBOL]];
+                }
+            horizon = memo.horizon;
+            }
+
+        if (lastAccept != -1 || open)
+            {
+            _match.start = start;
+            _match.length = (lastAccept == -1) ? 0 : (lastAccept - start);
+            _match.open = open;
+            return true;
+            }
+        }
+    return false;
+    }
+
+const TokenMatcher& TokenMatcher::defaultMatcher()
+    {
+    static const TokenMatcher matcher;
+    return matcher;
+    }
+
+TokenScanMemo::TokenScanMemo() : length(-1), states(0), horizon(-1)
+    {
+    }
+
+void TokenScanMemo::reset()
+    {
+    exhausted.clear();
+    reachesEnd.clear();
+    length = -1;
+    states = 0;
+    horizon = -1;
+    }
+
+void TokenScanMemo::prepare(int _length, int _states)
+    {
+    if (_length != length || _states != states)
+        {
+        reset();
+        length = _length;
+        states = _states;
+        }
+    }
+
+bool TokenScanMemo::known(int32_t _state, int _position, bool& _open) const
+    {
+    size_t bit = static_cast<size_t>(_position) * static_cast<size_t>(states) + static_cast<size_t>(_state);
+    if (exhausted.empty() || (exhausted[bit / 64] & (Q_UINT64_C(1) << (bit % 64))) == 0)
+        {
+        return false;
+        }
+    _open = (reachesEnd[bit / 64] & (Q_UINT64_C(1) << (bit % 64))) != 0;
+    return true;
+    }
+
+void TokenScanMemo::remember(int32_t _state, int _position, bool _open)
+    {
+    if (exhausted.empty())
+        {
+        // only sized once something is worth remembering, which ordinary text never is
+        size_t words = (static_cast<size_t>(length) * static_cast<size_t>(states) + 63) / 64;
+        exhausted.assign(words, 0);
+        reachesEnd.assign(words, 0);
+        }
+    size_t bit = static_cast<size_t>(_position) * static_cast<size_t>(states) + static_cast<size_t>(_state);
+    exhausted[bit / 64] |= Q_UINT64_C(1) << (bit % 64);
+    if (_open)
+        {
+        reachesEnd[bit / 64] |= Q_UINT64_C(1) << (bit % 64);
+        }
+    horizon = qMax(horizon, _position);
+    }
@@ -0,0 +1,542 @@
+#include <vocabularyTrie.h>
+
+#include <string.h>
+
+#include <algorithm>
+#include <queue>
+
+namespace
+    {
+    //! size of the write buffer
+    const int VOCABULARY_BUFFER_SIZE = 1 << 20;
+    const int MAGIC_LENGTH = 8;
+    //! root offset and key count, at the very end of the file
+    const int TRAILER_LENGTH = 16;
+
+    void appendNumber(QByteArray& _buffer, uint64_t _value)
+        {
+        while (_value >= 0x80)
+            {
+            _buffer.append(static_cast<char>((_value & 0x7F) | 0x80));
+            _value >>= 7;
+            }
+        _buffer.append(static_cast<char>(_value));
+        }
+
+    void appendFixed(QByteArray& _buffer, uint64_t _value)
+        {
+        for (int i = 0; i < 8; ++i)
+            {
+            _buffer.append(static_cast<char>((_value >> (i * 8)) & 0xFF));
+            }
+        }
+
+    uint64_t readFixed(const char* _data)
+        {
+        uint64_t value = 0;
+        for (int i = 7; i >= 0; --i)
+            {
+            value = (value << 8) | static_cast<unsigned char>(_data[i]);
+            }
+        return value;
+        }
+
+    //! byte-wise key order, as the keys are stored
+    int compareKeys(const QByteArray& _left, const QByteArray& _right)
+        {
+        int shared = std::min(_left.size(), _right.size());
+        int result = memcmp(_left.constData(), _right.constData(), shared);
+        if (result != 0)
+            {
+            return result;
+            }
+        return _left.size() - _right.size();
+        }
+
+    //! a node still to be expanded, or a key found, in the top-K search
+    struct Candidate
+        {
+        //! the count of the key, or the highest count below the node
+        uint64_t count;
+        //! node offset; unused for a key
+        uint64_t node;
+        QByteArray key;
+        bool found;
+        };
+
+    //! queue order; true if _left is taken after _right
+    bool takenLater(const Candidate& _left, const Candidate& _right)
+        {
+        if (_left.count != _right.count)
+            {
+            return _left.count < _right.count;
+            }
+        // a node that might still hold an equal count is expanded before any
+        // key of that count is taken, so equal keys are all compared below
+        if (_left.found != _right.found)
+            {
+            return _left.found;
+            }
+        return _left.found && compareKeys(_left.key, _right.key) < 0;
+        }
+
+    //! an edge waiting to be followed by the enumeration
+    struct PendingEdge
+        {
+        uint64_t node;
+        //! length of the key above the edge
+        int depth;
+        const char* label;
+        uint64_t length;
+        };
+    }
+
+VocabularyWriter::VocabularyWriter() : written(0), recordCount(0), failed(false)
+    {
+    }
+
+VocabularyWriter::~VocabularyWriter()
+    {
+    if (output.isOpen())
+        {
+        close();
+        }
+    }
+
+bool VocabularyWriter::open(const QString& _fileName, int _order)
+    {
+    output.setFileName(_fileName);
+    failed = !output.open(QIODevice::WriteOnly|QIODevice::Truncate);
+    buffer.clear();
+    buffer.reserve(VOCABULARY_BUFFER_SIZE + 4096);
+    buffer.append(VOCABULARY_FILE_MAGIC);
+    appendNumber(buffer, static_cast<uint64_t>(_order));
+    written = 0;
+    previous.clear();
+    path.clear();
+    PathNode root = { 0, 0, 0, std::vector<Edge>() };
+    path.push_back(root);
+    recordCount = 0;
+    return !failed;
+    }
+
+void VocabularyWriter::add(const QByteArray& _key, uint64_t _count)
+    {
+    if (_count == 0 || failed)
+        {
+        return;
+        }
+
+    size_t length = static_cast<size_t>(_key.size());
+    size_t shared = 0;
+    size_t limit = std::min(length, previous.size());
+    while (shared < limit && _key[static_cast<int>(shared)] == previous[shared])
+        {
+        ++shared;
+        }
+    if (recordCount > 0 && (shared == length ||
+        (shared < previous.size() && static_cast<unsigned char>(_key[static_cast<int>(shared)]) < static_cast<unsigned char>(previous[shared]))))
+        {
+        // out of order or repeated; the trie would be wrong
+        failed = true;
+        return;
+        }
+
+    // everything below the shared prefix is complete
+    while (path.back().depth > shared)
+        {
+        finishNode(shared);
+        }
+    if (path.back().depth == length)
+        {
+        // only the empty key ends at the root
+        path.back().count = _count;
+        path.back().best = std::max(path.back().best, _count);
+        }
+    else
+        {
+        PathNode node = { length, _count, _count, std::vector<Edge>() };
+        path.push_back(node);
+        }
+    previous.assign(_key.constData(), length);
+    ++recordCount;
+    }
+
+void VocabularyWriter::finishNode(size_t _shared)
+    {
+    PathNode node;
+    node.depth = path.back().depth;
+    node.count = path.back().count;
+    node.best = path.back().best;
+    node.children.swap(path.back().children);
+    path.pop_back();
+
+    if (path.back().depth < _shared)
+        {
+        // the next key leaves the previous one part way along the edge; split it there
+        PathNode split = { _shared, 0, 0, std::vector<Edge>() };
+        path.push_back(split);
+        }
+
+    uint64_t offset = writeNode(node);
+    PathNode& parent = path.back();
+    Edge edge = { previous.substr(parent.depth, node.depth - parent.depth), offset };
+    parent.children.push_back(edge);
+    parent.best = std::max(parent.best, node.best);
+    }
+
+uint64_t VocabularyWriter::writeNode(const PathNode& _node)
+    {
+    uint64_t offset = written + static_cast<uint64_t>(buffer.size());
+    // most nodes are leaves; for them the count is the whole node
+    bool leaf = _node.children.empty();
+    appendNumber(buffer, (_node.count << 1) | (leaf ? 0 : 1));
+    if (!leaf)
+        {
+        appendNumber(buffer, static_cast<uint64_t>(_node.children.size()));
+        appendNumber(buffer, _node.best);
+        for (std::vector<Edge>::const_iterator iter = _node.children.begin(); iter != _node.children.end(); ++iter)
+            {
+            appendNumber(buffer, static_cast<uint64_t>(iter->label.size()));
+            buffer.append(iter->label.data(), static_cast<int>(iter->label.size()));
+            // children are always written first, so the distance back is positive
+            appendNumber(buffer, offset - iter->offset);
+            }
+        }
+    if (buffer.size() >= VOCABULARY_BUFFER_SIZE)
+        {
+        flush();
+        }
+    return offset;
+    }
+
+void VocabularyWriter::flush()
+    {
+    if (!failed && buffer.size() > 0)
+        {
+        failed = (output.write(buffer) != buffer.size());
+        }
+    written += static_cast<uint64_t>(buffer.size());
+    buffer.resize(0);
+    }
+
+bool VocabularyWriter::close()
+    {
+    if (!path.empty())
+        {
+        while (path.size() > 1)
+            {
+            finishNode(0);
+            }
+        uint64_t root = writeNode(path.back());
+        path.clear();
+        appendFixed(buffer, root);
+        appendFixed(buffer, recordCount);
+        }
+    flush();
+    output.close();
+    return !failed;
+    }
+
+uint64_t VocabularyWriter::records() const
+    {
+    return recordCount;
+    }
+
+uint64_t VocabularyWriter::size() const
+    {
+    return written + static_cast<uint64_t>(buffer.size());
+    }
+
+Vocabulary::Vocabulary() : data(NULL), length(0), root(0), keys(0), keyOrder(0), corrupt(false)
+    {
+    }
+
+Vocabulary::~Vocabulary()
+    {
+    close();
+    }
+
+bool Vocabulary::open(const QString& _fileName)
+    {
+    close();
+    input.setFileName(_fileName);
+    if (!input.open(QIODevice::ReadOnly) || input.size() < (MAGIC_LENGTH + 1 + TRAILER_LENGTH))
+        {
+        close();
+        return false;
+        }
+    uchar* mapped = input.map(0, input.size());
+    if (mapped == NULL || memcmp(mapped, VOCABULARY_FILE_MAGIC, MAGIC_LENGTH) != 0)
+        {
+        close();
+        return false;
+        }
+    data = reinterpret_cast<const char*>(mapped);
+    length = static_cast<uint64_t>(input.size()) - TRAILER_LENGTH;
+    root = readFixed(data + length);
+    keys = readFixed(data + length + 8);
+
+    uint64_t position = MAGIC_LENGTH;
+    uint64_t order = 0;
+    if (!readNumber(position, order) || order < 1 || order > MAX_NGRAM_ORDER || root < position || root >= length)
+        {
+        close();
+        return false;
+        }
+    keyOrder = static_cast<int>(order);
+    return true;
+    }
+
+void Vocabulary::close()
+    {
+    if (data != NULL)
+        {
+        input.unmap(reinterpret_cast<uchar*>(const_cast<char*>(data)));
+        }
+    input.close();
+    data = NULL;
+    length = 0;
+    root = 0;
+    keys = 0;
+    keyOrder = 0;
+    corrupt = false;
+    }
+
+int Vocabulary::order() const
+    {
+    return keyOrder;
+    }
+
+uint64_t Vocabulary::size() const
+    {
+    return keys;
+    }
+
+bool Vocabulary::failed() const
+    {
+    return corrupt;
+    }
+
+bool Vocabulary::readNumber(uint64_t& _position, uint64_t& _value) const
+    {
+    _value = 0;
+    for (int shift = 0; shift < 64 && _position < length; shift += 7)
+        {
+        unsigned char byte = static_cast<unsigned char>(data[_position++]);
+        _value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+            {
+            return true;
+            }
+        }
+    corrupt = true;
+    return false;
+    }
+
+bool Vocabulary::readNode(uint64_t _offset, Node& _node) const
+    {
+    uint64_t head = 0;
+    _node.edges = _offset;
+    if (!readNumber(_node.edges, head))
+        {
+        return false;
+        }
+    _node.count = head >> 1;
+    _node.best = _node.count;
+    _node.children = 0;
+    return ((head & 1) == 0) || (readNumber(_node.edges, _node.children) && readNumber(_node.edges, _node.best));
+    }
+
+bool Vocabulary::readEdge(uint64_t& _position, uint64_t _parent, const char*& _label, uint64_t& _length, uint64_t& _child) const
+    {
+    uint64_t distance = 0;
+    if (!readNumber(_position, _length) || _length > (length - _position))
+        {
+        corrupt = true;
+        return false;
+        }
+    _label = data + _position;
+    _position += _length;
+    if (!readNumber(_position, distance) || distance == 0 || distance > _parent)
+        {
+        corrupt = true;
+        return false;
+        }
+    _child = _parent - distance;
+    return true;
+    }
+
+bool Vocabulary::locate(const QByteArray& _prefix, uint64_t& _node, QByteArray& _key) const
+    {
+    _node = root;
+    _key.clear();
+    int matched = 0;
+    while (matched < _prefix.size())
+        {
+        // the edges of a node start with distinct bytes; at most one can match
+        Node node;
+        if (!readNode(_node, node))
+            {
+            return false;
+            }
+        uint64_t position = node.edges;
+        bool followed = false;
+        for (uint64_t i = 0; i < node.children && !followed; ++i)
+            {
+            const char* label;
+            uint64_t labelLength;
+            uint64_t child;
+            if (!readEdge(position, _node, label, labelLength, child))
+                {
+                return false;
+                }
+            if (labelLength == 0 || label[0] != _prefix[matched])
+                {
+                continue;
+                }
+            // the prefix may end part way along the edge
+            int compared = static_cast<int>(std::min(labelLength, static_cast<uint64_t>(_prefix.size() - matched)));
+            if (memcmp(label, _prefix.constData() + matched, compared) != 0)
+                {
+                return false;
+                }
+            _key.append(label, static_cast<int>(labelLength));
+            matched += compared;
+            _node = child;
+            followed = true;
+            }
+        if (!followed)
+            {
+            return false;
+            }
+        }
+    return true;
+    }
+
+uint64_t Vocabulary::count(const QString& _key) const
+    {
+    if (data == NULL)
+        {
+        return 0;
+        }
+    QByteArray key = _key.toUtf8();
+    uint64_t offset;
+    QByteArray found;
+    Node node;
+    if (!locate(key, offset, found) || found.size() != key.size() || !readNode(offset, node))
+        {
+        return 0;
+        }
+    return node.count;
+    }
+
+bool Vocabulary::entries(const QString& _prefix, RunConsumer& _consumer) const
+    {
+    if (data == NULL)
+        {
+        return false;
+        }
+    uint64_t start;
+    QByteArray key;
+    if (!locate(_prefix.toUtf8(), start, key))
+        {
+        return !corrupt;
+        }
+
+    // depth first, children in order, so the keys come out sorted
+    QByteArray startKey = key;
+    std::vector<PendingEdge> pending;
+    PendingEdge first = { start, 0, startKey.constData(), static_cast<uint64_t>(startKey.size()) };
+    pending.push_back(first);
+    while (!pending.empty())
+        {
+        PendingEdge edge = pending.back();
+        pending.pop_back();
+        key.resize(edge.depth);
+        key.append(edge.label, static_cast<int>(edge.length));
+
+        Node node;
+        if (!readNode(edge.node, node))
+            {
+            return false;
+            }
+        if (node.count > 0)
+            {
+            _consumer.add(key, node.count);
+            }
+
+        // pushed in reverse so the first child is visited first
+        size_t firstChild = pending.size();
+        uint64_t position = node.edges;
+        for (uint64_t i = 0; i < node.children; ++i)
+            {
+            PendingEdge child = { 0, key.size(), NULL, 0 };
+            if (!readEdge(position, edge.node, child.label, child.length, child.node))
+                {
+                return false;
+                }
+            pending.push_back(child);
+            }
+        std::reverse(pending.begin() + firstChild, pending.end());
+        }
+    return true;
+    }
+
+std::vector<PhraseCount> Vocabulary::top(const QString& _prefix, int _limit) const
+    {
+    std::vector<PhraseCount> result;
+    uint64_t start;
+    QByteArray key;
+    if (data == NULL || _limit <= 0 || !locate(_prefix.toUtf8(), start, key))
+        {
+        return result;
+        }
+
+    // best first: a node is only expanded while its highest count could
+    // still make the list, so most of the trie is never read
+    std::priority_queue<Candidate, std::vector<Candidate>, bool (*)(const Candidate&, const Candidate&)> queue(takenLater);
+    Node node;
+    if (!readNode(start, node))
+        {
+        return result;
+        }
+    Candidate first = { node.best, start, key, false };
+    queue.push(first);
+    while (!queue.empty() && static_cast<int>(result.size()) < _limit)
+        {
+        Candidate next = queue.top();
+        queue.pop();
+        if (next.found)
+            {
+            result.push_back(PhraseCount(next.count, QString::fromUtf8(next.key.constData(), next.key.size())));
+            continue;
+            }
+
+        if (!readNode(next.node, node))
+            {
+            break;
+            }
+        if (node.count > 0)
+            {
+            Candidate found = { node.count, 0, next.key, true };
+            queue.push(found);
+            }
+        uint64_t position = node.edges;
+        for (uint64_t i = 0; i < node.children; ++i)
+            {
+            const char* label;
+            uint64_t labelLength;
+            Candidate child = { 0, 0, next.key, false };
+            Node childNode;
+            if (!readEdge(position, next.node, label, labelLength, child.node) || !readNode(child.node, childNode))
+                {
+                return result;
+                }
+            child.key.append(label, static_cast<int>(labelLength));
+            child.count = childNode.best;
+            queue.push(child);
+            }
+        }
+    return result;
+    }
@@ -0,0 +1,179 @@
+#include <wordTally.h>
+
+#include <algorithm>
+
+#include <countRuns.h>
+
+namespace
+    {
+    /*! \brief Run Order for Words
+     *
+     *  Sorts word ids the way their text sorts in a run file
+     */
+    class WordOrder
+        {
+        public:
+            WordOrder(const WordInterner& _words) : words(&_words)
+                {
+                }
+            bool operator()(uint32_t _left, uint32_t _right) const
+                {
+                const QChar* left = words->wordData(_left);
+                const QChar* right = words->wordData(_right);
+                int leftLength = words->wordLength(_left);
+                int rightLength = words->wordLength(_right);
+                int shared = std::min(leftLength, rightLength);
+                for (int i = 0; i < shared; ++i)
+                    {
+                    if (left[i] != right[i])
+                        {
+                        return codePointOrder(left[i].unicode()) < codePointOrder(right[i].unicode());
+                        }
+                    }
+                return leftLength < rightLength;
+                }
+        private:
+            const WordInterner* words;
+        };
+
+    /*! \brief Count Order for Words
+     *
+     *  Most frequent first; ties by id so the order is stable
+     */
+    class HigherCount
+        {
+        public:
+            HigherCount(const std::vector<uint64_t, TableAllocator<uint64_t> >& _counts) : counts(&_counts)
+                {
+                }
+            bool operator()(uint32_t _left, uint32_t _right) const
+                {
+                if ((*counts)[_left] != (*counts)[_right])
+                    {
+                    return (*counts)[_left] > (*counts)[_right];
+                    }
+                return _left < _right;
+                }
+        private:
+            const std::vector<uint64_t, TableAllocator<uint64_t> >* counts;
+        };
+    }
+
+WordTally::WordTally()
+    {
+    clear();
+    }
+
+void WordTally::addToken(const QChar* _word, int _length, uint64_t _count)
+    {
+    uint32_t id = words.intern(_word, _length);
+    if (id >= counts.size())
+        {
+        counts.push_back(0);
+        }
+    counts[id] += _count;
+    }
+
+void WordTally::add(const QString& _word, uint64_t _count)
+    {
+    uint32_t id = words.intern(_word);
+    if (id >= counts.size())
+        {
+        counts.push_back(0);
+        }
+    counts[id] += _count;
+    }
+
+void WordTally::merge(const WordTally& _other)
+    {
+    for (uint32_t id = 1; id < _other.counts.size(); ++id)
+        {
+        add(_other.words.word(id), _other.counts[id]);
+        }
+    }
+
+void WordTally::mergeSquares(const WordTally& _other)
+    {
+    for (uint32_t id = 1; id < _other.counts.size(); ++id)
+        {
+        add(_other.words.word(id), _other.counts[id] * _other.counts[id]);
+        }
+    }
+
+int WordTally::size() const
+    {
+    return static_cast<int>(counts.size() - 1);
+    }
+
+QString WordTally::word(uint32_t _id) const
+    {
+    return words.word(_id);
+    }
+
+uint64_t WordTally::count(uint32_t _id) const
+    {
+    return (_id < counts.size()) ? counts[_id] : 0;
+    }
+
+uint64_t WordTally::count(const QString& _word) const
+    {
+    return count(words.find(_word));
+    }
+
+std::vector<PhraseCount> WordTally::topWords(int _limit) const
+    {
+    // select on the ids and only build strings for the words reported
+    std::vector<uint32_t> ids;
+    ids.reserve(counts.size());
+    for (uint32_t id = 1; id < counts.size(); ++id)
+        {
+        if (counts[id] > 0)
+            {
+            ids.push_back(id);
+            }
+        }
+
+    size_t limit = std::min(ids.size(), static_cast<size_t>(std::max(_limit, 0)));
+    std::partial_sort(ids.begin(), ids.begin() + limit, ids.end(), HigherCount(counts));
+
+    std::vector<PhraseCount> result;
+    for (size_t i = 0; i < limit; ++i)
+        {
+        result.push_back(PhraseCount(counts[ids[i]], words.word(ids[i])));
+        }
+    return result;
+    }
+
+uint64_t WordTally::memoryUsage() const
+    {
+    // growing the counts briefly holds them and a copy twice their size
+    return words.memoryUsage() + 3 * counts.capacity() * sizeof(uint64_t);
+    }
+
+bool WordTally::spillTo(RunWriter& _writer)
+    {
+    std::vector<uint32_t> order;
+    order.reserve(counts.size());
+    for (uint32_t id = 1; id < counts.size(); ++id)
+        {
+        if (counts[id] > 0)
+            {
+            order.push_back(id);
+            }
+        }
+    std::sort(order.begin(), order.end(), WordOrder(words));
+
+    for (std::vector<uint32_t>::const_iterator iter = order.begin(); iter != order.end(); ++iter)
+        {
+        _writer.add(words.wordData(*iter), words.wordLength(*iter), counts[*iter]);
+        }
+    clear();
+    return true;
+    }
+
+void WordTally::clear()
+    {
+    words.clear();
+    // id 0 is reserved by the interner; a fresh vector gives the memory back
+    std::vector<uint64_t, TableAllocator<uint64_t> >(1, 0).swap(counts);
+    }